@@ -35,6 +35,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -52,6 +53,7 @@
 #include "Counter.h"
 #include "CounterMeasurement.h"
 #include "Debug.h"
+#include "EphemerisStore.h"
 #include "Javad.h"
 #include "MeasurementPair.h"
 #include "NVS.h"
@@ -64,12 +66,12 @@
 #include "Ublox.h"
 #include "Utility.h"
 
-extern Application *app;
-extern std::ostream *debugStream;
-extern std::string   debugFileName;
-extern std::ofstream debugLog;
-extern int verbosity;
-extern bool shortDebugMessage;
+// These are defined here rather than in Main.cpp so that the library build has them
+std::ostream *debugStream=NULL;
+std::string   debugFileName;
+std::ofstream debugLog;
+int verbosity=1;
+bool shortDebugMessage=false;
 
 Application *app;
 
@@ -264,38 +266,63 @@ Application::Application(int argc,char **argv)
 		exit(EXIT_FAILURE);
 	}
 	
-	if (!loadConfig()){
-		std::cerr << "Error! Configuration failed" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	
 	// Note: can't get any debugging output until the command line is parsed !
 	
-	if (positioningMode){
-		TICenabled=false; // no TIC correction needed for positioning and it will only add noise anyway
-		allObservations=true; // configuration file may say otherwise
-		if (!createRINEX){
-			std::cerr << std::endl;
-			std::cerr << "Warning! RINEX output is not enabled in the configuration files and this is needed for" << std::endl;
-			std::cerr << "positioning mode. Has a valid RINEX output been configured ?" << std::endl;
-			exit(EXIT_FAILURE);
-		}
-	}
+	if (!checkConfig())
+		exit(EXIT_FAILURE);
 	
 }
 
+Application::Application()
+{
+	app = this;
+	init();
+}
+
 Application::~Application()
 {
 	for (unsigned int i =0;i<MPAIRS_SIZE;i++)
 		delete mpairs[i];
 	delete[] mpairs;
+	
+	delete receiver;
+	delete counter;
+	delete antenna;
 }
 
-void Application::run()
+bool Application::configure(std::string configFile,unsigned int options)
 {
+	configurationFile=configFile;
+	
+	if (options & DisableTIC) TICenabled=false;
+	if (options & Positioning){
+		positioningMode=true;
+		allObservations=true;
+	}
+	if (options & TimingDiagnostics) timingDiagnosticsOn=true;
+	if (options & SVDiagnostics) SVDiagnosticsOn=true;
+	
+	return checkConfig();
+}
+
+bool Application::process(int mjd,int start,int stop)
+{
+	if (start > stop){
+		std::cerr  << "Error! The start time is after the stop time" << std::endl;
+		return false;
+	}
+	
+	MJD=mjd;
+	startTime=start;
+	stopTime=stop;
+	
 	Timer timer;
 	timer.start();
 	
+	// Data from any previous call are discarded so that each day is processed
+	// exactly as it would be by a fresh instance
+	resetData();
+	
 	// Set the reference time for resolving GPS week number ambiguity
 	// from the MJD that we are processing for
 	refTime = (MJD - 40587)*86400;
@@ -309,28 +336,43 @@ void Application::run()
 	logMessage(timeStamp() + APP_NAME +  " version " + APP_VERSION + " run started");
 	
 	// Subtract 4 hours to make sure we get ephemeris, UTC, ionosphere ...
+	// unless these have been saved from the previous day
+	// The store only holds GPS data so other constellations still need the full log
 	int sloppyStartTime = startTime - 4*3600;
+	if (!ephemerisStorePath.empty()){
+		EphemerisStore store;
+		if (store.read(receiver,store.makeFileName(ephemerisStorePath,MJD-1),MJD)){ // sets gps.gotUTCdata/gotIonoData
+			logMessage("loaded ephemeris store for MJD " + boost::lexical_cast<std::string>(MJD-1));
+			if (receiver->constellations == GNSSSystem::GPS)
+				sloppyStartTime = startTime;
+		}
+	}
 	if (sloppyStartTime < 0) sloppyStartTime = 0;
 	
 	// add 960 s to capture CGGTTS tracks which don't end before stopTime
 	int sloppyStopTime = stopTime + 960;
 	if (sloppyStopTime > 86399) sloppyStopTime = 86399;
 			
-	bool recompress = decompress(receiverFile);
-	if (!receiver->readLog(receiverFile,MJD,sloppyStartTime,sloppyStopTime,interval)){
-		std::cerr << "Exiting" << std::endl;
-		exit(EXIT_FAILURE);
-	}
+	bool recompress;
+	if (!decompress(receiverFile,&recompress))
+		return false;
+	if (!receiver->readLog(receiverFile,MJD,sloppyStartTime,sloppyStopTime,interval))
+		return false;
 	if (recompress) compress(receiverFile);
 	
-	recompress = decompress(counterFile);
-	if (!counter->readLog(counterFile,startTime,sloppyStopTime)){
-		std::cerr << "Exiting" << std::endl;
-		exit(EXIT_FAILURE);
+	if (!ephemerisStorePath.empty()){ // save before any user-supplied ephemeris replaces the receiver's
+		EphemerisStore store;
+		store.write(receiver,store.makeFileName(ephemerisStorePath,MJD),MJD);
 	}
+	
+	if (!decompress(counterFile,&recompress))
+		return false;
+	if (!counter->readLog(counterFile,startTime,sloppyStopTime))
+		return false;
 	if (recompress) compress(counterFile);
 	
-	matchMeasurements(receiver,counter); // only do this once
+	if (!matchMeasurements(receiver,counter)) // only do this once
+		return false;
 	
 	if (fixBadSawtooth) // this attempts to fix TIC measurements made wrt to GPSDO
 		fixBadSawtoothCorrection(receiver,counter);
@@ -348,12 +390,12 @@ void Application::run()
 					std::string fname=rnx.makeFileName(CGGTTSoutputs.at(i).ephemerisFile,MJD);
 					if (fname.empty()){
 						std::cerr << "Unable to make a RINEX navigation file name from the specified pattern: " << CGGTTSoutputs.at(i).ephemerisFile << std::endl;
-						exit(EXIT_FAILURE);
+						return false;
 					}
 					std::string navFile=CGGTTSoutputs.at(i).ephemerisPath+"/"+fname;
 					DBGMSG(debugStream,INFO,"using nav file " << navFile);
 					if (!rnx.readNavigationFile(receiver,GNSSSystem::GPS,navFile)){
-						exit(EXIT_FAILURE);
+						return false;
 					}
 				}
 			}
@@ -373,6 +415,7 @@ void Application::run()
 			cggtts.maxDSG = CGGTTSmaxDSG;
 			cggtts.maxURA = CGGTTSmaxURA;
 			cggtts.minTrackLength=CGGTTSminTrackLength;
+			cggtts.threads=CGGTTSthreads;
 			cggtts.ver=CGGTTSversion;
 			cggtts.constellation=CGGTTSoutputs.at(i).constellation;
 			cggtts.code=CGGTTSoutputs.at(i).code;
@@ -380,7 +423,8 @@ void Application::run()
 			cggtts.isP3=CGGTTSoutputs.at(i).isP3;
 			cggtts.useMSIO=cggtts.isP3; // FIXME not the whole story
 			std::string CGGTTSfile =makeCGGTTSFilename(CGGTTSoutputs.at(i),MJD);
-			cggtts.writeObservationFile(CGGTTSfile,MJD,startTime,stopTime,mpairs,TICenabled);
+			if (cggtts.writeObservationFile(CGGTTSfile,MJD,startTime,stopTime,mpairs,TICenabled))
+				outputs.push_back(CGGTTSfile);
 	
 		}
 	} // if createCGGTTS
@@ -395,15 +439,18 @@ void Application::run()
 			if (RINEXmajorVersion == 2){
 				if (receiver->constellations == GNSSSystem::GPS){
 					// FIXME needs rework
-					rnx.writeNavigationFile(receiver,receiver->constellations,RINEXmajorVersion,RINEXminorVersion,RINEXnavFile,MJD);
+					if (rnx.writeNavigationFile(receiver,receiver->constellations,RINEXmajorVersion,RINEXminorVersion,RINEXnavFile,MJD))
+						outputs.push_back(RINEXnavFile);
 				}
 			}
 			else{
-				rnx.writeNavigationFile(receiver,receiver->constellations,RINEXmajorVersion,RINEXminorVersion,RINEXnavFile,MJD);
+				if (rnx.writeNavigationFile(receiver,receiver->constellations,RINEXmajorVersion,RINEXminorVersion,RINEXnavFile,MJD))
+					outputs.push_back(RINEXnavFile);
 			}
 		}
-		rnx.writeObservationFile(antenna,counter,receiver,RINEXmajorVersion,RINEXminorVersion
-            ,RINEXobsFile,MJD,interval,mpairs,TICenabled);
+		if (rnx.writeObservationFile(antenna,counter,receiver,RINEXmajorVersion,RINEXminorVersion
+            ,RINEXobsFile,MJD,interval,mpairs,TICenabled))
+			outputs.push_back(RINEXobsFile);
 	} // if createRINEX
 	
 	if (timingDiagnosticsOn) 
@@ -423,11 +470,22 @@ void Application::run()
 	DBGMSG(debugStream,INFO,"counter data memory usage: " << ctMem << " bytes");
 	DBGMSG(debugStream,INFO,"total memory usage: " << rxMem + ctMem << " bytes");
 	
-	delete receiver;
-	delete counter;
-	delete antenna;
+	nRxMeasurements = receiver->measurements.size();
+	nCtrMeasurements = counter->measurements.size();
+	memUsage = rxMem + ctMem;
+	tElapsed = timer.elapsedTime(Timer::SECS);
 	
 	logMessage(timeStamp() + " run finished");
+	
+	return true;
+}
+
+void Application::run()
+{
+	if (!process(MJD,startTime,stopTime)){
+		std::cerr << "Exiting" << std::endl;
+		exit(EXIT_FAILURE);
+	}
 }
 
 void Application::showHelp()
@@ -508,6 +566,7 @@ void Application::init()
 	CGGTTSmaxDSG=10.0;
 	CGGTTSmaxURA=3.0;
 	CGGTTSminTrackLength=390;
+	CGGTTSthreads=0;
 	
 	observer="Time and Frequency";
 	agency="NMIx";
@@ -554,9 +613,57 @@ void Application::init()
 	mpairs= new MeasurementPair*[MPAIRS_SIZE];
 	for (int i=0;i<MPAIRS_SIZE;i++)
 		mpairs[i]=new MeasurementPair();
+	
+	nRxMeasurements=nCtrMeasurements=nMatched=memUsage=0;
+	tElapsed=0.0;
 
 }
 
+bool Application::checkConfig()
+{
+	if (!loadConfig()){
+		std::cerr << "Error! Configuration failed" << std::endl;
+		return false;
+	}
+	
+	if (positioningMode){
+		TICenabled=false; // no TIC correction needed for positioning and it will only add noise anyway
+		allObservations=true; // configuration file may say otherwise
+		if (!createRINEX){
+			std::cerr << std::endl;
+			std::cerr << "Warning! RINEX output is not enabled in the configuration files and this is needed for" << std::endl;
+			std::cerr << "positioning mode. Has a valid RINEX output been configured ?" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+void Application::resetData()
+{
+	outputs.clear();
+	nRxMeasurements=nCtrMeasurements=nMatched=memUsage=0;
+	tElapsed=0.0;
+	
+	receiver->deleteMeasurements();
+	// The receiver readers don't clear these, so that UTC and ionosphere data
+	// restored from the ephemeris store in process() carry over into the new day
+	receiver->gps.gotUTCdata = receiver->gps.gotIonoData = false;
+	receiver->galileo.gotUTCdata = receiver->galileo.gotIonoData = false;
+	receiver->gps.deleteEphemerides();
+	receiver->galileo.deleteEphemerides();
+	receiver->glonass.deleteEphemerides();
+	receiver->beidou.deleteEphemerides();
+	
+	counter->deleteMeasurements();
+	
+	for (int i=0;i<MPAIRS_SIZE;i++){ 
+		mpairs[i]->flags=0;
+		mpairs[i]->cm=NULL;
+		mpairs[i]->rm=NULL;
+	}
+}
+
 std::string Application::relativeToAbsolutePath(std::string path)
 {
 	std::string absPath=path;
@@ -642,9 +749,10 @@ void  Application::makeFilenames()
 	
 }
 
-bool Application::decompress(std::string f)
+bool Application::decompress(std::string f,bool *recompress)
 {
 	struct stat statBuf;
+	*recompress=false;
 	int ret = stat(f.c_str(),&statBuf);
 	if (ret !=0 ){ // decompressed file is not there
 		std::string fgz = f + ".gz";
@@ -653,16 +761,16 @@ bool Application::decompress(std::string f)
 			std::string cmd = gzip + " -d " + fgz;
 			if ((ret=system(cmd.c_str()))!=0){
 				std::cerr << "\"" << cmd << "\"" << " failed (return value = " << ret << ")" << std::endl;
-				exit(EXIT_FAILURE);
+				return false;
 			}
-			return true;
+			*recompress=true;
 		}
 		else{ // file is missing/wrong permissions on path 
 			std::cerr << " can't open " << f << std::endl;
-			exit(EXIT_FAILURE);
+			return false;
 		}
 	}
-	return false;
+	return true;
 }
 
 void Application::compress(std::string f){
@@ -701,12 +809,21 @@ std::string Application::makeCGGTTSFilename(CGGTTSOutput & cggtts, int MJD){
 
 bool Application::loadConfig()
 {
-
+	// If we are being reconfigured, start again with a clean slate
+	delete receiver;
+	receiver = NULL;
+	delete antenna;
+	antenna = new Antenna();
+	delete counter;
+	counter = new Counter();
+	CGGTTSoutputs.clear();
+	ephemerisStorePath="";
+	
 	// Our conventional config file format is used to maintain compatibility with existing scripts
 	ListEntry *last;
 	if (!configfile_parse_as_list(&last,configurationFile.c_str())){
-		std::cerr << "Unable to open the configuration file " << configurationFile << " - exiting" << std::endl;
-		exit(EXIT_FAILURE);
+		std::cerr << "Unable to open the configuration file " << configurationFile << std::endl;
+		return false;
 	}
 	
 	bool configOK=true;
@@ -748,6 +865,10 @@ bool Application::loadConfig()
 	if (setConfig(last,"paths","processing log",path,&configOK,false))
 		processingLogPath=relativeToAbsolutePath(path);
 	
+	path="";
+	if (setConfig(last,"paths","ephemeris store",path,&configOK,false))
+		ephemerisStorePath=relativeToAbsolutePath(path);
+	
 	DBGMSG(debugStream,TRACE,"parsed Paths config");
 	
 	// CGGTTS generation
@@ -885,6 +1006,7 @@ bool Application::loadConfig()
 		setConfig(last,"cggtts","maximum dsg",&CGGTTSmaxDSG,&configOK,false);
 		setConfig(last,"cggtts","maximum ura",&CGGTTSmaxURA,&configOK,false);
 		setConfig(last,"cggtts","minimum elevation",&CGGTTSminElevation,&configOK,false);
+		setConfig(last,"cggtts","threads",&CGGTTSthreads,&configOK,false);
 		if (setConfig(last,"cggtts","naming convention",stmp,&configOK,false)){
 			boost::to_upper(stmp);
 			if (stmp == "BIPM")
@@ -1014,10 +1136,11 @@ bool Application::loadConfig()
 		else if (rxManufacturer.find("ublox") != std::string::npos){
 			receiver = new Ublox(antenna,rxModel); 
 		}
-		else{
-			std::cerr << "A valid receiver model/manufacturer has not been configured - exiting" << std::endl;
-			exit(EXIT_FAILURE);
-		}
+	}
+	
+	if (NULL == receiver){
+		std::cerr << "A valid receiver model/manufacturer has not been configured" << std::endl;
+		return false;
 	}
 	
 	if (setConfig(last,"receiver","observations",stmp,&configOK,false)){
@@ -1221,11 +1344,11 @@ bool Application::writeRIN2CGGTTSParamFile(Receiver *rx, Antenna *ant, std::stri
 	return true;
 }
 
-void Application::matchMeasurements(Receiver *rx,Counter *cntr)
+bool Application::matchMeasurements(Receiver *rx,Counter *cntr)
 {
 	// Measurements are matched using PC time stamps
 	if (cntr->measurements.size() == 0 || rx->measurements.size()==0)
-		return;
+		return true;
 
 	// Instead of a complicated search, use an array that records whether the required measurements exist for 
 	// each second. This approach:
@@ -1282,6 +1405,7 @@ void Application::matchMeasurements(Receiver *rx,Counter *cntr)
 		}
 	}
 	
+	nMatched=matchcnt;
 	logMessage(boost::lexical_cast<std::string>(matchcnt) + " matched measurements");
 	
 	// Paranoia
@@ -1295,10 +1419,11 @@ void Application::matchMeasurements(Receiver *rx,Counter *cntr)
 			int trx1=((int) rxm->pchh)*3600 +  ((int) rxm->pcmm)*60 + ((int) rxm->pcss);
 			if (trx1 < trx0){ // duplicates are already filtered
 				std::cerr << "Application::matchMeasurements() not monotonically ordered!" << std::endl;
-				exit(EXIT_FAILURE);
+				return false;
 			}
 		}
 	}
+	return true;
 }
 
 void Application::fixBadSawtoothCorrection(Receiver *rx,Counter *)
@@ -1342,47 +1467,75 @@ void Application::writeReceiverTimingDiagnostics(Receiver *rx,Counter *cntr,std:
 
 void Application::writeSVDiagnostics(Receiver *rx,std::string path)
 {
-	FILE *fout;
+	// All SVs, for all constellation+code combinations, are written to one CSV file, grouped by SV
+	// An index file gives the byte offset and number of rows for each group so that tools can go
+	// straight to the SV they want.
+	
+	std::ostringstream sstr;
+	sstr << path << "/" << "svdiag." << MJD;
+	std::string csvFile = sstr.str() + ".csv";
+	std::string idxFile = sstr.str() + ".idx";
+	
+	DBGMSG(debugStream,INFO,"writing to " << csvFile);
+	
+	// One pass over the measurements, binning each SV measurement by constellation+code+SVN
+	// The key is built so that iterating over the map orders the output by constellation, code and SVN
+	typedef std::vector<std::pair<unsigned int,SVMeasurement *> > SVBin; // (index of measurement, SV measurement)
+	typedef std::map<unsigned long long, SVBin> SVBins;
+	SVBins bins;
+	
+	for (unsigned int m=0;m<rx->measurements.size();m++){
+		std::vector<SVMeasurement *> &meas = rx->measurements.at(m)->meas;
+		for (unsigned int svm=0; svm < meas.size();svm++){
+			SVMeasurement *sv=meas.at(svm);
+			if (!(rx->constellations & sv->constellation)) continue;
+			if (!(rx->codes & sv->code)) continue;
+			unsigned long long key = ((unsigned long long) sv->constellation << 40) | ((unsigned long long) sv->code << 8) | sv->svn;
+			SVBin &bin = bins[key];
+			if (!bin.empty() && bin.back().first == m) continue; // first match in each epoch only
+			bin.push_back(std::make_pair(m,sv));
+		}
+	}
 	
-	DBGMSG(debugStream,INFO,"writing to " << path);
+	FILE *fout,*fidx;
+	if (!(fout = std::fopen(csvFile.c_str(),"w"))){
+		std::cerr << "Unable to open " << csvFile << std::endl;
+		return;
+	}
+	if (!(fidx = std::fopen(idxFile.c_str(),"w"))){
+		std::cerr << "Unable to open " << idxFile << std::endl;
+		std::fclose(fout);
+		return;
+	}
 	
-	for (int g = GNSSSystem::GPS; g<= GNSSSystem::GALILEO; (g <<= 1)){ 
-		
-		if (!(rx->constellations & g)) continue;
+	// The default here is that dbuf1 contains the raw (non-interpolated) pseudo range and dbuf2 contains 
+	// corrected pseudoranges when CGGTTS output has been generated (which can be useful to look at) 
+	std::fprintf(fout,"tod,gnss,svn,code,meas,dbuf1,dbuf2,dbuf3\n");
+	std::fprintf(fidx,"gnss,svn,code,offset,rows\n");
+	
+	for (SVBins::iterator it=bins.begin();it != bins.end();it++){
+		SVBin &bin = it->second;
+		SVMeasurement *sv0 = bin.front().second;
 		
-		GNSSSystem *gnss;
-		switch (g){
-			case GNSSSystem::BEIDOU:gnss = &(rx->beidou);
-			case GNSSSystem::GALILEO:gnss = &(rx->galileo) ;
-			case GNSSSystem::GLONASS:gnss = &(rx->glonass) ;
-			case GNSSSystem::GPS:gnss = &(rx->gps) ;
+		std::string gnss;
+		switch (sv0->constellation){
+			case GNSSSystem::BEIDOU:gnss = rx->beidou.oneLetterCode();break;
+			case GNSSSystem::GALILEO:gnss = rx->galileo.oneLetterCode();break;
+			case GNSSSystem::GLONASS:gnss = rx->glonass.oneLetterCode();break;
+			case GNSSSystem::GPS:gnss = rx->gps.oneLetterCode();break;
 		}
+		std::string code = GNSSSystem::observationCodeToStr(sv0->code,RINEX::V3);
 		
-		for (unsigned int code = GNSSSystem::C1C;code <=GNSSSystem::L7I; (code <<= 1)){
-			
-			if (!(rx->codes & code)) continue;
-			
-			for (int svn=1;svn<=gnss->maxSVN();svn++){ // loop over all svn for constellation+code combination
-				std::ostringstream sstr;
-				sstr << path << "/" << gnss->oneLetterCode() << svn << ".dat";
-				if (!(fout = std::fopen(sstr.str().c_str(),"w"))){
-					std::cerr << "Unable to open " << sstr.str().c_str() << std::endl;
-					return;
-				}
-				for (unsigned int m=0;m<rx->measurements.size();m++){
-					for (unsigned int svm=0; svm < rx->measurements.at(m)->meas.size();svm++){
-						SVMeasurement *sv=rx->measurements.at(m)->meas.at(svm);
-						if ((svn == sv->svn) && (g==sv->constellation) && (code==sv->code)){
-							int tod = rx->measurements[m]->tmUTC.tm_hour*3600+ rx->measurements[m]->tmUTC.tm_min*60 + rx->measurements[m]->tmUTC.tm_sec;
-							// The default here is that df1 contains the raw (non-interpolated) pseudo range and df2 contains 
-							// corrected pseudoranges when CGGTTS output has been generated (which can be useful to look at) 
-							std::fprintf(fout,"%d %.16e %.16e %.16e %.16e\n",tod,sv->meas,sv->dbuf1,sv->dbuf2,sv->dbuf3);
-							break;
-						}
-					}
-				}
-				std::fclose(fout);
-			} //for (int svn= ...
-		}// for (int code = ...
-	} // for (int g =
+		std::fprintf(fidx,"%s,%d,%s,%ld,%d\n",gnss.c_str(),(int) sv0->svn,code.c_str(),std::ftell(fout),(int) bin.size());
+		for (unsigned int i=0;i<bin.size();i++){
+			ReceiverMeasurement *rxm = rx->measurements[bin.at(i).first];
+			SVMeasurement *sv = bin.at(i).second;
+			int tod = rxm->tmUTC.tm_hour*3600+ rxm->tmUTC.tm_min*60 + rxm->tmUTC.tm_sec;
+			std::fprintf(fout,"%d,%s,%d,%s,%.16e,%.16e,%.16e,%.16e\n",tod,gnss.c_str(),(int) sv->svn,code.c_str(),
+				sv->meas,sv->dbuf1,sv->dbuf2,sv->dbuf3);
+		}
+	}
+	
+	std::fclose(fidx);
+	std::fclose(fout);
 }
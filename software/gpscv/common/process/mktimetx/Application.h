@@ -79,10 +79,14 @@ class Application
 {
 	public:
 		
+		enum Options {DisableTIC=0x01,Positioning=0x02,TimingDiagnostics=0x04,SVDiagnostics=0x08};
+		
 		Application(int argc,char **argv);
+		Application(); // for embedding - no command line processing
 		~Application();
 		
-		void setMJD(int);
+		bool configure(std::string configFile,unsigned int options=0); // may be called again to reconfigure
+		bool process(int mjd,int start=0,int stop=86399);
 		void run();
 		
 		void showHelp();
@@ -95,14 +99,24 @@ class Application
 		bool positioningMode;
 		bool allObservations;
 		
+		// Results from the last call to process()
+		std::vector<std::string> &outputFiles(){return outputs;}
+		unsigned int receiverMeasurements(){return nRxMeasurements;}
+		unsigned int counterMeasurements(){return nCtrMeasurements;}
+		unsigned int matchedMeasurements(){return nMatched;}
+		unsigned int memoryUsage(){return memUsage;}
+		double elapsedTime(){return tElapsed;} // in seconds
+		
 	private:
 	
 		enum CGGTTSNamingConvention {Plain,BIPM};
 		
 		void init();
+		bool checkConfig();
+		void resetData();
 		std::string relativeToAbsolutePath(std::string);
 		void   makeFilenames();
-		bool decompress(std::string);
+		bool decompress(std::string,bool *);
 		void compress(std::string);
 		std::string makeCGGTTSFilename(CGGTTSOutput & cggtts, int MJD);
 		
@@ -114,7 +128,7 @@ class Application
 		
 		bool writeRIN2CGGTTSParamFile(Receiver *,Antenna *,std::string);
 		
-		void matchMeasurements(Receiver *,Counter *);
+		bool matchMeasurements(Receiver *,Counter *);
 		void fixBadSawtoothCorrection(Receiver *,Counter *);
 		void writeReceiverTimingDiagnostics(Receiver *,Counter *,std::string);
 		void writeSVDiagnostics(Receiver *,std::string);
@@ -137,6 +151,7 @@ class Application
 		int CGGTTSversion;
 		int CGGTTSRevDateYYYY,CGGTTSRevDateMM,CGGTTSRevDateDD;
 		int CGGTTSminTrackLength;
+		int CGGTTSthreads;
 		double CGGTTSminElevation, CGGTTSmaxDSG,CGGTTSmaxURA;
 		
 		// RINEX generation
@@ -166,6 +181,7 @@ class Application
 		std::string timingDiagnosticsFile;
 		std::string processingLogPath,processingLog;
 		std::string tmpPath;
+		std::string ephemerisStorePath; // empty if not used
 		
 		std::string gzip;
 		
@@ -178,6 +194,10 @@ class Application
 		bool TICenabled;
 		bool fixBadSawtooth;
 		double sawtoothStepThreshold;
+		
+		std::vector<std::string> outputs;
+		unsigned int nRxMeasurements,nCtrMeasurements,nMatched,memUsage;
+		double tElapsed;
 };
 #endif
 
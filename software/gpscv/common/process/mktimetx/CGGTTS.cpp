@@ -25,9 +25,12 @@
 #include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <algorithm>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 
@@ -55,6 +58,62 @@ extern std::ostream *debugStream;
 #define OBSV2    1
 #define OBSV3    2
 
+// The results for one track, filled in by CGGTTS::computeTrack()
+
+class CGGTTSTrack
+{
+	public:
+		CGGTTSTrack(int schedMins,int start,int stop):
+			hh(schedMins/60),mm(schedMins%60),trackStart(start),trackStop(stop),
+			lowElevationCnt(0),highDSGCnt(0),shortTrackCnt(0),goodTrackCnt(0),
+			ephemerisMisses(0),badHealth(0),pseudoRangeFailures(0),badMeasurementCnt(0){}
+		
+		int hh,mm;
+		int trackStart,trackStop;
+		std::vector<std::string> lines; // formatted, with checksum
+		std::string error;              // set if a sanity check failed
+		int lowElevationCnt,highDSGCnt,shortTrackCnt,goodTrackCnt;
+		int ephemerisMisses,badHealth,pseudoRangeFailures,badMeasurementCnt;
+};
+
+// Working storage for a worker thread.
+// Use a fixed array of vectors so that we can use the index as a hash for the SVN. Memory is cheap
+// and svtrk is only 780 points long anyway
+
+class CGGTTSTrackBuffer
+{
+	public:
+		SVMeasurement * svtrk[MAXSV+1][NTRACKPOINTS][3]; 
+		int svObsCount[MAXSV+1];
+};
+
+// Hands out tracks to the worker threads
+
+class CGGTTSTrackQueue
+{
+	public:
+		CGGTTSTrackQueue(CGGTTS *c,std::vector<CGGTTSTrack> *t):cggtts(c),tracks(t),nextTrack(0){
+			pthread_mutex_init(&mutex,NULL);
+		}
+		~CGGTTSTrackQueue(){pthread_mutex_destroy(&mutex);}
+		
+		CGGTTSTrack *next(){
+			CGGTTSTrack *trk=NULL;
+			pthread_mutex_lock(&mutex);
+			if (nextTrack < tracks->size())
+				trk = &(tracks->at(nextTrack++));
+			pthread_mutex_unlock(&mutex);
+			return trk;
+		}
+		
+		CGGTTS *cggtts;
+		
+	private:
+		std::vector<CGGTTSTrack> *tracks;
+		unsigned int nextTrack;
+		pthread_mutex_t mutex;
+};
+
 static unsigned int str2ToCode(std::string s)
 {
 	int c=0;
@@ -250,377 +309,447 @@ bool CGGTTS::writeObservationFile(std::string fname,int mjd,int startTime,int st
 		default:quadFits=false;
 	}
 	
-	// Use a fixed array of vectors so that we can use the index as a hash for the SVN. Memory is cheap
-	// and svtrk is only 780 points long anyway
-	SVMeasurement * svtrk[MAXSV+1][NTRACKPOINTS][3]; 
-	int svObsCount[MAXSV+1];
-	
+	// Tracks are independent of each other so they are computed by a pool of worker threads.
+	// The results are collected and written in schedule order so that the output
+	// does not depend on the number of threads.
+	
+	trkMJD=mjd;
+	trkPairs=mpairs;
+	trkMeasDelay=measDelay;
+	trkUseTIC=useTIC;
+	trkCode1=code1;
+	trkCode2=code2;
+	trkAij=aij;
+	trkGNSSsys=GNSSsys;
+	trkFRCcode=FRCcode;
+	
+	std::vector<CGGTTSTrack> tracks;
 	for (int i=0;i<ntracks;i++){
-	
 		int trackStart = schedule[i]*60;
 		int trackStop =  schedule[i]*60+NTRACKPOINTS-1;
 		if (trackStop >= 86400) trackStop=86400-1;
 		// Now window it
-		if (trackStart < startTime || trackStart > stopTime) continue; // svtrk empty so no need to clear
+		if (trackStart < startTime || trackStart > stopTime) continue;
+		tracks.push_back(CGGTTSTrack(schedule[i],trackStart,trackStop));
+	}
 	
-		// Matched measurement pairs can be looked up without a search since the index is TOD
-		
-		for (int s=1;s<=MAXSV;s++){
-			svObsCount[s]=0;
-			for (int t=0;t<NTRACKPOINTS;t++)
-				for (int o=0;o<2;o++)
-					svtrk[s][t][o]=NULL;
+	unsigned int nThreads = threads;
+	if (threads <= 0){
+		long nCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+		nThreads = (nCPUs > 0 ? nCPUs : 1);
+	}
+	if (NULL != debugStream) // keep the debugging output in order
+		nThreads = 1;
+	if (nThreads > tracks.size())
+		nThreads = tracks.size();
+	DBGMSG(debugStream,1,"Computing " << tracks.size() << " tracks using " << nThreads << " thread(s)");
+	
+	CGGTTSTrackQueue queue(this,&tracks);
+	std::vector<pthread_t> workers;
+	for (unsigned int t=1;t<nThreads;t++){ // this thread is a worker too
+		pthread_t tid;
+		if (0 != pthread_create(&tid,NULL,CGGTTS::trackWorker,&queue)){
+			app->logMessage("failed to create a CGGTTS worker thread");
+			break; // whatever is left will be done by this thread
+		}
+		workers.push_back(tid);
+	}
+	trackWorker(&queue);
+	for (unsigned int t=0;t<workers.size();t++)
+		pthread_join(workers[t],NULL);
+	
+	for (unsigned int t=0;t<tracks.size();t++){
+		CGGTTSTrack &trk = tracks[t];
+		if (!trk.error.empty()){
+			std::cerr << "Error in CGGTTS::writeObservationFile() - " << trk.error << std::endl;
+			std::fclose(fout);
+			return false;
 		}
+		for (unsigned int l=0;l<trk.lines.size();l++)
+			std::fputs(trk.lines[l].c_str(),fout);
 		
-		if (!isP3 && !useMSIO){ // CASE 1: single code + MDIO
-			for (int m=trackStart;m<=trackStop;m++){
-				if ((mpairs[m]->flags==0x03)){
-					ReceiverMeasurement *rm = mpairs[m]->rm;
-					for (unsigned int sv=0;sv<rm->meas.size();sv++){
-						SVMeasurement * svm = rm->meas.at(sv);
-						if (svm->constellation == constellation && svm->code == code1){
-							svtrk[svm->svn][m-trackStart][OBSV1]=svm;
-							svObsCount[svm->svn] += 1;
-						}
+		lowElevationCnt += trk.lowElevationCnt;
+		highDSGCnt += trk.highDSGCnt;
+		shortTrackCnt += trk.shortTrackCnt;
+		goodTrackCnt += trk.goodTrackCnt;
+		ephemerisMisses += trk.ephemerisMisses;
+		badHealth += trk.badHealth;
+		pseudoRangeFailures += trk.pseudoRangeFailures;
+		badMeasurementCnt += trk.badMeasurementCnt;
+	}
+	
+	
+	app->logMessage("Ephemeris search misses: " + boost::lexical_cast<std::string>(ephemerisMisses));
+	app->logMessage("Bad health: " + boost::lexical_cast<std::string>(badHealth) );
+	app->logMessage("Pseudorange calculation failures: " + boost::lexical_cast<std::string>(pseudoRangeFailures-ephemerisMisses) ); // PR calculation skipped if unhealthy
+	app->logMessage("Bad measurements: " + boost::lexical_cast<std::string>(badMeasurementCnt) );
+	
+	app->logMessage(boost::lexical_cast<std::string>(goodTrackCnt) + " good tracks");
+	app->logMessage(boost::lexical_cast<std::string>(lowElevationCnt) + " low elevation tracks");
+	app->logMessage(boost::lexical_cast<std::string>(highDSGCnt) + " high DSG tracks");
+	app->logMessage(boost::lexical_cast<std::string>(shortTrackCnt) + " short tracks");
+	
+	std::fclose(fout);
+	
+	return true;
+}
+ 
+//
+//	Private members
+//		
+
+void CGGTTS::computeTrack(CGGTTSTrack *trk,CGGTTSTrackBuffer *buf)
+{
+	// Matched measurement pairs can be looked up without a search since the index is TOD
+	
+	for (int s=1;s<=MAXSV;s++){
+		buf->svObsCount[s]=0;
+		for (int t=0;t<NTRACKPOINTS;t++)
+			for (int o=0;o<2;o++)
+				buf->svtrk[s][t][o]=NULL;
+	}
+	
+	if (!isP3 && !useMSIO){ // CASE 1: single code + MDIO
+		for (int m=trk->trackStart;m<=trk->trackStop;m++){
+			if ((trkPairs[m]->flags==0x03)){
+				ReceiverMeasurement *rm = trkPairs[m]->rm;
+				for (unsigned int sv=0;sv<rm->meas.size();sv++){
+					SVMeasurement * svm = rm->meas.at(sv);
+					if (svm->constellation == constellation && svm->code == trkCode1){
+						buf->svtrk[svm->svn][m-trk->trackStart][OBSV1]=svm;
+						buf->svObsCount[svm->svn] += 1;
 					}
-				} 
-			}
-		}
-		else if (!isP3 && useMSIO){// CASE 2: single code + MSIO
+				}
+			} 
 		}
-		else if (isP3){// CASE 3: dual frequency
-			for (int m=trackStart;m<=trackStop;m++){
-				if ((mpairs[m]->flags==0x03)){
-					ReceiverMeasurement *rm = mpairs[m]->rm;
-					for (unsigned int sv=0;sv<rm->meas.size();sv++){
-						SVMeasurement * svm = rm->meas.at(sv);
-						if (svm->constellation == constellation && svm->code == code1){
-							svtrk[svm->svn][m-trackStart][OBSV1]=svm;
-							svObsCount[svm->svn] += 1;
-						}
-						if (svm->constellation == constellation && svm->code == code2)
-							svtrk[svm->svn][m-trackStart][OBSV2]=svm;
+	}
+	else if (!isP3 && useMSIO){// CASE 2: single code + MSIO
+	}
+	else if (isP3){// CASE 3: dual frequency
+		for (int m=trk->trackStart;m<=trk->trackStop;m++){
+			if ((trkPairs[m]->flags==0x03)){
+				ReceiverMeasurement *rm = trkPairs[m]->rm;
+				for (unsigned int sv=0;sv<rm->meas.size();sv++){
+					SVMeasurement * svm = rm->meas.at(sv);
+					if (svm->constellation == constellation && svm->code == trkCode1){
+						buf->svtrk[svm->svn][m-trk->trackStart][OBSV1]=svm;
+						buf->svObsCount[svm->svn] += 1;
 					}
-				} 
-			}
+					if (svm->constellation == constellation && svm->code == trkCode2)
+						buf->svtrk[svm->svn][m-trk->trackStart][OBSV2]=svm;
+				}
+			} 
 		}
+	}
+	
+	 //use arrays which can store the 15s quadratic fits and 30s decimated data
+	double refsv[52],refsys[52],mdtr[52],mdio[52],msio[52],tutc[52],svaz[52],svel[52];
+	
+	int linFitInterval=30; // length of fitting interval 
+	if (quadFits) linFitInterval=15;
+	
+	for (unsigned int sv=1;sv<=MAXSV;sv++){
 		
-		int hh = schedule[i] / 60;
-		int mm = schedule[i] % 60;
-		
-		 //use arrays which can store the 15s quadratic fits and 30s decimated data
-		double refsv[52],refsys[52],mdtr[52],mdio[52],msio[52],tutc[52],svaz[52],svel[52];
-		
-		int linFitInterval=30; // length of fitting interval 
-		if (quadFits) linFitInterval=15;
+		if (0 == buf->svObsCount[sv]) continue;
 		
-		for (unsigned int sv=1;sv<=MAXSV;sv++){
-			
-			if (0 == svObsCount[sv]) continue;
+		int npts=0;
+		int ioe;
+		if (quadFits){
+			double qprange[15],qtutc[15],qrefpps[15]; // for the 15s fits
+			double uncorrprange[52], refpps[52]; // for the results of the 15s fits
+			unsigned int nqfitpts=0,nqfits=0,gpsTOW[52];
+			int t=trk->trackStart;
+			ReceiverMeasurement *rxm;
+			while (t<=trk->trackStop){
+				SVMeasurement *svm1 = buf->svtrk[sv][t-trk->trackStart][OBSV1];
+				if (NULL != svm1){
+					rxm = svm1->rm;
+					int tmeas=rint(rxm->tmUTC.tm_sec + rxm->tmUTC.tm_min*60 + rxm->tmUTC.tm_hour*3600 + rxm->tmfracs); // tmfracs is set to zero by interpolateMeasurements()
+					
+					// FIXME MDIO needs to change for L2
+					if (nqfitpts > 14){ // shouldn't happen
+						trk->error="nqfitpts too big";
+						return;
+					}
+					// smooth the counter measurements - this helps clean up any residual sawtooth error
+					qrefpps[nqfitpts]= trkUseTIC*(rxm->cm->rdg + rxm->sawtooth)*1.0E9;
+					qprange[nqfitpts]=svm1->meas;
+					qtutc[nqfitpts]=tmeas;
+					nqfitpts++;
+				}
+				
+				t++;
 			
-			int npts=0;
-			int ioe;
-			if (quadFits){
-				double qprange[15],qtutc[15],qrefpps[15]; // for the 15s fits
-				double uncorrprange[52], refpps[52]; // for the results of the 15s fits
-				unsigned int nqfitpts=0,nqfits=0,gpsTOW[52];
-				int t=trackStart;
-				ReceiverMeasurement *rxm;
-				while (t<=trackStop){
-					SVMeasurement *svm1 = svtrk[sv][t-trackStart][OBSV1];
-					if (NULL != svm1){
-						rxm = svm1->rm;
-						int tmeas=rint(rxm->tmUTC.tm_sec + rxm->tmUTC.tm_min*60 + rxm->tmUTC.tm_hour*3600 + rxm->tmfracs); // tmfracs is set to zero by interpolateMeasurements()
-						
-						// FIXME MDIO needs to change for L2
-						if (nqfitpts > 14){ // shouldn't happen
-							std::cerr << "Error in CGGTTS::writeObservationFile() - nqfitpts too big" << std::endl;
-							exit(EXIT_FAILURE);
-						}
-						// smooth the counter measurements - this helps clean up any residual sawtooth error
-						qrefpps[nqfitpts]= useTIC*(rxm->cm->rdg + rxm->sawtooth)*1.0E9;
-						qprange[nqfitpts]=svm1->meas;
-						qtutc[nqfitpts]=tmeas;
-						nqfitpts++;
+				if (((t-trk->trackStart) % 15 == 0) || ((t - trk->trackStart)== NTRACKPOINTS)){ // have got a full set of points for a quadratic fit
+					//DBGMSG(debugStream,1,sv << " " << trk->trackStart << " " << nqfitpts << " " << nqfits);
+					// Sanity checks
+					if (nqfits > 51){// shouldn't happen
+						trk->error="nqfits too big";
+						return;
 					}
 					
-					t++;
-				
-					if (((t-trackStart) % 15 == 0) || ((t - trackStart)== NTRACKPOINTS)){ // have got a full set of points for a quadratic fit
-						//DBGMSG(debugStream,1,sv << " " << trackStart << " " << nqfitpts << " " << nqfits);
-						// Sanity checks
-						if (nqfits > 51){// shouldn't happen
-							std::cerr << "Error in CGGTTS::writeObservationFile() - nqfits too big" << std::endl;
-							exit(EXIT_FAILURE);
-						}
-						
-						if (nqfitpts > 7){ // demand at least half a track - then we are not extrapolating
-							double tc=(t-1)-7; // subtract 1 because we've gone one too far
-							tutc[nqfits] = tc;
-							// Compute and save GPS TOW so that we have it available for computing the pseudorange corrections
-							// FIXME This does not handle the week rollover 
-							unsigned int gpsDay = (rxm->gpstow / 86400); // use the last receiver measurement for day number - shouldn't be NULL because nqfitpts >0
-							unsigned int TOD = tc+rx->leapsecs;
-							if (TOD >= 86400){
-								TOD -= 86400;
-								gpsDay++;
-								if (gpsDay == 7){
-									gpsDay=0;
-								}
+					if (nqfitpts > 7){ // demand at least half a track - then we are not extrapolating
+						double tc=(t-1)-7; // subtract 1 because we've gone one too far
+						tutc[nqfits] = tc;
+						// Compute and save GPS TOW so that we have it available for computing the pseudorange corrections
+						// FIXME This does not handle the week rollover 
+						unsigned int gpsDay = (rxm->gpstow / 86400); // use the last receiver measurement for day number - shouldn't be NULL because nqfitpts >0
+						unsigned int TOD = tc+rx->leapsecs;
+						if (TOD >= 86400){
+							TOD -= 86400;
+							gpsDay++;
+							if (gpsDay == 7){
+								gpsDay=0;
 							}
-							// FIXME as a kludge could just drop points at the week rollover
-							gpsTOW[nqfits] =  tc + rx->leapsecs + gpsDay*86400;
-							Utility::quadFit(qtutc,qprange,nqfitpts,tc,&(uncorrprange[nqfits]) );
-							Utility::quadFit(qtutc,qrefpps,nqfitpts,tc,&(refpps[nqfits]) );
-							nqfits++;
 						}
-						nqfitpts=0;
-					} // 
-					
-					//if ((t - trackStart) == NTRACKPOINTS) break;  // no more measurements available FIXME off by 1?
-				} // while (t<=trackStart)
+						// FIXME as a kludge could just drop points at the week rollover
+						gpsTOW[nqfits] =  tc + rx->leapsecs + gpsDay*86400;
+						Utility::quadFit(qtutc,qprange,nqfitpts,tc,&(uncorrprange[nqfits]) );
+						Utility::quadFit(qtutc,qrefpps,nqfitpts,tc,&(refpps[nqfits]) );
+						nqfits++;
+					}
+					nqfitpts=0;
+				} // 
 				
-				// Now we can compute the pr corrections etc for the fitted prs
+				//if ((t - trk->trackStart) == NTRACKPOINTS) break;  // no more measurements available FIXME off by 1?
+			} // while (t<=trk->trackStart)
+			
+			// Now we can compute the pr corrections etc for the fitted prs
 
-				GPSEphemeris *ed=NULL;
-				npts=0;
-				for ( unsigned int q=0;q<nqfits;q++){
+			GPSEphemeris *ed=NULL;
+			npts=0;
+			for ( unsigned int q=0;q<nqfits;q++){
+				if (ed==NULL) // use only one ephemeris for each track
+						ed = dynamic_cast<GPSEphemeris *>(rx->gps.nearestEphemeris(sv,gpsTOW[q],maxURA));
+				if (NULL == ed){
+					trk->ephemerisMisses++;
+				}
+				else{
+					if (ed->SV_health > 0){
+						trk->badHealth++;
+						continue;
+					}
+				}
+				
+				double refsyscorr,refsvcorr,iono,tropo,az,el;
+				// FIXME MDIO needs to change for L2
+				// getPseudorangeCorrections will check for NULL ephemeris
+				if (rx->gps.getPseudorangeCorrections(gpsTOW[q],uncorrprange[q],ant,ed,code,
+						&refsyscorr,&refsvcorr,&iono,&tropo,&az,&el,&ioe)){
+					tutc[npts]=tutc[q]; // ok to overwrite, because npts <= q
+					svaz[npts]=az;
+					svel[npts]=el;
+					mdtr[npts]=tropo;
+					mdio[npts]=iono;
+					refsv[npts]  = uncorrprange[q]*1.0E9 + refsvcorr  - iono - tropo + refpps[q];
+					refsys[npts] = uncorrprange[q]*1.0E9 + refsyscorr - iono - tropo + refpps[q];
+					npts++;
+				}
+				else{
+					trk->pseudoRangeFailures++;
+				}
+			}
+		}                                 
+		else{ // v2E specifies 30s sampled values 
+			int tsearch=trk->trackStart;
+			int t=0;
+			
+			GPSEphemeris *ed=NULL;
+			while (t< NTRACKPOINTS){
+				SVMeasurement *svm1  = buf->svtrk[sv][t][OBSV1];
+				SVMeasurement *svm2  = NULL;
+				if (NULL == svm1){
+					t++;
+					continue;
+				}
+				if (isP3){
+					svm2  = buf->svtrk[sv][t][OBSV2];
+					if (NULL == svm2){
+						t++;
+						continue;
+					}
+				}
+				
+				svm1->dbuf2=0.0;
+				ReceiverMeasurement *rxmt = svm1->rm;
+				int tmeas=rint(rxmt->tmUTC.tm_sec + rxmt->tmUTC.tm_min*60+ rxmt->tmUTC.tm_hour*3600+rxmt->tmfracs);
+				
+				if (tmeas==tsearch){
+				
 					if (ed==NULL) // use only one ephemeris for each track
-							ed = dynamic_cast<GPSEphemeris *>(rx->gps.nearestEphemeris(sv,gpsTOW[q],maxURA));
+						ed = dynamic_cast<GPSEphemeris *>(rx->gps.nearestEphemeris(sv,rxmt->gpstow,maxURA));
+					
 					if (NULL == ed){
-						ephemerisMisses++;
+						trk->ephemerisMisses++;
 					}
 					else{
 						if (ed->SV_health > 0){
-							badHealth++;
+							trk->badHealth++;
+							tsearch += 30;
+							t++;
 							continue;
 						}
 					}
+				
+					double refsyscorr,refsvcorr,iono,tropo,az,el,refpps,pr;
 					
-					double refsyscorr,refsvcorr,iono,tropo,az,el;
 					// FIXME MDIO needs to change for L2
 					// getPseudorangeCorrections will check for NULL ephemeris
-					if (rx->gps.getPseudorangeCorrections(gpsTOW[q],uncorrprange[q],ant,ed,code,
-							&refsyscorr,&refsvcorr,&iono,&tropo,&az,&el,&ioe)){
-						tutc[npts]=tutc[q]; // ok to overwrite, because npts <= q
+					pr = svm1->meas;
+					if (isP3)
+						pr = trkAij*svm1->meas + (1.0-trkAij)*svm2->meas + ed->t_GD; // FUDGE
+					if (rx->gps.getPseudorangeCorrections(rxmt->gpstow,pr,ant,ed,trkCode1,&refsyscorr,&refsvcorr,&iono,&tropo,&az,&el,&ioe)){
+						tutc[npts]=tmeas;
 						svaz[npts]=az;
 						svel[npts]=el;
 						mdtr[npts]=tropo;
 						mdio[npts]=iono;
-						refsv[npts]  = uncorrprange[q]*1.0E9 + refsvcorr  - iono - tropo + refpps[q];
-						refsys[npts] = uncorrprange[q]*1.0E9 + refsyscorr - iono - tropo + refpps[q];
-						npts++;
-					}
-					else{
-						pseudoRangeFailures++;
-					}
-				}
-			}                                 
-			else{ // v2E specifies 30s sampled values 
-				int tsearch=trackStart;
-				int t=0;
-				
-				GPSEphemeris *ed=NULL;
-				while (t< NTRACKPOINTS){
-					SVMeasurement *svm1  = svtrk[sv][t][OBSV1];
-					SVMeasurement *svm2  = NULL;
-					if (NULL == svm1){
-						t++;
-						continue;
-					}
-					if (isP3){
-						svm2  = svtrk[sv][t][OBSV2];
-						if (NULL == svm2){
-							t++;
-							continue;
-						}
-					}
-					
-					svm1->dbuf2=0.0;
-					ReceiverMeasurement *rxmt = svm1->rm;
-					int tmeas=rint(rxmt->tmUTC.tm_sec + rxmt->tmUTC.tm_min*60+ rxmt->tmUTC.tm_hour*3600+rxmt->tmfracs);
-					
-					if (tmeas==tsearch){
-					
-						if (ed==NULL) // use only one ephemeris for each track
-							ed = dynamic_cast<GPSEphemeris *>(rx->gps.nearestEphemeris(sv,rxmt->gpstow,maxURA));
-						
-						if (NULL == ed){
-							ephemerisMisses++;
-						}
-						else{
-							if (ed->SV_health > 0){
-								badHealth++;
-								tsearch += 30;
-								t++;
-								continue;
-							}
+						if (useMSIO){
+							msio[npts]=1.0E9*rx->gps.measIonoDelay(trkCode1,trkCode2,svm1->meas,svm2->meas,0,0,ed);// FIXME calibrated delays ....
+							//DBGMSG(debugStream,INFO,tmeas << " " <<"G"<<(int) svm1->svn << "G" << (int)svm2->svn <<  " " << (svm2->meas - svm1->meas)*1.0E9 << " " << msio[npts])
 						}
-					
-						double refsyscorr,refsvcorr,iono,tropo,az,el,refpps,pr;
-						
-						// FIXME MDIO needs to change for L2
-						// getPseudorangeCorrections will check for NULL ephemeris
-						pr = svm1->meas;
-						if (isP3)
-							pr = aij*svm1->meas + (1.0-aij)*svm2->meas + ed->t_GD; // FUDGE
-						if (rx->gps.getPseudorangeCorrections(rxmt->gpstow,pr,ant,ed,code1,&refsyscorr,&refsvcorr,&iono,&tropo,&az,&el,&ioe)){
-							tutc[npts]=tmeas;
-							svaz[npts]=az;
-							svel[npts]=el;
-							mdtr[npts]=tropo;
-							mdio[npts]=iono;
-							if (useMSIO){
-								msio[npts]=1.0E9*rx->gps.measIonoDelay(code1,code2,svm1->meas,svm2->meas,0,0,ed);// FIXME calibrated delays ....
-								//DBGMSG(debugStream,INFO,tmeas << " " <<"G"<<(int) svm1->svn << "G" << (int)svm2->svn <<  " " << (svm2->meas - svm1->meas)*1.0E9 << " " << msio[npts])
-							}
-							refpps= useTIC*(rxmt->cm->rdg + rxmt->sawtooth)*1.0E9;
-							if (isP3){ // ionosphere free so don't use mdio
-								refsv[npts]  = pr*1.0E9 + refsvcorr  - tropo + refpps;
-								refsys[npts] = pr*1.0E9 + refsyscorr - tropo + refpps;
-							}
-							else{
-								refsv[npts]  = pr*1.0E9 + refsvcorr  - iono - tropo + refpps;
-								refsys[npts] = pr*1.0E9 + refsyscorr - iono - tropo + refpps;
-							}
-							svm1->dbuf2 = refsv[npts]/1.0E9; // back to seconds !
-							npts++;
+						refpps= trkUseTIC*(rxmt->cm->rdg + rxmt->sawtooth)*1.0E9;
+						if (isP3){ // ionosphere free so don't use mdio
+							refsv[npts]  = pr*1.0E9 + refsvcorr  - tropo + refpps;
+							refsys[npts] = pr*1.0E9 + refsyscorr - tropo + refpps;
 						}
 						else{
-							
-							pseudoRangeFailures++;
+							refsv[npts]  = pr*1.0E9 + refsvcorr  - iono - tropo + refpps;
+							refsys[npts] = pr*1.0E9 + refsyscorr - iono - tropo + refpps;
 						}
-						tsearch += 30;
-						t++;
-					}
-					else if (tmeas > tsearch){
-						tsearch += 30;
-						// don't increment t because this measurement must be re-tested	
+						svm1->dbuf2 = refsv[npts]/1.0E9; // back to seconds !
+						npts++;
 					}
 					else{
-						t++;
+						
+						trk->pseudoRangeFailures++;
 					}
+					tsearch += 30;
+					t++;
 				}
-			} // else quadfits
-			
-			if (npts*linFitInterval >= minTrackLength){
-				
-				double tc=(trackStart+trackStop)/2.0; // FIXME may need to add MJD to allow rollovers
-				
-				double aztc,azc,azm,azresid;
-				Utility::linearFit(tutc,svaz,npts,tc,&aztc,&azc,&azm,&azresid);
-				aztc=rint(aztc*10);
-				
-				double eltc,elc,elm,elresid;
-				Utility::linearFit(tutc,svel,npts,tc,&eltc,&elc,&elm,&elresid);
-				eltc=rint(eltc*10);
-				
-				double mdtrtc,mdtrc,mdtrm,mdtrresid;
-				Utility::linearFit(tutc,mdtr,npts,tc,&mdtrtc,&mdtrc,&mdtrm,&mdtrresid);
-				mdtrtc=rint(mdtrtc*10);
-				mdtrm=rint(mdtrm*10000);
-				
-				double refsvtc,refsvc,refsvm,refsvresid;
-				Utility::linearFit(tutc,refsv,npts,tc,&refsvtc,&refsvc,&refsvm,&refsvresid);
-				refsvtc=rint((refsvtc-measDelay)*10); // apply total measurement system delay
-				refsvm=rint(refsvm*10000);
-				
-				double refsystc,refsysc,refsysm,refsysresid;
-				Utility::linearFit(tutc,refsys,npts,tc,&refsystc,&refsysc,&refsysm,&refsysresid);
-				refsystc=rint((refsystc-measDelay)*10); // apply total measurement system delay
-				refsysm=rint(refsysm*10000);
-				refsysresid=rint(refsysresid*10);
-				
-				double mdiotc,mdioc,mdiom,mdioresid;
-				Utility::linearFit(tutc,mdio,npts,tc,&mdiotc,&mdioc,&mdiom,&mdioresid);
-				mdiotc=rint(mdiotc*10);
-				mdiom=rint(mdiom*10000);
-				
-				double msiotc=0.0,msioc=0.0,msiom=0.0,msioresid=0.0;
-				if (useMSIO){
-					Utility::linearFit(tutc,msio,npts,tc,&msiotc,&msioc,&msiom,&msioresid);
-					msiotc=rint(msiotc*10);
-					if (msiotc < -999)
-						msiotc=-999;
-					else if (msiotc > 9999)
-						msiotc=9999;
-					msiom=rint(msiom*10000); // 4 digits
-					if (msiom < -999) // clamp out of range
-						msiom=-999;
-					else if (msiom > 9999)
-						msiom=9999;
-					msioresid=rint(msioresid*10); // 3 digits
-					if (msioresid > 999)
-						msioresid=999;
+				else if (tmeas > tsearch){
+					tsearch += 30;
+					// don't increment t because this measurement must be re-tested	
 				}
-				
-				// Some range checks on the data - flag bad measurements
-				if (refsvm >  99999) refsvm=99999;
-				if (refsvm < -99999) refsvm=-99999;
-				
-				if (refsysm >  99999) refsysm=99999;
-				if (refsysm < -99999) refsysm=-99999;
-				
-				if (refsysresid > 999.9) refsysresid = 999.9;
-				
-				if (fabs(refsvm)==99999 || fabs(refsysm) == 99999 || refsysresid == 999.9 || msioresid==999) // so that we only count a single track
-					badMeasurementCnt++;
-				
-				// Ready to output
-				if (eltc >= minElevation*10 && refsysresid <= maxDSG*10){ 
-					char sout[155]; // V2E
-					goodTrackCnt++;
-					switch (ver){
-						case V1:
-							std::snprintf(sout,128," %02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i ",sv,"FF",mjd,hh,mm,
-											npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc ,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
-											ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom);
-							std::fprintf(fout,"%s%02X\n",sout,checkSum(sout) % 256);
-							break;
-						case V2E:
-							if (isP3)
-								std::snprintf(sout,154,"%s%02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i %4i %4i %3i %2i %2i %3s ",GNSSsys.c_str(),sv,"FF",mjd,hh,mm,
-											npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
-											ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom,(int) msiotc,(int) msiom,(int) msioresid,0,0,FRCcode.c_str());
-							else 
-								std::snprintf(sout,154,"%s%02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i %2i %2i %3s ",GNSSsys.c_str(),sv,"FF",mjd,hh,mm,
-											npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
-											ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom,0,0,FRCcode.c_str());
-							std::fprintf(fout,"%s%02X\n",sout,checkSum(sout) % 256); // FIXME
-							break;
-					} // switch
-				} // if (eltc >= minElevation*10 && refsysresid <= maxDSG*10)
 				else{
-					if (eltc < minElevation*10) lowElevationCnt++;
-					if (refsysresid > maxDSG*10) highDSGCnt++;
+					t++;
 				}
-			} // if (npts*linFitInterval >= minTrackLength)
+			}
+		} // else quadfits
+		
+		if (npts*linFitInterval >= minTrackLength){
+			
+			double tc=(trk->trackStart+trk->trackStop)/2.0; // FIXME may need to add MJD to allow rollovers
+			
+			double aztc,azc,azm,azresid;
+			Utility::linearFit(tutc,svaz,npts,tc,&aztc,&azc,&azm,&azresid);
+			aztc=rint(aztc*10);
+			
+			double eltc,elc,elm,elresid;
+			Utility::linearFit(tutc,svel,npts,tc,&eltc,&elc,&elm,&elresid);
+			eltc=rint(eltc*10);
+			
+			double mdtrtc,mdtrc,mdtrm,mdtrresid;
+			Utility::linearFit(tutc,mdtr,npts,tc,&mdtrtc,&mdtrc,&mdtrm,&mdtrresid);
+			mdtrtc=rint(mdtrtc*10);
+			mdtrm=rint(mdtrm*10000);
+			
+			double refsvtc,refsvc,refsvm,refsvresid;
+			Utility::linearFit(tutc,refsv,npts,tc,&refsvtc,&refsvc,&refsvm,&refsvresid);
+			refsvtc=rint((refsvtc-trkMeasDelay)*10); // apply total measurement system delay
+			refsvm=rint(refsvm*10000);
+			
+			double refsystc,refsysc,refsysm,refsysresid;
+			Utility::linearFit(tutc,refsys,npts,tc,&refsystc,&refsysc,&refsysm,&refsysresid);
+			refsystc=rint((refsystc-trkMeasDelay)*10); // apply total measurement system delay
+			refsysm=rint(refsysm*10000);
+			refsysresid=rint(refsysresid*10);
+			
+			double mdiotc,mdioc,mdiom,mdioresid;
+			Utility::linearFit(tutc,mdio,npts,tc,&mdiotc,&mdioc,&mdiom,&mdioresid);
+			mdiotc=rint(mdiotc*10);
+			mdiom=rint(mdiom*10000);
+			
+			double msiotc=0.0,msioc=0.0,msiom=0.0,msioresid=0.0;
+			if (useMSIO){
+				Utility::linearFit(tutc,msio,npts,tc,&msiotc,&msioc,&msiom,&msioresid);
+				msiotc=rint(msiotc*10);
+				if (msiotc < -999)
+					msiotc=-999;
+				else if (msiotc > 9999)
+					msiotc=9999;
+				msiom=rint(msiom*10000); // 4 digits
+				if (msiom < -999) // clamp out of range
+					msiom=-999;
+				else if (msiom > 9999)
+					msiom=9999;
+				msioresid=rint(msioresid*10); // 3 digits
+				if (msioresid > 999)
+					msioresid=999;
+			}
+			
+			// Some range checks on the data - flag bad measurements
+			if (refsvm >  99999) refsvm=99999;
+			if (refsvm < -99999) refsvm=-99999;
+			
+			if (refsysm >  99999) refsysm=99999;
+			if (refsysm < -99999) refsysm=-99999;
+			
+			if (refsysresid > 999.9) refsysresid = 999.9;
+			
+			if (fabs(refsvm)==99999 || fabs(refsysm) == 99999 || refsysresid == 999.9 || msioresid==999) // so that we only count a single track
+				trk->badMeasurementCnt++;
+			
+			// Ready to output
+			if (eltc >= minElevation*10 && refsysresid <= maxDSG*10){ 
+				char sout[155]; // V2E
+				char sline[160];
+				trk->goodTrackCnt++;
+				switch (ver){
+					case V1:
+						std::snprintf(sout,128," %02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i ",sv,"FF",trkMJD,trk->hh,trk->mm,
+										npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc ,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
+										ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom);
+						std::snprintf(sline,160,"%s%02X\n",sout,checkSum(sout) % 256);
+						trk->lines.push_back(sline);
+						break;
+					case V2E:
+						if (isP3)
+							std::snprintf(sout,154,"%s%02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i %4i %4i %3i %2i %2i %3s ",trkGNSSsys.c_str(),sv,"FF",trkMJD,trk->hh,trk->mm,
+										npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
+										ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom,(int) msiotc,(int) msiom,(int) msioresid,0,0,trkFRCcode.c_str());
+						else 
+							std::snprintf(sout,154,"%s%02i %2s %5i %02i%02i00 %4i %3i %4i %11li %6i %11li %6i %4i %3i %4i %4i %4i %4i %2i %2i %3s ",trkGNSSsys.c_str(),sv,"FF",trkMJD,trk->hh,trk->mm,
+										npts*linFitInterval,(int) eltc,(int) aztc, (long int) refsvtc,(int) refsvm,(long int)refsystc,(int) refsysm,(int) refsysresid,
+										ioe,(int) mdtrtc, (int) mdtrm, (int) mdiotc, (int) mdiom,0,0,trkFRCcode.c_str());
+						std::snprintf(sline,160,"%s%02X\n",sout,checkSum(sout) % 256); // FIXME
+						trk->lines.push_back(sline);
+						break;
+				} // switch
+			} // if (eltc >= minElevation*10 && refsysresid <= maxDSG*10)
 			else{
-				shortTrackCnt++;
+				if (eltc < minElevation*10) trk->lowElevationCnt++;
+				if (refsysresid > maxDSG*10) trk->highDSGCnt++;
 			}
+		} // if (npts*linFitInterval >= minTrackLength)
+		else{
+			trk->shortTrackCnt++;
 		}
+	}
+
 	
-		
-	} // for (int i=0;i<ntracks;i++){
-	
-	app->logMessage("Ephemeris search misses: " + boost::lexical_cast<std::string>(ephemerisMisses));
-	app->logMessage("Bad health: " + boost::lexical_cast<std::string>(badHealth) );
-	app->logMessage("Pseudorange calculation failures: " + boost::lexical_cast<std::string>(pseudoRangeFailures-ephemerisMisses) ); // PR calculation skipped if unhealthy
-	app->logMessage("Bad measurements: " + boost::lexical_cast<std::string>(badMeasurementCnt) );
-	
-	app->logMessage(boost::lexical_cast<std::string>(goodTrackCnt) + " good tracks");
-	app->logMessage(boost::lexical_cast<std::string>(lowElevationCnt) + " low elevation tracks");
-	app->logMessage(boost::lexical_cast<std::string>(highDSGCnt) + " high DSG tracks");
-	app->logMessage(boost::lexical_cast<std::string>(shortTrackCnt) + " short tracks");
-	
-	std::fclose(fout);
-	
-	return true;
 }
- 
-//
-//	Private members
-//		
+
+void *CGGTTS::trackWorker(void *arg)
+{
+	CGGTTSTrackQueue *queue = (CGGTTSTrackQueue *) arg;
+	CGGTTSTrackBuffer *buf = new CGGTTSTrackBuffer(); // too big for a thread's stack
+	CGGTTSTrack *trk;
+	while (NULL != (trk = queue->next()))
+		queue->cggtts->computeTrack(trk,buf);
+	delete buf;
+	return NULL;
+}
 
 void CGGTTS::init()
 {
@@ -638,6 +767,7 @@ void CGGTTS::init()
 	minElevation=10.0;
 	maxDSG=100.0;
 	maxURA=3.0; // as reported by receivers, typically 2.0 m, with a few at 2.8 m
+	threads=0;
 	useMSIO=false;
 	isP3=false;
 }
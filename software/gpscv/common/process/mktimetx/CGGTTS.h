@@ -30,6 +30,8 @@
 
 class Antenna;
 class Counter;
+class CGGTTSTrack;
+class CGGTTSTrackBuffer;
 class MeasurementPair;
 class Receiver;
 
@@ -67,6 +69,8 @@ class CGGTTS
 		double maxDSG; // in ns
 		double maxURA; // in m
 		
+		int threads; // number of worker threads used to compute tracks, 0 = one per CPU
+		
 	private:
 		
 		void init();
@@ -74,11 +78,23 @@ class CGGTTS
 		void writeHeader(FILE *fout);
 		int checkSum(char *);
 		
+		void computeTrack(CGGTTSTrack *,CGGTTSTrackBuffer *);
+		static void *trackWorker(void *);
+		
 		Antenna *ant;
 		Counter *cntr;
 		Receiver *rx;
 		
 		std::string code1Str,code2Str;
+		
+		// parameters shared by the track computations in writeObservationFile()
+		int trkMJD;
+		MeasurementPair **trkPairs;
+		double trkMeasDelay;
+		int trkUseTIC;
+		unsigned int trkCode1,trkCode2;
+		double trkAij;
+		std::string trkGNSSsys,trkFRCcode;
 };
 
 #endif
@@ -100,6 +100,15 @@ bool Counter::readLog(std::string fname,int startTime,int stopTime)
 	return true;
 }
 
+void Counter::deleteMeasurements()
+{
+	while(! measurements.empty()){
+		CounterMeasurement *tmp= measurements.back();
+		delete tmp;
+		measurements.pop_back();
+	}
+}
+
 unsigned int Counter::memoryUsage()
 {
 	unsigned int mem=0;
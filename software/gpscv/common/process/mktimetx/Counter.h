@@ -43,6 +43,7 @@ class Counter
 		bool flipSign;
 		
 		std::vector<CounterMeasurement *> measurements;
+		void deleteMeasurements();
 	
 		unsigned int memoryUsage();
 		
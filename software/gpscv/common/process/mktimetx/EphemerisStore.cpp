@@ -0,0 +1,243 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+
+#include <iostream>
+#include <sstream>
+
+#include "Debug.h"
+#include "EphemerisStore.h"
+#include "GPS.h"
+#include "Receiver.h"
+
+extern std::ostream *debugStream;
+
+#define STORE_MAGIC "OTTPEPH1"
+#define STORE_MAGIC_LEN 8
+
+//
+//	public
+//
+
+EphemerisStore::EphemerisStore()
+{
+}
+
+std::string EphemerisStore::makeFileName(std::string path,int mjd)
+{
+	std::ostringstream ss;
+	ss << path << "/" << mjd << ".eph";
+	return ss.str();
+}
+
+bool EphemerisStore::write(Receiver *rx,std::string fname,int mjd)
+{
+	GPS &gps = rx->gps;
+	
+	if (!(gps.gotUTCdata && gps.gotIonoData)){
+		DBGMSG(debugStream,INFO,"no UTC/ionosphere data - " << fname << " not written");
+		return false;
+	}
+	
+	// Keep only the most recent healthy ephemeris for each SV
+	std::vector<GPSEphemeris *> latest;
+	for (int svn=1;svn<=gps.maxSVN();svn++){
+		GPSEphemeris *best=NULL;
+		for (unsigned int i=0;i<gps.sortedEphemeris[svn].size();i++){
+			GPSEphemeris *ed = dynamic_cast<GPSEphemeris *>(gps.sortedEphemeris[svn].at(i));
+			if (ed->SV_health != 0) continue;
+			if (NULL == best || ed->t0cAbs > best->t0cAbs)
+				best=ed;
+		}
+		if (best) latest.push_back(best);
+	}
+	
+	FILE *fout;
+	if (!(fout = std::fopen(fname.c_str(),"w"))){
+		std::cerr << "Unable to open " << fname << std::endl;
+		return false;
+	}
+	
+	std::fwrite(STORE_MAGIC,1,STORE_MAGIC_LEN,fout);
+	put<SINT32>(fout,mjd);
+	put<SINT32>(fout,rx->leapsecs);
+	
+	put(fout,gps.UTCdata.A0);
+	put(fout,gps.UTCdata.A1);
+	put(fout,gps.UTCdata.dt_LS);
+	put(fout,gps.UTCdata.t_ot);
+	put(fout,gps.UTCdata.WN_t);
+	put(fout,gps.UTCdata.WN_LSF);
+	put(fout,gps.UTCdata.DN);
+	put(fout,gps.UTCdata.dt_LSF);
+	
+	put(fout,gps.ionoData.a0);put(fout,gps.ionoData.a1);put(fout,gps.ionoData.a2);put(fout,gps.ionoData.a3);
+	put(fout,gps.ionoData.B0);put(fout,gps.ionoData.B1);put(fout,gps.ionoData.B2);put(fout,gps.ionoData.B3);
+	
+	put<UINT32>(fout,latest.size());
+	for (unsigned int i=0;i<latest.size();i++)
+		writeEphemeris(fout,latest.at(i));
+	
+	bool ok = (0 == std::ferror(fout));
+	std::fclose(fout);
+	
+	DBGMSG(debugStream,INFO,"wrote " << latest.size() << " GPS ephemerides to " << fname);
+	
+	return ok;
+}
+
+bool EphemerisStore::read(Receiver *rx,std::string fname,int mjd)
+{
+	GPS &gps = rx->gps;
+	
+	FILE *fin;
+	if (!(fin = std::fopen(fname.c_str(),"r"))){
+		DBGMSG(debugStream,INFO,"unable to open " << fname);
+		return false;
+	}
+	
+	char magic[STORE_MAGIC_LEN];
+	SINT32 storeMJD,storeLeapSecs;
+	if (STORE_MAGIC_LEN != std::fread(magic,1,STORE_MAGIC_LEN,fin) || 
+		0 != std::strncmp(magic,STORE_MAGIC,STORE_MAGIC_LEN) ||
+		!get(fin,&storeMJD) || !get(fin,&storeLeapSecs)){
+		std::cerr << fname << " is not a valid ephemeris store" << std::endl;
+		std::fclose(fin);
+		return false;
+	}
+	
+	// Only data from the previous day are used
+	if (storeMJD != mjd-1){
+		std::cerr << fname << " is for MJD " << storeMJD << " but MJD " << mjd-1 << " was expected" << std::endl;
+		std::fclose(fin);
+		return false;
+	}
+	
+	GPS::UTCData utc;
+	GPS::IonosphereData iono;
+	UINT32 nEph;
+	
+	bool ok = get(fin,&utc.A0) && get(fin,&utc.A1) && get(fin,&utc.dt_LS) && get(fin,&utc.t_ot) &&
+		get(fin,&utc.WN_t) && get(fin,&utc.WN_LSF) && get(fin,&utc.DN) && get(fin,&utc.dt_LSF) &&
+		get(fin,&iono.a0) && get(fin,&iono.a1) && get(fin,&iono.a2) && get(fin,&iono.a3) &&
+		get(fin,&iono.B0) && get(fin,&iono.B1) && get(fin,&iono.B2) && get(fin,&iono.B3) &&
+		get(fin,&nEph);
+	
+	std::vector<GPSEphemeris *> eph;
+	for (unsigned int i=0;ok && i<nEph;i++){
+		GPSEphemeris *ed = new GPSEphemeris();
+		if (readEphemeris(fin,ed) && ed->SVN >= 1 && ed->SVN <= gps.maxSVN())
+			eph.push_back(ed);
+		else{
+			delete ed;
+			ok=false;
+		}
+	}
+	std::fclose(fin);
+	
+	if (!ok){
+		std::cerr << fname << " is truncated or corrupted" << std::endl;
+		for (unsigned int i=0;i<eph.size();i++)
+			delete eph.at(i);
+		return false;
+	}
+	
+	gps.UTCdata=utc;
+	gps.ionoData=iono;
+	gps.gotIonoData=true;
+	// The leap second may have been scheduled for today
+	if (!gps.currentLeapSeconds(mjd,&(rx->leapsecs)))
+		rx->leapsecs=storeLeapSecs;
+	gps.gotUTCdata=true;
+	
+	for (unsigned int i=0;i<eph.size();i++){
+		if (!gps.addEphemeris(eph.at(i)))
+			delete eph.at(i);
+	}
+	
+	DBGMSG(debugStream,INFO,"read " << eph.size() << " GPS ephemerides from " << fname);
+	
+	return true;
+}
+
+//
+//	private
+//
+
+void EphemerisStore::writeEphemeris(FILE *fout,GPSEphemeris *ed)
+{
+	put(fout,ed->SVN);
+	put(fout,ed->t_ephem);
+	put(fout,ed->week_number);
+	put(fout,ed->SV_accuracy_raw);
+	put(fout,ed->SV_health);
+	put(fout,ed->IODC);
+	put(fout,ed->t_GD);
+	put(fout,ed->t_OC);
+	put(fout,ed->a_f2);
+	put(fout,ed->a_f1);
+	put(fout,ed->a_f0);
+	put(fout,ed->SV_accuracy);
+	put(fout,ed->IODE);
+	put(fout,ed->C_rs);
+	put(fout,ed->delta_N);
+	put(fout,ed->M_0);
+	put(fout,ed->C_uc);
+	put(fout,ed->e);
+	put(fout,ed->C_us);
+	put(fout,ed->sqrtA);
+	put(fout,ed->t_0e);
+	put(fout,ed->C_ic);
+	put(fout,ed->OMEGA_0);
+	put(fout,ed->C_is);
+	put(fout,ed->i_0);
+	put(fout,ed->C_rc);
+	put(fout,ed->OMEGA);
+	put(fout,ed->OMEGADOT);
+	put(fout,ed->IDOT);
+	put(fout,ed->Axis);
+	put(fout,ed->n);
+	put(fout,ed->r1me2);
+	put(fout,ed->OMEGA_N);
+	put(fout,ed->ODOT_n);
+	put(fout,ed->subframes);
+	put(fout,ed->f3IODE);
+}
+
+bool EphemerisStore::readEphemeris(FILE *fin,GPSEphemeris *ed)
+{
+	bool ok = get(fin,&ed->SVN) && get(fin,&ed->t_ephem) && get(fin,&ed->week_number) &&
+		get(fin,&ed->SV_accuracy_raw) && get(fin,&ed->SV_health) && get(fin,&ed->IODC) &&
+		get(fin,&ed->t_GD) && get(fin,&ed->t_OC) && get(fin,&ed->a_f2) && get(fin,&ed->a_f1) &&
+		get(fin,&ed->a_f0) && get(fin,&ed->SV_accuracy) && get(fin,&ed->IODE) && get(fin,&ed->C_rs) &&
+		get(fin,&ed->delta_N) && get(fin,&ed->M_0) && get(fin,&ed->C_uc) && get(fin,&ed->e) &&
+		get(fin,&ed->C_us) && get(fin,&ed->sqrtA) && get(fin,&ed->t_0e) && get(fin,&ed->C_ic) &&
+		get(fin,&ed->OMEGA_0) && get(fin,&ed->C_is) && get(fin,&ed->i_0) && get(fin,&ed->C_rc) &&
+		get(fin,&ed->OMEGA) && get(fin,&ed->OMEGADOT) && get(fin,&ed->IDOT) && get(fin,&ed->Axis) &&
+		get(fin,&ed->n) && get(fin,&ed->r1me2) && get(fin,&ed->OMEGA_N) && get(fin,&ed->ODOT_n) &&
+		get(fin,&ed->subframes) && get(fin,&ed->f3IODE);
+	ed->tLogged = -1; // not logged today
+	return ok;
+}
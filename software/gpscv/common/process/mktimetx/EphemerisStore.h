@@ -0,0 +1,58 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __EPHEMERIS_STORE_H_
+#define __EPHEMERIS_STORE_H_
+
+#include <cstdio>
+#include <string>
+
+class Receiver;
+class GPSEphemeris;
+
+// Compact binary store of the GPS navigation data known at the end of a day.
+// Loading the store for the previous day means that the 'pre-roll' of the receiver
+// log, needed to pick up ephemerides, UTC and ionosphere parameters, can be skipped.
+
+class EphemerisStore
+{
+	public:
+		
+		EphemerisStore();
+		
+		bool write(Receiver *rx,std::string fname,int mjd);
+		bool read(Receiver *rx,std::string fname,int mjd);
+		
+		std::string makeFileName(std::string path,int mjd);
+		
+	private:
+		
+		void writeEphemeris(FILE *fout,GPSEphemeris *ed);
+		bool readEphemeris(FILE *fin,GPSEphemeris *ed);
+		
+		template <class T> void put(FILE *fout,T val){std::fwrite(&val,sizeof(T),1,fout);}
+		template <class T> bool get(FILE *fin,T *val){return (1 == std::fread(val,sizeof(T),1,fin));}
+};
+
+#endif
@@ -0,0 +1,175 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cmath>
+
+#include "GPS.h"
+#include "GPSOrbits.h"
+
+#define MU 3.986005e14 // WGS 84 value of the earth's gravitational constant for GPS USER
+#define OMEGA_E_DOT 7.2921151467e-5
+#define KEPLER_ITERATIONS 3 // Newton-Raphson iterations, from a first order starting value - plenty for e < 0.1
+#define KEPLER_TOLERANCE 1.0E-10
+
+// sin() and cos() without branches or library calls so that loops using them can be vectorized.
+// The argument is reduced to [-pi/4,pi/4] and then the fdlibm kernel polynomials are used.
+// Accurate to a few ulp for |x| < 1.0E5, which is more than enough here.
+
+static inline void fastSinCos(double x,double *sinx,double *cosx)
+{
+	const double twoOverPi = 6.36619772367581382433e-01;
+	const double pio2_1  = 1.57079632673412561417e+00; // first 33 bits of pi/2
+	const double pio2_1t = 6.07710050650619224932e-11; // pi/2 - pio2_1
+	
+	const double roundingConst = 6755399441055744.0; // 1.5*2^52, adding and subtracting this rounds to the nearest integer
+	
+	double k = (x*twoOverPi + roundingConst) - roundingConst;
+	double r = (x - k*pio2_1) - k*pio2_1t;
+	
+	// quadrant, 0..3, done in floating point because integer conversions stop vectorization
+	double q  = k - 4.0*((0.25*k - 0.375 + roundingConst) - roundingConst);
+	double qh = (0.5*q - 0.25 + roundingConst) - roundingConst; // 1 for quadrants 2,3
+	double qodd = q - 2.0*qh;                                    // 1 for quadrants 1,3
+	
+	double z = r*r;
+	
+	double s = r + r*z*(-1.66666666666666324348e-01 + z*(8.33333333332248946124e-03 + z*(-1.98412698298579493134e-04 +
+		z*(2.75573137070700676789e-06 + z*(-2.50507602534068634195e-08 + z*1.58969099521155010221e-10)))));
+	double c = 1.0 - 0.5*z + z*z*(4.16666666666666019037e-02 + z*(-1.38888888888741095749e-03 + z*(2.48015872894767294178e-05 +
+		z*(-2.75573143513906633035e-07 + z*(2.08757232129817482790e-09 + z*-1.13596475577881948265e-11)))));
+	
+	double sq = (qodd > 0.5) ? c : s;
+	double cq = (qodd > 0.5) ? s : c;
+	*sinx = (qh > 0.5) ? -sq : sq;
+	*cosx = (qodd + qh == 1.0) ? -cq : cq; // quadrants 1,2
+}
+
+GPSOrbits::GPSOrbits()
+{
+}
+
+void GPSOrbits::clear()
+{
+	A.clear();n.clear();M_0.clear();e.clear();sqrt1me2.clear();OMEGA.clear();
+	C_us.clear();C_uc.clear();C_rs.clear();C_rc.clear();C_is.clear();C_ic.clear();
+	i_0.clear();IDOT.clear();OMEGA_k0.clear();OMEGA_kdot.clear();t_0e.clear();
+}
+
+void GPSOrbits::add(GPSEphemeris *ed)
+{
+	double a=ed->sqrtA*ed->sqrtA;
+	A.push_back(a);
+	n.push_back(sqrt(MU/(a*a*a)) + ed->delta_N); // corrected mean motion
+	M_0.push_back(ed->M_0);
+	e.push_back(ed->e);
+	sqrt1me2.push_back(sqrt(1.0-ed->e*ed->e));
+	OMEGA.push_back(ed->OMEGA);
+	C_us.push_back(ed->C_us);
+	C_uc.push_back(ed->C_uc);
+	C_rs.push_back(ed->C_rs);
+	C_rc.push_back(ed->C_rc);
+	C_is.push_back(ed->C_is);
+	C_ic.push_back(ed->C_ic);
+	i_0.push_back(ed->i_0);
+	IDOT.push_back(ed->IDOT);
+	// longitude of ascending node is OMEGA_k0 + OMEGA_kdot*tk
+	OMEGA_k0.push_back(ed->OMEGA_0 - OMEGA_E_DOT*ed->t_0e);
+	OMEGA_kdot.push_back(ed->OMEGADOT - OMEGA_E_DOT);
+	t_0e.push_back(ed->t_0e);
+}
+
+void GPSOrbits::satXYZ(const double t[],double Ek[],double x[],double y[],double z[],bool ok[])
+{
+	// As per GPS::satXYZ() but each step is done for all satellites before moving on to the next
+	unsigned int nsv = size();
+	tk.resize(nsv);
+	Mk.resize(nsv);
+	E.resize(nsv);
+	phik.resize(nsv);
+	rk.resize(nsv);
+	
+	// time from ephemeris reference epoch, accounting for beginning/end of week crossovers (ICD 20.3.3.4.3.1)
+	for (unsigned int i=0;i<nsv;i++){
+		double dt = t[i] - t_0e[i];
+		dt = (dt >  302400) ? dt - 604800.0 : dt;
+		dt = (dt < -302400) ? dt + 604800.0 : dt;
+		tk[i] = dt;
+	}
+	
+	// solve Kepler's Equation for the Eccentric Anomaly
+	for (unsigned int i=0;i<nsv;i++){
+		double sinM,cosM;
+		Mk[i] = M_0[i] + n[i]*tk[i];
+		fastSinCos(Mk[i],&sinM,&cosM);
+		E[i]  = Mk[i] + e[i]*sinM;
+	}
+	for (int it=0;it<KEPLER_ITERATIONS;it++){
+		for (unsigned int i=0;i<nsv;i++){
+			double sinE,cosE;
+			fastSinCos(E[i],&sinE,&cosE);
+			E[i] -= (E[i] - e[i]*sinE - Mk[i])/(1.0 - e[i]*cosE);
+		}
+	}
+	
+	// atan2() is the only library call left
+	for (unsigned int i=0;i<nsv;i++){
+		double sinE,cosE;
+		fastSinCos(E[i],&sinE,&cosE);
+		phik[i] = atan2(sqrt1me2[i]*sinE,cosE - e[i]) + OMEGA[i];
+		rk[i] = A[i]*(1-e[i]*cosE);
+	}
+	
+	#pragma GCC ivdep
+	for (unsigned int i=0;i<nsv;i++){
+		double sin2phik,cos2phik,sinuk,cosuk,sinik,cosik,sinomegak,cosomegak;
+		fastSinCos(2*phik[i],&sin2phik,&cos2phik);
+		
+		double uk = phik[i] + C_us[i]*sin2phik + C_uc[i]*cos2phik;
+		double r  = rk[i] + C_rc[i]*cos2phik + C_rs[i]*sin2phik;
+		double ik = i_0[i] + IDOT[i]*tk[i] + C_ic[i]*cos2phik + C_is[i]*sin2phik;
+		fastSinCos(uk,&sinuk,&cosuk);
+		fastSinCos(ik,&sinik,&cosik);
+		double xkprime = r*cosuk;
+		double ykprime = r*sinuk;
+		double omegak = OMEGA_k0[i] + OMEGA_kdot[i]*tk[i];
+		fastSinCos(omegak,&sinomegak,&cosomegak);
+		
+		x[i] = xkprime*cosomegak - ykprime*cosik*sinomegak;
+		y[i] = xkprime*sinomegak + ykprime*cosik*cosomegak;
+		z[i] = ykprime*sinik;
+	}
+	
+	if (NULL != Ek){
+		for (unsigned int i=0;i<nsv;i++)
+			Ek[i]=E[i];
+	}
+	
+	if (NULL != ok){ 
+		for (unsigned int i=0;i<nsv;i++){
+			double sinE,cosE;
+			fastSinCos(E[i],&sinE,&cosE);
+			ok[i] = (fabs(E[i] - e[i]*sinE - Mk[i]) < KEPLER_TOLERANCE);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __GPS_ORBITS_H_
+#define __GPS_ORBITS_H_
+
+#include <vector>
+
+class GPSEphemeris;
+
+// Evaluates the orbits of many GPS satellites in one call, eg all the satellites tracked at one epoch.
+// The ephemeris parameters are stored as arrays (one per parameter) and Kepler's equation is solved with a fixed
+// number of iterations. sin() and cos() are evaluated inline, so that the loops are free of branches and library
+// calls (apart from atan2()) and can be vectorized by the compiler.
+// The results agree with GPS::satXYZ() at the millimetre level - see orbitbench.cpp.
+
+class GPSOrbits
+{
+	public:
+		
+		GPSOrbits();
+		
+		void clear();
+		void add(GPSEphemeris *ed);
+		unsigned int size(){return t_0e.size();}
+		
+		// t[i] is the GPS system time of transmission for the i-th ephemeris added
+		// Ek[i] and ok[i] may be NULL
+		void satXYZ(const double t[],double Ek[],double x[],double y[],double z[],bool ok[]=NULL);
+		
+	private:
+		
+		// per-ephemeris constants, precomputed by add()
+		std::vector<double> A,n,M_0,e,sqrt1me2,OMEGA;
+		std::vector<double> C_us,C_uc,C_rs,C_rc,C_is,C_ic;
+		std::vector<double> i_0,IDOT,OMEGA_k0,OMEGA_kdot,t_0e;
+		
+		// working storage
+		std::vector<double> tk,Mk,E,phik,rk;
+};
+
+#endif
@@ -153,8 +153,6 @@ bool Javad::readLog(std::string fname,int mjd,int startTime,int stopTime,int rin
 	std::vector<std::string> rxid;
 	
 	std::vector<SVMeasurement *> gpsmeas;
-	gps.gotIonoData = false;
-	gps.gotUTCdata=false;
 	
 	U1 uint8buf;
 	I1 sint8buf;
@@ -44,12 +44,7 @@
 #include "Debug.h"
 #include "Application.h"
 
-std::ostream *debugStream;
-std::string   debugFileName;
-std::ofstream debugLog;
-int verbosity=1;
-bool shortDebugMessage=false;
-
+extern std::ostream *debugStream;
 extern Application *app;
 
 int main(
@@ -162,8 +162,6 @@ bool NVS::readLog(std::string fname,int mjd,int startTime,int stopTime,int rinex
 	INT8U int8ubuf;
 	
 	std::vector<SVMeasurement *> gnssmeas;
-	gps.gotIonoData = false;
-	gps.gotUTCdata=false;
 	
 	INT8U msg46ss,msg46mm,msg46hh,msg46mday,msg46mon;
 	INT16U msg46yyyy;
@@ -89,6 +89,15 @@ std::string Receiver::version()
 	return version_;
 }
 
+void Receiver::deleteMeasurements()
+{
+	while(! measurements.empty()){
+		ReceiverMeasurement *tmp= measurements.back();
+		delete tmp;
+		measurements.pop_back();
+	}
+}
+
 //
 // protected
 //
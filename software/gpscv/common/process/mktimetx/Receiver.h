@@ -82,6 +82,7 @@ class Receiver
 		virtual bool readLog(std::string,int,int startTime=0,int stopTime=86399,int rinexObsInterval=30){return true;} // must be reimplemented
 		
 		std::vector<ReceiverMeasurement *> measurements;
+		void deleteMeasurements();
 		
 		int sawtoothPhase; // pps to apply sawtooth correction to
 		
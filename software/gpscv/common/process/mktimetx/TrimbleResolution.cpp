@@ -153,8 +153,6 @@ bool TrimbleResolution::readLog(std::string fname,int mjd,int startTime,int stop
 	unsigned char cbuf;
 	
 	std::vector<SVMeasurement *> gpsmeas;
-	gps.gotIonoData = false;
-	gps.gotUTCdata=false;
 	UINT8 fabss,fabmm,fabhh,fabmday,fabmon;
 	UINT16 fabyyyy;
 	
@@ -213,9 +213,6 @@ bool Ublox::readLog(std::string fname,int mjd,int startTime,int stopTime,int rin
 	
 	std::vector<SVMeasurement *> svmeas;
 	
-	gps.gotUTCdata=false;
-	gps.gotIonoData=false;
-	
 	unsigned int currentMsgs=0;
 	unsigned int reqdMsgs =  MSG0121 | MSG0122 | MSG0215 | MSG0D01 ;
 	
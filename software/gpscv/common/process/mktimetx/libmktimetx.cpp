@@ -0,0 +1,145 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstdlib>
+#include <ctime>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "Application.h"
+#include "Debug.h"
+#include "libmktimetx.h"
+
+extern Application *app;
+extern std::ostream *debugStream;
+extern std::string   debugFileName;
+extern std::ofstream debugLog;
+extern int verbosity;
+
+struct _MktimetxHandle
+{
+	Application *app;
+	int mjd;
+};
+
+const char *mktimetx_version()
+{
+	return APP_VERSION;
+}
+
+void mktimetx_set_debug(const char *filename,int v)
+{
+	verbosity=v;
+	
+	if (debugLog.is_open())
+		debugLog.close();
+	
+	if (NULL == filename){
+		debugStream = NULL;
+		return;
+	}
+	
+	std::string dbgout = filename;
+	if (std::string::npos != dbgout.find("stderr")){
+		debugStream = & std::cerr;
+	}
+	else{
+		debugFileName = dbgout;
+		debugLog.open(debugFileName.c_str(),std::ios_base::out);
+		if (!debugLog.is_open()){
+			std::cerr << "Error! Unable to open " << dbgout << std::endl;
+			debugStream = NULL;
+			return;
+		}
+		debugStream = & debugLog;
+	}
+}
+
+MktimetxHandle *mktimetx_open(const char *configfile,unsigned int options)
+{
+	if (NULL != app){
+		std::cerr << "Error! mktimetx is already open" << std::endl;
+		return NULL;
+	}
+	
+	// make sure we are using UTC so mktime() works the way we want
+	setenv("TZ","UTC",1);
+	tzset();
+	
+	unsigned int appOptions=0;
+	if (options & MKTIMETX_DISABLE_TIC)        appOptions |= Application::DisableTIC;
+	if (options & MKTIMETX_POSITIONING)        appOptions |= Application::Positioning;
+	if (options & MKTIMETX_TIMING_DIAGNOSTICS) appOptions |= Application::TimingDiagnostics;
+	if (options & MKTIMETX_SV_DIAGNOSTICS)     appOptions |= Application::SVDiagnostics;
+	
+	Application *a = new Application(); // this will initialize 'app'
+	if (!a->configure(configfile,appOptions)){
+		delete a;
+		app = NULL;
+		return NULL;
+	}
+	
+	MktimetxHandle *h = new MktimetxHandle;
+	h->app = a;
+	h->mjd = -1;
+	return h;
+}
+
+void mktimetx_close(MktimetxHandle *h)
+{
+	if (NULL == h) return;
+	delete h->app;
+	app = NULL;
+	delete h;
+}
+
+int mktimetx_process(MktimetxHandle *h,int mjd,int starttime,int stoptime)
+{
+	if (NULL == h) return 0;
+	h->mjd = mjd;
+	return (h->app->process(mjd,starttime,stoptime) ? 1 : 0);
+}
+
+int mktimetx_get_stats(MktimetxHandle *h,MktimetxStats *stats)
+{
+	if (NULL == h || NULL == stats) return 0;
+	
+	stats->mjd = h->mjd;
+	stats->receiverMeasurements = h->app->receiverMeasurements();
+	stats->counterMeasurements  = h->app->counterMeasurements();
+	stats->matchedMeasurements  = h->app->matchedMeasurements();
+	stats->outputFiles = h->app->outputFiles().size();
+	stats->memoryUsage = h->app->memoryUsage();
+	stats->elapsedTime = h->app->elapsedTime();
+	return 1;
+}
+
+const char *mktimetx_get_output(MktimetxHandle *h,unsigned int n)
+{
+	if (NULL == h) return NULL;
+	if (n >= h->app->outputFiles().size()) return NULL;
+	return h->app->outputFiles().at(n).c_str();
+}
@@ -0,0 +1,82 @@
+/*
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 Michael J. Wouters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * C interface to the mktimetx processing pipeline, for callers that want to
+ * process many days without paying the start-up cost for each one.
+ *
+ * The configuration is parsed once, by mktimetx_open(). Each call to mktimetx_process()
+ * then reads the receiver and counter logs for one MJD and writes the configured
+ * CGGTTS and RINEX files, exactly as 'mktimetx -c <config> -m <mjd>' does.
+ *
+ * Only one handle may be open at a time, because the processing code logs through a global
+ * application object: mktimetx_open() returns NULL while another handle is open.
+ * To change the configuration, close the handle and open a new one.
+ * Functions returning int return 1 on success and 0 on failure, as libconfigurator does.
+ */
+ 
+#ifndef __LIBMKTIMETX_H_
+#define __LIBMKTIMETX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Options for mktimetx_open(), which can be OR'd together */
+#define MKTIMETX_DISABLE_TIC         0x01
+#define MKTIMETX_POSITIONING         0x02
+#define MKTIMETX_TIMING_DIAGNOSTICS  0x04
+#define MKTIMETX_SV_DIAGNOSTICS      0x08
+
+typedef struct _MktimetxHandle MktimetxHandle;
+
+/* Statistics for the last processed MJD */
+typedef struct _MktimetxStats
+{
+	int mjd;
+	unsigned int receiverMeasurements;
+	unsigned int counterMeasurements;
+	unsigned int matchedMeasurements;
+	unsigned int outputFiles;
+	unsigned int memoryUsage;  /* bytes */
+	double elapsedTime;        /* seconds */
+}MktimetxStats;
+
+const char *     mktimetx_version();
+void             mktimetx_set_debug(const char *filename,int verbosity);
+
+MktimetxHandle * mktimetx_open(const char *configfile,unsigned int options);
+void             mktimetx_close(MktimetxHandle *h);
+
+int              mktimetx_process(MktimetxHandle *h,int mjd,int starttime,int stoptime);
+int              mktimetx_get_stats(MktimetxHandle *h,MktimetxStats *stats);
+const char *     mktimetx_get_output(MktimetxHandle *h,unsigned int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
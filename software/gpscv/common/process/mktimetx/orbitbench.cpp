@@ -0,0 +1,198 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Micro-benchmark for GPSOrbits, which checks agreement with GPS::satXYZ() at the same time
+// Usage: orbitbench [number of satellites] [number of epochs]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "GPS.h"
+#include "GPSOrbits.h"
+#include "Timer.h"
+
+class Application;
+
+Application *app=NULL;
+std::ostream *debugStream=NULL;
+int verbosity=0;
+bool shortDebugMessage=false;
+
+#define MAX_DIFF 1.0E-3 // in m
+#define MAX_SCALAR_DIFF 1.0E-2 // in m, limited by the convergence criterion in GPS::satXYZ()
+#define MU 3.986005e14
+#define OMEGA_E_DOT 7.2921151467e-5
+
+// Reference solution, as for GPS::satXYZ() but in long double and with Kepler's equation fully converged.
+// GPS::satXYZ() stops iterating at 1E-8 rad, which can leave an error of a few mm. 
+
+static void referenceXYZ(GPSEphemeris *ed,double t,double x[3])
+{
+	long double A=(long double) ed->sqrtA*ed->sqrtA;
+	long double e=ed->e;
+	long double tk=t - ed->t_0e;
+	if (tk > 302400) tk -= 604800;
+	else if (tk < -302400) tk += 604800;
+	long double Mk = ed->M_0 + (sqrtl(MU/(A*A*A)) + ed->delta_N)*tk;
+	long double Ek=Mk,Ekold;
+	for (int i=0;i<50;i++){
+		Ek = Mk + e*sinl(Ekold = Ek);
+		if (fabsl(Ek-Ekold) < 1.0E-17) break;
+	}
+	long double phik= atan2l(sqrtl(1-e*e)*sinl(Ek),cosl(Ek) - e) + ed->OMEGA;
+	long double uk = phik + ed->C_us*sinl(2*phik) + ed->C_uc*cosl(2*phik) ;
+	long double rk = A*(1-e*cosl(Ek)) + ed->C_rc*cosl(2*phik) + ed->C_rs*sinl(2*phik);
+	long double ik = ed->i_0 + ed->IDOT*tk + ed->C_ic*cosl(2*phik) + ed->C_is*sinl(2*phik);
+	long double xkprime = rk*cosl(uk);
+	long double ykprime = rk*sinl(uk);
+	long double omegak = ed->OMEGA_0 + (ed->OMEGADOT - OMEGA_E_DOT)*tk - OMEGA_E_DOT*ed->t_0e;
+	x[0] = xkprime*cosl(omegak) - ykprime*cosl(ik)*sinl(omegak);
+	x[1] = xkprime*sinl(omegak) + ykprime*cosl(ik)*cosl(omegak);
+	x[2] = ykprime*sinl(ik);
+}
+
+static double distance(double x,double y,double z,double xyz[3])
+{
+	return sqrt((x-xyz[0])*(x-xyz[0]) + (y-xyz[1])*(y-xyz[1]) + (z-xyz[2])*(z-xyz[2]));
+}
+
+static double uniform(double lo,double hi)
+{
+	return lo + (hi-lo)*(std::rand()/(double) RAND_MAX);
+}
+
+int main(int argc,char **argv)
+{
+	int nsv=31;
+	int nepochs=86400;
+	if (argc > 1) nsv = std::atoi(argv[1]);
+	if (argc > 2) nepochs = std::atoi(argv[2]);
+	if (nsv < 1 || nepochs < 1){
+		std::cerr << "Usage: orbitbench [number of satellites] [number of epochs]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	
+	// Plausible GPS broadcast ephemerides
+	std::srand(1);
+	GPS gps;
+	std::vector<GPSEphemeris *> eph;
+	GPSOrbits orbits;
+	for (int s=0;s<nsv;s++){
+		GPSEphemeris *ed = new GPSEphemeris();
+		ed->SVN=s+1;
+		ed->t_0e=7200*(std::rand() % 84);
+		ed->sqrtA=uniform(5153.5,5153.8);
+		ed->e=uniform(0.0,0.02);
+		ed->M_0=uniform(-M_PI,M_PI);
+		ed->delta_N=uniform(4.0E-9,5.5E-9);
+		ed->OMEGA=uniform(-M_PI,M_PI);
+		ed->OMEGA_0=uniform(-M_PI,M_PI);
+		ed->OMEGADOT=uniform(-8.5E-9,-7.5E-9);
+		ed->i_0=uniform(0.93,0.99);
+		ed->IDOT=uniform(-5.0E-10,5.0E-10);
+		ed->C_us=uniform(-1.0E-5,1.0E-5);
+		ed->C_uc=uniform(-1.0E-5,1.0E-5);
+		ed->C_rs=uniform(-150.0,150.0);
+		ed->C_rc=uniform(150.0,350.0);
+		ed->C_is=uniform(-2.0E-7,2.0E-7);
+		ed->C_ic=uniform(-2.0E-7,2.0E-7);
+		eph.push_back(ed);
+		orbits.add(ed);
+	}
+	
+	std::vector<double> t(nsv),Ek(nsv),x(nsv),y(nsv),z(nsv);
+	std::vector<double> xs(nsv*3);
+	bool *ok = new bool[nsv];
+	double maxDiff=0.0,maxScalarDiff=0.0,maxBatchScalarDiff=0.0;
+	int nfailed=0;
+	
+	// Agreement
+	for (int epoch=0;epoch<nepochs;epoch+=60){
+		for (int s=0;s<nsv;s++)
+			t[s]=epoch + uniform(0.066,0.086); // typical transmission times
+		orbits.satXYZ(&t[0],&Ek[0],&x[0],&y[0],&z[0],ok);
+		for (int s=0;s<nsv;s++){
+			double Eks,xyz[3],xyzref[3];
+			bool scalarOK = gps.satXYZ(eph[s],t[s],&Eks,xyz);
+			if (!(scalarOK && ok[s])){
+				nfailed++;
+				continue;
+			}
+			referenceXYZ(eph[s],t[s],xyzref);
+			double d = distance(x[s],y[s],z[s],xyzref);
+			if (d > maxDiff) maxDiff = d;
+			d = distance(xyz[0],xyz[1],xyz[2],xyzref);
+			if (d > maxScalarDiff) maxScalarDiff = d;
+			d = distance(x[s],y[s],z[s],xyz);
+			if (d > maxBatchScalarDiff) maxBatchScalarDiff = d;
+		}
+	}
+	
+	// Timing
+	Timer timer;
+	double dummy=0.0;
+	timer.start();
+	for (int epoch=0;epoch<nepochs;epoch++){
+		for (int s=0;s<nsv;s++){
+			double Eks;
+			gps.satXYZ(eph[s],epoch+0.075,&Eks,&xs[3*s]);
+		}
+		dummy += xs[0];
+	}
+	timer.stop();
+	double tScalar = timer.elapsedTime(Timer::MSECS);
+	
+	timer.start();
+	for (int epoch=0;epoch<nepochs;epoch++){
+		for (int s=0;s<nsv;s++)
+			t[s]=epoch+0.075;
+		orbits.satXYZ(&t[0],&Ek[0],&x[0],&y[0],&z[0]);
+		dummy += x[0];
+	}
+	timer.stop();
+	double tBatch = timer.elapsedTime(Timer::MSECS);
+	
+	std::printf("%d satellites, %d epochs\n",nsv,nepochs);
+	std::printf("GPS::satXYZ   %10.1f ms %8.1f ns/satellite\n",tScalar,1.0E6*tScalar/((double) nsv*nepochs));
+	std::printf("GPSOrbits     %10.1f ms %8.1f ns/satellite\n",tBatch,1.0E6*tBatch/((double) nsv*nepochs));
+	std::printf("maximum difference from reference: GPSOrbits %.6f mm, GPS::satXYZ %.3f mm\n",maxDiff*1000.0,maxScalarDiff*1000.0);
+	std::printf("maximum difference GPSOrbits - GPS::satXYZ %.3f mm\n",maxBatchScalarDiff*1000.0);
+	std::printf("%d failures (%g)\n",nfailed,dummy);
+	
+	for (int s=0;s<nsv;s++)
+		delete eph[s];
+	delete[] ok;
+	
+	if (maxDiff > MAX_DIFF || maxBatchScalarDiff > MAX_SCALAR_DIFF || nfailed > 0){
+		std::printf("FAIL\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("PASS\n");
+	return EXIT_SUCCESS;
+}
@@ -49,507 +49,717 @@ THE SOFTWARE.
 
 #include "OpenOK.h"
 
+#ifdef __linux
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#define BITFILE_CHUNK_SIZE 1048576 // bytes per bulk transfer when configuring the FPGA
+
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Constructor Class
+OpenOK_TransferTrace
 */
 
-OpenOK_CPLL22150::OpenOK_CPLL22150()
+bool OpenOK_TransferTrace::s_enabled = false;
+int OpenOK_TransferTrace::s_numberSlots = 0;
+OpenOK_TransferTrace::Slot OpenOK_TransferTrace::s_slots[ OpenOK_TransferTrace::MAX_SLOTS ];
+__thread OpenOK_TransferTrace::Slot *OpenOK_TransferTrace::t_slot = NULL;
+
+void OpenOK_TransferTrace::Enable( bool enable )
 {
-    memset( m_registersPLL, 0, sizeRegistersPLL22150 );
-    m_referenceFrequency = 0;
+    __atomic_store_n( &s_enabled, enable, __ATOMIC_RELAXED );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Returns true is the specified output is enabled.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+Records a transfer which started at 'start'. Transfers started while tracing was disabled are ignored.
 */
 
-bool OpenOK_CPLL22150::IsOutputEnabled( int output )
+void OpenOK_TransferTrace::Record( Type type, const struct timespec &start, long bytes, Outcome outcome )
 {
-    return ( ( m_registersPLL[ register_09H ] >> output ) & 1 );
+    if ( start.tv_sec == 0 && start.tv_nsec == 0 ) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    unsigned long long ns = ( now.tv_sec - start.tv_sec ) * 1000000000ULL + now.tv_nsec - start.tv_nsec;
+
+    if ( t_slot == NULL ) {
+        int slot = __atomic_fetch_add( &s_numberSlots, 1, __ATOMIC_RELAXED );
+        t_slot = &s_slots[ ( slot < MAX_SLOTS ) ? slot : MAX_SLOTS - 1 ];
+    }
+
+    Counters &c = t_slot->counters[ type ];
+
+    // Another thread only touches these if it overflowed into the last slot, or is reporting
+    __atomic_add_fetch( &c.count, 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &c.bytes, bytes, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &c.totalNs, ns, __ATOMIC_RELAXED );
+
+    if ( outcome == Short ) {
+        __atomic_add_fetch( &c.shortTransfers, 1, __ATOMIC_RELAXED );
+    } else if ( outcome == TimedOut ) {
+        __atomic_add_fetch( &c.timeouts, 1, __ATOMIC_RELAXED );
+    } else if ( outcome == Failed ) {
+        __atomic_add_fetch( &c.errors, 1, __ATOMIC_RELAXED );
+    }
+
+    unsigned long long maxNs = __atomic_load_n( &c.maxNs, __ATOMIC_RELAXED );
+    while ( ns > maxNs && !__atomic_compare_exchange_n( &c.maxNs, &maxNs, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) {
+    }
+
+    int bin = 0;
+    for ( unsigned long long us = ns / 1000; us > 1 && bin < HISTOGRAM_BINS - 1; us >>= 1 ) {
+        bin++;
+    }
+    __atomic_add_fetch( &c.histogram[ bin ], 1, __ATOMIC_RELAXED );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the current reference crystal frequency.
+Classifies a control transfer by its setup packet.
 */
 
-double OpenOK_CPLL22150::GetReference()
+OpenOK_TransferTrace::Type OpenOK_TransferTrace::ControlType( uint8_t requestType, uint8_t bRequest, uint16_t wValue )
 {
-    return m_referenceFrequency;
+    const bool isRead = ( requestType & 0x80 );
+
+    if ( bRequest == 0xb5 ) {
+        if ( isRead ) {
+            return ( wValue == 0x0060 ) ? TriggerOut : WireOut;
+        }
+        return ( wValue == 0x0001 ) ? TriggerIn : WireIn;
+    } else if ( bRequest == 0xb7 ) {
+        return PipeSetup;
+    }
+    return Control;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the VCO P(total) value.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+Returns:
+a table of the counts, outcomes and latency histogram of each type of transfer, summed over all threads
 */
 
-int OpenOK_CPLL22150::GetVCOP()
+std::string OpenOK_TransferTrace::Report()
 {
-    unsigned char PO;
-    unsigned short int PB;
+    static const char *names[ NumberTypes ] = { "wire in", "wire out", "trigger in", "trigger out",
+                                                "pipe setup", "control", "bulk in", "bulk out" };
+
+    const int numberSlots = std::min( __atomic_load_n( &s_numberSlots, __ATOMIC_RELAXED ), (int) MAX_SLOTS );
+
+    std::ostringstream report;
+    char line[ 256 ];
+
+    snprintf( line, sizeof( line ), "%-12s %10s %12s %6s %8s %6s %10s %10s  latency histogram (us: <2 <4 <8 ...)\n",
+              "type", "count", "bytes", "short", "timeout", "error", "mean (us)", "max (us)" );
+    report << line;
+
+    for ( int t = 0; t < NumberTypes; t++ ) {
+        Counters sum;
+        memset( &sum, 0, sizeof( sum ) );
+
+        for ( int i = 0; i < numberSlots; i++ ) {
+            const Counters &c = s_slots[ i ].counters[ t ];
+            sum.count += __atomic_load_n( &c.count, __ATOMIC_RELAXED );
+            sum.bytes += __atomic_load_n( &c.bytes, __ATOMIC_RELAXED );
+            sum.shortTransfers += __atomic_load_n( &c.shortTransfers, __ATOMIC_RELAXED );
+            sum.timeouts += __atomic_load_n( &c.timeouts, __ATOMIC_RELAXED );
+            sum.errors += __atomic_load_n( &c.errors, __ATOMIC_RELAXED );
+            sum.totalNs += __atomic_load_n( &c.totalNs, __ATOMIC_RELAXED );
+            sum.maxNs = std::max( sum.maxNs, __atomic_load_n( &c.maxNs, __ATOMIC_RELAXED ) );
+            for ( int b = 0; b < HISTOGRAM_BINS; b++ ) {
+                sum.histogram[ b ] += __atomic_load_n( &c.histogram[ b ], __ATOMIC_RELAXED );
+            }
+        }
 
-    int VCOPTotal;
+        if ( sum.count == 0 ) {
+            continue;
+        }
 
-    PO = ( ( m_registersPLL[ register_42H ] >> 7 ) & 1 );
-    PB = ( ( m_registersPLL[ register_40H ] & 3 ) << 8 ) + m_registersPLL[ register_41H ];
+        snprintf( line, sizeof( line ), "%-12s %10llu %12llu %6llu %8llu %6llu %10.1f %10.1f ",
+                  names[ t ], sum.count, sum.bytes, sum.shortTransfers, sum.timeouts, sum.errors,
+                  sum.totalNs / 1000.0 / sum.count, sum.maxNs / 1000.0 );
+        report << line;
 
-    VCOPTotal = 2 * ( PB + 4 ) + PO;
+        for ( int b = 0; b < HISTOGRAM_BINS; b++ ) {
+            report << " " << sum.histogram[ b ];
+        }
+        report << "\n";
+    }
 
-    return VCOPTotal;
+    return report.str();
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the VCO Q(total) value.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+Zeroes the counters. Transfers being recorded at the same time may be partly counted.
 */
 
-int OpenOK_CPLL22150::GetVCOQ()
+void OpenOK_TransferTrace::Reset()
 {
-    int VCOQTotal;
+    for ( int i = 0; i < MAX_SLOTS; i++ ) {
+        for ( int t = 0; t < NumberTypes; t++ ) {
+            Counters &c = s_slots[ i ].counters[ t ];
+            __atomic_store_n( &c.count, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.bytes, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.shortTransfers, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.timeouts, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.errors, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.totalNs, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &c.maxNs, 0, __ATOMIC_RELAXED );
+            for ( int b = 0; b < HISTOGRAM_BINS; b++ ) {
+                __atomic_store_n( &c.histogram[ b ], 0, __ATOMIC_RELAXED );
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    VCOQTotal = ( m_registersPLL[ register_42H ] & 127 ) + 2;
+static inline void TraceControlTransfer( const struct timespec &start, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                         uint16_t wLength, int responseLibusb )
+{
+    if ( start.tv_sec == 0 && start.tv_nsec == 0 ) {
+        return;
+    }
 
-    return VCOQTotal;
+    OpenOK_TransferTrace::Outcome outcome = OpenOK_TransferTrace::Completed;
+
+    if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
+        outcome = OpenOK_TransferTrace::TimedOut;
+    } else if ( responseLibusb < 0 ) {
+        outcome = OpenOK_TransferTrace::Failed;
+    } else if ( responseLibusb < wLength ) {
+        outcome = OpenOK_TransferTrace::Short;
+    }
+
+    OpenOK_TransferTrace::Record( OpenOK_TransferTrace::ControlType( requestType, bRequest, wValue ), start,
+                                  ( responseLibusb > 0 ) ? responseLibusb : 0, outcome );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Get the VCO output frequency.
-*/
-
-double OpenOK_CPLL22150::GetVCOFrequency()
+static inline void TraceBulkTransfer( const struct timespec &start, unsigned char endpoint, int length, int transferred,
+                                      int responseLibusb )
 {
-    double VCOFrequency = 0;
+    if ( start.tv_sec == 0 && start.tv_nsec == 0 ) {
+        return;
+    }
 
-    if ( GetVCOQ() ) {
-        VCOFrequency = GetReference() * GetVCOP() / GetVCOQ();
+    OpenOK_TransferTrace::Outcome outcome = OpenOK_TransferTrace::Completed;
+
+    if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
+        outcome = OpenOK_TransferTrace::TimedOut;
+    } else if ( responseLibusb != LIBUSB_SUCCESS ) {
+        outcome = OpenOK_TransferTrace::Failed;
+    } else if ( transferred < length ) {
+        outcome = OpenOK_TransferTrace::Short;
     }
-    return VCOFrequency;
+
+    OpenOK_TransferTrace::Record( ( endpoint & 0x80 ) ? OpenOK_TransferTrace::BulkIn : OpenOK_TransferTrace::BulkOut, start,
+                                  transferred, outcome );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the source for divider #1.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+As above, for a completed asynchronous transfer
 */
 
-OpenOK_CPLL22150::DividerSource OpenOK_CPLL22150::GetDiv1Source()
+static void TraceURB( const struct timespec &start, const struct libusb_transfer *urb )
 {
-    if ( ( m_registersPLL[ register_OCH ] >> 7 ) & 1 ) {
-        return DivSrc_Ref;
+    if ( start.tv_sec == 0 && start.tv_nsec == 0 ) {
+        return;
     }
-    return DivSrc_VCO;
+
+    OpenOK_TransferTrace::Outcome outcome = OpenOK_TransferTrace::Completed;
+    OpenOK_TransferTrace::Type type;
+    int length = urb->length;
+
+    if ( urb->type == LIBUSB_TRANSFER_TYPE_CONTROL ) {
+        // the setup packet is at the start of the buffer; wValue is little endian
+        type = OpenOK_TransferTrace::ControlType( urb->buffer[ 0 ], urb->buffer[ 1 ], urb->buffer[ 2 ] | ( urb->buffer[ 3 ] << 8 ) );
+        length -= LIBUSB_CONTROL_SETUP_SIZE;
+    } else {
+        type = ( urb->endpoint & 0x80 ) ? OpenOK_TransferTrace::BulkIn : OpenOK_TransferTrace::BulkOut;
+    }
+
+    if ( urb->status == LIBUSB_TRANSFER_TIMED_OUT ) {
+        outcome = OpenOK_TransferTrace::TimedOut;
+    } else if ( urb->status != LIBUSB_TRANSFER_COMPLETED ) {
+        outcome = OpenOK_TransferTrace::Failed;
+    } else if ( urb->actual_length < length ) {
+        outcome = OpenOK_TransferTrace::Short;
+    }
+
+    OpenOK_TransferTrace::Record( type, start, urb->actual_length, outcome );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the source for divider #2.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+64 bit FNV-1a hash
 */
 
-OpenOK_CPLL22150::DividerSource OpenOK_CPLL22150::GetDiv2Source()
+static unsigned long long HashData( const unsigned char *data, size_t size )
 {
-    if ( ( m_registersPLL[ register_47H ] >> 7 ) & 1 ) {
-        return DivSrc_Ref;
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for ( size_t i = 0; i < size; ++i ) {
+        hash = ( hash ^ data[ i ] ) * 1099511628211ULL;
     }
-    return DivSrc_VCO;
+    return hash;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Get the divider value for divider #1.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
-*/
-int OpenOK_CPLL22150::GetDiv1Divider()
+static uint64_t ElapsedNs( const struct timespec &start )
 {
-    return ( m_registersPLL[ register_OCH ] & 127 );
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( now.tv_sec - start.tv_sec ) * 1000000000ULL + now.tv_nsec - start.tv_nsec;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get the divider value for divider #2.
-
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+OpenOK_Transport
 */
 
-int OpenOK_CPLL22150::GetDiv2Divider()
+static const char RECORDING_MAGIC[ 8 ] = { 'O', 'P', 'E', 'N', 'O', 'K', 'R', '1' }; // R1 is the version of the recording format
+
+int OpenOK_Transport::ControlTransfer( libusb_device_handle *handle, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                      uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout )
 {
-    return ( m_registersPLL[ register_47H ] & 127 );
+    return libusb_control_transfer( handle, requestType, bRequest, wValue, wIndex, data, wLength, timeout );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Gets the current output clock source for a particular output.
+int OpenOK_Transport::BulkTransfer( libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length,
+                                   int *transferred, unsigned int timeout )
+{
+    return libusb_bulk_transfer( handle, endpoint, data, length, transferred, timeout );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+int OpenOK_Transport::ClearHalt( libusb_device_handle *handle, unsigned char endpoint )
+{
+    return libusb_clear_halt( handle, endpoint );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+OpenOK_RecordingTransport
+
+Each record is a kind character followed by
+'C' : requestType (1 byte), bRequest (1), wValue (2), wIndex (2), wLength (4), response (4), duration in ns (8),
+      then the IN data (response bytes) or the hash of the OUT data (8)
+'B' : endpoint (1), length (4), response (4), bytes transferred (4), duration in ns (8),
+      then the IN data (bytes transferred) or the hash of the OUT data (8)
+'H' : endpoint (1), response (4), duration in ns (8)
+'D' : size of OpenOK_device (4), the OpenOK_device
 */
 
-OpenOK_CPLL22150::ClockSource OpenOK_CPLL22150::GetOutputSource( int output )
+bool OpenOK_RecordingTransport::Open( const std::string &filename )
 {
-    unsigned char clkSrc = 0;
+    Close();
 
-    switch( output ) {
-        case 0 : // LCLK1
-            clkSrc = ( m_registersPLL[ register_44H ] >> 5 ) & 7;
-            break;
+    m_file.open( filename.c_str(), std::ios::binary | std::ios::trunc );
 
-        case 1 : // LCLK2
-            clkSrc = ( m_registersPLL[ register_44H ] >> 2 ) & 7;
-            break;
+    if ( !m_file.is_open() ) {
+        return false;
+    }
+    m_file.write( RECORDING_MAGIC, sizeof( RECORDING_MAGIC ) );
 
-        case 2 : // LCLK3
-            clkSrc = ( ( m_registersPLL[ register_44H ] & 3 ) << 1 ) +
-                    ( m_registersPLL[ register_45H ] >> 7 );
-            break;
+    return m_file.good();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        case 3 : // LCLK4
-            clkSrc = ( m_registersPLL[ register_45H ] >> 4 ) & 7;
-            break;
+void OpenOK_RecordingTransport::Close()
+{
+    if ( m_file.is_open() ) {
+        m_file.close();
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        case 4 : // CLK5
-            clkSrc = ( m_registersPLL[ register_45H ] >> 1 ) & 7;
-            break;
+int OpenOK_RecordingTransport::ControlTransfer( libusb_device_handle *handle, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                                uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout )
+{
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    const int response = m_transport->ControlTransfer( handle, requestType, bRequest, wValue, wIndex, data, wLength, timeout );
+
+    const uint64_t ns = ElapsedNs( start );
+
+    if ( m_file.is_open() ) {
+        Put<char>( 'C' );
+        Put<uint8_t>( requestType );
+        Put<uint8_t>( bRequest );
+        Put<uint16_t>( wValue );
+        Put<uint16_t>( wIndex );
+        Put<int32_t>( wLength );
+        Put<int32_t>( response );
+        Put<uint64_t>( ns );
+
+        if ( requestType & 0x80 ) {
+            if ( response > 0 ) {
+                m_file.write( reinterpret_cast<const char *>( data ), response );
+            }
+        } else {
+            Put<uint64_t>( HashData( data, wLength ) );
+        }
+    }
+    return response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        case 5 : // CLK6
-            clkSrc = ( ( m_registersPLL[ register_45H ] & 1 ) << 2 ) +
-                    ( m_registersPLL[ register_46H ] >> 6 );
-            break;
+int OpenOK_RecordingTransport::BulkTransfer( libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length,
+                                             int *transferred, unsigned int timeout )
+{
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
 
-        default :
-            return ClkSrc_Ref;
-            break;
-    }
+    const int response = m_transport->BulkTransfer( handle, endpoint, data, length, transferred, timeout );
 
-    switch( clkSrc ) {
+    const uint64_t ns = ElapsedNs( start );
 
-        case 0 :
-            return ClkSrc_Ref;
-            break;
+    if ( m_file.is_open() ) {
+        Put<char>( 'B' );
+        Put<uint8_t>( endpoint );
+        Put<int32_t>( length );
+        Put<int32_t>( response );
+        Put<int32_t>( *transferred );
+        Put<uint64_t>( ns );
 
-        case 1 :
-            return ClkSrc_Div1ByN;
-            break;
+        if ( endpoint & 0x80 ) {
+            if ( *transferred > 0 ) {
+                m_file.write( reinterpret_cast<const char *>( data ), *transferred );
+            }
+        } else {
+            Put<uint64_t>( HashData( data, length ) );
+        }
+    }
+    return response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        case 2 :
-            return ClkSrc_Div1By2;
-            break;
+int OpenOK_RecordingTransport::ClearHalt( libusb_device_handle *handle, unsigned char endpoint )
+{
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
 
-        case 3 :
-            return ClkSrc_Div1By3;
-            break;
+    const int response = m_transport->ClearHalt( handle, endpoint );
 
-        case 4 :
-            return ClkSrc_Div2ByN;
-            break;
+    const uint64_t ns = ElapsedNs( start );
 
-        case 5 :
-            return ClkSrc_Div2By2;
-            break;
+    if ( m_file.is_open() ) {
+        Put<char>( 'H' );
+        Put<uint8_t>( endpoint );
+        Put<int32_t>( response );
+        Put<uint64_t>( ns );
+    }
+    return response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        case 6 :
-            return ClkSrc_Div2By4;
-            break;
+void OpenOK_RecordingTransport::DeviceOpened( const OpenOK_device &device )
+{
+    m_transport->DeviceOpened( device );
 
-        default:
-            return ClkSrc_Ref;
-            break;
+    if ( m_file.is_open() ) {
+        OpenOK_device copy = device;
+        copy.device = NULL;
+
+        Put<char>( 'D' );
+        Put<uint32_t>( sizeof( copy ) );
+        Put<OpenOK_device>( copy );
     }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Gets the current output frequency for a particular output.
+OpenOK_ReplayTransport
 */
 
-double OpenOK_CPLL22150::GetOutputFrequency( int output )
+/*
+Reads a recording and lists the devices in it.
+
+Returns:
+false if the file can't be read or isn't a recording
+*/
+
+bool OpenOK_ReplayTransport::Open( const std::string &filename )
 {
-    ClockSource clkSrc;
-    double CLK;
+    m_recording.clear();
+    m_devices.clear();
+    m_position = 0;
+    m_mismatches = 0;
+    m_lastMismatch = "";
 
-    clkSrc = GetOutputSource( output );
+    std::ifstream file( filename.c_str(), std::ios::binary );
 
-    //CLK = ((REF * P)/Q)/Post Divider
-    //CLK = REF/Post Divider
-    //CLK = REF
+    if ( !file.is_open() ) {
+        return false;
+    }
 
-    switch( clkSrc ) {
-        case ClkSrc_Ref :
-            CLK = GetReference();
-            break;
+    m_recording.assign( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() );
 
-        case ClkSrc_Div1ByN :
-            if ( GetDiv1Source() ) {
-                CLK = GetReference() / GetDiv1Divider();
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / GetDiv1Divider();
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+    if ( ( m_recording.size() < sizeof( RECORDING_MAGIC ) ) ||
+         ( memcmp( &m_recording[ 0 ], RECORDING_MAGIC, sizeof( RECORDING_MAGIC ) ) != 0 ) ) {
+        m_recording.clear();
+        return false;
+    }
 
-        case ClkSrc_Div1By2 :
-            if ( GetDiv1Source() ) {
-                CLK = GetReference() / 2.0;
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 2.0;
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+    // Each device is listed once, however many times it was opened
+    m_position = sizeof( RECORDING_MAGIC );
 
-        case ClkSrc_Div1By3 :
-            if ( GetDiv1Source() ) {
-                CLK = GetReference() / 3.0;
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 3.0;
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+    Record record;
 
-        case ClkSrc_Div2ByN :
-            if ( GetDiv2Source() ) {
-                CLK = GetReference() / GetDiv2Divider();
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / GetDiv2Divider();
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+    while ( ReadRecord( record ) ) {
+        if ( record.kind != 'D' ) {
+            continue;
+        }
 
-        case ClkSrc_Div2By2 :
-            if ( GetDiv2Source() ) {
-                CLK = GetReference() / 2.0;
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 2.0;
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+        OpenOK_device device;
+        memcpy( &device, record.data, sizeof( device ) );
 
-        case ClkSrc_Div2By4 :
-            if ( GetDiv2Source() ) {
-                CLK = GetReference() / 4.0;
-            } else {
-                if ( GetVCOQ() ) {
-                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 4.0;
-                } else {
-                    CLK = 0;
-                }
-            }
-            break;
+        size_t i = 0;
 
-        default :
-            CLK = 0;
-            break;
+        while ( ( i < m_devices.size() ) && ( strncmp( m_devices[ i ].serial, device.serial, OpenOK_device::SSIZE ) != 0 ) ) {
+            ++i;
+        }
+
+        if ( i == m_devices.size() ) {
+            m_devices.push_back( device );
+        }
     }
-    return CLK;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Sets the reference crystal frequency for output frequency computations.
+    m_position = sizeof( RECORDING_MAGIC );
 
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
-*/
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-void OpenOK_CPLL22150::SetReference( double freq, bool extosc )
+int OpenOK_ReplayTransport::ControlTransfer( libusb_device_handle *, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                             uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int )
 {
-    // Using an External Clock as the Reference Input
-    // The CY22150 also accepts an external clock as reference, with
-    // speeds up to 133 MHz. With an external clock, the XDRV
-    // (register 12H) bits must be set according to Table 5 on page 6.
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
 
-    if ( extosc ) {
-        if ( freq >= 1 && freq < 25 ) {
-            m_registersPLL[ register_12H ] = 32;
-        } else if ( freq >= 25 && freq < 50 ) {
-            m_registersPLL[ register_12H ] = 40;
-        } else if ( freq >= 50 && freq < 90 ) {
-            m_registersPLL[ register_12H ] = 48;
-        } else if ( freq >= 90 && freq <= 133 ) {
-            m_registersPLL[ register_12H ] = 56;
-        }
+    Record record;
 
-        m_registersPLL[ register_13H ] = 149;
+    if ( !ReadRecord( record ) ) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
 
-        m_referenceFrequency = freq;
+    if ( ( record.kind != 'C' ) || ( record.requestType != requestType ) || ( record.bRequest != bRequest ) ||
+         ( record.wValue != wValue ) || ( record.wIndex != wIndex ) || ( record.length != wLength ) ) {
+        return Mismatch( "control transfer" );
     }
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Set the VCO P(total) and Q(total) values.
+    if ( requestType & 0x80 ) {
+        memcpy( data, record.data, std::min( record.size, (size_t) wLength ) );
+    } else if ( record.hash != HashData( data, wLength ) ) {
+        return Mismatch( "control transfer data" );
+    }
 
-See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
-*/
+    Wait( start, record.ns );
 
-bool OpenOK_CPLL22150::SetVCOParameters( int p, int q )
+    return record.response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int OpenOK_ReplayTransport::BulkTransfer( libusb_device_handle *, unsigned char endpoint, unsigned char *data, int length,
+                                          int *transferred, unsigned int )
 {
-    double VCOFreq = 0;
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
 
-    unsigned char pump;
+    *transferred = 0;
 
-    unsigned char PO;
-    unsigned short int PB;
+    Record record;
 
-    // Ptotal = (2(PB + 4) + PO)
-    // The minimum value of Ptotal is 8. The maximum value of Ptotal is 2055. To achieve the minimum value of Ptotal,
-    // PB and PO should both be programmed to 0. To achieve the maximum value of Ptotal, PB should be programmed to
-    // 1023, and PO should be
-    // programmed to 1.
-    // Qtotal= Q + 2
-    // The minimum value of Qtotal is 2. The maximum value of Q total is 129.
-    // Stable operation of the CY22150 cannot be guaranteed if REF/Qtotal falls below 250 kHz.
-    if ( q >= 2 && q <= 129 && p >= 8 && p <= 2055 ) {
-        VCOFreq = ( GetReference() * p ) / q;
-    } else {
-        return false;
+    if ( !ReadRecord( record ) ) {
+        return LIBUSB_ERROR_NO_DEVICE;
     }
 
-    // Stable operation of the CY22150 cannot be guaranteed if the value of (Ptotal*(REF/Qtotal)) is above 400 MHz or below
-    // 100 MHz.
-    if ( VCOFreq > 400 || VCOFreq < 100 ) {
-        return false;
+    if ( ( record.kind != 'B' ) || ( record.requestType != endpoint ) || ( record.length != length ) ) {
+        return Mismatch( "bulk transfer" );
     }
 
-    m_registersPLL[ register_42H ] &= 128;
-    m_registersPLL[ register_42H ] |= ( ( q - 2 ) & 127 ) ;
+    if ( endpoint & 0x80 ) {
+        memcpy( data, record.data, std::min( record.size, (size_t) length ) );
+    } else if ( record.hash != HashData( data, length ) ) {
+        return Mismatch( "bulk transfer data" );
+    }
 
-    PO = p % 2;
-    PB = ( ( ( p - PO ) / 2 ) - 4 );
-    m_registersPLL[ register_42H ] &= 127;
-    m_registersPLL[ register_42H ] |= ( ( PO & 1 ) << 7 );
-    m_registersPLL[ register_40H ] &= 252;
-    m_registersPLL[ register_40H ] |= ( ( PB >> 8 ) & 3 );
-    m_registersPLL[ register_41H ] = ( PB & 255 );
+    Wait( start, record.ns );
 
-    // PLL stability cannot be guaranteed for values below 16 and above 1023. If values above 1023 are needed, use CyClocksRT to
-    // determine the best charge pump setting.
-    if ( PB >= 16 && PB <= 44 ) {
-        pump = 0;
-    } else if ( PB >= 45 && PB <= 479 ) {
-        pump = 1;
-    } else if ( PB >= 480 && PB <= 639 ) {
-        pump = 2;
-    } else if ( PB >= 640 && PB <= 799 ) {
-        pump = 3;
-    } else if ( PB >= 800 && PB <= 1023 ) {
-        pump = 4;
-    } else {
-        pump = 1;
+    *transferred = record.transferred;
+
+    return record.response;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int OpenOK_ReplayTransport::ClearHalt( libusb_device_handle *, unsigned char endpoint )
+{
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    Record record;
+
+    if ( !ReadRecord( record ) ) {
+        return LIBUSB_ERROR_NO_DEVICE;
     }
 
-    m_registersPLL[ register_40H ] &= 195;
-    m_registersPLL[ register_40H ] = ( ( ( pump & 7 ) << 2 ) | 192 );
+    if ( ( record.kind != 'H' ) || ( record.requestType != endpoint ) ) {
+        return Mismatch( "clear halt" );
+    }
 
-    return true;
+    Wait( start, record.ns );
+
+    return record.response;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Set the values for divider #1.
+Moves to where the device was opened in the recording. Transfers recorded before that are skipped.
 */
 
-void OpenOK_CPLL22150::SetDiv1( DividerSource divsrc, int n )
+void OpenOK_ReplayTransport::DeviceOpened( const OpenOK_device &device )
 {
-    if ( n >= 4 && n <= 127 ) {
-        m_registersPLL[ register_OCH ] = ( n & 127 ) + ( ( divsrc & 1 ) << 7 ) ;
+    Record record;
+
+    while ( ReadRecord( record ) ) {
+        if ( ( record.kind == 'D' ) &&
+             ( strncmp( reinterpret_cast<const OpenOK_device *>( record.data )->serial, device.serial, OpenOK_device::SSIZE ) == 0 ) ) {
+            return;
+        }
     }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Set the values for divider #2.
-*/
-
-void OpenOK_CPLL22150::SetDiv2( DividerSource divsrc, int n )
+int OpenOK_ReplayTransport::GetDevices( OpenOK_device *devices, int maxDevices )
 {
-    if ( n >= 4 && n <= 127 ) {
-        m_registersPLL[ register_47H ] = ( n & 127 ) + ( ( divsrc & 1 ) << 7 ) ;
+    int numberDevices = std::min( (int) m_devices.size(), maxDevices );
+
+    for ( int i = 0; i < numberDevices; ++i ) {
+        devices[ i ] = m_devices[ i ];
+        devices[ i ].device = NULL;
+        devices[ i ].cached = true;
     }
+    return numberDevices;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Set the source for a particular output.
+Reads the next record.
+
+Returns:
+false at the end of the recording, or if the rest of the recording is corrupt
 */
 
-void OpenOK_CPLL22150::SetOutputSource( int output, OpenOK_CPLL22150::ClockSource clksrc )
+bool OpenOK_ReplayTransport::ReadRecord( Record &record )
 {
-    switch( output ) {
+    memset( &record, 0, sizeof( record ) );
 
-        case 0 : // LCLK1
-            m_registersPLL[ register_44H ] &= 31;
-            m_registersPLL[ register_44H ] |= ( ( clksrc & 7 ) << 5 );
-            break;
+    if ( !Get( &record.kind, 1 ) ) {
+        return false;
+    }
 
-        case 1 : // LCLK2
-            m_registersPLL[ register_44H ] &= 227;
-            m_registersPLL[ register_44H ] |= ( ( clksrc & 7 ) << 2 );
-            break;
+    bool ok = true;
+    bool isIn = false;
+    uint32_t size = 0;
 
-        case 2 : // LCLK3
-            m_registersPLL[ register_44H ] &= 252;
-            m_registersPLL[ register_44H ] |= ( ( clksrc >> 1 ) & 3 );
-            m_registersPLL[ register_45H ] &= 127;
-            m_registersPLL[ register_45H ] |= ( ( clksrc & 1 ) << 7 );
+    switch ( record.kind ) {
+        case 'C':
+            ok = Get( &record.requestType, 1 ) && Get( &record.bRequest, 1 ) && Get( &record.wValue, 2 ) &&
+                 Get( &record.wIndex, 2 ) && Get( &record.length, 4 ) && Get( &record.response, 4 ) && Get( &record.ns, 8 );
+            isIn = ( record.requestType & 0x80 );
+            record.size = ( isIn && record.response > 0 ) ? record.response : 0;
             break;
-
-        case 3 : // LCLK4
-            m_registersPLL[ register_45H ] &= 143;
-            m_registersPLL[ register_45H ] |= ( ( clksrc & 7 ) << 4 );
+        case 'B':
+            ok = Get( &record.requestType, 1 ) && Get( &record.length, 4 ) && Get( &record.response, 4 ) &&
+                 Get( &record.transferred, 4 ) && Get( &record.ns, 8 );
+            isIn = ( record.requestType & 0x80 );
+            record.size = ( isIn && record.transferred > 0 ) ? record.transferred : 0;
             break;
-
-        case 4 : // CLK5
-            m_registersPLL[ register_45H ] &= 241;
-            m_registersPLL[ register_45H ] |= ( ( clksrc & 7 ) << 1 );
+        case 'H':
+            ok = Get( &record.requestType, 1 ) && Get( &record.response, 4 ) && Get( &record.ns, 8 );
+            return ok;
+        case 'D':
+            ok = Get( &size, 4 ) && ( size == sizeof( OpenOK_device ) );
+            isIn = true;
+            record.size = size;
             break;
+        default:
+            ok = false;
+    }
 
-        case 5 : // CLK6
-            m_registersPLL[ register_45H ] &= 254;
-            m_registersPLL[ register_45H ] |= ( ( clksrc >> 2 ) & 1 );
-            m_registersPLL[ register_46H ] = ( ( ( clksrc & 3 ) << 6 ) | 63 );
-            break;
+    if ( ok && !isIn ) {
+        ok = Get( &record.hash, 8 );
+    }
 
-        default :
-            break;
+    if ( ok && ( m_position + record.size <= m_recording.size() ) ) {
+        record.data = &m_recording[ 0 ] + m_position;
+        m_position += record.size;
+        return true;
     }
+
+    m_position = m_recording.size();
+
+    return false;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Set the output enable for a particular output.
-*/
+bool OpenOK_ReplayTransport::Get( void *value, size_t size )
+{
+    if ( m_position + size > m_recording.size() ) {
+        m_position = m_recording.size();
+        return false;
+    }
 
-void OpenOK_CPLL22150::SetOutputEnable( int output, bool enable )
+    memcpy( value, &m_recording[ m_position ], size );
+    m_position += size;
+
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+int OpenOK_ReplayTransport::Mismatch( const char *transfer )
 {
-    if ( enable ) {
-        m_registersPLL[ register_09H ] |= ( 1 << output );
-    } else {
-        m_registersPLL[ register_09H ] &= ~( 1 << output );
+    std::ostringstream msg;
+    msg << transfer << " at offset " << m_position << " doesn't match the recording";
+
+    m_lastMismatch = msg.str();
+    m_mismatches++;
+
+    return LIBUSB_ERROR_IO;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_ReplayTransport::Wait( const struct timespec &start, uint64_t ns )
+{
+    if ( !m_realTime ) {
+        return;
+    }
+
+    struct timespec until = start;
+    until.tv_sec += ns / 1000000000ULL;
+    until.tv_nsec += ns % 1000000000ULL;
+
+    if ( until.tv_nsec >= 1000000000L ) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL ) == EINTR ) {
     }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
@@ -558,3447 +768,5542 @@ void OpenOK_CPLL22150::SetOutputEnable( int output, bool enable )
 Constructor Class
 */
 
-OpenOK::OpenOK()
-    : m_deviceHandle( NULL )
-    , m_ctx( NULL )
-    , m_listUSBDevices( NULL )
-    , m_indexOpenedDevice( -1 )
-    , m_lastTransferred( 0 )
-    , m_enablePrintStdError( true )
-    , m_timeoutUSB( 3000 )
+OpenOK_CPLL22150::OpenOK_CPLL22150()
 {
-    try {
-        int responseLibusb = LIBUSB_SUCCESS;
+    memset( m_registersPLL, 0, sizeRegistersPLL22150 );
+    m_referenceFrequency = 0;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
-        memset( m_wireIns, 0, OpenOK::WIREINSIZE );
+/*
+Returns true is the specified output is enabled.
 
-        // libusb_init return : 0 on success, or a LIBUSB_ERROR code on failure
-        if ( ( responseLibusb = libusb_init( &m_ctx ) ) == LIBUSB_SUCCESS ) {
-            // set verbosity level to LIBUSB_LOG_LEVEL_INFO, as suggested in the documentation :
-            // LIBUSB_LOG_LEVEL_NONE (0) : no messages ever printed by the library (default)
-            // LIBUSB_LOG_LEVEL_ERROR (1) : error messages are printed to stderr
-            // LIBUSB_LOG_LEVEL_WARNING (2) : warning and error messages are printed to stderr
-            // LIBUSB_LOG_LEVEL_INFO (3) : informational messages are printed to stdout, warning and
-            // error messages are printed to stderr
-            // LIBUSB_LOG_LEVEL_DEBUG (4) : debug and informational messages are printed to stdout, warnings and errors to stderr
-            // enable log debug compiling with "--enable-debug-log"
-
-            libusb_set_debug( m_ctx, 3/*LIBUSB_LOG_LEVEL_INFO*/ );
-
-            m_libusbInitialization = true;
-
-            //            PrintInfoAllDevice();
-            //            PrintStdError( "Constructor OpenOK()",
-            //                           GetLibUSBVersion() );
-            //            PrintStdError( "Constructor OpenOK()",
-            //                           GetOpenOKVersion() );
-        } else {
-            m_libusbInitialization = false;
-
-            PrintStdError( "Constructor OpenOK()",
-                           "libusb_init() failed",
-                           responseLibusb );
-        }
-    } catch(...) {
-        m_libusbInitialization = false;
-
-        PrintStdError( "Constructor OpenOK()",
-                       "catch() - Closing communication" );
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+*/
 
-        Close( true );
-    }
+bool OpenOK_CPLL22150::IsOutputEnabled( int output )
+{
+    return ( ( m_registersPLL[ register_09H ] >> output ) & 1 );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Destructor Class
+Get the current reference crystal frequency.
 */
 
-OpenOK::~OpenOK()
+double OpenOK_CPLL22150::GetReference()
 {
-    try {
-        Close();
-
-        if ( m_libusbInitialization ) {
-            ErrorCode responseClearListUSB = ClearListUSB( m_listUSBDevices );
-
-            if ( responseClearListUSB == NoError ) {
-                libusb_exit( m_ctx );
-            } else {
-                PrintStdError( "Destructor OpenOK()",
-                               "ClearListUSB() failed",
-                               0,
-                               responseClearListUSB );
-            }
-        }
-    } catch(...) {
-        PrintStdError( "Destructor OpenOK()",
-                       "catch() - Closing communication" );
-
-        Close( true );
-    }
+    return m_referenceFrequency;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get openOK major version.
+Get the VCO P(total) value.
+
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-int OpenOK::GetOpenOKMajorVersion()
+int OpenOK_CPLL22150::GetVCOP()
 {
-    return OPENOK_MAJOR;
+    unsigned char PO;
+    unsigned short int PB;
+
+    int VCOPTotal;
+
+    PO = ( ( m_registersPLL[ register_42H ] >> 7 ) & 1 );
+    PB = ( ( m_registersPLL[ register_40H ] & 3 ) << 8 ) + m_registersPLL[ register_41H ];
+
+    VCOPTotal = 2 * ( PB + 4 ) + PO;
+
+    return VCOPTotal;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get openOK minor version.
+Get the VCO Q(total) value.
+
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-int OpenOK::GetOpenOKMinorVersion()
+int OpenOK_CPLL22150::GetVCOQ()
 {
-    return OPENOK_MINOR;
+    int VCOQTotal;
+
+    VCOQTotal = ( m_registersPLL[ register_42H ] & 127 ) + 2;
+
+    return VCOQTotal;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get openOK micro version.
+Get the VCO output frequency.
 */
 
-int OpenOK::GetOpenOKMicroVersion()
+double OpenOK_CPLL22150::GetVCOFrequency()
 {
-    return OPENOK_MICRO;
+    double VCOFrequency = 0;
+
+    if ( GetVCOQ() ) {
+        VCOFrequency = GetReference() * GetVCOP() / GetVCOQ();
+    }
+    return VCOFrequency;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get openOK nano version.
+Get the source for divider #1.
+
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-int OpenOK::GetOpenOKNanoVersion()
+OpenOK_CPLL22150::DividerSource OpenOK_CPLL22150::GetDiv1Source()
 {
-    return OPENOK_NANO;
+    if ( ( m_registersPLL[ register_OCH ] >> 7 ) & 1 ) {
+        return DivSrc_Ref;
+    }
+    return DivSrc_VCO;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get openOK version.
+Get the source for divider #2.
+
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-std::string OpenOK::GetOpenOKVersion()
+OpenOK_CPLL22150::DividerSource OpenOK_CPLL22150::GetDiv2Source()
 {
-    char version_str[ 256 ];
-
-    sprintf( version_str, "OpenOK version = %d.%d.%d.%d",
-             OPENOK_MAJOR,
-             OPENOK_MINOR,
-             OPENOK_MICRO,
-             OPENOK_NANO );
-
-    return version_str;
+    if ( ( m_registersPLL[ register_47H ] >> 7 ) & 1 ) {
+        return DivSrc_Ref;
+    }
+    return DivSrc_VCO;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get libusb version.
-*/
+Get the divider value for divider #1.
 
-std::string OpenOK::GetLibUSBVersion()
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
+*/
+int OpenOK_CPLL22150::GetDiv1Divider()
 {
-#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000100)
-    try {
-        const libusb_version *version = libusb_get_version();
-
-        if ( version != NULL ) {
-            char version_str[ 256 ];
-
-            sprintf( version_str, "LibUSB version = %d.%d.%d.%d",
-                     version->major,
-                     version->minor,
-                     version->micro,
-                     version->nano );
-
-            return version_str;
-        } else {
-            PrintStdError( "GetLibUSBVersion()",
-                           "pointer 'version' is NULL" );
-        }
-    } catch(...) {
-        PrintStdError( "GetLibUSBVersion()",
-                       "catch() - Closing communication" );
-
-        Close( true );
-    }
-#endif
-    return "LibUSB version = Not Available";
+    return ( m_registersPLL[ register_OCH ] & 127 );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Check libusb initialization.
+Get the divider value for divider #2.
+
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-bool OpenOK::InitializationLibUSB()
+int OpenOK_CPLL22150::GetDiv2Divider()
 {
-    return m_libusbInitialization;
+    return ( m_registersPLL[ register_47H ] & 127 );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method return string index descriptor.
-
-Parameters:
-[out]   string that will receive the descriptor
-[in] 	libusb_device_handle
-[in]	indexStr - index of string descriptor
-[in]	maxSize - max size of string
+Gets the current output clock source for a particular output.
 
-Returns:
-ErrorCode
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-OpenOK::ErrorCode OpenOK::GetStringDescriptor( char *str, libusb_device_handle *handle,
-                                               int indexStr, int maxSize )
+OpenOK_CPLL22150::ClockSource OpenOK_CPLL22150::GetOutputSource( int output )
 {
-    try {
-        if ( ( handle != NULL ) &&
-             ( str != NULL ) ) {
-            memset( str, 0, maxSize );
-
-            // libusb_get_string_descriptor_ascii return : number of bytes returned in data, or LIBUSB_ERROR code on failure
-            const int responseLibusb = libusb_get_string_descriptor_ascii( handle,
-                                                                           indexStr,
-                                                                           reinterpret_cast< unsigned char* >( str ),
-                                                                           maxSize - 1 );
-
-            if ( responseLibusb < 0 ) {
-                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                    Close();
-                }
+    unsigned char clkSrc = 0;
 
-                PrintStdError( "GetStringDescriptor()",
-                               "libusb_get_string_descriptor_ascii() failed",
-                               responseLibusb );
+    switch( output ) {
+        case 0 : // LCLK1
+            clkSrc = ( m_registersPLL[ register_44H ] >> 5 ) & 7;
+            break;
 
-                return LibusbError;
-            }
-        } else {
-            if ( handle == NULL ) {
-                PrintStdError( "GetStringDescriptor()",
-                               "pointer 'handle' is NULL" );
+        case 1 : // LCLK2
+            clkSrc = ( m_registersPLL[ register_44H ] >> 2 ) & 7;
+            break;
 
-                return PointerNULL;
-            }
+        case 2 : // LCLK3
+            clkSrc = ( ( m_registersPLL[ register_44H ] & 3 ) << 1 ) +
+                    ( m_registersPLL[ register_45H ] >> 7 );
+            break;
 
-            if ( str == NULL ) {
-                PrintStdError( "GetStringDescriptor()",
-                               "pointer 'str' is NULL" );
+        case 3 : // LCLK4
+            clkSrc = ( m_registersPLL[ register_45H ] >> 4 ) & 7;
+            break;
 
-                return PointerNULL;
-            }
-        }
-    } catch(...) {
-        PrintStdError( "GetStringDescriptor()",
-                       "catch() - Closing communication" );
+        case 4 : // CLK5
+            clkSrc = ( m_registersPLL[ register_45H ] >> 1 ) & 7;
+            break;
 
-        Close( true );
+        case 5 : // CLK6
+            clkSrc = ( ( m_registersPLL[ register_45H ] & 1 ) << 2 ) +
+                    ( m_registersPLL[ register_46H ] >> 6 );
+            break;
 
-        return CatchError;
+        default :
+            return ClkSrc_Ref;
+            break;
     }
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
-
-/*
-Clear list of USB devices
 
-Parameters:
-[in] 	libusb_device_handle
+    switch( clkSrc ) {
 
-Return:
-ErrorCode
-*/
+        case 0 :
+            return ClkSrc_Ref;
+            break;
 
-OpenOK::ErrorCode OpenOK::ClearListUSB( libusb_device **device )
-{
-    try {
-        // Clear the list of USB devices.
-        if ( ( device != NULL ) &&
-             ( *device != NULL ) ) {
-            libusb_free_device_list( device, 1 );
-            device = NULL;
-        }
-    } catch(...) {
-        PrintStdError( "ClearListUSB()",
-                       "catch() - Closing communication" );
+        case 1 :
+            return ClkSrc_Div1ByN;
+            break;
 
-        Close( true );
+        case 2 :
+            return ClkSrc_Div1By2;
+            break;
 
-        return CatchError;
-    }
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+        case 3 :
+            return ClkSrc_Div1By3;
+            break;
 
-/*
-Clear list of OpenOK devices
+        case 4 :
+            return ClkSrc_Div2ByN;
+            break;
 
-Parameters:
-[in] 	libusb_device_handle
+        case 5 :
+            return ClkSrc_Div2By2;
+            break;
 
-Return:
-ErrorCode
-*/
+        case 6 :
+            return ClkSrc_Div2By4;
+            break;
 
-OpenOK::ErrorCode OpenOK::ClearListOpenOK()
-{
-    for ( int idxClear = 0; idxClear < maxUSBDevices; ++idxClear ) {
-        m_listOKDevices[ idxClear ] = OpenOK_device();
+        default:
+            return ClkSrc_Ref;
+            break;
     }
-    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Given list of USB devices
-
-Parameters:
-[in] 	libusb_context
-[out]   list of USB devices
-
-Return:
-Number of USB devices
+Gets the current output frequency for a particular output.
 */
 
-int OpenOK::GetListUSB( libusb_context *ctx,
-                        libusb_device ***listDevices )
+double OpenOK_CPLL22150::GetOutputFrequency( int output )
 {
-    ssize_t responseLibusb = 0;
+    ClockSource clkSrc;
+    double CLK;
 
-    try {
-        // libusb_get_device_list return : the number of devices in the outputted list,
-        // or any libusb_error according to errors encountered by the backend.
-        responseLibusb = libusb_get_device_list( ctx,
-                                                 listDevices );
+    clkSrc = GetOutputSource( output );
 
-        if ( responseLibusb < 0 ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                Close();
+    //CLK = ((REF * P)/Q)/Post Divider
+    //CLK = REF/Post Divider
+    //CLK = REF
+
+    switch( clkSrc ) {
+        case ClkSrc_Ref :
+            CLK = GetReference();
+            break;
+
+        case ClkSrc_Div1ByN :
+            if ( GetDiv1Source() ) {
+                CLK = GetReference() / GetDiv1Divider();
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / GetDiv1Divider();
+                } else {
+                    CLK = 0;
+                }
             }
+            break;
 
-            PrintStdError( "GetListUSB()",
-                           "libusb_get_device_list() failed",
-                           responseLibusb );
+        case ClkSrc_Div1By2 :
+            if ( GetDiv1Source() ) {
+                CLK = GetReference() / 2.0;
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 2.0;
+                } else {
+                    CLK = 0;
+                }
+            }
+            break;
 
-            return LibusbError;
-        }
+        case ClkSrc_Div1By3 :
+            if ( GetDiv1Source() ) {
+                CLK = GetReference() / 3.0;
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 3.0;
+                } else {
+                    CLK = 0;
+                }
+            }
+            break;
 
-        if ( ( listDevices == NULL ) ||
-             ( *listDevices == NULL ) ||
-             ( **listDevices == NULL ) ) {
-            PrintStdError( "GetListUSB()",
-                           "pointer 'listDevices' is NULL" );
+        case ClkSrc_Div2ByN :
+            if ( GetDiv2Source() ) {
+                CLK = GetReference() / GetDiv2Divider();
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / GetDiv2Divider();
+                } else {
+                    CLK = 0;
+                }
+            }
+            break;
 
-            return PointerNULL;
-        }
-    } catch(...) {
-        PrintStdError( "GetListUSB()",
-                       "catch() - Closing communication" );
+        case ClkSrc_Div2By2 :
+            if ( GetDiv2Source() ) {
+                CLK = GetReference() / 2.0;
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 2.0;
+                } else {
+                    CLK = 0;
+                }
+            }
+            break;
 
-        Close( true );
+        case ClkSrc_Div2By4 :
+            if ( GetDiv2Source() ) {
+                CLK = GetReference() / 4.0;
+            } else {
+                if ( GetVCOQ() ) {
+                    CLK = ( ( GetReference() * GetVCOP() ) / GetVCOQ() ) / 4.0;
+                } else {
+                    CLK = 0;
+                }
+            }
+            break;
 
-        return CatchError;
+        default :
+            CLK = 0;
+            break;
     }
-    return responseLibusb;
+    return CLK;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Given the descriptor device of USB device
-
-Parameters:
-[in] 	libusb_device
-[out]   descriptor device
+Sets the reference crystal frequency for output frequency computations.
 
-Return:
-ErrorCode
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-OpenOK::ErrorCode OpenOK::GetDeviceDescriptor( libusb_device *device,
-                                               libusb_device_descriptor *descriptorDevice )
+void OpenOK_CPLL22150::SetReference( double freq, bool extosc )
 {
-    try {
-        if ( device != NULL ) {
-            // libusb_get_device_descriptor return : 0 on success or a LIBUSB_ERROR code on failure
-            const int responseLibusb = libusb_get_device_descriptor( device,
-                                                                     descriptorDevice );
-
-            if ( responseLibusb != LIBUSB_SUCCESS ) {
-                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                    Close();
-                }
-
-                PrintStdError( "GetDeviceDescriptorListUSB()",
-                               "libusb_get_device_descriptor() failed",
-                               responseLibusb );
-
-                return LibusbError;
-            }
-
-            if ( descriptorDevice == NULL ) {
-                PrintStdError( "GetDeviceDescriptorListUSB()",
-                               "pointer 'descriptorDevice' is NULL" );
-
-                return PointerNULL;
-            }
-        } else {
-            PrintStdError( "GetDeviceDescriptorListUSB()",
-                           "pointer 'device' is NULL" );
+    // Using an External Clock as the Reference Input
+    // The CY22150 also accepts an external clock as reference, with
+    // speeds up to 133 MHz. With an external clock, the XDRV
+    // (register 12H) bits must be set according to Table 5 on page 6.
 
-            return PointerNULL;
+    if ( extosc ) {
+        if ( freq >= 1 && freq < 25 ) {
+            m_registersPLL[ register_12H ] = 32;
+        } else if ( freq >= 25 && freq < 50 ) {
+            m_registersPLL[ register_12H ] = 40;
+        } else if ( freq >= 50 && freq < 90 ) {
+            m_registersPLL[ register_12H ] = 48;
+        } else if ( freq >= 90 && freq <= 133 ) {
+            m_registersPLL[ register_12H ] = 56;
         }
-    } catch(...) {
-        PrintStdError( "GetDeviceDescriptorListUSB()",
-                       "catch() - Closing communication" );
 
-        Close( true );
+        m_registersPLL[ register_13H ] = 149;
 
-        return CatchError;
+        m_referenceFrequency = freq;
     }
-    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Open device USB
-
-Parameters:
-[in] 	libusb_device
-[out]   libusb_device_handle
+Set the VCO P(total) and Q(total) values.
 
-Return:
-ErrorCode
+See Datasheet CY22150 - Table 2. Summary Table - CY22150 Programmable Registers
 */
 
-OpenOK::ErrorCode OpenOK::OpenDeviceUSB( libusb_device *deviceOpen,
-                                         libusb_device_handle **handleOpen )
+bool OpenOK_CPLL22150::SetVCOParameters( int p, int q )
 {
-    try {
-        if ( ( deviceOpen != NULL ) ) {
-            // libusb_open return :
-            // 0 on success
-            // LIBUSB_ERROR_NO_MEM on memory allocation failure
-            // LIBUSB_ERROR_ACCESS if the user has insufficient permissions
-            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-            // another LIBUSB_ERROR code on other failure
-            const int responseLibusb = libusb_open( deviceOpen,
-                                                    handleOpen );
+    double VCOFreq = 0;
 
-            if ( responseLibusb != LIBUSB_SUCCESS ) {
-                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                    Close();
-                }
+    unsigned char pump;
 
-                PrintStdError( "OpenDeviceUSB()",
-                               "libusb_open() failed",
-                               responseLibusb );
+    unsigned char PO;
+    unsigned short int PB;
 
-                return LibusbError;
-            }
+    // Ptotal = (2(PB + 4) + PO)
+    // The minimum value of Ptotal is 8. The maximum value of Ptotal is 2055. To achieve the minimum value of Ptotal,
+    // PB and PO should both be programmed to 0. To achieve the maximum value of Ptotal, PB should be programmed to
+    // 1023, and PO should be
+    // programmed to 1.
+    // Qtotal= Q + 2
+    // The minimum value of Qtotal is 2. The maximum value of Q total is 129.
+    // Stable operation of the CY22150 cannot be guaranteed if REF/Qtotal falls below 250 kHz.
+    if ( q >= 2 && q <= 129 && p >= 8 && p <= 2055 ) {
+        VCOFreq = ( GetReference() * p ) / q;
+    } else {
+        return false;
+    }
 
-            if ( ( handleOpen == NULL ) ||
-                 ( *handleOpen == NULL ) ) {
-                PrintStdError( "OpenDeviceUSB()",
-                               "pointer 'handleOpen' is NULL",
-                               responseLibusb );
+    // Stable operation of the CY22150 cannot be guaranteed if the value of (Ptotal*(REF/Qtotal)) is above 400 MHz or below
+    // 100 MHz.
+    if ( VCOFreq > 400 || VCOFreq < 100 ) {
+        return false;
+    }
 
-                return PointerNULL;
-            }
-        } else {
-            PrintStdError( "OpenDeviceUSB()",
-                           "pointer 'deviceOpen' is NULL" );
+    m_registersPLL[ register_42H ] &= 128;
+    m_registersPLL[ register_42H ] |= ( ( q - 2 ) & 127 ) ;
 
-            return PointerNULL;
-        }
-    } catch(...) {
-        PrintStdError( "OpenDeviceUSB()",
-                       "catch() - Closing communication" );
+    PO = p % 2;
+    PB = ( ( ( p - PO ) / 2 ) - 4 );
+    m_registersPLL[ register_42H ] &= 127;
+    m_registersPLL[ register_42H ] |= ( ( PO & 1 ) << 7 );
+    m_registersPLL[ register_40H ] &= 252;
+    m_registersPLL[ register_40H ] |= ( ( PB >> 8 ) & 3 );
+    m_registersPLL[ register_41H ] = ( PB & 255 );
 
-        Close( true );
+    // PLL stability cannot be guaranteed for values below 16 and above 1023. If values above 1023 are needed, use CyClocksRT to
+    // determine the best charge pump setting.
+    if ( PB >= 16 && PB <= 44 ) {
+        pump = 0;
+    } else if ( PB >= 45 && PB <= 479 ) {
+        pump = 1;
+    } else if ( PB >= 480 && PB <= 639 ) {
+        pump = 2;
+    } else if ( PB >= 640 && PB <= 799 ) {
+        pump = 3;
+    } else if ( PB >= 800 && PB <= 1023 ) {
+        pump = 4;
+    } else {
+        pump = 1;
+    }
 
-        return CatchError;
+    m_registersPLL[ register_40H ] &= 195;
+    m_registersPLL[ register_40H ] = ( ( ( pump & 7 ) << 2 ) | 192 );
+
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Set the values for divider #1.
+*/
+
+void OpenOK_CPLL22150::SetDiv1( DividerSource divsrc, int n )
+{
+    if ( n >= 4 && n <= 127 ) {
+        m_registersPLL[ register_OCH ] = ( n & 127 ) + ( ( divsrc & 1 ) << 7 ) ;
     }
-    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Close device USB
+Set the values for divider #2.
+*/
 
-Parameters:
-[in]   libusb_device_handle
+void OpenOK_CPLL22150::SetDiv2( DividerSource divsrc, int n )
+{
+    if ( n >= 4 && n <= 127 ) {
+        m_registersPLL[ register_47H ] = ( n & 127 ) + ( ( divsrc & 1 ) << 7 ) ;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-Return:
-ErrorCode
+/*
+Set the source for a particular output.
 */
 
-OpenOK::ErrorCode OpenOK::CloseDeviceUSB( libusb_device_handle *handle )
+void OpenOK_CPLL22150::SetOutputSource( int output, OpenOK_CPLL22150::ClockSource clksrc )
 {
-    try {
-        if ( handle != NULL ) {
-            libusb_close( handle );
+    switch( output ) {
 
-            return NoError;
-        } else {
-            PrintStdError( "CloseDeviceUSB()",
-                           "pointer 'handle' is NULL" );
+        case 0 : // LCLK1
+            m_registersPLL[ register_44H ] &= 31;
+            m_registersPLL[ register_44H ] |= ( ( clksrc & 7 ) << 5 );
+            break;
 
-            return PointerNULL;
-        }
-    } catch(...) {
-        PrintStdError( "CloseDeviceUSB()",
-                       "catch()" );
+        case 1 : // LCLK2
+            m_registersPLL[ register_44H ] &= 227;
+            m_registersPLL[ register_44H ] |= ( ( clksrc & 7 ) << 2 );
+            break;
 
-        return CatchError;
+        case 2 : // LCLK3
+            m_registersPLL[ register_44H ] &= 252;
+            m_registersPLL[ register_44H ] |= ( ( clksrc >> 1 ) & 3 );
+            m_registersPLL[ register_45H ] &= 127;
+            m_registersPLL[ register_45H ] |= ( ( clksrc & 1 ) << 7 );
+            break;
+
+        case 3 : // LCLK4
+            m_registersPLL[ register_45H ] &= 143;
+            m_registersPLL[ register_45H ] |= ( ( clksrc & 7 ) << 4 );
+            break;
+
+        case 4 : // CLK5
+            m_registersPLL[ register_45H ] &= 241;
+            m_registersPLL[ register_45H ] |= ( ( clksrc & 7 ) << 1 );
+            break;
+
+        case 5 : // CLK6
+            m_registersPLL[ register_45H ] &= 254;
+            m_registersPLL[ register_45H ] |= ( ( clksrc >> 2 ) & 1 );
+            m_registersPLL[ register_46H ] = ( ( ( clksrc & 3 ) << 6 ) | 63 );
+            break;
+
+        default :
+            break;
     }
-    return Failed;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Given the descriptor configuration of USB device
+Set the output enable for a particular output.
+*/
 
-Parameters:
-[in] 	libusb_device
-[out]   descriptor configuration
+void OpenOK_CPLL22150::SetOutputEnable( int output, bool enable )
+{
+    if ( enable ) {
+        m_registersPLL[ register_09H ] |= ( 1 << output );
+    } else {
+        m_registersPLL[ register_09H ] &= ~( 1 << output );
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-Return:
-ErrorCode
+/*
+Constructor Class
 */
 
-OpenOK::ErrorCode OpenOK::GetConfigurationDescriptor( libusb_device *device,
-                                                      libusb_config_descriptor **descriptorConfiguration )
+OpenOK::OpenOK()
+    : m_deviceHandle( NULL )
+    , m_ctx( NULL )
+    , m_listUSBDevices( NULL )
+    , m_indexOpenedDevice( -1 )
+    , m_numberOKDevices( 0 )
+    , m_registryValid( false )
+    , m_hotplugRegistered( false )
+    , m_filterVendor( VENDOR_OPAL_KELLY )
+    , m_filterProduct( 0 )
+    , m_lastTransferred( 0 )
+    , m_enablePrintStdError( true )
+    , m_timeoutUSB( 3000 )
+    , m_controlURB( NULL )
+    , m_pipeStage( PipeStageSetup )
+    , m_numberURBs( 8 )
+    , m_sizeURB( 65536 )
+    , m_pipeActive( false )
+    , m_pipeCancelling( false )
 {
+    m_transport = &m_libusbTransport;
+    m_emulatedOpen = false;
+
     try {
-        if ( device != NULL ) {
-            // libusb_get_config_descriptor return :
-            // 0 on success
-            // LIBUSB_ERROR_NOT_FOUND if the configuration does not exist
-            // another LIBUSB_ERROR code on error
-            const int responseLibusb = libusb_get_config_descriptor( device,
-                                                                     0,
-                                                                     descriptorConfiguration );
+        int responseLibusb = LIBUSB_SUCCESS;
 
-            if ( responseLibusb != LIBUSB_SUCCESS ) {
-                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                    Close();
-                }
+        memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
+        memset( m_wireIns, 0, OpenOK::WIREINSIZE );
 
-                PrintStdError( "GetConfigurationDescriptorListUSB()",
-                               "libusb_get_config_descriptor() failed",
-                               responseLibusb );
+        // libusb_init return : 0 on success, or a LIBUSB_ERROR code on failure
+        if ( ( responseLibusb = libusb_init( &m_ctx ) ) == LIBUSB_SUCCESS ) {
+            // set verbosity level to LIBUSB_LOG_LEVEL_INFO, as suggested in the documentation :
+            // LIBUSB_LOG_LEVEL_NONE (0) : no messages ever printed by the library (default)
+            // LIBUSB_LOG_LEVEL_ERROR (1) : error messages are printed to stderr
+            // LIBUSB_LOG_LEVEL_WARNING (2) : warning and error messages are printed to stderr
+            // LIBUSB_LOG_LEVEL_INFO (3) : informational messages are printed to stdout, warning and
+            // error messages are printed to stderr
+            // LIBUSB_LOG_LEVEL_DEBUG (4) : debug and informational messages are printed to stdout, warnings and errors to stderr
+            // enable log debug compiling with "--enable-debug-log"
 
-                return LibusbError;
-            }
+            libusb_set_debug( m_ctx, 3/*LIBUSB_LOG_LEVEL_INFO*/ );
 
-            if ( ( descriptorConfiguration == NULL ) ||
-                 ( *descriptorConfiguration == NULL ) ) {
-                PrintStdError( "GetConfigurationDescriptorListUSB()",
-                               "pointer 'descriptorConfiguration' is NULL",
-                               responseLibusb );
+            m_libusbInitialization = true;
 
-                return PointerNULL;
-            }
+            //            PrintInfoAllDevice();
+            //            PrintStdError( "Constructor OpenOK()",
+            //                           GetLibUSBVersion() );
+            //            PrintStdError( "Constructor OpenOK()",
+            //                           GetOpenOKVersion() );
         } else {
-            PrintStdError( "GetConfigurationDescriptorListUSB()",
-                           "pointer 'device' is NULL" );
-            return PointerNULL;
+            m_libusbInitialization = false;
+
+            PrintStdError( "Constructor OpenOK()",
+                           "libusb_init() failed",
+                           responseLibusb );
         }
     } catch(...) {
-        PrintStdError( "GetConfigurationDescriptorListUSB()",
+        m_libusbInitialization = false;
+
+        PrintStdError( "Constructor OpenOK()",
                        "catch() - Closing communication" );
 
         Close( true );
-
-        return CatchError;
     }
-    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Free configuration descriptor
-
-Parameters:
-[in] 	libusb_config_descriptor
-
-Return:
-ErrorCode
+Destructor Class
 */
 
-OpenOK::ErrorCode OpenOK::FreeConfigurationDescriptor( libusb_config_descriptor *descriptorConfiguration )
+OpenOK::~OpenOK()
 {
     try {
-        if ( descriptorConfiguration != NULL ) {
-            libusb_free_config_descriptor(descriptorConfiguration);
+        Close();
 
-            return NoError;
-        } else {
-            PrintStdError( "FreeConfigurationDescriptor()",
-                           "pointer 'descriptorConfiguration' is NULL" );
+        if ( !m_pipeActive ) {
+            FreePipeURBs();
+        }
 
-            return PointerNULL;
+        if ( m_libusbInitialization ) {
+            DeregisterHotplug();
+            ClearListOpenOK();
+
+            ErrorCode responseClearListUSB = ClearListUSB( m_listUSBDevices );
+
+            if ( responseClearListUSB == NoError ) {
+                libusb_exit( m_ctx );
+            } else {
+                PrintStdError( "Destructor OpenOK()",
+                               "ClearListUSB() failed",
+                               0,
+                               responseClearListUSB );
+            }
         }
     } catch(...) {
-        PrintStdError( "FreeConfigurationDescriptor()",
+        PrintStdError( "Destructor OpenOK()",
                        "catch() - Closing communication" );
 
         Close( true );
-
-        return CatchError;
     }
-    return Failed;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method get OK devices in list.
-
-Parameters:
-[in] 	countEnable	used for GetCountDevices
-[out]	countDevices	number of OK devices
-
-Returns:
-ErrorCode
+Get openOK major version.
 */
 
-OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount )
+int OpenOK::GetOpenOKMajorVersion()
 {
-    unsigned char countOK_Devices = 0;
-		
-		deviceCount = 0;
-		
-		// Removed this, because as the compiler warns, the pointer cannot be NULL
-    //if ( &deviceCount != NULL ) {
-    //    deviceCount = 0;
-   // } else {
-    //    PrintStdError( "Get_OK_Devices()",
-    //                   "pointer 'deviceCount' is NULL" );
-
-    //    return PointerNULL;
-   // }
-
-    if ( !m_libusbInitialization ) {
-        return LibusbNotInitialization;
-    }
-
-    // Not is permitted get info devices while the device is opened.
-    if ( IsOpen() ) {
-        PrintStdError( "Get_OK_Devices()",
-                       "Not is permitted get info devices while the device is opened",
-                       0,
-                       OperationNotPermitted );
-        return OperationNotPermitted;
-    }
-
-    ErrorCode responseClearListUSB = ClearListUSB( m_listUSBDevices );
+    return OPENOK_MAJOR;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( responseClearListUSB != NoError ) {
-        PrintStdError( "Get_OK_Devices()",
-                       "ClearListUSB failed",
-                       0,
-                       responseClearListUSB );
-    }
+/*
+Get openOK minor version.
+*/
 
-    ErrorCode responseClearListOpenOK = ClearListOpenOK();
+int OpenOK::GetOpenOKMinorVersion()
+{
+    return OPENOK_MINOR;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( responseClearListOpenOK != NoError ) {
-        PrintStdError( "Get_OK_Devices()",
-                       "ClearListOpenOK failed",
-                       0,
-                       responseClearListOpenOK );
-    }
+/*
+Get openOK micro version.
+*/
 
-    // Get the list of USB devices.
-    const int numUSBDevices = GetListUSB( m_ctx,
-                                          &m_listUSBDevices );
+int OpenOK::GetOpenOKMicroVersion()
+{
+    return OPENOK_MICRO;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    // Not found USB devices.
-    if ( numUSBDevices <= 0 ) {
-        if ( numUSBDevices < 0 ) {
-            PrintStdError( "Get_OK_Devices()",
-                           "GetListUSB failed",
-                           0,
-                           numUSBDevices );
-        }
-        return NotFoundUSBDevices;
-    }
+/*
+Get openOK nano version.
+*/
 
-    for ( unsigned char idxUSBDevice = 0; idxUSBDevice < numUSBDevices; ++idxUSBDevice ) {
+int OpenOK::GetOpenOKNanoVersion()
+{
+    return OPENOK_NANO;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        libusb_device_descriptor descriptorDevice;
+/*
+Get openOK version.
+*/
 
-        // Get descriptor USB device.
-        const ErrorCode result = GetDeviceDescriptor( m_listUSBDevices[ idxUSBDevice ],
-                                                      &descriptorDevice );
+std::string OpenOK::GetOpenOKVersion()
+{
+    char version_str[ 256 ];
 
-        if ( result >= 0 ) {
-            if ( descriptorDevice.idVendor == VENDOR_OPAL_KELLY ) {
-                if ( !countEnable ) {
-                    OpenOK_device &currentOpalKellyDevice = m_listOKDevices[ countOK_Devices ];
+    sprintf( version_str, "OpenOK version = %d.%d.%d.%d",
+             OPENOK_MAJOR,
+             OPENOK_MINOR,
+             OPENOK_MICRO,
+             OPENOK_NANO );
 
-                    currentOpalKellyDevice.device = m_listUSBDevices[ idxUSBDevice ] ;
+    return version_str;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                    libusb_device_handle *currentHandleDevice;
+/*
+Get libusb version.
+*/
 
-                    // Open USB device
-                    const ErrorCode responseOpen = OpenDeviceUSB( currentOpalKellyDevice.device,
-                                                                  &currentHandleDevice );
+std::string OpenOK::GetLibUSBVersion()
+{
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000100)
+    try {
+        const libusb_version *version = libusb_get_version();
 
-                    if ( ( responseOpen == NoError ) &&
-                         ( currentHandleDevice != NULL ) ) {
+        if ( version != NULL ) {
+            char version_str[ 256 ];
 
-                        char strDeviceID[ OpenOK_device::SSIZE ];
+            sprintf( version_str, "LibUSB version = %d.%d.%d.%d",
+                     version->major,
+                     version->minor,
+                     version->micro,
+                     version->nano );
 
-                        // Get Device ID
-                        const int responseControl = ControlTransfer( currentHandleDevice,
-                                                                     controlReadMode,
-                                                                     0xb0,
-                                                                     0x1fd0,
-                                                                     0x0000,
-                                                                     reinterpret_cast< unsigned char* >(strDeviceID),
-                                                                     32,
-                                                                     m_timeoutUSB );
+            return version_str;
+        } else {
+            PrintStdError( "GetLibUSBVersion()",
+                           "pointer 'version' is NULL" );
+        }
+    } catch(...) {
+        PrintStdError( "GetLibUSBVersion()",
+                       "catch() - Closing communication" );
 
-                        if ( responseControl >= 0 ) {
-                            strncpy( currentOpalKellyDevice.deviceID, strDeviceID, OpenOK_device::SSIZE );
+        Close( true );
+    }
+#endif
+    return "LibUSB version = Not Available";
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                            // Serial
-                            GetStringDescriptor( currentOpalKellyDevice.serial, currentHandleDevice, descriptorDevice.iSerialNumber,
-                                                 OpenOK_device::SSIZE );
+/*
+Check libusb initialization.
+*/
 
-                            // Manufacturer
-                            GetStringDescriptor( currentOpalKellyDevice.manufacturer, currentHandleDevice, descriptorDevice.iManufacturer,
-                                                 OpenOK_device::SSIZE );
+bool OpenOK::InitializationLibUSB()
+{
+    return m_libusbInitialization;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                            // Product
-                            GetStringDescriptor( currentOpalKellyDevice.product, currentHandleDevice, descriptorDevice.iProduct,
-                                                 OpenOK_device::SSIZE );
+/*
+This method return string index descriptor.
 
-                            currentOpalKellyDevice.idVendor           = descriptorDevice.idVendor;
-                            currentOpalKellyDevice.idProduct          = descriptorDevice.idProduct;
-                            currentOpalKellyDevice.bcdUSB             = descriptorDevice.bcdDevice;
-                            currentOpalKellyDevice.bNumConfigurations = descriptorDevice.bNumConfigurations;
-                            currentOpalKellyDevice.bDeviceClass       = descriptorDevice.bDeviceClass;
+Parameters:
+[out]   string that will receive the descriptor
+[in] 	libusb_device_handle
+[in]	indexStr - index of string descriptor
+[in]	maxSize - max size of string
 
-                            libusb_config_descriptor* descriptorConfiguration = NULL;
+Returns:
+ErrorCode
+*/
 
-                            const ErrorCode responseConfigDesc = GetConfigurationDescriptor( m_listUSBDevices[ idxUSBDevice ],
-                                                                                             &descriptorConfiguration );
+OpenOK::ErrorCode OpenOK::GetStringDescriptor( char *str, libusb_device_handle *handle,
+                                               int indexStr, int maxSize )
+{
+    try {
+        if ( ( handle != NULL ) &&
+             ( str != NULL ) ) {
+            memset( str, 0, maxSize );
 
-                            if ( responseConfigDesc != NoError ) {
-                                PrintStdError( "Get_OK_Devices()",
-                                               "GetConfigurationDescriptorListUSB() failed",
-                                               0,
-                                               responseConfigDesc );
-                            }
+            // libusb_get_string_descriptor_ascii return : number of bytes returned in data, or LIBUSB_ERROR code on failure
+            const int responseLibusb = libusb_get_string_descriptor_ascii( handle,
+                                                                           indexStr,
+                                                                           reinterpret_cast< unsigned char* >( str ),
+                                                                           maxSize - 1 );
 
-                            if ( descriptorConfiguration != NULL ) {
-                                currentOpalKellyDevice.bNumInterfaces = descriptorConfiguration->bNumInterfaces;
+            if ( responseLibusb < 0 ) {
+                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                    Close();
+                }
 
-                                for ( unsigned char i = 0; i < descriptorConfiguration->bNumInterfaces ; ++i ) {
-                                    const libusb_interface *interface = &descriptorConfiguration->interface[i];
+                PrintStdError( "GetStringDescriptor()",
+                               "libusb_get_string_descriptor_ascii() failed",
+                               responseLibusb );
 
-                                    currentOpalKellyDevice.num_altsetting[ i ] = interface->num_altsetting;
+                return LibusbError;
+            }
+        } else {
+            if ( handle == NULL ) {
+                PrintStdError( "GetStringDescriptor()",
+                               "pointer 'handle' is NULL" );
 
-                                    for ( int j = 0; j < interface->num_altsetting ; ++j ) {
-                                        const libusb_interface_descriptor *descriptorInterface = &interface->altsetting[ j ];
+                return PointerNULL;
+            }
 
-                                        currentOpalKellyDevice.bInterfaceNumber[ j ] = descriptorInterface->bInterfaceNumber;
-                                        currentOpalKellyDevice.bNumEndpoints[ j ] = descriptorInterface->bNumEndpoints;
+            if ( str == NULL ) {
+                PrintStdError( "GetStringDescriptor()",
+                               "pointer 'str' is NULL" );
 
-                                        for ( unsigned char k = 0; k < descriptorInterface->bNumEndpoints; ++k ) {
-                                            const libusb_endpoint_descriptor* epdesc = &descriptorInterface->endpoint[ k ];
+                return PointerNULL;
+            }
+        }
+    } catch(...) {
+        PrintStdError( "GetStringDescriptor()",
+                       "catch() - Closing communication" );
 
-                                            currentOpalKellyDevice.bDescriptorType[ k ] = epdesc->bDescriptorType;
-                                            currentOpalKellyDevice.bEndpointAddress[ k ] = epdesc->bEndpointAddress;
-                                            currentOpalKellyDevice.bInterval[ k ] = epdesc->bInterval;
-                                            currentOpalKellyDevice.wMaxPacketSize[ k ] = epdesc->wMaxPacketSize;
-                                        }
-                                    }
-                                }
+        Close( true );
 
-                                // High Speed = 512 bytes
-                                // Full Speed = 8, 16, 32 or 64 bytes
-                                currentOpalKellyDevice.maxPacketSize = currentOpalKellyDevice.wMaxPacketSize[ 0 ];
+        return CatchError;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                                // To calculate multiple of MaxPacketSize.
-                                currentOpalKellyDevice.shiftMaxPacketSize = log2( currentOpalKellyDevice.maxPacketSize << 1 );
+/*
+Clear list of USB devices
 
-                                if ( FreeConfigurationDescriptor( descriptorConfiguration ) != NoError ) {
-                                    PrintStdError( "Get_OK_Devices()",
-                                                   "FreeConfigurationDescriptor() failed" );
-                                }
-                            } else {
-                                currentOpalKellyDevice.bNumInterfaces = 0;
-                            }
-                        } else {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "ControlTransfer() failed",
-                                           0,
-                                           responseControl );
-                        }
+Parameters:
+[in] 	libusb_device_handle
 
-                        if ( CloseDeviceUSB( currentHandleDevice ) != NoError ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "CloseDeviceUSB() failed" );
-                        }
-                        currentHandleDevice = NULL;
-                    } else {
-                        if ( currentHandleDevice == NULL ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "pointer 'currentHandleDevice' is NULL" );
-                        } else {
-                            currentOpalKellyDevice = OpenOK_device();
-                        }
+Return:
+ErrorCode
+*/
 
-                        if ( responseOpen != NoError ) {
-                            PrintStdError( "Get_OK_Devices()",
-                                           "OpenDeviceUSB() failed",
-                                           0,
-                                           responseOpen );
-                        }
-                    }
-                }
-                ++countOK_Devices;
-            }
+OpenOK::ErrorCode OpenOK::ClearListUSB( libusb_device **device )
+{
+    try {
+        // Clear the list of USB devices.
+        if ( ( device != NULL ) &&
+             ( *device != NULL ) ) {
+            libusb_free_device_list( device, 1 );
+            device = NULL;
         }
-    }
+    } catch(...) {
+        PrintStdError( "ClearListUSB()",
+                       "catch() - Closing communication" );
 
-    deviceCount = countOK_Devices;
+        Close( true );
 
-    if ( countOK_Devices <= 0 ) {
-        return NotFoundOpallKellyBoard;
+        return CatchError;
     }
     return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Check is Open
+Clear list of OpenOK devices
+
+Parameters:
+[in] 	libusb_device_handle
+
+Return:
+ErrorCode
 */
 
-bool OpenOK::IsOpen()
+OpenOK::ErrorCode OpenOK::ClearListOpenOK()
 {
-    return ( m_deviceHandle != NULL );
+    for ( int idxClear = 0; idxClear < maxUSBDevices; ++idxClear ) {
+        if ( m_listOKDevices[ idxClear ].device != NULL ) {
+            libusb_unref_device( m_listOKDevices[ idxClear ].device );
+        }
+        m_listOKDevices[ idxClear ] = OpenOK_device();
+    }
+    m_numberOKDevices = 0;
+
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Performs a RESET of the FPGA internals. This requires that FrontPanel support be present in the FPGA design because the RESET signal
-actually comes from the FrontPanel Host Interface.
+Given list of USB devices
 
-Returns:
-ErrorCode
-*/
-
-OpenOK::ErrorCode OpenOK::ResetFPGA()
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
-
-    static unsigned char dataControl[ 3 ] = { 0x00, 0x01, 0x00 };
-
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlWriteMode,
-                                                 0xb3,
-                                                 0x0000,
-                                                 0x0000,
-                                                 dataControl,
-                                                 3,
-                                                 m_timeoutUSB );
-
-    if ( responseControl < 0 ) {
-        PrintStdError( "ResetFPGA()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
-        return ControlTransferError;
-    }
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
-
-/*
-ResetDeviceUSB resets the specified device by sending a RESET down the port it is connected to.
+Parameters:
+[in] 	libusb_context
+[out]   list of USB devices
 
-OBS :Causes re-enumeration: After calling ResetDeviceUSB, the device will need to re-enumerate and thusly,
-requires you to find the new device and open a new handle. The handle used to call libusb_reset_device will no longer work.
+Return:
+Number of USB devices
 */
 
-bool OpenOK::ResetDeviceUSB( std::string serial )
+int OpenOK::GetListUSB( libusb_context *ctx,
+                        libusb_device ***listDevices )
 {
-    char stringWait[ 256 ];
-
-    sprintf( stringWait, "Waiting for %02d milliseconds to open the device", WAIT_RESET_MICROSECONDS / 1000 );
-
-    PrintStdError( "ResetDeviceUSB()",
-                   stringWait );
-
-#ifdef QT_CORE_LIB
-    SleepUtil::usleep( WAIT_RESET_MICROSECONDS );
-#else
-    usleep( WAIT_RESET_MICROSECONDS );
-#endif
-
-    ErrorCode responseOpen = OpenBySerial( serial );
+    ssize_t responseLibusb = 0;
 
-    if ( responseOpen == NoError ) {
-        try {
-            if ( m_deviceHandle != NULL ) {
-                // Perform a USB port reset to reinitialize a device.
-                //
-                // The system will attempt to restore the previous configuration and
-                // alternate settings after the reset has completed.
-                //
-                // If the reset fails, the descriptors change,
-                // or the previous state cannot be restored,
-                // the device will appear to be disconnected and reconnected.
-                // This means that the device handle is no longer valid (you should close it) and
-                // rediscover the device. A return code of LIBUSB_ERROR_NOT_FOUND indicates when
-                // this is the case.
-                //
-                // This is a blocking function which usually incurs a noticeable delay.
-                //
-                // libusb_reset_device return :
-                // 0 on success
-                // LIBUSB_ERROR_NOT_FOUND if re-enumeration is required, or if the device has been disconnected
-                // another LIBUSB_ERROR code on other failure
-                const int responseLibusb = libusb_reset_device( m_deviceHandle );
+    try {
+        // libusb_get_device_list return : the number of devices in the outputted list,
+        // or any libusb_error according to errors encountered by the backend.
+        responseLibusb = libusb_get_device_list( ctx,
+                                                 listDevices );
 
-                if ( responseLibusb != LIBUSB_SUCCESS ) {
-                    if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                        Close();
-                    }
+        if ( responseLibusb < 0 ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                Close();
+            }
 
-                    PrintStdError( "ResetDeviceUSB()",
-                                   "libusb_reset_device() failed",
-                                   responseLibusb );
+            PrintStdError( "GetListUSB()",
+                           "libusb_get_device_list() failed",
+                           responseLibusb );
 
-                    if ( responseLibusb == LIBUSB_ERROR_NOT_FOUND ) {
-                        PrintStdError( "ResetDeviceUSB()",
-                                       "re-enumeration is required - Closing communication" );
-                        Close();
-                    }
-                } else {
-                    PrintStdError( "ResetDeviceUSB()",
-                                   stringWait );
+            return LibusbError;
+        }
 
-                    // wait re-enumeration
-#ifdef QT_CORE_LIB
-                    SleepUtil::usleep( WAIT_RESET_MICROSECONDS );
-#else
-                    usleep( WAIT_RESET_MICROSECONDS );
-#endif
-                    responseOpen = OpenBySerial( serial );
+        if ( ( listDevices == NULL ) ||
+             ( *listDevices == NULL ) ||
+             ( **listDevices == NULL ) ) {
+            PrintStdError( "GetListUSB()",
+                           "pointer 'listDevices' is NULL" );
 
-                    if ( responseOpen == NoError ) {
-                        PrintStdError( "ResetDeviceUSB()",
-                                       "reset successfully!" );
+            return PointerNULL;
+        }
+    } catch(...) {
+        PrintStdError( "GetListUSB()",
+                       "catch() - Closing communication" );
 
-                        return true;
-                    } else {
-                        PrintStdError( "ResetDeviceUSB()",
-                                       "OpenBySerial() failed",
-                                       0,
-                                       responseOpen );
-                    }
-                }
-            } else {
-                PrintStdError( "ResetDeviceUSB()",
-                               "pointer 'm_deviceHandle' is NULL" );
-            }
-        } catch(...) {
-            PrintStdError( "ResetDeviceUSB()",
-                           "catch() - Closing communication" );
+        Close( true );
 
-            Close( true );
-        }
-    } else {
-        PrintStdError( "ResetDeviceUSB()",
-                       "OpenBySerial() failed",
-                       0,
-                       responseOpen );
+        return CatchError;
     }
-    return false;
+    return responseLibusb;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-inline int OpenOK::OptionalControlTransfer( libusb_device_handle *dev_handle,
-                                            uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
-                                            unsigned char *data, uint16_t wLength, unsigned int timeout )
-{
-    int responseLibusb = 0;
-
-    if ( dev_handle == NULL ) {
-        PrintStdError( "OptionalControlTransfer()",
-                       "pointer 'dev_handle' is NULL" );
-
-        return PointerNULL;
-    }
+/*
+Given the descriptor device of USB device
 
-    if ( data == NULL ) {
-        PrintStdError( "OptionalControlTransfer()",
-                       "pointer 'data' is NULL" );
+Parameters:
+[in] 	libusb_device
+[out]   descriptor device
 
-        return PointerNULL;
-    }
+Return:
+ErrorCode
+*/
 
+OpenOK::ErrorCode OpenOK::GetDeviceDescriptor( libusb_device *device,
+                                               libusb_device_descriptor *descriptorDevice )
+{
     try {
-        // libusb_control_transfer return :
-        // on success, the number of bytes actually transferred
-        // LIBUSB_ERROR_TIMEOUT if the transfer timed out
-        // LIBUSB_ERROR_PIPE if the control request was not supported by the device
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // another LIBUSB_ERROR code on other failures
-        responseLibusb = libusb_control_transfer( dev_handle,
-                                                  request_type, bRequest, wValue, wIndex,
-                                                  data, wLength, timeout );
+        if ( device != NULL ) {
+            // libusb_get_device_descriptor return : 0 on success or a LIBUSB_ERROR code on failure
+            const int responseLibusb = libusb_get_device_descriptor( device,
+                                                                     descriptorDevice );
 
+            if ( responseLibusb != LIBUSB_SUCCESS ) {
+                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                    Close();
+                }
 
-        if ( responseLibusb < 0 ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                PrintStdError( "OptionalControlTransfer()",
-                               "libusb_control_transfer() failed - Closing communication",
+                PrintStdError( "GetDeviceDescriptorListUSB()",
+                               "libusb_get_device_descriptor() failed",
                                responseLibusb );
 
-                Close();
-            } else {
-                if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
-                    PrintStdError( "OptionalControlTransfer()",
-                                   "libusb_control_transfer() failed - control request was not supported by the device",
-                                   responseLibusb );
-                } else {
-                    PrintStdError( "OptionalControlTransfer()",
-                                   "libusb_control_transfer() failed",
-                                   responseLibusb );
-                }
+                return LibusbError;
             }
-            return ( ControlTransferError + responseLibusb );
-        } else if ( data == NULL ) {
-            PrintStdError( "OptionalControlTransfer()",
-                           "libusb_control_transfer failed - pointer 'data' is NULL" );
 
-            return PointerNULL;
-        } else if ( responseLibusb < wLength ) {
-            PrintStdError( "OptionalControlTransfer()",
-                           "libusb_control_transfer() failed - lost data" );
+            if ( descriptorDevice == NULL ) {
+                PrintStdError( "GetDeviceDescriptorListUSB()",
+                               "pointer 'descriptorDevice' is NULL" );
 
-            return ControlTransferError;
-        } else if ( responseLibusb > wLength ) {
-            PrintStdError( "OptionalControlTransfer()",
-                           "libusb_control_transfer() failed - overflow data" );
+                return PointerNULL;
+            }
+        } else {
+            PrintStdError( "GetDeviceDescriptorListUSB()",
+                           "pointer 'device' is NULL" );
 
-            return ControlTransferError;
+            return PointerNULL;
         }
     } catch(...) {
-        PrintStdError( "OptionalControlTransfer()",
-                       "catch() - Closing communication!" );
+        PrintStdError( "GetDeviceDescriptorListUSB()",
+                       "catch() - Closing communication" );
 
         Close( true );
 
         return CatchError;
     }
-
-    if ( responseLibusb < 0 ) {
-        return LibusbError;
-    }
-    return responseLibusb;
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-inline int OpenOK::OptionalBulkTransfer( libusb_device_handle *dev_handle,
-                                         unsigned char endpoint, unsigned char *data, int length,
-                                         int *actual_length, unsigned int timeout )
-{
-    int responseLibusb = 0;
+/*
+Open device USB
 
-    if ( dev_handle == NULL ) {
-        PrintStdError( "OptionalBulkTransfer()",
-                       "pointer 'dev_handle' is NULL" );
-
-        return PointerNULL;
-    }
-
-    if ( data == NULL ) {
-        PrintStdError( "OptionalBulkTransfer()",
-                       "pointer 'data' is NULL" );
-
-        return PointerNULL;
-    }
-
-    if ( actual_length == NULL ) {
-        PrintStdError( "OptionalBulkTransfer()",
-                       "pointer 'actual_length' is NULL" );
+Parameters:
+[in] 	libusb_device
+[out]   libusb_device_handle
 
-        return PointerNULL;
-    }
+Return:
+ErrorCode
+*/
 
+OpenOK::ErrorCode OpenOK::OpenDeviceUSB( libusb_device *deviceOpen,
+                                         libusb_device_handle **handleOpen )
+{
     try {
-        // The direction of the transfer is inferred from the direction bits of the endpoint address.
-        //
-        // For bulk reads, the length field indicates the maximum length of data you are expecting to receive.
-        // If less data arrives than expected, this function will return that data,
-        // so be sure to check the transferred output parameter.
-        //
-        // You should also check the transferred parameter for bulk writes. Not all of the data may have been written.
-        //
-        // Also check transferred when dealing with a timeout error code.
-        // libusb may have to split your transfer into a number of chunks to satisfy underlying O/S requirements,
-        // meaning that the timeout may expire after the first few chunks have completed.
-        // libusb is careful not to lose any data that may have been transferred;
-        // do not assume that timeout conditions indicate a complete lack of I/O.
-        //
-        // Bulk/interrupt transfer overflows
-        //
-        // When requesting data on a bulk endpoint, libusb requires you to supply a buffer and the maximum number of
-        // bytes of data that libusb can put in that buffer. However, the size of the buffer is not communicated to
-        // the device - the device is just asked to send any amount of data.
-        //
-        // There is no problem if the device sends an amount of data that is less than or equal to the buffer size.
-        // libusb reports this condition to you through the libusb_transfer.actual_length field.
-        //
-        // Problems may occur if the device attempts to send more data than can fit in the buffer.
-        // libusb reports LIBUSB_TRANSFER_OVERFLOW for this condition but other behaviour is largely undefined:
-        // actual_length may or may not be accurate, the chunk of data that can fit in the buffer (before overflow)
-        // may or may not have been transferred.
-        //
-        // Overflows are nasty, but can be avoided. Even though you were told to ignore packets above,
-        // think about the lower level details: each transfer is split into packets (typically small,
-        // with a maximum size of 512 bytes). Overflows can only happen if the final packet in an incoming data transfer is
-        // smaller than the actual packet that the device wants to transfer. Therefore, you will never see an overflow if
-        // your transfer buffer size is a multiple of the endpoint's packet size: the final packet will either fill up
-        // completely or will be only partially filled.
-        //
-        // libusb_bulk_transfer return :
-        // 0 on success (and populates transferred)
-        // LIBUSB_ERROR_TIMEOUT if the transfer timed out (and populates transferred)
-        // LIBUSB_ERROR_PIPE if the endpoint halted
-        // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // another LIBUSB_ERROR code on other failures
-        responseLibusb = libusb_bulk_transfer( dev_handle,
-                                               endpoint, data, length,
-                                               actual_length, timeout );
-
-        if ( responseLibusb != LIBUSB_SUCCESS ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                PrintStdError( "OptionalBulkTransfer()",
-                               "libusb_bulk_transfer() failed - Closing communication",
-                               responseLibusb );
-
-                Close();
-            } else {
-                if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
-                    PrintStdError( "OptionalBulkTransfer()",
-                                   "libusb_bulk_transfer() failed",
-                                   responseLibusb );
+        if ( ( deviceOpen != NULL ) ) {
+            // libusb_open return :
+            // 0 on success
+            // LIBUSB_ERROR_NO_MEM on memory allocation failure
+            // LIBUSB_ERROR_ACCESS if the user has insufficient permissions
+            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+            // another LIBUSB_ERROR code on other failure
+            const int responseLibusb = libusb_open( deviceOpen,
+                                                    handleOpen );
 
-                    if ( data == NULL ) {
-                        PrintStdError( "OptionalBulkTransfer()",
-                                       "pointer 'data' is NULL" );
+            if ( responseLibusb != LIBUSB_SUCCESS ) {
+                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                    Close();
+                }
 
-                        return PointerNULL;
-                    } else if ( *actual_length == length ) {
-                        return NoError;
-                    }
-                } else if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
-                    PrintStdError( "OptionalBulkTransfer()",
-                                   "libusb_bulk_transfer() failed - Cleaning the endpoint halted",
-                                   responseLibusb );
+                PrintStdError( "OpenDeviceUSB()",
+                               "libusb_open() failed",
+                               responseLibusb );
 
-                    // Clear the halt/stall condition for an endpoint.
-                    //
-                    // Endpoints with halt status are unable to receive or transmit data until the halt condition is stalled.
-                    //
-                    // You should cancel all pending transfers before attempting to clear the halt condition.
-                    //
-                    // This is a blocking function.
-                    //
-                    // libusb_clear_halt return :
-                    // 0 on success
-                    // LIBUSB_ERROR_NOT_FOUND if the endpoint does not exist
-                    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-                    // another LIBUSB_ERROR code on other failure
-                    const int responseClearHalt = libusb_clear_halt( dev_handle, endpoint );
+                return LibusbError;
+            }
 
-                    if ( responseClearHalt != LIBUSB_SUCCESS ) {
-                        if ( responseClearHalt == LIBUSB_ERROR_NO_DEVICE ) {
-                            PrintStdError( "OptionalBulkTransfer()",
-                                           "libusb_clear_halt() failed - Closing communication",
-                                           responseClearHalt );
+            if ( ( handleOpen == NULL ) ||
+                 ( *handleOpen == NULL ) ) {
+                PrintStdError( "OpenDeviceUSB()",
+                               "pointer 'handleOpen' is NULL",
+                               responseLibusb );
 
-                            Close();
-                        } else {
-                            PrintStdError( "OptionalBulkTransfer()",
-                                           "libusb_clear_halt() failed",
-                                           responseClearHalt );
-                        }
-                    }
-                } else {
-                    PrintStdError( "OptionalBulkTransfer()",
-                                   "libusb_bulk_transfer() failed",
-                                   responseLibusb );
-                }
+                return PointerNULL;
             }
-            return ( BulkTransferError + responseLibusb );
-        } else if ( data == NULL ) {
-            PrintStdError( "OptionalBulkTransfer()",
-                           "pointer 'data' is NULL" );
-
-            return PointerNULL;
-        } else if ( actual_length == NULL ) {
-            PrintStdError( "OptionalBulkTransfer()",
-                           "pointer 'actual_length' is NULL" );
+        } else {
+            PrintStdError( "OpenDeviceUSB()",
+                           "pointer 'deviceOpen' is NULL" );
 
             return PointerNULL;
-        } else if ( *actual_length < length ) {
-            PrintStdError( "OptionalBulkTransfer()",
-                           "libusb_bulk_transfer() failed - lost data" );
-
-            return BulkTransferError;
-        } else if ( *actual_length > length ) {
-            PrintStdError( "OptionalBulkTransfer()",
-                           "libusb_bulk_transfer() failed - overflow data" );
-
-            return BulkTransferError;
         }
     } catch(...) {
-        PrintStdError( "OptionalBulkTransfer()",
+        PrintStdError( "OpenDeviceUSB()",
                        "catch() - Closing communication" );
 
         Close( true );
 
         return CatchError;
     }
-
-    if ( responseLibusb < 0 ) {
-        return LibusbError;
-    }
-    return responseLibusb;
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-inline int OpenOK::ControlTransfer( libusb_device_handle *dev_handle,
-                                    uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
-                                    unsigned char *data, uint16_t wLength, unsigned int timeout )
+/*
+Close device USB
+
+Parameters:
+[in]   libusb_device_handle
+
+Return:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::CloseDeviceUSB( libusb_device_handle *handle )
 {
-    int responseLibusb = 0;
+    try {
+        if ( handle != NULL ) {
+            libusb_close( handle );
 
-    if ( dev_handle == NULL ) {
-        PrintStdError( "ControlTransfer()",
-                       "pointer 'dev_handle' is NULL" );
+            return NoError;
+        } else {
+            PrintStdError( "CloseDeviceUSB()",
+                           "pointer 'handle' is NULL" );
 
-        return PointerNULL;
+            return PointerNULL;
+        }
+    } catch(...) {
+        PrintStdError( "CloseDeviceUSB()",
+                       "catch()" );
+
+        return CatchError;
     }
+    return Failed;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( data == NULL ) {
-        PrintStdError( "ControlTransfer()",
-                       "pointer 'data' is NULL" );
+/*
+Given the descriptor configuration of USB device
 
-        return PointerNULL;
-    }
+Parameters:
+[in] 	libusb_device
+[out]   descriptor configuration
+
+Return:
+ErrorCode
+*/
 
+OpenOK::ErrorCode OpenOK::GetConfigurationDescriptor( libusb_device *device,
+                                                      libusb_config_descriptor **descriptorConfiguration )
+{
     try {
-        // libusb_control_transfer return :
-        // on success, the number of bytes actually transferred
-        // LIBUSB_ERROR_TIMEOUT if the transfer timed out
-        // LIBUSB_ERROR_PIPE if the control request was not supported by the device
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // another LIBUSB_ERROR code on other failures
-        responseLibusb = libusb_control_transfer( dev_handle,
-                                                  request_type, bRequest, wValue, wIndex,
-                                                  data, wLength, timeout );
+        if ( device != NULL ) {
+            // libusb_get_config_descriptor return :
+            // 0 on success
+            // LIBUSB_ERROR_NOT_FOUND if the configuration does not exist
+            // another LIBUSB_ERROR code on error
+            const int responseLibusb = libusb_get_config_descriptor( device,
+                                                                     0,
+                                                                     descriptorConfiguration );
 
-        if ( responseLibusb < 0 ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                PrintStdError( "ControlTransfer()",
-                               "libusb_control_transfer() failed - Closing communication",
+            if ( responseLibusb != LIBUSB_SUCCESS ) {
+                if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                    Close();
+                }
+
+                PrintStdError( "GetConfigurationDescriptorListUSB()",
+                               "libusb_get_config_descriptor() failed",
                                responseLibusb );
 
-                Close();
-            } else {
-                if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
-                    PrintStdError( "ControlTransfer()",
-                                   "libusb_control_transfer() failed - control request was not supported by the device",
-                                   responseLibusb );
-                } else {
-                    PrintStdError( "ControlTransfer()",
-                                   "libusb_control_transfer() failed",
-                                   responseLibusb );
-                }
-
-                ErrorCode error = CheckFrontPanelEnabled();
+                return LibusbError;
+            }
 
-                if ( error != NoError ) {
-                    if ( error == FrontPanelDisabled ) {
-                        PrintStdError( "ControlTransfer()",
-                                       "FrontPanel disabled - Closing communication",
-                                       0,
-                                       error );
+            if ( ( descriptorConfiguration == NULL ) ||
+                 ( *descriptorConfiguration == NULL ) ) {
+                PrintStdError( "GetConfigurationDescriptorListUSB()",
+                               "pointer 'descriptorConfiguration' is NULL",
+                               responseLibusb );
 
-                        Close();
-                    } else if ( error == NotPossibleCheckFrontPanel ) {
-                        PrintStdError( "ControlTransfer()",
-                                       "Is not possible check if the FrontPanel is enabled",
-                                       0,
-                                       error );
-                    } else {
-                        PrintStdError( "ControlTransfer()",
-                                       "CheckFrontPanelEnabled() failed",
-                                       0,
-                                       error );
-                    }
-                }
+                return PointerNULL;
             }
-            return ( ControlTransferError + responseLibusb );
-        } else if ( data == NULL ) {
-            PrintStdError( "ControlTransfer()",
-                           "libusb_control_transfer failed - pointer 'data' is NULL" );
-
+        } else {
+            PrintStdError( "GetConfigurationDescriptorListUSB()",
+                           "pointer 'device' is NULL" );
             return PointerNULL;
-        } else if ( responseLibusb < wLength ) {
-            PrintStdError( "ControlTransfer()",
-                           "libusb_control_transfer() failed - lost data" );
-
-            return ControlTransferError;
-        } else if ( responseLibusb > wLength ) {
-            PrintStdError( "ControlTransfer()",
-                           "libusb_control_transfer() failed - overflow data" );
-
-            return ControlTransferError;
         }
     } catch(...) {
-        PrintStdError( "ControlTransfer()",
+        PrintStdError( "GetConfigurationDescriptorListUSB()",
                        "catch() - Closing communication" );
 
         Close( true );
 
         return CatchError;
     }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( responseLibusb < 0 ) {
-        return LibusbError;
+/*
+Free configuration descriptor
+
+Parameters:
+[in] 	libusb_config_descriptor
+
+Return:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::FreeConfigurationDescriptor( libusb_config_descriptor *descriptorConfiguration )
+{
+    try {
+        if ( descriptorConfiguration != NULL ) {
+            libusb_free_config_descriptor(descriptorConfiguration);
+
+            return NoError;
+        } else {
+            PrintStdError( "FreeConfigurationDescriptor()",
+                           "pointer 'descriptorConfiguration' is NULL" );
+
+            return PointerNULL;
+        }
+    } catch(...) {
+        PrintStdError( "FreeConfigurationDescriptor()",
+                       "catch() - Closing communication" );
+
+        Close( true );
+
+        return CatchError;
     }
-    return responseLibusb;
+    return Failed;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-inline int OpenOK::BulkTransfer( libusb_device_handle *dev_handle,
-                                 unsigned char endpoint, unsigned char *data, int length,
-                                 int *actual_length, unsigned int timeout )
+/*
+This method get OK devices in list.
+
+The list is kept as a registry of the devices matching the filter set by SetUSBDeviceFilter(). Each device's descriptors and
+strings are read once, when it is first seen, and a reference to it is held so that it can be recognised in later enumerations.
+If libusb supports hotplug, the bus is enumerated only once and the registry is then updated from hotplug events.
+The registry is kept per OpenOK instance, since each has its own libusb context, so several instances in one process
+(for example, one per board) each enumerate the bus.
+
+Parameters:
+[in] 	countEnable	used for GetCountDevices
+[out]	countDevices	number of OK devices
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::Get_OK_Devices( bool countEnable, int &deviceCount )
 {
-    int responseLibusb = 0;
+    deviceCount = 0;
 
-    if ( dev_handle == NULL ) {
-        PrintStdError( "BulkTransfer()",
-                       "pointer 'dev_handle' is NULL" );
+    if ( !m_libusbInitialization && !m_transport->IsEmulated() ) {
+        return LibusbNotInitialization;
+    }
 
-        return PointerNULL;
+    // Not is permitted get info devices while the device is opened.
+    if ( IsOpen() ) {
+        PrintStdError( "Get_OK_Devices()",
+                       "Not is permitted get info devices while the device is opened",
+                       0,
+                       OperationNotPermitted );
+        return OperationNotPermitted;
     }
 
-    if ( data == NULL ) {
-        PrintStdError( "BulkTransfer()",
-                       "pointer 'data' is NULL" );
+    if ( m_transport->IsEmulated() ) {
+        ClearListOpenOK();
 
-        return PointerNULL;
+        m_numberOKDevices = m_transport->GetDevices( m_listOKDevices, maxUSBDevices );
+        deviceCount = m_numberOKDevices;
+
+        return ( m_numberOKDevices > 0 ) ? NoError : NotFoundOpallKellyBoard;
     }
 
-    if ( actual_length == NULL ) {
-        PrintStdError( "BulkTransfer()",
-                       "pointer 'actual_length' is NULL" );
+    if ( !m_registryValid ) {
+        // Register for hotplug events before enumerating so that no device can be missed
+        RegisterHotplug();
 
-        return PointerNULL;
+        const ErrorCode responseRefresh = RefreshDeviceRegistry();
+
+        if ( responseRefresh != NoError ) {
+            return responseRefresh;
+        }
+        m_registryValid = m_hotplugRegistered;
+    } else {
+        struct timeval noWait = { 0, 0 };
+
+        // Deliver any pending hotplug events
+        libusb_handle_events_timeout_completed( m_ctx, &noWait, NULL );
+
+        ApplyHotplugEvents();
     }
 
-    try {
-        // The direction of the transfer is inferred from the direction bits of the endpoint address.
-        //
-        // For bulk reads, the length field indicates the maximum length of data you are expecting to receive.
-        // If less data arrives than expected, this function will return that data,
-        // so be sure to check the transferred output parameter.
-        //
-        // You should also check the transferred parameter for bulk writes. Not all of the data may have been written.
-        //
-        // Also check transferred when dealing with a timeout error code.
-        // libusb may have to split your transfer into a number of chunks to satisfy underlying O/S requirements,
-        // meaning that the timeout may expire after the first few chunks have completed.
-        // libusb is careful not to lose any data that may have been transferred;
-        // do not assume that timeout conditions indicate a complete lack of I/O.
-        //
-        // Bulk/interrupt transfer overflows
-        //
-        // When requesting data on a bulk endpoint, libusb requires you to supply a buffer and the maximum number of
-        // bytes of data that libusb can put in that buffer. However, the size of the buffer is not communicated to
-        // the device - the device is just asked to send any amount of data.
-        //
-        // There is no problem if the device sends an amount of data that is less than or equal to the buffer size.
-        // libusb reports this condition to you through the libusb_transfer.actual_length field.
-        //
-        // Problems may occur if the device attempts to send more data than can fit in the buffer.
-        // libusb reports LIBUSB_TRANSFER_OVERFLOW for this condition but other behaviour is largely undefined:
-        // actual_length may or may not be accurate, the chunk of data that can fit in the buffer (before overflow)
-        // may or may not have been transferred.
-        //
-        // Overflows are nasty, but can be avoided. Even though you were told to ignore packets above,
-        // think about the lower level details: each transfer is split into packets (typically small,
-        // with a maximum size of 512 bytes). Overflows can only happen if the final packet in an incoming data transfer is
-        // smaller than the actual packet that the device wants to transfer. Therefore, you will never see an overflow if
-        // your transfer buffer size is a multiple of the endpoint's packet size: the final packet will either fill up
-        // completely or will be only partially filled.
-        //
-        // libusb_bulk_transfer return :
-        // 0 on success (and populates transferred)
-        // LIBUSB_ERROR_TIMEOUT if the transfer timed out (and populates transferred)
-        // LIBUSB_ERROR_PIPE if the endpoint halted
-        // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // another LIBUSB_ERROR code on other failures
-        responseLibusb = libusb_bulk_transfer( dev_handle,
-                                               endpoint, data, length,
-                                               actual_length, timeout );
+    // Retry devices which couldn't be read before (eg because they were still being set up by the OS)
+    for ( int idxDevice = 0; idxDevice < m_numberOKDevices; ++idxDevice ) {
+        if ( !m_listOKDevices[ idxDevice ].cached ) {
+            ReadDeviceInfo( m_listOKDevices[ idxDevice ] );
+        }
+    }
 
-        if ( responseLibusb != LIBUSB_SUCCESS ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                PrintStdError( "BulkTransfer()",
-                               "libusb_bulk_transfer() failed - Closing communication",
-                               responseLibusb );
+    deviceCount = m_numberOKDevices;
 
-                Close();
-            } else {
-                if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
-                    PrintStdError( "BulkTransfer()",
-                                   "libusb_bulk_transfer() failed",
-                                   responseLibusb );
+    if ( m_numberOKDevices <= 0 ) {
+        return NotFoundOpallKellyBoard;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                    if ( data == NULL ) {
-                        PrintStdError( "BulkTransfer()",
-                                       "pointer 'data' is NULL" );
+/*
+Sets the USB vendor and product IDs of the devices which are listed. Devices which don't match are never opened.
 
-                        return PointerNULL;
-                    } else if ( *actual_length == length ) {
-                        return NoError;
-                    }
-                } else if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
-                    PrintStdError( "BulkTransfer()",
-                                   "libusb_bulk_transfer() failed - Cleaning the endpoint halted",
-                                   responseLibusb );
+Parameters:
+[in] 	idVendor	USB Vendor ID (VID)
+[in] 	idProduct	USB Product ID (PID), or 0 for any product
+*/
 
-                    // Clear the halt/stall condition for an endpoint.
-                    //
-                    // Endpoints with halt status are unable to receive or transmit data until the halt condition is stalled.
-                    //
-                    // You should cancel all pending transfers before attempting to clear the halt condition.
-                    //
-                    // This is a blocking function.
-                    //
-                    // libusb_clear_halt return :
-                    // 0 on success
-                    // LIBUSB_ERROR_NOT_FOUND if the endpoint does not exist
-                    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-                    // another LIBUSB_ERROR code on other failure
-                    const int responseClearHalt = libusb_clear_halt( dev_handle, endpoint );
+void OpenOK::SetUSBDeviceFilter( unsigned short int idVendor, unsigned short int idProduct )
+{
+    if ( ( idVendor == m_filterVendor ) && ( idProduct == m_filterProduct ) ) {
+        return;
+    }
 
-                    if ( responseClearHalt != LIBUSB_SUCCESS ) {
-                        if ( responseClearHalt == LIBUSB_ERROR_NO_DEVICE ) {
-                            PrintStdError( "BulkTransfer()",
-                                           "libusb_clear_halt() failed - Closing communication",
-                                           responseClearHalt );
+    m_filterVendor = idVendor;
+    m_filterProduct = idProduct;
 
-                            Close();
-                        } else {
-                            PrintStdError( "BulkTransfer()",
-                                           "libusb_clear_halt() failed",
-                                           responseClearHalt );
-                        }
-                    }
-                } else {
-                    PrintStdError( "BulkTransfer()",
-                                   "libusb_bulk_transfer() failed",
-                                   responseLibusb );
-                }
+    // The registry and hotplug callback were set up for the old filter
+    DeregisterHotplug();
+    m_registryValid = false;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                ErrorCode error = CheckFrontPanelEnabled();
+/*
+Checks a device descriptor against the filter
 
-                if ( error == FrontPanelDisabled ) {
-                    PrintStdError( "BulkTransfer()",
-                                   "FrontPanel disabled! Closing communication",
-                                   0,
-                                   error );
+Returns:
+True if the device should be listed.
+*/
 
-                    Close();
-                } else if ( error == NotPossibleCheckFrontPanel ) {
-                    PrintStdError( "BulkTransfer()",
-                                   "Is not possible check if the FrontPanel is enabled",
-                                   0,
-                                   error );
-                } else {
-                    PrintStdError( "BulkTransfer()",
-                                   "CheckFrontPanelEnabled() failed",
-                                   0,
-                                   error );
-                }
-            }
-            return ( BulkTransferError + responseLibusb );
-        } else if ( data == NULL ) {
-            PrintStdError( "BulkTransfer()",
-                           "pointer 'data' is NULL" );
+bool OpenOK::MatchesDeviceFilter( const libusb_device_descriptor &descriptorDevice )
+{
+    return ( ( descriptorDevice.idVendor == m_filterVendor ) &&
+             ( ( m_filterProduct == 0 ) || ( descriptorDevice.idProduct == m_filterProduct ) ) );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            return PointerNULL;
-        } else if ( actual_length == NULL ) {
-            PrintStdError( "BulkTransfer()",
-                           "pointer 'actual_length' is NULL" );
+/*
+Enumerates the USB devices and updates the registry. Devices already in the registry keep their cached information.
 
-            return PointerNULL;
-        } else if ( *actual_length < length ) {
-            PrintStdError( "BulkTransfer()",
-                           "libusb_bulk_transfer() failed - lost data",
-                           responseLibusb );
+Returns:
+ErrorCode
+*/
 
-            return BulkTransferError;
-        } else if ( *actual_length > length ) {
-            PrintStdError( "BulkTransfer()",
-                           "libusb_bulk_transfer() failed - overflow data",
-                           responseLibusb );
+OpenOK::ErrorCode OpenOK::RefreshDeviceRegistry()
+{
+    // Hotplug events received so far are superseded by the enumeration
+    ClearHotplugEvents();
 
-            return BulkTransferError;
+    // Get the list of USB devices.
+    const int numUSBDevices = GetListUSB( m_ctx,
+                                          &m_listUSBDevices );
+
+    // Not found USB devices.
+    if ( numUSBDevices <= 0 ) {
+        if ( numUSBDevices < 0 ) {
+            PrintStdError( "RefreshDeviceRegistry()",
+                           "GetListUSB failed",
+                           0,
+                           numUSBDevices );
         }
-    } catch(...) {
-        PrintStdError( "BulkTransfer()",
-                       "catch() - Closing communication" );
+        ClearListOpenOK();
+        return NotFoundUSBDevices;
+    }
 
-        Close( true );
+    std::vector<OpenOK_device> listDevices;
 
-        return CatchError;
+    for ( int idxUSBDevice = 0; idxUSBDevice < numUSBDevices; ++idxUSBDevice ) {
+        libusb_device *device = m_listUSBDevices[ idxUSBDevice ];
+
+        libusb_device_descriptor descriptorDevice;
+
+        // Get descriptor USB device. This is cached by libusb so doesn't need any I/O.
+        if ( GetDeviceDescriptor( device, &descriptorDevice ) < 0 || !MatchesDeviceFilter( descriptorDevice ) ) {
+            continue;
+        }
+
+        if ( listDevices.size() >= ( size_t ) maxUSBDevices ) {
+            break;
+        }
+
+        const int idxRegistry = FindRegistryDevice( device );
+
+        if ( idxRegistry >= 0 ) {
+            // Known device: take over its entry, and the reference held by it
+            listDevices.push_back( m_listOKDevices[ idxRegistry ] );
+            m_listOKDevices[ idxRegistry ].device = NULL;
+        } else {
+            OpenOK_device newDevice;
+            newDevice.device = libusb_ref_device( device );
+            ReadDeviceInfo( newDevice );
+            listDevices.push_back( newDevice );
+        }
     }
 
-    if ( responseLibusb < 0 ) {
-        return LibusbError;
+    // Anything left in the registry has gone
+    ClearListOpenOK();
+
+    for ( unsigned int idxDevice = 0; idxDevice < listDevices.size(); ++idxDevice ) {
+        m_listOKDevices[ idxDevice ] = listDevices[ idxDevice ];
     }
-    return responseLibusb;
+    m_numberOKDevices = listDevices.size();
+
+    ErrorCode responseClearListUSB = ClearListUSB( m_listUSBDevices );
+
+    if ( responseClearListUSB != NoError ) {
+        PrintStdError( "RefreshDeviceRegistry()",
+                       "ClearListUSB failed",
+                       0,
+                       responseClearListUSB );
+    }
+    m_listUSBDevices = NULL;
+
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-// Don't use ControlTransfer here, only OptionalControlTransfer.
-OpenOK::ErrorCode OpenOK::ControlStatus( unsigned int mode )
+/*
+Returns:
+The index of a device in the registry, or -1 if it is not there.
+*/
+
+int OpenOK::FindRegistryDevice( libusb_device *device )
 {
-    unsigned char dataControl[ 1 ] = { 0x00 };
+    for ( int idxDevice = 0; idxDevice < m_numberOKDevices; ++idxDevice ) {
+        if ( m_listOKDevices[ idxDevice ].device == device ) {
+            return idxDevice;
+        }
+    }
+    return -1;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    int responseControl;
+/*
+Reads the device ID, strings and endpoint descriptors of a device into its registry entry.
+The device is opened briefly to do this.
 
-    if ( mode == controlReadMode ) {
-        responseControl = OptionalControlTransfer( m_deviceHandle,
-                                                   mode,
-                                                   0xb2,
-                                                   0x0000,
-                                                   0x0000,
-                                                   dataControl,
-                                                   1,
-                                                   m_timeoutUSB );
+Parameters:
+[in,out] 	currentOpalKellyDevice	registry entry, with the device set
 
-        if ( responseControl == 1 ) {
-            // check for successful status
-            if ( dataControl[ 0 ] == 0x01 ) {
-                return NoError;
-            } else {
-                PrintStdError( "ControlStatus()",
-                               "controlReadMode - invalid response" );
+Returns:
+ErrorCode
+*/
 
-                return ControlStatusInvalidResponse;
+OpenOK::ErrorCode OpenOK::ReadDeviceInfo( OpenOK_device &currentOpalKellyDevice )
+{
+    libusb_device_descriptor descriptorDevice;
+
+    ErrorCode error = GetDeviceDescriptor( currentOpalKellyDevice.device,
+                                           &descriptorDevice );
+
+    if ( error < 0 ) {
+        return error;
+    }
+
+    error = Failed;
+
+    libusb_device_handle *currentHandleDevice = NULL;
+
+    // Open USB device
+    const ErrorCode responseOpen = OpenDeviceUSB( currentOpalKellyDevice.device,
+                                                  &currentHandleDevice );
+
+    if ( ( responseOpen == NoError ) &&
+         ( currentHandleDevice != NULL ) ) {
+
+        char strDeviceID[ OpenOK_device::SSIZE ];
+
+        // Get Device ID
+        const int responseControl = ControlTransfer( currentHandleDevice,
+                                                     controlReadMode,
+                                                     0xb0,
+                                                     0x1fd0,
+                                                     0x0000,
+                                                     reinterpret_cast< unsigned char* >(strDeviceID),
+                                                     32,
+                                                     m_timeoutUSB );
+
+        if ( responseControl >= 0 ) {
+            strncpy( currentOpalKellyDevice.deviceID, strDeviceID, OpenOK_device::SSIZE );
+
+            // Serial
+            GetStringDescriptor( currentOpalKellyDevice.serial, currentHandleDevice, descriptorDevice.iSerialNumber,
+                                 OpenOK_device::SSIZE );
+
+            // Manufacturer
+            GetStringDescriptor( currentOpalKellyDevice.manufacturer, currentHandleDevice, descriptorDevice.iManufacturer,
+                                 OpenOK_device::SSIZE );
+
+            // Product
+            GetStringDescriptor( currentOpalKellyDevice.product, currentHandleDevice, descriptorDevice.iProduct,
+                                 OpenOK_device::SSIZE );
+
+            currentOpalKellyDevice.idVendor           = descriptorDevice.idVendor;
+            currentOpalKellyDevice.idProduct          = descriptorDevice.idProduct;
+            currentOpalKellyDevice.bcdUSB             = descriptorDevice.bcdDevice;
+            currentOpalKellyDevice.bNumConfigurations = descriptorDevice.bNumConfigurations;
+            currentOpalKellyDevice.bDeviceClass       = descriptorDevice.bDeviceClass;
+
+            libusb_config_descriptor* descriptorConfiguration = NULL;
+
+            const ErrorCode responseConfigDesc = GetConfigurationDescriptor( currentOpalKellyDevice.device,
+                                                                             &descriptorConfiguration );
+
+            if ( responseConfigDesc != NoError ) {
+                PrintStdError( "ReadDeviceInfo()",
+                               "GetConfigurationDescriptorListUSB() failed",
+                               0,
+                               responseConfigDesc );
             }
-        } else if ( responseControl < 0 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlReadMode - OptionalControlTransfer() failed",
+
+            if ( descriptorConfiguration != NULL ) {
+                currentOpalKellyDevice.bNumInterfaces = descriptorConfiguration->bNumInterfaces;
+
+                for ( unsigned char i = 0; i < descriptorConfiguration->bNumInterfaces ; ++i ) {
+                    const libusb_interface *interface = &descriptorConfiguration->interface[i];
+
+                    currentOpalKellyDevice.num_altsetting[ i ] = interface->num_altsetting;
+
+                    for ( int j = 0; j < interface->num_altsetting ; ++j ) {
+                        const libusb_interface_descriptor *descriptorInterface = &interface->altsetting[ j ];
+
+                        currentOpalKellyDevice.bInterfaceNumber[ j ] = descriptorInterface->bInterfaceNumber;
+                        currentOpalKellyDevice.bNumEndpoints[ j ] = descriptorInterface->bNumEndpoints;
+
+                        for ( unsigned char k = 0; k < descriptorInterface->bNumEndpoints; ++k ) {
+                            const libusb_endpoint_descriptor* epdesc = &descriptorInterface->endpoint[ k ];
+
+                            currentOpalKellyDevice.bDescriptorType[ k ] = epdesc->bDescriptorType;
+                            currentOpalKellyDevice.bEndpointAddress[ k ] = epdesc->bEndpointAddress;
+                            currentOpalKellyDevice.bInterval[ k ] = epdesc->bInterval;
+                            currentOpalKellyDevice.wMaxPacketSize[ k ] = epdesc->wMaxPacketSize;
+                        }
+                    }
+                }
+
+                // High Speed = 512 bytes
+                // Full Speed = 8, 16, 32 or 64 bytes
+                currentOpalKellyDevice.maxPacketSize = currentOpalKellyDevice.wMaxPacketSize[ 0 ];
+
+                // To calculate multiple of MaxPacketSize.
+                currentOpalKellyDevice.shiftMaxPacketSize = log2( currentOpalKellyDevice.maxPacketSize << 1 );
+
+                if ( FreeConfigurationDescriptor( descriptorConfiguration ) != NoError ) {
+                    PrintStdError( "ReadDeviceInfo()",
+                                   "FreeConfigurationDescriptor() failed" );
+                }
+            } else {
+                currentOpalKellyDevice.bNumInterfaces = 0;
+            }
+
+            currentOpalKellyDevice.cached = true;
+            error = NoError;
+        } else {
+            PrintStdError( "ReadDeviceInfo()",
+                           "ControlTransfer() failed",
                            0,
                            responseControl );
-        } else if ( responseControl < 1 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlReadMode - OptionalControlTransfer() failed - lost data" );
-        } else if ( responseControl > 1 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlReadMode - OptionalControlTransfer() failed - overflow data" );
         }
-    } else if ( mode == controlWriteMode ) {
-        responseControl = OptionalControlTransfer( m_deviceHandle,
-                                                   mode,
-                                                   0xb2,
-                                                   0x0000,
-                                                   0x0000,
-                                                   dataControl,
-                                                   0,
-                                                   m_timeoutUSB );
 
-        if ( responseControl == 0 ) {
-            return NoError;
-        } else if ( responseControl < 0 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlWriteMode - OptionalControlTransfer() failed",
+        if ( CloseDeviceUSB( currentHandleDevice ) != NoError ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "CloseDeviceUSB() failed" );
+        }
+        currentHandleDevice = NULL;
+    } else {
+        if ( currentHandleDevice == NULL ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "pointer 'currentHandleDevice' is NULL" );
+        }
+
+        if ( responseOpen != NoError ) {
+            PrintStdError( "ReadDeviceInfo()",
+                           "OpenDeviceUSB() failed",
                            0,
-                           responseControl );
-        }/* else if ( responseControl < 0 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlWriteMode - OptionalControlTransfer() failed - lost data" );
-        } */else if ( responseControl > 0 ) {
-            PrintStdError( "ControlStatus()",
-                           "controlWriteMode - OptionalControlTransfer() failed - overflow data" );
+                           responseOpen );
         }
     }
-    return CommunicationError;
+
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-// Don't use ControlTransfer here, only OptionalControlTransfer.
-OpenOK::ErrorCode OpenOK::CheckEnable()
+/*
+Registers a hotplug callback for devices matching the filter, if libusb supports hotplug on this platform.
+*/
+
+void OpenOK::RegisterHotplug()
 {
-    unsigned char dataControl[ 2 ] = { 0x00, 0x00 };
+    if ( m_hotplugRegistered || !libusb_has_capability( LIBUSB_CAP_HAS_HOTPLUG ) ) {
+        return;
+    }
 
-    const int responseControl = OptionalControlTransfer( m_deviceHandle,
-                                                         controlReadMode,
-                                                         0xb3,
-                                                         0x0000,
-                                                         0x0000,
-                                                         dataControl,
-                                                         2,
-                                                         m_timeoutUSB );
+    const int responseLibusb = libusb_hotplug_register_callback( m_ctx,
+                                                                 ( libusb_hotplug_event ) ( LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                                                                            LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT ),
+                                                                 LIBUSB_HOTPLUG_NO_FLAGS,
+                                                                 m_filterVendor,
+                                                                 m_filterProduct ? m_filterProduct : LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                 LIBUSB_HOTPLUG_MATCH_ANY,
+                                                                 HotplugCallback,
+                                                                 this,
+                                                                 &m_hotplugHandle );
+
+    if ( responseLibusb != LIBUSB_SUCCESS ) {
+        PrintStdError( "RegisterHotplug()",
+                       "libusb_hotplug_register_callback() failed",
+                       responseLibusb );
+        return;
+    }
+    m_hotplugRegistered = true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( responseControl == 2 ) {
-        // check for successful status
-        if ( ( dataControl[ 0 ] == 0xd7 ) &&
-             ( dataControl[ 1 ] == 0xa5 ) ) {
-            return NoError;
-        } else {
-            PrintStdError( "CheckEnable()",
-                           "invalid response" );
+/*
+Deregisters the hotplug callback. The registry is no longer kept up to date.
+*/
 
-            return CheckEnableInvalidResponse;
-        }
-    } else if ( responseControl < 0 ) {
-        PrintStdError( "CheckEnable()",
-                       "OptionalControlTransfer() failed",
-                       0,
-                       responseControl );
-    } else if ( responseControl > 2 ) {
-        PrintStdError( "CheckEnable()",
-                       "OptionalControlTransfer() failed - overflow data" );
-    } else if ( responseControl < 2 ) {
-        PrintStdError( "CheckEnable()",
-                       "OptionalControlTransfer() failed - lost data" );
+void OpenOK::DeregisterHotplug()
+{
+    if ( m_hotplugRegistered ) {
+        libusb_hotplug_deregister_callback( m_ctx, m_hotplugHandle );
+        m_hotplugRegistered = false;
     }
-    return CommunicationError;
+    ClearHotplugEvents();
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-// Don't use ControlTransfer here, only OptionalControlTransfer.
-OpenOK::ErrorCode OpenOK::CheckDisable()
+/*
+Called by libusb, from libusb_handle_events(), when a matching device arrives or leaves.
+Devices can't be opened from here, so the event is queued for the next call to Get_OK_Devices().
+*/
+
+int LIBUSB_CALL OpenOK::HotplugCallback( libusb_context *, libusb_device *device, libusb_hotplug_event event, void *userData )
 {
-    unsigned char dataControl[ 1 ] = { 0x00 };
+    OpenOK *ok = static_cast<OpenOK *>( userData );
 
-    const int responseControl = OptionalControlTransfer( m_deviceHandle,
-                                                         controlReadMode,
-                                                         0xb8,
-                                                         0x0000,
-                                                         0x0000,
-                                                         dataControl,
-                                                         1,
-                                                         m_timeoutUSB );
+    ok->m_hotplugEvents.push_back( std::make_pair( libusb_ref_device( device ), ( int ) event ) );
 
-    if ( responseControl == 1 ) {
-        // check for successful status
-        if ( dataControl[ 0 ] == 0x00 ) {
-            return NoError;
-        } else {
+    return 0; // stay registered
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Updates the registry from queued hotplug events.
+*/
+
+void OpenOK::ApplyHotplugEvents()
+{
+    for ( unsigned int idxEvent = 0; idxEvent < m_hotplugEvents.size(); ++idxEvent ) {
+        libusb_device *device = m_hotplugEvents[ idxEvent ].first;
+
+        const int idxRegistry = FindRegistryDevice( device );
+
+        if ( m_hotplugEvents[ idxEvent ].second == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT ) {
+            if ( idxRegistry >= 0 ) {
+                libusb_unref_device( m_listOKDevices[ idxRegistry ].device );
+
+                for ( int idxDevice = idxRegistry; idxDevice < m_numberOKDevices - 1; ++idxDevice ) {
+                    m_listOKDevices[ idxDevice ] = m_listOKDevices[ idxDevice + 1 ];
+                }
+                --m_numberOKDevices;
+                m_listOKDevices[ m_numberOKDevices ] = OpenOK_device();
+            }
+        } else if ( ( idxRegistry < 0 ) && ( m_numberOKDevices < maxUSBDevices ) ) {
+            bool left = false;
+
+            // Don't try to open a device which has already gone again
+            for ( unsigned int idxLater = idxEvent + 1; idxLater < m_hotplugEvents.size(); ++idxLater ) {
+                if ( m_hotplugEvents[ idxLater ].first == device ) {
+                    left = true;
+                    break;
+                }
+            }
+
+            if ( !left ) {
+                OpenOK_device &newDevice = m_listOKDevices[ m_numberOKDevices ];
+
+                newDevice = OpenOK_device();
+                newDevice.device = libusb_ref_device( device );
+                ReadDeviceInfo( newDevice );
+                ++m_numberOKDevices;
+            }
+        }
+    }
+    ClearHotplugEvents();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Discards queued hotplug events
+*/
+
+void OpenOK::ClearHotplugEvents()
+{
+    for ( unsigned int idxEvent = 0; idxEvent < m_hotplugEvents.size(); ++idxEvent ) {
+        libusb_unref_device( m_hotplugEvents[ idxEvent ].first );
+    }
+    m_hotplugEvents.clear();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Check is Open
+*/
+
+bool OpenOK::IsOpen()
+{
+    return ( m_deviceHandle != NULL ) || m_emulatedOpen;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Performs a RESET of the FPGA internals. This requires that FrontPanel support be present in the FPGA design because the RESET signal
+actually comes from the FrontPanel Host Interface.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::ResetFPGA()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    static unsigned char dataControl[ 3 ] = { 0x00, 0x01, 0x00 };
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlWriteMode,
+                                                 0xb3,
+                                                 0x0000,
+                                                 0x0000,
+                                                 dataControl,
+                                                 3,
+                                                 m_timeoutUSB );
+
+    if ( responseControl < 0 ) {
+        PrintStdError( "ResetFPGA()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+        return ControlTransferError;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+ResetDeviceUSB resets the specified device by sending a RESET down the port it is connected to.
+
+OBS :Causes re-enumeration: After calling ResetDeviceUSB, the device will need to re-enumerate and thusly,
+requires you to find the new device and open a new handle. The handle used to call libusb_reset_device will no longer work.
+*/
+
+bool OpenOK::ResetDeviceUSB( std::string serial )
+{
+    char stringWait[ 256 ];
+
+    sprintf( stringWait, "Waiting for %02d milliseconds to open the device", WAIT_RESET_MICROSECONDS / 1000 );
+
+    PrintStdError( "ResetDeviceUSB()",
+                   stringWait );
+
+#ifdef QT_CORE_LIB
+    SleepUtil::usleep( WAIT_RESET_MICROSECONDS );
+#else
+    usleep( WAIT_RESET_MICROSECONDS );
+#endif
+
+    ErrorCode responseOpen = OpenBySerial( serial );
+
+    if ( responseOpen == NoError ) {
+        try {
+            if ( m_deviceHandle != NULL ) {
+                // Perform a USB port reset to reinitialize a device.
+                //
+                // The system will attempt to restore the previous configuration and
+                // alternate settings after the reset has completed.
+                //
+                // If the reset fails, the descriptors change,
+                // or the previous state cannot be restored,
+                // the device will appear to be disconnected and reconnected.
+                // This means that the device handle is no longer valid (you should close it) and
+                // rediscover the device. A return code of LIBUSB_ERROR_NOT_FOUND indicates when
+                // this is the case.
+                //
+                // This is a blocking function which usually incurs a noticeable delay.
+                //
+                // libusb_reset_device return :
+                // 0 on success
+                // LIBUSB_ERROR_NOT_FOUND if re-enumeration is required, or if the device has been disconnected
+                // another LIBUSB_ERROR code on other failure
+                const int responseLibusb = libusb_reset_device( m_deviceHandle );
+
+                if ( responseLibusb != LIBUSB_SUCCESS ) {
+                    if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                        Close();
+                    }
+
+                    PrintStdError( "ResetDeviceUSB()",
+                                   "libusb_reset_device() failed",
+                                   responseLibusb );
+
+                    if ( responseLibusb == LIBUSB_ERROR_NOT_FOUND ) {
+                        PrintStdError( "ResetDeviceUSB()",
+                                       "re-enumeration is required - Closing communication" );
+                        Close();
+                    }
+                } else {
+                    PrintStdError( "ResetDeviceUSB()",
+                                   stringWait );
+
+                    // wait re-enumeration
+#ifdef QT_CORE_LIB
+                    SleepUtil::usleep( WAIT_RESET_MICROSECONDS );
+#else
+                    usleep( WAIT_RESET_MICROSECONDS );
+#endif
+                    responseOpen = OpenBySerial( serial );
+
+                    if ( responseOpen == NoError ) {
+                        PrintStdError( "ResetDeviceUSB()",
+                                       "reset successfully!" );
+
+                        return true;
+                    } else {
+                        PrintStdError( "ResetDeviceUSB()",
+                                       "OpenBySerial() failed",
+                                       0,
+                                       responseOpen );
+                    }
+                }
+            } else {
+                PrintStdError( "ResetDeviceUSB()",
+                               "pointer 'm_deviceHandle' is NULL" );
+            }
+        } catch(...) {
+            PrintStdError( "ResetDeviceUSB()",
+                           "catch() - Closing communication" );
+
+            Close( true );
+        }
+    } else {
+        PrintStdError( "ResetDeviceUSB()",
+                       "OpenBySerial() failed",
+                       0,
+                       responseOpen );
+    }
+    return false;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+inline int OpenOK::OptionalControlTransfer( libusb_device_handle *dev_handle,
+                                            uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                                            unsigned char *data, uint16_t wLength, unsigned int timeout )
+{
+    int responseLibusb = 0;
+
+    if ( dev_handle == NULL && !m_emulatedOpen ) {
+        PrintStdError( "OptionalControlTransfer()",
+                       "pointer 'dev_handle' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( data == NULL ) {
+        PrintStdError( "OptionalControlTransfer()",
+                       "pointer 'data' is NULL" );
+
+        return PointerNULL;
+    }
+
+    try {
+        // libusb_control_transfer return :
+        // on success, the number of bytes actually transferred
+        // LIBUSB_ERROR_TIMEOUT if the transfer timed out
+        // LIBUSB_ERROR_PIPE if the control request was not supported by the device
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // another LIBUSB_ERROR code on other failures
+        struct timespec traceStart = { 0, 0 };
+        OpenOK_TransferTrace::Start( &traceStart );
+        responseLibusb = m_transport->ControlTransfer( dev_handle,
+                                                       request_type, bRequest, wValue, wIndex,
+                                                       data, wLength, timeout );
+        TraceControlTransfer( traceStart, request_type, bRequest, wValue, wLength, responseLibusb );
+
+
+        if ( responseLibusb < 0 ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                PrintStdError( "OptionalControlTransfer()",
+                               "libusb_control_transfer() failed - Closing communication",
+                               responseLibusb );
+
+                Close();
+            } else {
+                if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
+                    PrintStdError( "OptionalControlTransfer()",
+                                   "libusb_control_transfer() failed - control request was not supported by the device",
+                                   responseLibusb );
+                } else {
+                    PrintStdError( "OptionalControlTransfer()",
+                                   "libusb_control_transfer() failed",
+                                   responseLibusb );
+                }
+            }
+            return ( ControlTransferError + responseLibusb );
+        } else if ( data == NULL ) {
+            PrintStdError( "OptionalControlTransfer()",
+                           "libusb_control_transfer failed - pointer 'data' is NULL" );
+
+            return PointerNULL;
+        } else if ( responseLibusb < wLength ) {
+            PrintStdError( "OptionalControlTransfer()",
+                           "libusb_control_transfer() failed - lost data" );
+
+            return ControlTransferError;
+        } else if ( responseLibusb > wLength ) {
+            PrintStdError( "OptionalControlTransfer()",
+                           "libusb_control_transfer() failed - overflow data" );
+
+            return ControlTransferError;
+        }
+    } catch(...) {
+        PrintStdError( "OptionalControlTransfer()",
+                       "catch() - Closing communication!" );
+
+        Close( true );
+
+        return CatchError;
+    }
+
+    if ( responseLibusb < 0 ) {
+        return LibusbError;
+    }
+    return responseLibusb;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+inline int OpenOK::OptionalBulkTransfer( libusb_device_handle *dev_handle,
+                                         unsigned char endpoint, unsigned char *data, int length,
+                                         int *actual_length, unsigned int timeout )
+{
+    int responseLibusb = 0;
+
+    if ( dev_handle == NULL && !m_emulatedOpen ) {
+        PrintStdError( "OptionalBulkTransfer()",
+                       "pointer 'dev_handle' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( data == NULL ) {
+        PrintStdError( "OptionalBulkTransfer()",
+                       "pointer 'data' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( actual_length == NULL ) {
+        PrintStdError( "OptionalBulkTransfer()",
+                       "pointer 'actual_length' is NULL" );
+
+        return PointerNULL;
+    }
+
+    try {
+        // The direction of the transfer is inferred from the direction bits of the endpoint address.
+        //
+        // For bulk reads, the length field indicates the maximum length of data you are expecting to receive.
+        // If less data arrives than expected, this function will return that data,
+        // so be sure to check the transferred output parameter.
+        //
+        // You should also check the transferred parameter for bulk writes. Not all of the data may have been written.
+        //
+        // Also check transferred when dealing with a timeout error code.
+        // libusb may have to split your transfer into a number of chunks to satisfy underlying O/S requirements,
+        // meaning that the timeout may expire after the first few chunks have completed.
+        // libusb is careful not to lose any data that may have been transferred;
+        // do not assume that timeout conditions indicate a complete lack of I/O.
+        //
+        // Bulk/interrupt transfer overflows
+        //
+        // When requesting data on a bulk endpoint, libusb requires you to supply a buffer and the maximum number of
+        // bytes of data that libusb can put in that buffer. However, the size of the buffer is not communicated to
+        // the device - the device is just asked to send any amount of data.
+        //
+        // There is no problem if the device sends an amount of data that is less than or equal to the buffer size.
+        // libusb reports this condition to you through the libusb_transfer.actual_length field.
+        //
+        // Problems may occur if the device attempts to send more data than can fit in the buffer.
+        // libusb reports LIBUSB_TRANSFER_OVERFLOW for this condition but other behaviour is largely undefined:
+        // actual_length may or may not be accurate, the chunk of data that can fit in the buffer (before overflow)
+        // may or may not have been transferred.
+        //
+        // Overflows are nasty, but can be avoided. Even though you were told to ignore packets above,
+        // think about the lower level details: each transfer is split into packets (typically small,
+        // with a maximum size of 512 bytes). Overflows can only happen if the final packet in an incoming data transfer is
+        // smaller than the actual packet that the device wants to transfer. Therefore, you will never see an overflow if
+        // your transfer buffer size is a multiple of the endpoint's packet size: the final packet will either fill up
+        // completely or will be only partially filled.
+        //
+        // libusb_bulk_transfer return :
+        // 0 on success (and populates transferred)
+        // LIBUSB_ERROR_TIMEOUT if the transfer timed out (and populates transferred)
+        // LIBUSB_ERROR_PIPE if the endpoint halted
+        // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // another LIBUSB_ERROR code on other failures
+        struct timespec traceStart = { 0, 0 };
+        OpenOK_TransferTrace::Start( &traceStart );
+        responseLibusb = m_transport->BulkTransfer( dev_handle,
+                                                    endpoint, data, length,
+                                                    actual_length, timeout );
+        TraceBulkTransfer( traceStart, endpoint, length, *actual_length, responseLibusb );
+
+        if ( responseLibusb != LIBUSB_SUCCESS ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                PrintStdError( "OptionalBulkTransfer()",
+                               "libusb_bulk_transfer() failed - Closing communication",
+                               responseLibusb );
+
+                Close();
+            } else {
+                if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
+                    PrintStdError( "OptionalBulkTransfer()",
+                                   "libusb_bulk_transfer() failed",
+                                   responseLibusb );
+
+                    if ( data == NULL ) {
+                        PrintStdError( "OptionalBulkTransfer()",
+                                       "pointer 'data' is NULL" );
+
+                        return PointerNULL;
+                    } else if ( *actual_length == length ) {
+                        return NoError;
+                    }
+                } else if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
+                    PrintStdError( "OptionalBulkTransfer()",
+                                   "libusb_bulk_transfer() failed - Cleaning the endpoint halted",
+                                   responseLibusb );
+
+                    // Clear the halt/stall condition for an endpoint.
+                    //
+                    // Endpoints with halt status are unable to receive or transmit data until the halt condition is stalled.
+                    //
+                    // You should cancel all pending transfers before attempting to clear the halt condition.
+                    //
+                    // This is a blocking function.
+                    //
+                    // libusb_clear_halt return :
+                    // 0 on success
+                    // LIBUSB_ERROR_NOT_FOUND if the endpoint does not exist
+                    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+                    // another LIBUSB_ERROR code on other failure
+                    const int responseClearHalt = m_transport->ClearHalt( dev_handle, endpoint );
+
+                    if ( responseClearHalt != LIBUSB_SUCCESS ) {
+                        if ( responseClearHalt == LIBUSB_ERROR_NO_DEVICE ) {
+                            PrintStdError( "OptionalBulkTransfer()",
+                                           "libusb_clear_halt() failed - Closing communication",
+                                           responseClearHalt );
+
+                            Close();
+                        } else {
+                            PrintStdError( "OptionalBulkTransfer()",
+                                           "libusb_clear_halt() failed",
+                                           responseClearHalt );
+                        }
+                    }
+                } else {
+                    PrintStdError( "OptionalBulkTransfer()",
+                                   "libusb_bulk_transfer() failed",
+                                   responseLibusb );
+                }
+            }
+            return ( BulkTransferError + responseLibusb );
+        } else if ( data == NULL ) {
+            PrintStdError( "OptionalBulkTransfer()",
+                           "pointer 'data' is NULL" );
+
+            return PointerNULL;
+        } else if ( actual_length == NULL ) {
+            PrintStdError( "OptionalBulkTransfer()",
+                           "pointer 'actual_length' is NULL" );
+
+            return PointerNULL;
+        } else if ( *actual_length < length ) {
+            PrintStdError( "OptionalBulkTransfer()",
+                           "libusb_bulk_transfer() failed - lost data" );
+
+            return BulkTransferError;
+        } else if ( *actual_length > length ) {
+            PrintStdError( "OptionalBulkTransfer()",
+                           "libusb_bulk_transfer() failed - overflow data" );
+
+            return BulkTransferError;
+        }
+    } catch(...) {
+        PrintStdError( "OptionalBulkTransfer()",
+                       "catch() - Closing communication" );
+
+        Close( true );
+
+        return CatchError;
+    }
+
+    if ( responseLibusb < 0 ) {
+        return LibusbError;
+    }
+    return responseLibusb;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+inline int OpenOK::ControlTransfer( libusb_device_handle *dev_handle,
+                                    uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                                    unsigned char *data, uint16_t wLength, unsigned int timeout )
+{
+    int responseLibusb = 0;
+
+    if ( dev_handle == NULL && !m_emulatedOpen ) {
+        PrintStdError( "ControlTransfer()",
+                       "pointer 'dev_handle' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( data == NULL ) {
+        PrintStdError( "ControlTransfer()",
+                       "pointer 'data' is NULL" );
+
+        return PointerNULL;
+    }
+
+    try {
+        // libusb_control_transfer return :
+        // on success, the number of bytes actually transferred
+        // LIBUSB_ERROR_TIMEOUT if the transfer timed out
+        // LIBUSB_ERROR_PIPE if the control request was not supported by the device
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // another LIBUSB_ERROR code on other failures
+        struct timespec traceStart = { 0, 0 };
+        OpenOK_TransferTrace::Start( &traceStart );
+        responseLibusb = m_transport->ControlTransfer( dev_handle,
+                                                       request_type, bRequest, wValue, wIndex,
+                                                       data, wLength, timeout );
+        TraceControlTransfer( traceStart, request_type, bRequest, wValue, wLength, responseLibusb );
+
+        if ( responseLibusb < 0 ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                PrintStdError( "ControlTransfer()",
+                               "libusb_control_transfer() failed - Closing communication",
+                               responseLibusb );
+
+                Close();
+            } else {
+                if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
+                    PrintStdError( "ControlTransfer()",
+                                   "libusb_control_transfer() failed - control request was not supported by the device",
+                                   responseLibusb );
+                } else {
+                    PrintStdError( "ControlTransfer()",
+                                   "libusb_control_transfer() failed",
+                                   responseLibusb );
+                }
+
+                ErrorCode error = CheckFrontPanelEnabled();
+
+                if ( error != NoError ) {
+                    if ( error == FrontPanelDisabled ) {
+                        PrintStdError( "ControlTransfer()",
+                                       "FrontPanel disabled - Closing communication",
+                                       0,
+                                       error );
+
+                        Close();
+                    } else if ( error == NotPossibleCheckFrontPanel ) {
+                        PrintStdError( "ControlTransfer()",
+                                       "Is not possible check if the FrontPanel is enabled",
+                                       0,
+                                       error );
+                    } else {
+                        PrintStdError( "ControlTransfer()",
+                                       "CheckFrontPanelEnabled() failed",
+                                       0,
+                                       error );
+                    }
+                }
+            }
+            return ( ControlTransferError + responseLibusb );
+        } else if ( data == NULL ) {
+            PrintStdError( "ControlTransfer()",
+                           "libusb_control_transfer failed - pointer 'data' is NULL" );
+
+            return PointerNULL;
+        } else if ( responseLibusb < wLength ) {
+            PrintStdError( "ControlTransfer()",
+                           "libusb_control_transfer() failed - lost data" );
+
+            return ControlTransferError;
+        } else if ( responseLibusb > wLength ) {
+            PrintStdError( "ControlTransfer()",
+                           "libusb_control_transfer() failed - overflow data" );
+
+            return ControlTransferError;
+        }
+    } catch(...) {
+        PrintStdError( "ControlTransfer()",
+                       "catch() - Closing communication" );
+
+        Close( true );
+
+        return CatchError;
+    }
+
+    if ( responseLibusb < 0 ) {
+        return LibusbError;
+    }
+    return responseLibusb;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+inline int OpenOK::BulkTransfer( libusb_device_handle *dev_handle,
+                                 unsigned char endpoint, unsigned char *data, int length,
+                                 int *actual_length, unsigned int timeout )
+{
+    int responseLibusb = 0;
+
+    if ( dev_handle == NULL && !m_emulatedOpen ) {
+        PrintStdError( "BulkTransfer()",
+                       "pointer 'dev_handle' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( data == NULL ) {
+        PrintStdError( "BulkTransfer()",
+                       "pointer 'data' is NULL" );
+
+        return PointerNULL;
+    }
+
+    if ( actual_length == NULL ) {
+        PrintStdError( "BulkTransfer()",
+                       "pointer 'actual_length' is NULL" );
+
+        return PointerNULL;
+    }
+
+    try {
+        // The direction of the transfer is inferred from the direction bits of the endpoint address.
+        //
+        // For bulk reads, the length field indicates the maximum length of data you are expecting to receive.
+        // If less data arrives than expected, this function will return that data,
+        // so be sure to check the transferred output parameter.
+        //
+        // You should also check the transferred parameter for bulk writes. Not all of the data may have been written.
+        //
+        // Also check transferred when dealing with a timeout error code.
+        // libusb may have to split your transfer into a number of chunks to satisfy underlying O/S requirements,
+        // meaning that the timeout may expire after the first few chunks have completed.
+        // libusb is careful not to lose any data that may have been transferred;
+        // do not assume that timeout conditions indicate a complete lack of I/O.
+        //
+        // Bulk/interrupt transfer overflows
+        //
+        // When requesting data on a bulk endpoint, libusb requires you to supply a buffer and the maximum number of
+        // bytes of data that libusb can put in that buffer. However, the size of the buffer is not communicated to
+        // the device - the device is just asked to send any amount of data.
+        //
+        // There is no problem if the device sends an amount of data that is less than or equal to the buffer size.
+        // libusb reports this condition to you through the libusb_transfer.actual_length field.
+        //
+        // Problems may occur if the device attempts to send more data than can fit in the buffer.
+        // libusb reports LIBUSB_TRANSFER_OVERFLOW for this condition but other behaviour is largely undefined:
+        // actual_length may or may not be accurate, the chunk of data that can fit in the buffer (before overflow)
+        // may or may not have been transferred.
+        //
+        // Overflows are nasty, but can be avoided. Even though you were told to ignore packets above,
+        // think about the lower level details: each transfer is split into packets (typically small,
+        // with a maximum size of 512 bytes). Overflows can only happen if the final packet in an incoming data transfer is
+        // smaller than the actual packet that the device wants to transfer. Therefore, you will never see an overflow if
+        // your transfer buffer size is a multiple of the endpoint's packet size: the final packet will either fill up
+        // completely or will be only partially filled.
+        //
+        // libusb_bulk_transfer return :
+        // 0 on success (and populates transferred)
+        // LIBUSB_ERROR_TIMEOUT if the transfer timed out (and populates transferred)
+        // LIBUSB_ERROR_PIPE if the endpoint halted
+        // LIBUSB_ERROR_OVERFLOW if the device offered more data, see Packets and overflows
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // another LIBUSB_ERROR code on other failures
+        struct timespec traceStart = { 0, 0 };
+        OpenOK_TransferTrace::Start( &traceStart );
+        responseLibusb = m_transport->BulkTransfer( dev_handle,
+                                                    endpoint, data, length,
+                                                    actual_length, timeout );
+        TraceBulkTransfer( traceStart, endpoint, length, *actual_length, responseLibusb );
+
+        if ( responseLibusb != LIBUSB_SUCCESS ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                PrintStdError( "BulkTransfer()",
+                               "libusb_bulk_transfer() failed - Closing communication",
+                               responseLibusb );
+
+                Close();
+            } else {
+                if ( responseLibusb == LIBUSB_ERROR_TIMEOUT ) {
+                    PrintStdError( "BulkTransfer()",
+                                   "libusb_bulk_transfer() failed",
+                                   responseLibusb );
+
+                    if ( data == NULL ) {
+                        PrintStdError( "BulkTransfer()",
+                                       "pointer 'data' is NULL" );
+
+                        return PointerNULL;
+                    } else if ( *actual_length == length ) {
+                        return NoError;
+                    }
+                } else if ( responseLibusb == LIBUSB_ERROR_PIPE ) {
+                    PrintStdError( "BulkTransfer()",
+                                   "libusb_bulk_transfer() failed - Cleaning the endpoint halted",
+                                   responseLibusb );
+
+                    // Clear the halt/stall condition for an endpoint.
+                    //
+                    // Endpoints with halt status are unable to receive or transmit data until the halt condition is stalled.
+                    //
+                    // You should cancel all pending transfers before attempting to clear the halt condition.
+                    //
+                    // This is a blocking function.
+                    //
+                    // libusb_clear_halt return :
+                    // 0 on success
+                    // LIBUSB_ERROR_NOT_FOUND if the endpoint does not exist
+                    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+                    // another LIBUSB_ERROR code on other failure
+                    const int responseClearHalt = m_transport->ClearHalt( dev_handle, endpoint );
+
+                    if ( responseClearHalt != LIBUSB_SUCCESS ) {
+                        if ( responseClearHalt == LIBUSB_ERROR_NO_DEVICE ) {
+                            PrintStdError( "BulkTransfer()",
+                                           "libusb_clear_halt() failed - Closing communication",
+                                           responseClearHalt );
+
+                            Close();
+                        } else {
+                            PrintStdError( "BulkTransfer()",
+                                           "libusb_clear_halt() failed",
+                                           responseClearHalt );
+                        }
+                    }
+                } else {
+                    PrintStdError( "BulkTransfer()",
+                                   "libusb_bulk_transfer() failed",
+                                   responseLibusb );
+                }
+
+                ErrorCode error = CheckFrontPanelEnabled();
+
+                if ( error == FrontPanelDisabled ) {
+                    PrintStdError( "BulkTransfer()",
+                                   "FrontPanel disabled! Closing communication",
+                                   0,
+                                   error );
+
+                    Close();
+                } else if ( error == NotPossibleCheckFrontPanel ) {
+                    PrintStdError( "BulkTransfer()",
+                                   "Is not possible check if the FrontPanel is enabled",
+                                   0,
+                                   error );
+                } else {
+                    PrintStdError( "BulkTransfer()",
+                                   "CheckFrontPanelEnabled() failed",
+                                   0,
+                                   error );
+                }
+            }
+            return ( BulkTransferError + responseLibusb );
+        } else if ( data == NULL ) {
+            PrintStdError( "BulkTransfer()",
+                           "pointer 'data' is NULL" );
+
+            return PointerNULL;
+        } else if ( actual_length == NULL ) {
+            PrintStdError( "BulkTransfer()",
+                           "pointer 'actual_length' is NULL" );
+
+            return PointerNULL;
+        } else if ( *actual_length < length ) {
+            PrintStdError( "BulkTransfer()",
+                           "libusb_bulk_transfer() failed - lost data",
+                           responseLibusb );
+
+            return BulkTransferError;
+        } else if ( *actual_length > length ) {
+            PrintStdError( "BulkTransfer()",
+                           "libusb_bulk_transfer() failed - overflow data",
+                           responseLibusb );
+
+            return BulkTransferError;
+        }
+    } catch(...) {
+        PrintStdError( "BulkTransfer()",
+                       "catch() - Closing communication" );
+
+        Close( true );
+
+        return CatchError;
+    }
+
+    if ( responseLibusb < 0 ) {
+        return LibusbError;
+    }
+    return responseLibusb;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// Don't use ControlTransfer here, only OptionalControlTransfer.
+OpenOK::ErrorCode OpenOK::ControlStatus( unsigned int mode )
+{
+    unsigned char dataControl[ 1 ] = { 0x00 };
+
+    int responseControl;
+
+    if ( mode == controlReadMode ) {
+        responseControl = OptionalControlTransfer( m_deviceHandle,
+                                                   mode,
+                                                   0xb2,
+                                                   0x0000,
+                                                   0x0000,
+                                                   dataControl,
+                                                   1,
+                                                   m_timeoutUSB );
+
+        if ( responseControl == 1 ) {
+            // check for successful status
+            if ( dataControl[ 0 ] == 0x01 ) {
+                return NoError;
+            } else {
+                PrintStdError( "ControlStatus()",
+                               "controlReadMode - invalid response" );
+
+                return ControlStatusInvalidResponse;
+            }
+        } else if ( responseControl < 0 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlReadMode - OptionalControlTransfer() failed",
+                           0,
+                           responseControl );
+        } else if ( responseControl < 1 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlReadMode - OptionalControlTransfer() failed - lost data" );
+        } else if ( responseControl > 1 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlReadMode - OptionalControlTransfer() failed - overflow data" );
+        }
+    } else if ( mode == controlWriteMode ) {
+        responseControl = OptionalControlTransfer( m_deviceHandle,
+                                                   mode,
+                                                   0xb2,
+                                                   0x0000,
+                                                   0x0000,
+                                                   dataControl,
+                                                   0,
+                                                   m_timeoutUSB );
+
+        if ( responseControl == 0 ) {
+            return NoError;
+        } else if ( responseControl < 0 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlWriteMode - OptionalControlTransfer() failed",
+                           0,
+                           responseControl );
+        }/* else if ( responseControl < 0 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlWriteMode - OptionalControlTransfer() failed - lost data" );
+        } */else if ( responseControl > 0 ) {
+            PrintStdError( "ControlStatus()",
+                           "controlWriteMode - OptionalControlTransfer() failed - overflow data" );
+        }
+    }
+    return CommunicationError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// Don't use ControlTransfer here, only OptionalControlTransfer.
+OpenOK::ErrorCode OpenOK::CheckEnable()
+{
+    unsigned char dataControl[ 2 ] = { 0x00, 0x00 };
+
+    const int responseControl = OptionalControlTransfer( m_deviceHandle,
+                                                         controlReadMode,
+                                                         0xb3,
+                                                         0x0000,
+                                                         0x0000,
+                                                         dataControl,
+                                                         2,
+                                                         m_timeoutUSB );
+
+    if ( responseControl == 2 ) {
+        // check for successful status
+        if ( ( dataControl[ 0 ] == 0xd7 ) &&
+             ( dataControl[ 1 ] == 0xa5 ) ) {
+            return NoError;
+        } else {
+            PrintStdError( "CheckEnable()",
+                           "invalid response" );
+
+            return CheckEnableInvalidResponse;
+        }
+    } else if ( responseControl < 0 ) {
+        PrintStdError( "CheckEnable()",
+                       "OptionalControlTransfer() failed",
+                       0,
+                       responseControl );
+    } else if ( responseControl > 2 ) {
+        PrintStdError( "CheckEnable()",
+                       "OptionalControlTransfer() failed - overflow data" );
+    } else if ( responseControl < 2 ) {
+        PrintStdError( "CheckEnable()",
+                       "OptionalControlTransfer() failed - lost data" );
+    }
+    return CommunicationError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// Don't use ControlTransfer here, only OptionalControlTransfer.
+OpenOK::ErrorCode OpenOK::CheckDisable()
+{
+    unsigned char dataControl[ 1 ] = { 0x00 };
+
+    const int responseControl = OptionalControlTransfer( m_deviceHandle,
+                                                         controlReadMode,
+                                                         0xb8,
+                                                         0x0000,
+                                                         0x0000,
+                                                         dataControl,
+                                                         1,
+                                                         m_timeoutUSB );
+
+    if ( responseControl == 1 ) {
+        // check for successful status
+        if ( dataControl[ 0 ] == 0x00 ) {
+            return NoError;
+        } else {
             PrintStdError( "CheckDisable()",
                            "invalid response" );
 
-            return CheckDisableInvalidResponse;
-        }
-    } else if ( responseControl < 0 ) {
-        PrintStdError( "CheckDisable()",
-                       "OptionalControlTransfer() failed",
-                       0 ,
+            return CheckDisableInvalidResponse;
+        }
+    } else if ( responseControl < 0 ) {
+        PrintStdError( "CheckDisable()",
+                       "OptionalControlTransfer() failed",
+                       0 ,
+                       responseControl );
+    } else if ( responseControl < 1 ) {
+        PrintStdError( "CheckDisable()",
+                       "OptionalControlTransfer() failed - lost data" );
+    } else if ( responseControl > 1 ) {
+        PrintStdError( "CheckDisable()",
+                       "OptionalControlTransfer() failed - overflow data" );
+    }
+    return CommunicationError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method checks to see if the FrontPanel Host Interface has been instantiated in the FPGA design.
+If it is detected, FrontPanel support is enabled and endpoint functionality is available.
+
+Returns:
+True is FrontPanel support is present, false otherwise.
+*/
+
+bool OpenOK::IsFrontPanelEnabled()
+{
+    return ( CheckFrontPanelEnabled() == NoError );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Check if the FrontPanel is enabled.
+
+Return:
+ErroCode
+*/
+
+OpenOK::ErrorCode OpenOK::CheckFrontPanelEnabled()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    ErrorCode error = ControlStatus( controlReadMode );
+
+    if ( error == NoError ) {
+        error = CheckEnable();
+
+        if ( error != NoError ) {
+            if ( error == CheckEnableInvalidResponse ) {
+                return FrontPanelDisabled;
+            } else if ( error == CommunicationError ) {
+                return NotPossibleCheckFrontPanel;
+            } else {
+                PrintStdError( "CheckFrontPanelEnabled()",
+                               "CheckEnable() failed - Unknown error",
+                               0,
+                               error );
+            }
+        }
+    } else if ( error == CommunicationError ) {
+        return NotPossibleCheckFrontPanel;
+    } else if ( error == ControlStatusInvalidResponse ) {
+        return FrontPanelDisabled;
+    } else {
+        PrintStdError( "CheckFrontPanelEnabled()",
+                       "ControlStatus() failed - Unknown error",
+                       0,
+                       error );
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Release an interface previously claimed with libusb_claim_interface().
+
+Return:
+ErroCode
+*/
+
+OpenOK::ErrorCode OpenOK::ReleaseInterface()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    try {
+        int responseLibusb = LIBUSB_SUCCESS;
+
+        // Release an interface previously claimed with libusb_claim_interface().
+        // You should release all claimed interfaces before closing a device handle.
+        // libusb_release_interface return LIBUSB_ERROR_NOT_FOUND if the interface was not claimed
+        //
+        // libusb_release_interface return :
+        // 0 on success
+        // LIBUSB_ERROR_NOT_FOUND if the interface was not claimed
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // another LIBUSB_ERROR code on other failure
+        responseLibusb = libusb_release_interface( m_deviceHandle, m_interfaceDesired );
+
+        if ( responseLibusb != LIBUSB_SUCCESS ) {
+            // if the interface was not claimed
+            if ( responseLibusb != LIBUSB_ERROR_NOT_FOUND ) {
+                PrintStdError( "ReleaseInterface()",
+                               "libusb_release_interface() failed",
+                               responseLibusb );
+            }
+        }
+#ifdef  __linux
+        // libusb_kernel_driver_active return :
+        // 0 if no kernel driver is active
+        // 1 if a kernel driver is active
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // LIBUSB_ERROR_NOT_SUPPORTED on platforms where the functionality is not available
+        // another LIBUSB_ERROR code on other failure
+        if ( ( responseLibusb = libusb_kernel_driver_active( m_deviceHandle, m_interfaceDesired ) ) == 1 ) {
+            // Detach a kernel driver from an interface.
+            // If successful, you will then be able to claim the interface and perform I/O.
+            // This functionality is not available on Darwin or Windows.
+            // Note that libusb itself also talks to the device through a special kernel driver,
+            // if this driver is already attached to the device, this call will not detach it and return LIBUSB_ERROR_NOT_FOUND.
+            // Detach a kernel driver from interface 0
+
+            // libusb_detach_kernel_driver return :
+            // 0 on success
+            // LIBUSB_ERROR_NOT_FOUND if no kernel driver was active
+            // LIBUSB_ERROR_INVALID_PARAM if the interface does not exist
+            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+            // LIBUSB_ERROR_NOT_SUPPORTED on platforms where the functionality is not available
+            // another LIBUSB_ERROR code on other failure
+            if ( ( responseLibusb = libusb_detach_kernel_driver( m_deviceHandle, m_interfaceDesired ) ) != LIBUSB_SUCCESS ) {
+                PrintStdError( "ReleaseInterface()",
+                               "libusb_detach_kernel_driver() failed",
+                               responseLibusb );
+            }
+        } else {
+            if ( responseLibusb < 0 ) {
+                PrintStdError( "ReleaseInterface()",
+                               "libusb_kernel_driver_active() failed",
+                               responseLibusb );
+            }
+        }
+#endif
+
+        if ( responseLibusb < 0 ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                return DeviceNotOpen;
+            }
+            return LibusbError;
+        }
+    } catch(...) {
+        PrintStdError( "ReleaseInterface()",
+                       "catch()" );
+
+        return CatchError;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Before any communication with the device can proceed, the device must be opened using this method.
+A Close() method is not provided and is not necessary.
+A device is opened matching the given device ID string
+If no device ID (or an empty string) is provided, then the first appropriate device is opened.
+
+Python and Java Note: To open the first available device, you must provide an empty string.
+
+Parameters:
+[in] 	str 	The device ID of the device to open.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::OpenByDeviceID( std::string str )
+{
+    Close();
+
+    bool device_found = false;
+
+    int numDevices = 0;
+
+    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+
+    if ( responseGetOKDevices != NoError ) {
+        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+            PrintStdError( "OpenByDeviceID()",
+                           "Get_OK_Devices() failed",
+                           0,
+                           responseGetOKDevices );
+        }
+        return responseGetOKDevices;
+    }
+
+    if ( numDevices > 0 ) {
+        if ( str == "" ) {
+            m_indexOpenedDevice = 0;
+            device_found = true;
+        } else {
+            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
+                if ( str == m_listOKDevices[ m_indexOpenedDevice ].deviceID ) {
+                    device_found = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if ( !device_found ) {
+        m_indexOpenedDevice = 0;
+        return NotFoundDeviceStringID;
+    }
+    return OpenByDeviceIndexList( m_indexOpenedDevice );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Before any communication with the device can proceed, the device must be opened using this method.
+A Close() method is not provided and is not necessary.
+A device is opened matching the given serial number string.
+If no serial number (or an empty string) is provided, then the first appropriate device is opened.
+
+Python and Java Note: To open the first available device, you must provide an empty string.
+
+Parameters:
+[in] 	str 	The serial number of the device to open.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::OpenBySerial( std::string str )
+{
+    Close();
+
+    bool device_found = false;
+
+    int numDevices = 0;
+
+    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+
+    if ( responseGetOKDevices != NoError ) {
+        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+            PrintStdError( "OpenBySerial()",
+                           "Get_OK_Devices() failed",
+                           0,
+                           responseGetOKDevices );
+        }
+        return responseGetOKDevices;
+    }
+
+    if ( numDevices > 0 ) {
+        if ( str == "" ) {
+            m_indexOpenedDevice = 0;
+            device_found = true;
+        } else {
+            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
+                if ( str == m_listOKDevices[ m_indexOpenedDevice ].serial ) {
+                    device_found = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if ( !device_found ) {
+        m_indexOpenedDevice = 0;
+        return NotFoundDeviceStringSerial;
+    }
+    return OpenByDeviceIndexList( m_indexOpenedDevice );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Before any communication with the device can proceed, the device must be opened using this method.
+A Close() method is not provided and is not necessary.
+
+Parameters:
+[in] 	indexDeviceList 	The position of list devices to open.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::OpenByDeviceIndexList( unsigned int indexDeviceList )
+{
+    if ( m_transport->IsEmulated() ) {
+        Close();
+
+        m_emulatedOpen = true;
+        m_transport->DeviceOpened( m_listOKDevices[ indexDeviceList ] );
+
+        const ErrorCode error = CheckOpenedDevice();
+
+        if ( error != NoError ) {
+            Close();
+            return error;
+        }
+
+        m_shiftMaxPacketSize = m_listOKDevices[ indexDeviceList ].shiftMaxPacketSize;
+        m_maxPacketSize = m_listOKDevices[ indexDeviceList ].maxPacketSize;
+        return NoError;
+    }
+
+    if ( !m_libusbInitialization ) {
+        return LibusbNotInitialization;
+    }
+
+    BoardModel boardModel;
+
+    std::string boardName;
+
+    int responseLibusb = LIBUSB_SUCCESS;
+    int responseLibusbSetConfiguration = LIBUSB_SUCCESS;
+    int responseLibusbGetConfiguration = LIBUSB_SUCCESS;
+
+    Close();
+
+    ErrorCode responseOpen = OpenDeviceUSB( m_listOKDevices[ indexDeviceList ].device,
+                                            &m_deviceHandle );
+
+    if ( responseOpen != NoError ) {
+        PrintStdError( "OpenByDeviceIndexList()",
+                       "OpenDeviceUSB() failed",
+                       0,
+                       responseOpen );
+
+        return DeviceNotOpen;
+    }
+
+    OpenOK::ErrorCode error = NoError;
+
+    // need to send setup packet on endpoint 0x00
+    // packet is 0x00 09 01 00 00 00 00 00
+    // libusb provides a convenient function usb_set_configuration for this
+
+    int configurationRead = 0;
+
+    ReleaseInterface();
+
+    // libusb_get_configuration retun :
+    // 0 on success
+    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+    // another LIBUSB_ERROR code on other failure
+    responseLibusbGetConfiguration = libusb_get_configuration( m_deviceHandle, &configurationRead );
+
+    if ( responseLibusbGetConfiguration == LIBUSB_SUCCESS ) {
+        // When libusb presents a device handle to an application, there is a chance that the corresponding
+        // device may be in unconfigured state. For devices with multiple configurations, there is also a chance
+        // that the configuration currently selected is not the one that the application wants to use.
+        //
+        // The obvious solution is to add a call to libusb_set_configuration() early on during your device
+        // initialization routines, but there are caveats to be aware of:
+        //
+        // 1) If the device is already in the desired configuration, calling libusb_set_configuration()
+        // using the same configuration value will cause a lightweight device reset.
+        // This may not be desirable behaviour.
+        // 2) libusb will be unable to change configuration if the device is in another configuration
+        // and other programs or drivers have claimed interfaces under that configuration.
+        // 3) In the case where the desired configuration is already active, libusb may not even be able to
+        // perform a lightweight device reset. For example, take my USB keyboard with fingerprint reader:
+        // I'm interested in driving the fingerprint reader interface through libusb,
+        // but the kernel's USB-HID driver will almost always have claimed the keyboard interface.
+        // Because the kernel has claimed an interface, it is not even possible to perform the lightweight device reset,
+        // so libusb_set_configuration() will fail. (Luckily the device in question only has a single configuration.)
+        if ( configurationRead != m_configurationDesired ) {
+            // libusb_set_configuration return :
+            // 0 on success
+            // LIBUSB_ERROR_NOT_FOUND if the requested configuration does not exist
+            // LIBUSB_ERROR_BUSY if interfaces are currently claimed
+            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+            // another LIBUSB_ERROR code on other failure
+            responseLibusbSetConfiguration = libusb_set_configuration( m_deviceHandle, m_configurationDesired );
+
+            // TODO : remove BUSY test
+            if ( responseLibusbSetConfiguration == LIBUSB_ERROR_BUSY ) {
+                responseLibusbSetConfiguration = LIBUSB_SUCCESS;
+            }
+        }
+    }
+
+    if ( ( responseLibusbSetConfiguration == LIBUSB_SUCCESS ) &&
+         ( responseLibusbGetConfiguration == LIBUSB_SUCCESS ) ) {
+
+        // claim interface 0
+        //
+        // Claiming of interfaces is a purely logical operation; it does not cause any requests to be sent over the bus.
+        // Interface claiming is used to instruct the underlying operating system that your application wishes to
+        // take ownership of the interface.
+        //
+        // Claim = One possible way to lock your device into a specific configuration,
+        //
+        // You cannot change/reset configuration if other applications or drivers have claimed interfaces.
+        //
+        // libusb_claim_interface return :
+        // 0 on success
+        // LIBUSB_ERROR_NOT_FOUND if the requested interface does not exist
+        // LIBUSB_ERROR_BUSY if another program or driver has claimed the interface
+        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
+        // a LIBUSB_ERROR code on other failure
+        responseLibusb = libusb_claim_interface(m_deviceHandle, m_interfaceDesired );
+
+        // TODO : remove BUSY test
+        if ( responseLibusb == LIBUSB_ERROR_BUSY ) {
+            responseLibusb = LIBUSB_SUCCESS;
+        }
+
+        if ( responseLibusb == LIBUSB_SUCCESS ) {
+
+            m_transport->DeviceOpened( m_listOKDevices[ indexDeviceList ] );
+
+            error = CheckOpenedDevice();
+        } else {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                Close();
+            }
+
+            PrintStdError( "OpenByDeviceIndexList()",
+                           "libusb_claim_interface() failed",
+                           responseLibusb );
+
+            error = ClaimInterfaceError;
+        }
+    } else {
+        if ( responseLibusbGetConfiguration != LIBUSB_SUCCESS ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                Close();
+            }
+
+            PrintStdError( "OpenByDeviceIndexList()",
+                           "libusb_get_configuration() failed",
+                           responseLibusbGetConfiguration );
+
+            error = GetConfigurationError;
+        }
+        if ( responseLibusbSetConfiguration != LIBUSB_SUCCESS ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                Close();
+            }
+
+            PrintStdError( "OpenByDeviceIndexList()",
+                           "libusb_set_configuration() failed",
+                           responseLibusbSetConfiguration );
+
+            error = SetConfigurationError;
+        }
+    }
+
+    if ( error == NoError ) {
+        boardModel = GetBoardModel();
+
+        boardName = GetBoardModelString( boardModel );
+
+        if ( boardName == "XEM3005" ) {
+            m_crystalReference = 48.0;//Mhz
+        }
+
+        m_shiftMaxPacketSize = m_listOKDevices[ indexDeviceList ].shiftMaxPacketSize;
+
+        m_maxPacketSize = m_listOKDevices[ indexDeviceList ].maxPacketSize;
+    }
+
+    if ( error != NoError ) {
+        Close();
+    }
+    return error;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Sends the request which the Opal Kelly library sends when it opens a device, and checks the response.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::CheckOpenedDevice()
+{
+    OpenOK::ErrorCode error = NoError;
+
+    // need to send USB_CONTROL packet, 0xc0:b9 00 00 00 00 01 00
+    // this is copied from a capture of traffic when using the official interface library
+    // don't know what this request is, but it returns a byte of 0x80 when called by real library
+    // request_type = 0xc0 = USB_DIR_HOST & USB_TYPE_VENDOR
+
+    unsigned char dataControl[ 1 ] = { 0x00 };
+
+    // should read 1 byte
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlReadMode,
+                                                 0xb9,
+                                                 0x0000,
+                                                 0x0000,
+                                                 dataControl,
+                                                 1,
+                                                 m_timeoutUSB );
+
+    if ( responseControl >= 0 ) {
+        if ( responseControl == 1 ) {
+            if ( ( dataControl[ 0 ] == 0x80 ) ||
+                 ( dataControl[ 0 ] == 0x00 ) ) {
+                error = NoError;
+            } else {
+                //device did not return 0x00 or 0x80
+
+                PrintStdError( "CheckOpenedDevice()",
+                               "invalid response" );
+
+                error = OpenByDeviceIndexListInvalidResponse;
+            }
+        } else {
+            if ( responseControl < 1 ) {
+                PrintStdError( "OptionalControlTransfer()",
+                               "libusb_control_transfer() failed - lost data" );
+            } else if ( responseControl > 1 ) {
+                PrintStdError( "OptionalControlTransfer()",
+                               "libusb_control_transfer() failed - overflow data" );
+            }
+            error = ControlTransferError;
+        }
+    } else {
+        PrintStdError( "CheckOpenedDevice()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+
+        error = ControlTransferError;
+    }
+    return error;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Close device opened
+*/
+
+void OpenOK::Close( bool force )
+{
+    if ( !IsOpen() ) {
+        return;
+    }
+
+    memset( m_wireIns, 0, OpenOK::WIREINSIZE );
+    memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
+
+    if ( m_emulatedOpen ) {
+        m_emulatedOpen = false;
+        return;
+    }
+
+    if ( !force ) {
+        CancelPipeTransfers();
+    }
+
+    if ( force ) {
+        PrintStdError( "Close()",
+                       "Forcing close communication!" );
+    } else {
+        const ErrorCode responseRelease = ReleaseInterface();
+
+        if ( responseRelease != NoError ) {
+            PrintStdError( "Close() - ReleaseInterface()",
+                           "",
+                           0,
+                           responseRelease );
+        }
+
+        const ErrorCode responseCloseDevice = CloseDeviceUSB( m_deviceHandle );
+
+        if ( responseCloseDevice != NoError ) {
+            PrintStdError( "Close() - CloseDeviceUSB()",
+                           "",
+                           0,
+                           responseCloseDevice );
+        }
+    }
+    m_deviceHandle = NULL;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Configures the on-board PLL using the default configuration setup in the EEPROM. If the specific device does not support this,
+the method returns error code UnsupportedFeature.
+
+Returns:
+ErrorCode
+*/
+
+OpenOK::ErrorCode OpenOK::LoadDefaultPLLConfiguration()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    OpenOK_CPLL22150 *pllDefaultCofiguration = new OpenOK_CPLL22150;
+
+    ErrorCode result = NoError;
+
+    result = GetEepromPLL22150Configuration(*pllDefaultCofiguration);
+
+    if ( result == NoError ) {
+        result = SetPLL22150Configuration(*pllDefaultCofiguration);
+    }
+
+    delete pllDefaultCofiguration;
+
+    return result;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Queries the USB to determine how many Opal Kelly devices are attached. This method also builds a list of serial numbers and
+board models which can subsequently be queried using the methods GetDeviceListSerial() and GetDeviceListModel(), respectively.
+
+Returns:
+The number of devices attached.
+*/
+
+int OpenOK::GetDeviceCount()
+{
+    Close();
+
+    int numDevices = 0;
+
+    ErrorCode responseGetOKDevices = Get_OK_Devices( true, numDevices );
+
+    if ( responseGetOKDevices != NoError ) {
+        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+            PrintStdError( "GetDeviceCount()",
+                           "Get_OK_Devices() failed",
+                           0,
+                           responseGetOKDevices );
+        }
+        return responseGetOKDevices;
+    }
+    return numDevices;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns:
+Descriptor language of device
+*/
+
+int OpenOK::GetLanguageID( libusb_device_handle *handle )
+{
+    unsigned char strLangID[ 255 ];
+
+    if ( handle == NULL ) {
+        PrintStdError( "GetLanguageID()",
+                       "pointer 'handle' is NULL" );
+        return PointerNULL;
+    }
+
+    try {
+        // Read Language ID
+        //
+        // libusb_get_string_descriptor return :number of bytes returned in data, or LIBUSB_ERROR code on failure
+        int responseLibusb = libusb_get_string_descriptor( handle,
+                                                           0x00,
+                                                           0x00,
+                                                           strLangID,
+                                                           sizeof( strLangID ) );
+
+        if ( responseLibusb < 0 ) {
+            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
+                Close();
+            }
+
+            PrintStdError( "GetLanguageID()",
+                           "libusb_get_string_descriptor() failed",
+                           responseLibusb );
+
+            return LibusbError;
+        }
+    } catch(...) {
+        PrintStdError( "GetLanguageID()",
+                       "catch()" );
+
+        return CatchError;
+    }
+    return ( strLangID[ 3 ] << 8 ) + strLangID[ 2 ];
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method returns the serial number of a particular attached device. The device count must have already been queried using
+a call to GetDeviceCount(). If num is outside the range of attached devices, an empty string will be returned.
+The serial number may then be used to open the device by calling OpenBySerial().
+
+Parameters:
+[in] 	num 	Device number to query (0 to count-1)
+
+Returns:
+The serial number string of the specified device.
+*/
+
+std::string OpenOK::GetDeviceListSerial( int num )
+{
+    Close();
+
+    int numDevices = 0;
+
+    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+
+    if ( responseGetOKDevices != NoError ) {
+        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+            PrintStdError( "GetDeviceListSerial()",
+                           "Get_OK_Devices() failed",
+                           0,
+                           responseGetOKDevices );
+        }
+        return "Not Available";
+    }
+
+    if ( num < numDevices ) {
+        return m_listOKDevices[num].serial;
+    }
+    return "Not Available";
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Get board model
+
+Parameters:
+[in] string name
+
+Returns:
+BoardModel
+*/
+
+OpenOK::BoardModel OpenOK::GetBoardModelNumber( std::string name )
+{
+    for ( unsigned char i = brdUnknown; i < brdEnd; ++i ) {
+        if ( name == OpenOK::GetBoardModelString( static_cast< BoardModel >( i ) ) ) {
+            return static_cast< BoardModel >( i );
+        }
+    }
+    return brdUnknown;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method returns the board model of a particular attached device. The device count must have already been queried using
+a call to GetDeviceCount(). If a board is unknown or num is outside the range of attached devices,
+okCUsbFrontPanel::brdUnknown will be returned.
+
+Parameters:
+[in] 	num 	Device number to query (0 to count-1)
+
+Returns:
+The board model (enumerated type) of the specified device.
+*/
+
+OpenOK::BoardModel OpenOK::GetDeviceListModel( int num )
+{
+    Close();
+
+    int numDevices = 0;
+
+    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+
+    if ( responseGetOKDevices != NoError ) {
+        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
+            PrintStdError( "GetDeviceListModel()",
+                           "Get_OK_Devices() failed",
+                           0,
+                           responseGetOKDevices );
+        }
+        return brdUnknown;
+    }
+
+    if ( num < numDevices ) {
+        char* tmp = m_listOKDevices[ num ].product;
+
+        // "Opal Kelly " = 11 characters
+        return GetBoardModelNumber( tmp + 11 );
+    }
+    return brdUnknown;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the Product string from the device.
+
+Returns:
+A string containing the Product. If a device is not open, the string will be empty.
+*/
+
+std::string OpenOK::GetProduct()
+{
+    if ( !IsOpen() ) {
+        return "Not Available";
+    }
+
+    std::string tmp = m_listOKDevices[ m_indexOpenedDevice ].product;
+
+    return tmp;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns the specific board model.
+*/
+
+OpenOK::BoardModel OpenOK::GetBoardModel()
+{
+    std::string tmp = GetProduct();
+
+    // "Opal Kelly " = 11 characters
+    if ( ( tmp.length() > 11 ) &&
+         ( tmp != "Not Available" ) ) {
+        tmp = tmp.substr( 11,tmp.length() );
+
+        return GetBoardModelNumber( tmp );
+    }
+    return brdUnknown;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Get board model string
+*/
+
+std::string OpenOK::GetBoardModelString( BoardModel m )
+{
+    if ( m == brdXEM3001v1 ) {
+        return "XEM3001v1";
+    } else if ( m == brdXEM3001v2 ) {
+        return "XEM3001v2";
+    } else if ( m == brdXEM3010 ) {
+        return "XEM3010";
+    } else if ( m == brdXEM3005 ) {
+        return "XEM3005";
+    } else if ( m == brdXEM3001CL ) {
+        return "XEM3001CL";
+    } else if ( m == brdXEM3020 ) {
+        return "XEM3020";
+    } else if ( m == brdXEM3050 ) {
+        return "XEM3050";
+    } else if ( m == brdXEM9002 ) {
+        return "XEM9002";
+    } else if ( m == brdXEM3001RB ) {
+        return "XEM3001RB";
+    } else if ( m == brdXEM5010 ) {
+        return "XEM5010";
+    } else if ( m == brdXEM6110LX45 ) {
+        return "XEM6110LX45";
+    } else if ( m == brdXEM6110LX150 ) {
+        return "XEM6110LX150";
+    } else if ( m == brdXEM6001 ) {
+        return "XEM6001";
+    } else if ( m == brdXEM6010LX45 ) {
+        return "XEM6010LX45";
+    } else if ( m == brdXEM6010LX150 ) {
+        return "XEM6010LX150";
+    } else if ( m == brdXEM6006LX9 ) {
+        return "XEM6006LX9";
+    } else if ( m == brdXEM6006LX16 ) {
+        return "XEM6006LX16";
+    } else if ( m == brdXEM6006LX25 ) {
+        return "XEM6006LX25";
+    } else if ( m == brdXEM5010LX110 ) {
+        return "XEM5010LX110";
+    } else {
+        return "Unknown";
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Get serial number
+
+Returns:
+string serial
+*/
+
+std::string OpenOK::GetSerialNumber()
+{
+    if ( !IsOpen() ) {
+        return "Not Available";
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].serial;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the current XEM Device ID string from the device.
+
+Returns:
+A string containing the Device ID. If a device is not open, the string will be empty.
+*/
+
+std::string OpenOK::GetDeviceID()
+{
+    if ( !IsOpen() ) {
+        return "Not Available";
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].deviceID;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns:
+The firmware's major version number or DeviceNotOpen if device not open.
+*/
+
+int OpenOK::GetDeviceMajorVersion()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return ( ( m_listOKDevices[ m_indexOpenedDevice ].bcdUSB >> 8 ) & 255 );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Returns:
+The firmware's minor version number or -1 if the query failed
+*/
+
+int OpenOK::GetDeviceMinorVersion()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return ( m_listOKDevices[ m_indexOpenedDevice ].bcdUSB & 255 );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the Manufacturer string from the device.
+
+Returns:
+A string containing the Manufacturer. If a device is not open, the string will be empty.
+*/
+
+std::string OpenOK::GetManufacturer()
+{
+    if ( !IsOpen() ) {
+        return "Not Available";
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].manufacturer;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the Number Endpoints from the device.
+
+Returns:
+Number of Endpoints. If a device is not open, return DeviceNotOpen.
+*/
+
+int OpenOK::GetNumberEndpoints( unsigned int numberInterface )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].bNumEndpoints[ numberInterface ];
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the maximum packet size of endpoint from the device.
+
+Returns:
+The maximum packet size of endpoint. If a device is not open, return DeviceNotOpen.
+*/
+
+int OpenOK::GetMaxPacketSizeEndpoint( unsigned int numberEndpoint )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].wMaxPacketSize[ numberEndpoint ];
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the endpoint address from the device.
+
+Returns:
+The endpoint address. If a device is not open, return DeviceNotOpen.
+*/
+
+int OpenOK::GetEndpointAddress( unsigned int numberEndpoint )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return m_listOKDevices[ m_indexOpenedDevice ].bEndpointAddress[ numberEndpoint ];
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method retrieves the last length transferred bytes from the device or to pc.
+
+Returns:
+The last length transferred bytes. If a device is not open, return DeviceNotOpen.
+*/
+
+long OpenOK::GetLastTransferLength()
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+    return m_lastTransferred;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Parameters:
+[out] 	pll 	A reference to an okCPLL22150 object.
+Returns:
+ErrorCode
+This method retrieves the current PLL configuration from the on-board XEM EEPROM.
+The pll object is then initialized with this configuration.
+
+ErrorCodes: NoError, DeviceNotOpen
+*/
+
+OpenOK::ErrorCode OpenOK::GetEepromPLL22150Configuration( OpenOK_CPLL22150 &pll )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    unsigned char dataControl[ sizeRegistersPLL22150 ];
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlReadMode,
+                                                 0xb0,
+                                                 0x1ff0,
+                                                 0x0000,
+                                                 dataControl,
+                                                 sizeRegistersPLL22150,
+                                                 m_timeoutUSB );
+
+    // Read Eeprom PLL
+    if ( responseControl < 0 ) {
+        PrintStdError( "GetEepromPLL22150Configuration()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+        return ControlTransferError;
+    }
+
+    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
+        pll.m_registersPLL[ n ] = dataControl[ n ];
+    }
+
+    pll.m_referenceFrequency = m_crystalReference;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Parameters:
+[in] 	pll 	A reference to an okCPLL22150 object.
+Returns:
+ErrorCode
+Reads the current PLL configuration over the I2C bus and modifies the pll argument to reflect that configuration.
+
+ErrorCodes: NoError, DeviceNotOpen
+*/
+
+OpenOK::ErrorCode OpenOK::GetPLL22150Configuration( OpenOK_CPLL22150 &pll )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    unsigned char dataControl[ sizeRegistersPLL22150 ];
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlReadMode,
+                                                 0xb1,
+                                                 0x0000,
+                                                 0x0000,
+                                                 dataControl,
+                                                 sizeRegistersPLL22150,
+                                                 m_timeoutUSB );
+
+    // Read Cypress PLL
+    if ( responseControl < 0 ) {
+        PrintStdError( "GetPLL22150Configuration()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+
+        return ControlTransferError;
+    }
+
+    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
+        pll.m_registersPLL[ n ] = dataControl[ n ];
+    }
+
+    pll.m_referenceFrequency = m_crystalReference;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Parameters:
+[in] 	pll 	A reference to an okCPLL22150 object.
+Returns:
+ErrorCode
+Configures the on-board PLL via the I2C bus using the configuration information in the pll object.
+
+ErrorCodes: NoError, DeviceNotOpen
+*/
+
+OpenOK::ErrorCode OpenOK::SetEepromPLL22150Configuration( OpenOK_CPLL22150 &pll )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    unsigned char dataControl[ sizeRegistersPLL22150 ];
+
+    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
+        dataControl[ n ] = pll.m_registersPLL[ n ];
+    }
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlWriteMode,
+                                                 0xb0,
+                                                 0x1ff0,
+                                                 0x0000,
+                                                 dataControl,
+                                                 sizeRegistersPLL22150,
+                                                 m_timeoutUSB );
+    // Write Eeprom PLL
+    if ( responseControl < 0 ) {
+        PrintStdError( "SetEepromPLL22150Configuration()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+
+        return ControlTransferError;
+    }
+
+    pll.m_referenceFrequency = m_crystalReference;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Parameters:
+[in] 	pll 	A reference to an okCPLL22150 object.
+Returns:
+ErrorCode
+Configures the on-board PLL via the I2C bus using the configuration information in the pll object.
+
+ErrorCodes: NoError, DeviceNotOpen
+*/
+
+OpenOK::ErrorCode OpenOK::SetPLL22150Configuration( OpenOK_CPLL22150 &pll )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    unsigned char dataControl[ sizeRegistersPLL22150 ];
+
+    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
+        dataControl[ n ] = pll.m_registersPLL[ n ];
+    }
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlWriteMode,
+                                                 0xb1,
+                                                 0x0000,
+                                                 0x0000,
+                                                 dataControl,
+                                                 sizeRegistersPLL22150,
+                                                 m_timeoutUSB );
+
+    // Write Cypress PLL
+    if ( responseControl < 0 ) {
+        PrintStdError( "SetPLL22150Configuration()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
+        return ControlTransferError;
+    }
+
+    pll.m_referenceFrequency = m_crystalReference;
+
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+This method modifies the XEM Device ID string with the new string.
+The Device ID string is a user-programmable string of up to 32 characters
+that can be used to uniquely identify a particular XEM. The string will be truncated if it exceeds 32 characters.
+
+Parameters:
+[in] 	str 	A string containing the new Device ID.
+*/
+
+void OpenOK::SetDeviceID( const std::string str )
+{
+    if ( !IsOpen() ) {
+        return;
+    }
+
+    unsigned char* s = reinterpret_cast< unsigned char* >( const_cast< char* >( str.c_str() ) );
+
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlWriteMode,
+                                                 0xb0,
+                                                 0x1fd0,
+                                                 0x0000,
+                                                 s,
+                                                 32,
+                                                 m_timeoutUSB );
+
+    if ( responseControl < 0 ) {
+        PrintStdError( "SetDeviceID()",
+                       "ControlTransfer() failed",
+                       0,
                        responseControl );
-    } else if ( responseControl < 1 ) {
-        PrintStdError( "CheckDisable()",
-                       "OptionalControlTransfer() failed - lost data" );
-    } else if ( responseControl > 1 ) {
-        PrintStdError( "CheckDisable()",
-                       "OptionalControlTransfer() failed - overflow data" );
+
+        return;
     }
-    return CommunicationError;
+    strncpy( m_listOKDevices [m_indexOpenedDevice ].deviceID, str.c_str(), OpenOK_device::SSIZE );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method checks to see if the FrontPanel Host Interface has been instantiated in the FPGA design.
-If it is detected, FrontPanel support is enabled and endpoint functionality is available.
+This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
 
 Returns:
-True is FrontPanel support is present, false otherwise.
+Total
+*/
+
+int OpenOK::SendDataBitFile( unsigned char endp, unsigned char *bytes, unsigned int size, unsigned int timeout )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    if ( size <= 0 ) {
+        return SignedArgumentError;
+    }
+
+    unsigned int totalSend = 0;
+
+    // libusb splits a large bulk transfer into URBs which are all submitted at once, so the bitstream is
+    // streamed without the bus idling between 16384 byte transfers.
+    const unsigned int num1 = size / BITFILE_CHUNK_SIZE; // Multiple of BITFILE_CHUNK_SIZE
+    const unsigned int num2 = size - num1 * BITFILE_CHUNK_SIZE;// Remainder to give.
+
+    if ( num1 ) {
+        for ( unsigned int j = 0; j < num1; ++j ) {
+            int transferred = 0;
+            int responseBulk = 0;
+
+            responseBulk = BulkTransfer( m_deviceHandle,
+                                         endp,
+                                         bytes + j * BITFILE_CHUNK_SIZE,
+                                         BITFILE_CHUNK_SIZE,
+                                         &transferred,
+                                         timeout );
+
+            if ( responseBulk < 0 ) {
+                PrintStdError( "SendDataBitFile()",
+                               "BulkTransfer() failed - Step 01",
+                               0,
+                               responseBulk );
+
+                return responseBulk;
+            }
+            totalSend += transferred;
+        }
+    }
+
+    if ( num2 ) {
+        int transferred = 0;
+        int responseBulk = 0;
+
+        responseBulk = BulkTransfer( m_deviceHandle,
+                                     endp,
+                                     bytes + num1 * BITFILE_CHUNK_SIZE,
+                                     num2,
+                                     &transferred,
+                                     timeout );
+
+        if ( responseBulk < 0 ) {
+            PrintStdError( "SendDataBitFile()",
+                           "BulkTransfer() failed - Step 02",
+                           0,
+                           responseBulk );
+
+            return responseBulk;
+        }
+        totalSend += transferred;
+    }
+
+    if ( totalSend != size ) {
+        return NotSentBitFile;
+    }
+    return totalSend;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+OpenOK::ErrorCode OpenOK::SendPaddedFileToFPGA( unsigned char* buffer, const unsigned int size )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    if ( ControlStatus( controlWriteMode ) == NoError ) {
+        // do a bulk transfer of the file to endpoint 0x02, starting with the header of the xilinx file
+        // ff ff ff ff aa 99 55 66. however every byte is sent as an int16 with the actual byte in the upper bits, ie 0xff -> 0xff00
+        // this was taken care of in the loading and parsing of the file
+
+#ifdef QT_CORE_LIB
+        SleepUtil::usleep( 3200 );
+#else
+        usleep(3200);
+#endif
+
+        const int sent = SendDataBitFile( endpointOUT, buffer, size, 2000 );
+
+        // can not compare to zero, the return can be NoError
+        if ( sent < 0 ) {
+            return static_cast< OpenOK::ErrorCode > ( sent );
+        }
+
+#ifdef QT_CORE_LIB
+        SleepUtil::usleep( 1000 );
+#else
+        usleep( 1000 );
+#endif
+
+        if ( static_cast< unsigned int > ( sent ) == size ) {
+            return ControlStatus( controlReadMode );
+        }
+    }
+    return NotConfigureFPGA;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+template< class iterator >
+OpenOK::ErrorCode OpenOK::SendFileToFPGA( iterator it, iterator end )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
+
+    std::vector<unsigned char> buffer;
+
+    ErrorCode error = ParseBitFile( it, end, buffer );
+
+    if ( error != NoError ) {
+        return error;
+    }
+    return SendPaddedFileToFPGA( &buffer[ 0 ], buffer.size() );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Parses a Xilinx bitfile, filling m_bitStream and building the stream which is sent to the device, with each byte padded to 16 bits.
 */
 
-bool OpenOK::IsFrontPanelEnabled()
-{
-    return ( CheckFrontPanelEnabled() == NoError );
+template< class iterator >
+OpenOK::ErrorCode OpenOK::ParseBitFile( iterator it, iterator end, std::vector<unsigned char> &buffer )
+{
+    ErrorCode error = NoError;
+
+    unsigned int length = 0;
+    unsigned char lengthDummy = 0;
+
+    std::string str;
+
+    // Number of header fields + data field
+    static const unsigned char numberFields = 7;
+
+    for( unsigned char j = 0 ; j < numberFields ; ++j ) {
+
+        str = "";
+
+        if ( j < ( numberFields - 1 ) ) { // Read Header
+            length = ( *it & 255 ) << 8;
+            length += ( *(++it) & 255 );
+
+            for ( unsigned int n = 0 ; n < length ; ++n ) {
+                if ( ++it == end ) { // truncated, or not a bitfile
+                    return ReadBitFileError;
+                }
+                str += ( *it & 255 );
+            }
+
+            ++it;
+
+            if ( ( *it & 255 ) == 'a' || ( *it & 255 ) == 'b' || ( *it & 255 ) == 'c' || ( *it & 255 ) == 'd' ||
+                 ( *it & 255 ) == 'e' ) {
+                ++it;
+            }
+        } else if ( j == ( numberFields - 1 ) ) { // Read Data
+            length = ( *it & 255 ) << 24;
+            length += ( *(++it) & 255 ) << 16;
+            length += ( *(++it) & 255 ) << 8;
+            length += ( *(++it) & 255 );
+
+            for ( unsigned int n = 0 ; n < length ; ++n ) {
+                ++it;
+
+                if ( it != end ) {
+                    if ( ( *it & 255 ) == 0xFF ) {
+                        lengthDummy++;
+                    } else if ( ( *it & 255 ) == 0xAA ) {
+                        break;
+                    }
+                } else {
+                    return NotFoundSyncWord;
+                }
+            }
+        }
+
+        switch( j ) {
+            case 0 :
+                break;
+
+            case 1 :
+                break;
+
+            case 2 :
+                m_bitStream.designName = str;
+                break;
+
+            case 3 :
+                m_bitStream.partName = str;
+                break;
+
+            case 4 :
+                m_bitStream.date = str;
+                break;
+
+            case 5 :
+                m_bitStream.time = str;
+                break;
+
+            case 6 :
+                m_bitStream.dataLen = length;
+                m_bitStream.dummyLen = lengthDummy;
+
+                if ( lengthDummy <= 4 ) {
+                    m_bitStream.addPadWord = true;
+                } else {
+                    m_bitStream.addPadWord = false;
+                }
+
+                buffer.reserve( m_bitStream.addPadWord ? 2 * m_bitStream.dataLen : m_bitStream.dataLen );
+
+                for ( unsigned int n = 0 ; n < m_bitStream.dataLen ; ++n ) {
+                    if ( n < m_bitStream.dummyLen ) {
+                        buffer.push_back( 0xFF );
+
+                        if ( m_bitStream.addPadWord ) {
+                            buffer.push_back(0x00);
+                        }
+                    } else {
+                        if ( it == end ) {
+                            return ReadBitFileError;
+                        }
+                        buffer.push_back( ( *it & 255 ) );
+
+                        if ( m_bitStream.addPadWord ) {
+                            buffer.push_back(0x00);
+                        }
+
+                        ++it;
+                    }
+                }
+                break;
+
+            default :
+                error = ReadBitFileError;
+                break;
+        }
+    }
+
+    if ( ( error == NoError ) && buffer.empty() ) {
+        error = ReadBitFileError;
+    }
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Check if the FrontPanel is enabled.
+This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
 
-Return:
-ErroCode
+Parameters:
+[in] 	strFilename 	A string containing the filename of the configuration file.
+
+Returns:
+0 if successful, error code otherwise.
+NO_ERROR - Configuration has occurred successfully.
+DONE_NOT_HIGH - FPGA DONE signal did not assert.
+TRANSFER_ERROR - USB error has occurred during download.
+COMMUNICATION_ERROR - Communication error with the firmware.
+INVALID_BITSTREAM - The bitstream is not properly formatted.
+FILE_ERROR - File error occurred during open or read.
+DEVICE_NOT_OPEN - Communication with a device is not established.
 */
 
-OpenOK::ErrorCode OpenOK::CheckFrontPanelEnabled()
+OpenOK::ErrorCode OpenOK::ConfigureFPGA( const std::string strFilename )
 {
     if ( !IsOpen() ) {
         return DeviceNotOpen;
     }
 
-    ErrorCode error = ControlStatus( controlReadMode );
-
-    if ( error == NoError ) {
-        error = CheckEnable();
-
-        if ( error != NoError ) {
-            if ( error == CheckEnableInvalidResponse ) {
-                return FrontPanelDisabled;
-            } else if ( error == CommunicationError ) {
-                return NotPossibleCheckFrontPanel;
-            } else {
-                PrintStdError( "CheckFrontPanelEnabled()",
-                               "CheckEnable() failed - Unknown error",
-                               0,
-                               error );
-            }
-        }
-    } else if ( error == CommunicationError ) {
-        return NotPossibleCheckFrontPanel;
-    } else if ( error == ControlStatusInvalidResponse ) {
-        return FrontPanelDisabled;
-    } else {
-        PrintStdError( "CheckFrontPanelEnabled()",
-                       "ControlStatus() failed - Unknown error",
-                       0,
-                       error );
-    }
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+    // FPGA configuration is sent as a bulk transfer, with a control transfer preceding to
+    // tell the device to expect configuration data.
+    // the control transfer has no data bytes, and has setup packet 0x40 b2 00 00 00 00 00 00
+    // the bulk transfer is the bitstream from a Xilinx .bit file, starting with the dummy bytes ( FF FF FF FF ) +
+    // sync word ( AA 99 55 66 )
+    // however the bitstream is sent with each byte padded to 16bits on the right, so 0xFF becomes 0xFF00 in the
+    // data actually sent over USB.
+    // in the real library, a configure call is ended with another control transfer, this appears to be a check to
+    // see if configuration was successful
+    // the transfer has 1 data byte and the setup packet is 0xc0 b2 00 00 00 00 01 00. a byte of 0x01 is returned on success,
+    // and I have seen a byte of
+    // 0x02 returned when it didn't work, but I don't know what the 0x02 means,
+    // or if there are other return values indicating other errors
 
-/*
-Release an interface previously claimed with libusb_claim_interface().
+    // configures the fpga on an xem with the bitstream in Filename
 
-Return:
-ErroCode
-*/
+    // first get and parse the bitstream from the file
+#ifdef __linux
+    unsigned char *data = NULL;
+    size_t size = 0;
 
-OpenOK::ErrorCode OpenOK::ReleaseInterface()
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( MapFile( strFilename, &data, &size ) != NoError ) {
+        return NotOpenBitFile;
     }
 
-    try {
-        int responseLibusb = LIBUSB_SUCCESS;
+    const ErrorCode error = SendFileToFPGA( data, data + size );
 
-        // Release an interface previously claimed with libusb_claim_interface().
-        // You should release all claimed interfaces before closing a device handle.
-        // libusb_release_interface return LIBUSB_ERROR_NOT_FOUND if the interface was not claimed
-        //
-        // libusb_release_interface return :
-        // 0 on success
-        // LIBUSB_ERROR_NOT_FOUND if the interface was not claimed
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // another LIBUSB_ERROR code on other failure
-        responseLibusb = libusb_release_interface( m_deviceHandle, m_interfaceDesired );
+    munmap( data, size );
 
-        if ( responseLibusb != LIBUSB_SUCCESS ) {
-            // if the interface was not claimed
-            if ( responseLibusb != LIBUSB_ERROR_NOT_FOUND ) {
-                PrintStdError( "ReleaseInterface()",
-                               "libusb_release_interface() failed",
-                               responseLibusb );
-            }
-        }
-#ifdef  __linux
-        // libusb_kernel_driver_active return :
-        // 0 if no kernel driver is active
-        // 1 if a kernel driver is active
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // LIBUSB_ERROR_NOT_SUPPORTED on platforms where the functionality is not available
-        // another LIBUSB_ERROR code on other failure
-        if ( ( responseLibusb = libusb_kernel_driver_active( m_deviceHandle, m_interfaceDesired ) ) == 1 ) {
-            // Detach a kernel driver from an interface.
-            // If successful, you will then be able to claim the interface and perform I/O.
-            // This functionality is not available on Darwin or Windows.
-            // Note that libusb itself also talks to the device through a special kernel driver,
-            // if this driver is already attached to the device, this call will not detach it and return LIBUSB_ERROR_NOT_FOUND.
-            // Detach a kernel driver from interface 0
+    return error;
+#else
+    std::basic_ifstream< char > file( strFilename.c_str(), std::ios_base::in | std::ios_base::binary );
 
-            // libusb_detach_kernel_driver return :
-            // 0 on success
-            // LIBUSB_ERROR_NOT_FOUND if no kernel driver was active
-            // LIBUSB_ERROR_INVALID_PARAM if the interface does not exist
-            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-            // LIBUSB_ERROR_NOT_SUPPORTED on platforms where the functionality is not available
-            // another LIBUSB_ERROR code on other failure
-            if ( ( responseLibusb = libusb_detach_kernel_driver( m_deviceHandle, m_interfaceDesired ) ) != LIBUSB_SUCCESS ) {
-                PrintStdError( "ReleaseInterface()",
-                               "libusb_detach_kernel_driver() failed",
-                               responseLibusb );
-            }
-        } else {
-            if ( responseLibusb < 0 ) {
-                PrintStdError( "ReleaseInterface()",
-                               "libusb_kernel_driver_active() failed",
-                               responseLibusb );
-            }
-        }
-#endif
+    if ( file ) {
+        std::istreambuf_iterator< char > it( file );
+        std::istreambuf_iterator< char > eos;
 
-        if ( responseLibusb < 0 ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                return DeviceNotOpen;
-            }
-            return LibusbError;
-        }
-    } catch(...) {
-        PrintStdError( "ReleaseInterface()",
-                       "catch()" );
+        return SendFileToFPGA( it, eos );
+    }
+    return NotOpenBitFile;
+#endif
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        return CatchError;
+OpenOK::ErrorCode OpenOK::ConfigureFPGAFromMemory( unsigned char *data, const unsigned long length )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
     }
-    return NoError;
+    return SendFileToFPGA( data, data + length );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
+#ifdef __linux
 /*
-Before any communication with the device can proceed, the device must be opened using this method.
-A Close() method is not provided and is not necessary.
-A device is opened matching the given device ID string
-If no device ID (or an empty string) is provided, then the first appropriate device is opened.
+Configures the FPGA using a cache of preprocessed bitstreams.
 
-Python and Java Note: To open the first available device, you must provide an empty string.
+The bitfile is identified by a hash of its contents. The padded stream which is sent to the device is kept in
+cacheDir/<hash>.okbit, so that only the first load of a bitfile needs to parse it. The hash of the last bitfile loaded on
+each device is recorded in cacheDir/<serial number>.loaded. If skipIfLoaded is true, that bitfile is loaded and FrontPanel
+support is still present, then the device is not reconfigured.
+
+The device has no readable design ID, so skipping relies on the host-side record: it can't tell if the board was
+reconfigured by another host or program, or power cycled into a different FrontPanel design. For this reason it is
+opt-in and by default the device is always configured.
+
+If the cache can't be used, the FPGA is configured directly from the bitfile.
 
 Parameters:
-[in] 	str 	The device ID of the device to open.
+strFilename - Bitfile path.
+cacheDir - Cache directory, which is created if necessary.
+skipIfLoaded - Don't reconfigure the device if the bitfile is recorded as loaded (default false).
+skipped - Set to true if configuration was skipped. May be NULL.
 
 Returns:
 ErrorCode
 */
 
-OpenOK::ErrorCode OpenOK::OpenByDeviceID( std::string str )
+OpenOK::ErrorCode OpenOK::ConfigureFPGAFromCache( const std::string strFilename, const std::string cacheDir, bool skipIfLoaded, bool *skipped )
 {
-    Close();
-
-    bool device_found = false;
-
-    int numDevices = 0;
-
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
-
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "OpenByDeviceID()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
-        }
-        return responseGetOKDevices;
+    if ( skipped ) {
+        *skipped = false;
     }
 
-    if ( numDevices > 0 ) {
-        if ( str == "" ) {
-            m_indexOpenedDevice = 0;
-            device_found = true;
-        } else {
-            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
-                if ( str == m_listOKDevices[ m_indexOpenedDevice ].deviceID ) {
-                    device_found = true;
-                    break;
-                }
-            }
-        }
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
     }
 
-    if ( !device_found ) {
-        m_indexOpenedDevice = 0;
-        return NotFoundDeviceStringID;
+    unsigned char *data = NULL;
+    size_t size = 0;
+
+    if ( MapFile( strFilename, &data, &size ) != NoError ) {
+        return NotOpenBitFile;
     }
-    return OpenByDeviceIndexList( m_indexOpenedDevice );
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Before any communication with the device can proceed, the device must be opened using this method.
-A Close() method is not provided and is not necessary.
-A device is opened matching the given serial number string.
-If no serial number (or an empty string) is provided, then the first appropriate device is opened.
+    const unsigned long long hash = HashData( data, size );
 
-Python and Java Note: To open the first available device, you must provide an empty string.
+    char hashStr[ 17 ];
+    snprintf( hashStr, sizeof( hashStr ), "%016llx", hash );
 
-Parameters:
-[in] 	str 	The serial number of the device to open.
+    const std::string stateFile = cacheDir + "/" + GetSerialNumber() + ".loaded";
 
-Returns:
-ErrorCode
-*/
+    if ( skipIfLoaded ) {
+        std::ifstream state( stateFile.c_str() );
+        std::string loaded;
 
-OpenOK::ErrorCode OpenOK::OpenBySerial( std::string str )
-{
-    Close();
+        if ( state >> loaded ) {
+            if ( ( loaded == hashStr ) && IsFrontPanelEnabled() ) {
+                munmap( data, size );
+                if ( skipped ) {
+                    *skipped = true;
+                }
+                return NoError;
+            }
+        }
+    }
 
-    bool device_found = false;
+    ErrorCode error = NoError;
 
-    int numDevices = 0;
+    // Invalidate the state before touching the FPGA, in case configuration is interrupted
+    unlink( stateFile.c_str() );
 
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+    const std::string cacheFile = cacheDir + "/" + hashStr + ".okbit";
 
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "OpenBySerial()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
-        }
-        return responseGetOKDevices;
-    }
+    unsigned char *stream = NULL;
+    size_t streamSize = 0;
 
-    if ( numDevices > 0 ) {
-        if ( str == "" ) {
-            m_indexOpenedDevice = 0;
-            device_found = true;
-        } else {
-            for ( m_indexOpenedDevice = 0; m_indexOpenedDevice < numDevices; ++m_indexOpenedDevice ) {
-                if ( str == m_listOKDevices[ m_indexOpenedDevice ].serial ) {
-                    device_found = true;
-                    break;
-                }
-            }
+    if ( MapFile( cacheFile, &stream, &streamSize ) == NoError ) {
+        munmap( data, size );
+        error = SendPaddedFileToFPGA( stream, streamSize );
+        munmap( stream, streamSize );
+    } else {
+        std::vector<unsigned char> buffer;
+
+        error = ParseBitFile( data, data + size, buffer );
+        munmap( data, size );
+
+        if ( error != NoError ) {
+            return error;
         }
+
+        mkdir( cacheDir.c_str(), 0755 );
+
+        if ( WriteFileAtomically( cacheFile, &buffer[ 0 ], buffer.size() ) != NoError ) {
+            PrintStdError( "ConfigureFPGAFromCache()", "Couldn't write " + cacheFile );
+        }
+
+        error = SendPaddedFileToFPGA( &buffer[ 0 ], buffer.size() );
     }
 
-    if ( !device_found ) {
-        m_indexOpenedDevice = 0;
-        return NotFoundDeviceStringSerial;
+    if ( error == NoError ) {
+        const std::string hashLine = std::string( hashStr ) + "\n";
+
+        if ( WriteFileAtomically( stateFile, ( const unsigned char* ) hashLine.c_str(), hashLine.size() ) != NoError ) {
+            PrintStdError( "ConfigureFPGAFromCache()", "Couldn't write " + stateFile );
+        }
     }
-    return OpenByDeviceIndexList( m_indexOpenedDevice );
+    return error;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Before any communication with the device can proceed, the device must be opened using this method.
-A Close() method is not provided and is not necessary.
+Maps a file into memory, read-only. The mapping is released with munmap().
 
 Parameters:
-[in] 	indexDeviceList 	The position of list devices to open.
+strFilename - Path of the file.
+data - Set to the start of the mapping.
+size - Set to the size of the file.
 
 Returns:
 ErrorCode
 */
 
-OpenOK::ErrorCode OpenOK::OpenByDeviceIndexList( unsigned int indexDeviceList )
+OpenOK::ErrorCode OpenOK::MapFile( const std::string strFilename, unsigned char **data, size_t *size )
 {
-    if ( !m_libusbInitialization ) {
-        return LibusbNotInitialization;
+    const int fd = open( strFilename.c_str(), O_RDONLY );
+
+    if ( fd < 0 ) {
+        return FileError;
     }
 
-    BoardModel boardModel;
+    struct stat statBuf;
 
-    std::string boardName;
+    if ( ( fstat( fd, &statBuf ) < 0 ) || ( statBuf.st_size == 0 ) ) {
+        close( fd );
+        return FileError;
+    }
 
-    int responseLibusb = LIBUSB_SUCCESS;
-    int responseLibusbSetConfiguration = LIBUSB_SUCCESS;
-    int responseLibusbGetConfiguration = LIBUSB_SUCCESS;
+    void *addr = mmap( NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
 
-    Close();
+    if ( addr == MAP_FAILED ) {
+        return FileError;
+    }
 
-    ErrorCode responseOpen = OpenDeviceUSB( m_listOKDevices[ indexDeviceList ].device,
-                                            &m_deviceHandle );
+    madvise( addr, statBuf.st_size, MADV_SEQUENTIAL );
 
-    if ( responseOpen != NoError ) {
-        PrintStdError( "OpenByDeviceIndexList()",
-                       "OpenDeviceUSB() failed",
-                       0,
-                       responseOpen );
+    *data = ( unsigned char* ) addr;
+    *size = statBuf.st_size;
 
-        return DeviceNotOpen;
-    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    OpenOK::ErrorCode error = NoError;
+/*
+Writes a file via a temporary file and a rename, so that readers never see a partially written file.
 
-    // need to send setup packet on endpoint 0x00
-    // packet is 0x00 09 01 00 00 00 00 00
-    // libusb provides a convenient function usb_set_configuration for this
+Parameters:
+strFilename - Path of the file.
+data - Contents.
+size - Size of the contents.
 
-    int configurationRead = 0;
+Returns:
+ErrorCode
+*/
 
-    ReleaseInterface();
+OpenOK::ErrorCode OpenOK::WriteFileAtomically( const std::string strFilename, const unsigned char *data, const size_t size )
+{
+    std::string tmpName = strFilename + ".XXXXXX";
+    std::vector<char> tmpl( tmpName.begin(), tmpName.end() );
+    tmpl.push_back( '\0' );
 
-    // libusb_get_configuration retun :
-    // 0 on success
-    // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-    // another LIBUSB_ERROR code on other failure
-    responseLibusbGetConfiguration = libusb_get_configuration( m_deviceHandle, &configurationRead );
+    const int fd = mkstemp( &tmpl[ 0 ] );
 
-    if ( responseLibusbGetConfiguration == LIBUSB_SUCCESS ) {
-        // When libusb presents a device handle to an application, there is a chance that the corresponding
-        // device may be in unconfigured state. For devices with multiple configurations, there is also a chance
-        // that the configuration currently selected is not the one that the application wants to use.
-        //
-        // The obvious solution is to add a call to libusb_set_configuration() early on during your device
-        // initialization routines, but there are caveats to be aware of:
-        //
-        // 1) If the device is already in the desired configuration, calling libusb_set_configuration()
-        // using the same configuration value will cause a lightweight device reset.
-        // This may not be desirable behaviour.
-        // 2) libusb will be unable to change configuration if the device is in another configuration
-        // and other programs or drivers have claimed interfaces under that configuration.
-        // 3) In the case where the desired configuration is already active, libusb may not even be able to
-        // perform a lightweight device reset. For example, take my USB keyboard with fingerprint reader:
-        // I'm interested in driving the fingerprint reader interface through libusb,
-        // but the kernel's USB-HID driver will almost always have claimed the keyboard interface.
-        // Because the kernel has claimed an interface, it is not even possible to perform the lightweight device reset,
-        // so libusb_set_configuration() will fail. (Luckily the device in question only has a single configuration.)
-        if ( configurationRead != m_configurationDesired ) {
-            // libusb_set_configuration return :
-            // 0 on success
-            // LIBUSB_ERROR_NOT_FOUND if the requested configuration does not exist
-            // LIBUSB_ERROR_BUSY if interfaces are currently claimed
-            // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-            // another LIBUSB_ERROR code on other failure
-            responseLibusbSetConfiguration = libusb_set_configuration( m_deviceHandle, m_configurationDesired );
+    if ( fd < 0 ) {
+        return FileError;
+    }
+    tmpName = &tmpl[ 0 ];
 
-            // TODO : remove BUSY test
-            if ( responseLibusbSetConfiguration == LIBUSB_ERROR_BUSY ) {
-                responseLibusbSetConfiguration = LIBUSB_SUCCESS;
+    size_t written = 0;
+
+    while ( written < size ) {
+        const ssize_t n = write( fd, data + written, size - written );
+
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
             }
+            break;
         }
+        written += n;
     }
 
-    if ( ( responseLibusbSetConfiguration == LIBUSB_SUCCESS ) &&
-         ( responseLibusbGetConfiguration == LIBUSB_SUCCESS ) ) {
+    fchmod( fd, 0644 );
 
-        // claim interface 0
-        //
-        // Claiming of interfaces is a purely logical operation; it does not cause any requests to be sent over the bus.
-        // Interface claiming is used to instruct the underlying operating system that your application wishes to
-        // take ownership of the interface.
-        //
-        // Claim = One possible way to lock your device into a specific configuration,
-        //
-        // You cannot change/reset configuration if other applications or drivers have claimed interfaces.
-        //
-        // libusb_claim_interface return :
-        // 0 on success
-        // LIBUSB_ERROR_NOT_FOUND if the requested interface does not exist
-        // LIBUSB_ERROR_BUSY if another program or driver has claimed the interface
-        // LIBUSB_ERROR_NO_DEVICE if the device has been disconnected
-        // a LIBUSB_ERROR code on other failure
-        responseLibusb = libusb_claim_interface(m_deviceHandle, m_interfaceDesired );
+    if ( ( close( fd ) < 0 ) || ( written != size ) || ( rename( tmpName.c_str(), strFilename.c_str() ) < 0 ) ) {
+        unlink( tmpName.c_str() );
+        return FileError;
+    }
+    return NoError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        // TODO : remove BUSY test
-        if ( responseLibusb == LIBUSB_ERROR_BUSY ) {
-            responseLibusb = LIBUSB_SUCCESS;
-        }
+#else
 
-        if ( responseLibusb == LIBUSB_SUCCESS ) {
+// Without mmap() there is no cache: the FPGA is always configured from the bitfile.
 
-            // need to send USB_CONTROL packet, 0xc0:b9 00 00 00 00 01 00
-            // this is copied from a capture of traffic when using the official interface library
-            // don't know what this request is, but it returns a byte of 0x80 when called by real library
-            // request_type = 0xc0 = USB_DIR_HOST & USB_TYPE_VENDOR
+OpenOK::ErrorCode OpenOK::ConfigureFPGAFromCache( const std::string strFilename, const std::string, bool, bool *skipped )
+{
+    if ( skipped ) {
+        *skipped = false;
+    }
+    return ConfigureFPGA( strFilename );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            unsigned char dataControl[ 1 ] = { 0x00 };
+OpenOK::ErrorCode OpenOK::MapFile( const std::string, unsigned char **, size_t * )
+{
+    return FileError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            // should read 1 byte
-            const int responseControl = ControlTransfer( m_deviceHandle,
-                                                         controlReadMode,
-                                                         0xb9,
-                                                         0x0000,
-                                                         0x0000,
-                                                         dataControl,
-                                                         1,
-                                                         m_timeoutUSB );
+OpenOK::ErrorCode OpenOK::WriteFileAtomically( const std::string, const unsigned char *, const size_t )
+{
+    return FileError;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            if ( responseControl >= 0 ) {
-                if ( responseControl == 1 ) {
-                    if ( ( dataControl[ 0 ] == 0x80 ) ||
-                         ( dataControl[ 0 ] == 0x00 ) ) {
-                        error = NoError;
-                    } else {
-                        //device did not return 0x00 or 0x80
+#endif
 
-                        PrintStdError( "OpenByDeviceIndexList()",
-                                       "invalid response" );
+/*
+This method Read/Write data from/to Pipe Out/In.
 
-                        error = OpenByDeviceIndexListInvalidResponse;
-                    }
-                } else {
-                    if ( responseControl < 1 ) {
-                        PrintStdError( "OptionalControlTransfer()",
-                                       "libusb_control_transfer() failed - lost data" );
-                    } else if ( responseControl > 1 ) {
-                        PrintStdError( "OptionalControlTransfer()",
-                                       "libusb_control_transfer() failed - overflow data" );
-                    }
-                    error = ControlTransferError;
-                }
-            } else {
-                PrintStdError( "OpenByDeviceIndexList()",
-                               "ControlTransfer() failed",
-                               0,
-                               responseControl );
+Parameters:
+[in] 	epAddr 	The address of the destination Pipe In/Out.
+[in] 	length 	The length of the transfer.
+[in] 	data 	A pointer to the transfer data buffer.
 
-                error = ControlTransferError;
-            }
-        } else {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                Close();
-            }
+Returns:
+The number of bytes written/read or ErrorCode if the write failed.
+*/
 
-            PrintStdError( "OpenByDeviceIndexList()",
-                           "libusb_claim_interface() failed",
-                           responseLibusb );
+inline long OpenOK::ReadWritePipe( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
+                                   int32_t magicNumber1, int32_t magicNumber2, int64_t length, uint8_t *data )
+{
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
 
-            error = ClaimInterfaceError;
-        }
-    } else {
-        if ( responseLibusbGetConfiguration != LIBUSB_SUCCESS ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                Close();
-            }
+    // Can't mix with asynchronous transfers.
+    if ( !m_pipeQueue.empty() ) {
+        return Failed;
+    }
 
-            PrintStdError( "OpenByDeviceIndexList()",
-                           "libusb_get_configuration() failed",
-                           responseLibusbGetConfiguration );
+    int32_t totalTranferred = 0;
 
-            error = GetConfigurationError;
-        }
-        if ( responseLibusbSetConfiguration != LIBUSB_SUCCESS ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                Close();
-            }
+    const uint8_t sizeDataControl = 6;
+    uint8_t dataControl[ sizeDataControl ];
 
-            PrintStdError( "OpenByDeviceIndexList()",
-                           "libusb_set_configuration() failed",
-                           responseLibusbSetConfiguration );
+    uint8_t lengthDataControl = 2;
 
-            error = SetConfigurationError;
-        }
+    // If address not valid.
+    if ( ( epAddr < endpointLower ) || ( epAddr > endpointUpper ) ) {
+        return RangeAddressError;
     }
 
-    if ( error == NoError ) {
-        boardModel = GetBoardModel();
+    if ( length <= 0 ) {
+        return SignedArgumentError;
+    }
 
-        boardName = GetBoardModelString( boardModel );
+    // Odd transfers will be shortened by one byte.
+    if ( ( length % 2 ) != 0 ) {
+        PrintStdError( "ReadWritePipe()",
+                       "Odd transfers will be shortened by one byte" );
 
-        if ( boardName == "XEM3005" ) {
-            m_crystalReference = 48.0;//Mhz
-        }
+        length -= 1;
+    }
 
-        m_shiftMaxPacketSize = m_listOKDevices[ indexDeviceList ].shiftMaxPacketSize;
+    // First step : transferred multiples of 16384.
+    const uint32_t multipleMaxBulkPackage = length >> 14;// Multiple of 16384 (Maximum of bytes that transfers Bulk Package).
+    const uint32_t lenghtFirstPackage = ( multipleMaxBulkPackage << 14 );// Maximum multiple of 16384.
 
-        m_maxPacketSize = m_listOKDevices[ indexDeviceList ].maxPacketSize;
-    }
+    // Second step : transferred multiples of MaxPacketSize.
+    const uint32_t multipleMaxPacketSize = ( length - lenghtFirstPackage ) >> m_shiftMaxPacketSize;// Multiple of USB MaxPacketSize.
+    const uint32_t lenghtSecondPackage = ( multipleMaxPacketSize << m_shiftMaxPacketSize );// Maximum multiple of USB MaxPacketSize.
 
-    if ( error != NoError ) {
-        Close();
-    }
-    return error;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+    // Third step : transferred remaining.
+    const uint32_t remaining = length - lenghtFirstPackage - lenghtSecondPackage;
+    const uint32_t lenghtRemaining = remaining % 2 ? (remaining - 1) : remaining;// Remaining to give.
+    const uint32_t halfLenghtRemaining = lenghtRemaining >> 1; // Half of the remaining to give.
 
-/*
-Close device opened
-*/
+#if !defined(WRITE_READ_FAST)
+    ErrorCode error = CheckEnable();
 
-void OpenOK::Close( bool force )
-{
-    if ( !IsOpen() ) {
-        return;
+    if ( error != NoError ) {
+        return error;
     }
+#endif
 
-    memset( m_wireIns, 0, OpenOK::WIREINSIZE );
-    memset( m_wireOuts, 0, OpenOK::WIREOUTSIZE );
-
-    if ( force ) {
-        PrintStdError( "Close()",
-                       "Forcing close communication!" );
-    } else {
-        const ErrorCode responseRelease = ReleaseInterface();
+    if ( lenghtFirstPackage || lenghtSecondPackage ) {
+        dataControl[ 0 ] = epAddr;
+        dataControl[ 1 ] = magicNumber1;
 
-        if ( responseRelease != NoError ) {
-            PrintStdError( "Close() - ReleaseInterface()",
-                           "",
-                           0,
-                           responseRelease );
-        }
+        if ( endpointDir == endpointIN ) {
+            dataControl[ 2 ] = ( lenghtFirstPackage + lenghtSecondPackage ) & 255;
+            dataControl[ 3 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 8 ) & 255;
+            dataControl[ 4 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 16 ) & 255;
+            dataControl[ 5 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 24 ) & 255;
 
-        const ErrorCode responseCloseDevice = CloseDeviceUSB( m_deviceHandle );
+            lengthDataControl = sizeDataControl;
+        }
 
-        if ( responseCloseDevice != NoError ) {
-            PrintStdError( "Close() - CloseDeviceUSB()",
-                           "",
+        const int responseControl = ControlTransfer( m_deviceHandle,
+                                                     controlWriteMode,
+                                                     0xb7,
+                                                     m_maxPacketSize,
+                                                     0x0000,
+                                                     dataControl,
+                                                     lengthDataControl,
+                                                     m_timeoutUSB );
+        if ( responseControl < 0 ) {
+            PrintStdError( "ReadWritePipe()",
+                           "ControlTransfer() failed - Step 01 or Step 02",
                            0,
-                           responseCloseDevice );
+                           responseControl );
+
+            return responseControl;
         }
-    }
-    m_deviceHandle = NULL;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Configures the on-board PLL using the default configuration setup in the EEPROM. If the specific device does not support this,
-the method returns error code UnsupportedFeature.
+        // Write/Read Multiple of 16384.
+        if ( lenghtFirstPackage ) {
+            int32_t transferred = 0;
 
-Returns:
-ErrorCode
-*/
+            int32_t responseBulk = BulkTransfer( m_deviceHandle,
+                                                 endpointDir,
+                                                 data,
+                                                 lenghtFirstPackage,
+                                                 &transferred,
+                                                 m_timeoutUSB );
 
-OpenOK::ErrorCode OpenOK::LoadDefaultPLLConfiguration()
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
+            if ( responseBulk < 0 ) {
+                PrintStdError( "ReadWritePipe()",
+                               "BulkTransfer() failed - Step 01",
+                               0,
+                               responseBulk );
 
-    OpenOK_CPLL22150 *pllDefaultCofiguration = new OpenOK_CPLL22150;
+                return responseBulk;
+            }
+            totalTranferred += transferred;
+        }
 
-    ErrorCode result = NoError;
+        // Write/Read Multiple of USB MaxPacketSize.
+        if ( lenghtSecondPackage ) {
+            int32_t transferred = 0;
 
-    result = GetEepromPLL22150Configuration(*pllDefaultCofiguration);
+            int32_t responseBulk = BulkTransfer( m_deviceHandle,
+                                                 endpointDir,
+                                                 data + lenghtFirstPackage,
+                                                 lenghtSecondPackage,
+                                                 &transferred,
+                                                 m_timeoutUSB );
 
-    if ( result == NoError ) {
-        result = SetPLL22150Configuration(*pllDefaultCofiguration);
-    }
+            if ( responseBulk < 0 ) {
+                PrintStdError( "ReadWritePipe()",
+                               "BulkTransfer() failed - Step 02",
+                               0,
+                               responseBulk );
 
-    delete pllDefaultCofiguration;
+                return responseBulk;
+            }
+            totalTranferred += transferred;
+        }
 
-    return result;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+        m_lastTransferred = totalTranferred;
 
-/*
-Queries the USB to determine how many Opal Kelly devices are attached. This method also builds a list of serial numbers and
-board models which can subsequently be queried using the methods GetDeviceListSerial() and GetDeviceListModel(), respectively.
+#if !defined(WRITE_READ_FAST)
+        ErrorCode error = CheckDisable();
 
-Returns:
-The number of devices attached.
-*/
+        if ( error != NoError ) {
+            return error;
+        }
+#endif
+    }
 
-int OpenOK::GetDeviceCount()
-{
-    Close();
+    // Write/Read remaining.
+    if ( lenghtRemaining ) {
+        dataControl[ 0 ] = epAddr;
+        dataControl[ 1 ] = magicNumber2;
 
-    int numDevices = 0;
+        if ( endpointDir == endpointIN ) {
+            dataControl[ 2 ] = ( lenghtRemaining ) & 255;
+            dataControl[ 3 ] = ( ( lenghtRemaining ) >> 8 ) & 255;
+            dataControl[ 4 ] = ( ( lenghtRemaining ) >> 16 ) & 255;
+            dataControl[ 5 ] = ( ( lenghtRemaining ) >> 24 ) & 255;
 
-    ErrorCode responseGetOKDevices = Get_OK_Devices( true, numDevices );
+            lengthDataControl = sizeDataControl;
+        }
 
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "GetDeviceCount()",
-                           "Get_OK_Devices() failed",
+        const int responseControl = ControlTransfer( m_deviceHandle,
+                                                     controlWriteMode,
+                                                     0xb7,
+                                                     halfLenghtRemaining,
+                                                     0x0000,
+                                                     dataControl,
+                                                     lengthDataControl,
+                                                     m_timeoutUSB );
+        if ( responseControl < 0 ) {
+            PrintStdError( "ReadWritePipe()",
+                           "ControlTransfer() failed - Step 03",
                            0,
-                           responseGetOKDevices );
+                           responseControl );
+
+            return responseControl;
         }
-        return responseGetOKDevices;
-    }
-    return numDevices;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Returns:
-Descriptor language of device
-*/
+        int32_t transferred = 0;
 
-int OpenOK::GetLanguageID( libusb_device_handle *handle )
-{
-    unsigned char strLangID[ 255 ];
+        int32_t responseBulk = BulkTransfer( m_deviceHandle,
+                                             endpointDir,
+                                             data + ( lenghtFirstPackage + lenghtSecondPackage ),
+                                             lenghtRemaining,
+                                             &transferred,
+                                             m_timeoutUSB );
 
-    if ( handle == NULL ) {
-        PrintStdError( "GetLanguageID()",
-                       "pointer 'handle' is NULL" );
-        return PointerNULL;
-    }
+        if ( responseBulk < 0 ) {
+            PrintStdError( "ReadWritePipe()",
+                           "BulkTransfer() failed - Step 03",
+                           0,
+                           responseBulk );
 
-    try {
-        // Read Language ID
-        //
-        // libusb_get_string_descriptor return :number of bytes returned in data, or LIBUSB_ERROR code on failure
-        int responseLibusb = libusb_get_string_descriptor( handle,
-                                                           0x00,
-                                                           0x00,
-                                                           strLangID,
-                                                           sizeof( strLangID ) );
+            return responseBulk;
+        }
+        totalTranferred += transferred;
 
-        if ( responseLibusb < 0 ) {
-            if ( responseLibusb == LIBUSB_ERROR_NO_DEVICE ) {
-                Close();
-            }
+        m_lastTransferred = totalTranferred;
 
-            PrintStdError( "GetLanguageID()",
-                           "libusb_get_string_descriptor() failed",
-                           responseLibusb );
+#if !defined(WRITE_READ_FAST)
+        ErrorCode error = CheckDisable();
 
-            return LibusbError;
+        if ( error != NoError ) {
+            PrintStdError( "ReadWritePipe()",
+                           "CheckDisable() failed - Step 03" );
+
+            return error;
         }
-    } catch(...) {
-        PrintStdError( "GetLanguageID()",
-                       "catch()" );
+#endif
+    }
 
-        return CatchError;
+    if ( totalTranferred != length ) {
+        return TransferError;
     }
-    return ( strLangID[ 3 ] << 8 ) + strLangID[ 2 ];
+
+    m_lastTransferred = totalTranferred;
+
+    return totalTranferred;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method returns the serial number of a particular attached device. The device count must have already been queried using
-a call to GetDeviceCount(). If num is outside the range of attached devices, an empty string will be returned.
-The serial number may then be used to open the device by calling OpenBySerial().
+This method transfers a specified buffer of data to the given Pipe In endpoint.
+Note: For 16-bit boards (all but the XEM3001v1), the transfer length must be even. Odd transfers will be shortened by one byte.
+
+Python Note: Within Python, the 'length' parameter is not used and the 'data' parameter is a string buffer. For example,
+
+ buf = "\x00"*1076
+ xem.WriteToPipeIn(0x80, buf)
 
 Parameters:
-[in] 	num 	Device number to query (0 to count-1)
+[in] 	epAddr 	The address of the destination Pipe In.
+[in] 	length 	The length of the transfer.
+[in] 	data 	A pointer to the transfer data buffer.
 
 Returns:
-The serial number string of the specified device.
+The number of bytes written or ErrorCode if the write failed.
 */
 
-std::string OpenOK::GetDeviceListSerial( int num )
+long OpenOK::WriteToPipeIn( int epAddr, long length, unsigned char *data )
 {
-    Close();
-
-    int numDevices = 0;
-
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
-
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "GetDeviceListSerial()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
-        }
-        return "Not Available";
-    }
+    // I don't know what the 0x04 means.
+    // For 0x80 and 0x9F address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
+    const long response = ReadWritePipe( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data );
 
-    if ( num < numDevices ) {
-        return m_listOKDevices[num].serial;
+    if ( response < 0 ) {
+        PrintStdError( "WriteToPipeIn()",
+                       "ReadWritePipe() failed",
+                       0,
+                       response );
     }
-    return "Not Available";
+    return response;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Get board model
+This method transfers data from a specified Pipe Out endpoint to the given buffer. The maximum length of a transfer (per call to
+this method) is 16,777,215 bytes.
+Note: For 16-bit boards (all but the XEM3001v1), the transfer length must be even. Odd transfers will be shortened by one byte.
+
+Python Note: Within Python, the 'length' parameter is not used and the 'data' parameter is a string buffer. For example,
+
+ buf = "\x00"*1076
+ xem.ReadFromPipeOut(0xa0, buf)
 
 Parameters:
-[in] string name
+[in] 	epAddr 	The address of the source Pipe Out.
+[in] 	length 	The length of the transfer.
+[in] 	data 	A pointer to the transfer data buffer.
 
 Returns:
-BoardModel
+The number of bytes read or ErrorCode if the read failed.
 */
 
-OpenOK::BoardModel OpenOK::GetBoardModelNumber( std::string name )
+long OpenOK::ReadFromPipeOut( int epAddr, long length, unsigned char *data )
 {
-    for ( unsigned char i = brdUnknown; i < brdEnd; ++i ) {
-        if ( name == OpenOK::GetBoardModelString( static_cast< BoardModel >( i ) ) ) {
-            return static_cast< BoardModel >( i );
-        }
+    // I don't know what the 0x05 and 0x06 means.
+    // For 0xA0 and 0xBF address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
+    const long response = ReadWritePipe( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data );
+
+    if ( response < 0 ) {
+        PrintStdError( "ReadFromPipeOut()",
+                       "ReadWritePipe() failed",
+                       0,
+                       response );
     }
-    return brdUnknown;
+    return response;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method returns the board model of a particular attached device. The device count must have already been queried using
-a call to GetDeviceCount(). If a board is unknown or num is outside the range of attached devices,
-okCUsbFrontPanel::brdUnknown will be returned.
+This method transfers data from a specified Block-Throttled Pipe Out endpoint to the given buffer. Data is transferred in
+blocks of blockSize bytes and the device only sends a block when the FPGA asserts ep_ready, so the read blocks until the FPGA
+has data or the USB timeout (see SetTimeout()) expires. This makes it suitable for waiting on events from the FPGA.
+
+The block size is passed in wValue of the setup packet, as for ReadFromPipeOut() where the block is the USB packet size.
 
 Parameters:
-[in] 	num 	Device number to query (0 to count-1)
+[in] 	epAddr 	The address of the source Pipe Out.
+[in] 	blockSize 	Block size in bytes (2..1024, even).
+[in] 	length 	The length of the transfer, a multiple of blockSize.
+[in] 	data 	A pointer to the transfer data buffer.
 
 Returns:
-The board model (enumerated type) of the specified device.
+The number of bytes read or ErrorCode if the read failed. Timeout is returned if no data arrived within the USB timeout.
 */
 
-OpenOK::BoardModel OpenOK::GetDeviceListModel( int num )
+long OpenOK::ReadFromBlockPipeOut( int epAddr, int blockSize, long length, unsigned char *data )
 {
-    Close();
-
-    int numDevices = 0;
-
-    ErrorCode responseGetOKDevices = Get_OK_Devices( false, numDevices );
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
 
-    if ( responseGetOKDevices != NoError ) {
-        if ( responseGetOKDevices != NotFoundOpallKellyBoard ) {
-            PrintStdError( "GetDeviceListModel()",
-                           "Get_OK_Devices() failed",
-                           0,
-                           responseGetOKDevices );
-        }
-        return brdUnknown;
+    if ( ( epAddr < 0xA0 ) || ( epAddr > 0xBF ) ) {
+        return RangeAddressError;
     }
 
-    if ( num < numDevices ) {
-        char* tmp = m_listOKDevices[ num ].product;
+    if ( ( blockSize < 2 ) || ( blockSize > 1024 ) || ( ( blockSize % 2 ) != 0 ) ) {
+        return InvalidBlockSize;
+    }
 
-        // "Opal Kelly " = 11 characters
-        return GetBoardModelNumber( tmp + 11 );
+    if ( length <= 0 ) {
+        return SignedArgumentError;
     }
-    return brdUnknown;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-This method retrieves the Product string from the device.
+    if ( ( length % blockSize ) != 0 ) {
+        return InvalidBlockSize;
+    }
 
-Returns:
-A string containing the Product. If a device is not open, the string will be empty.
-*/
+#if !defined(WRITE_READ_FAST)
+    ErrorCode error = CheckEnable();
 
-std::string OpenOK::GetProduct()
-{
-    if ( !IsOpen() ) {
-        return "Not Available";
+    if ( error != NoError ) {
+        return error;
     }
+#endif
 
-    std::string tmp = m_listOKDevices[ m_indexOpenedDevice ].product;
+    const uint8_t sizeDataControl = 6;
+    uint8_t dataControl[ sizeDataControl ];
 
-    return tmp;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+    dataControl[ 0 ] = epAddr;
+    dataControl[ 1 ] = 0x06;
+    dataControl[ 2 ] = length & 255;
+    dataControl[ 3 ] = ( length >> 8 ) & 255;
+    dataControl[ 4 ] = ( length >> 16 ) & 255;
+    dataControl[ 5 ] = ( length >> 24 ) & 255;
 
-/*
-Returns the specific board model.
-*/
+    long response;
+    int32_t transferred = 0;
 
-OpenOK::BoardModel OpenOK::GetBoardModel()
-{
-    std::string tmp = GetProduct();
+    const int responseControl = ControlTransfer( m_deviceHandle,
+                                                 controlWriteMode,
+                                                 0xb7,
+                                                 blockSize,
+                                                 0x0000,
+                                                 dataControl,
+                                                 sizeDataControl,
+                                                 m_timeoutUSB );
+    if ( responseControl < 0 ) {
+        PrintStdError( "ReadFromBlockPipeOut()",
+                       "ControlTransfer() failed",
+                       0,
+                       responseControl );
 
-    // "Opal Kelly " = 11 characters
-    if ( ( tmp.length() > 11 ) &&
-         ( tmp != "Not Available" ) ) {
-        tmp = tmp.substr( 11,tmp.length() );
+        response = responseControl;
+    } else {
+        const int32_t responseBulk = BulkTransfer( m_deviceHandle,
+                                                   endpointIN,
+                                                   data,
+                                                   length,
+                                                   &transferred,
+                                                   m_timeoutUSB );
 
-        return GetBoardModelNumber( tmp );
-    }
-    return brdUnknown;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+        m_lastTransferred = transferred;
 
-/*
-Get board model string
-*/
+        if ( responseBulk == ( BulkTransferError + LIBUSB_ERROR_TIMEOUT ) ) {
+            response = Timeout;
+        } else if ( responseBulk < 0 ) {
+            PrintStdError( "ReadFromBlockPipeOut()",
+                           "BulkTransfer() failed",
+                           0,
+                           responseBulk );
 
-std::string OpenOK::GetBoardModelString( BoardModel m )
-{
-    if ( m == brdXEM3001v1 ) {
-        return "XEM3001v1";
-    } else if ( m == brdXEM3001v2 ) {
-        return "XEM3001v2";
-    } else if ( m == brdXEM3010 ) {
-        return "XEM3010";
-    } else if ( m == brdXEM3005 ) {
-        return "XEM3005";
-    } else if ( m == brdXEM3001CL ) {
-        return "XEM3001CL";
-    } else if ( m == brdXEM3020 ) {
-        return "XEM3020";
-    } else if ( m == brdXEM3050 ) {
-        return "XEM3050";
-    } else if ( m == brdXEM9002 ) {
-        return "XEM9002";
-    } else if ( m == brdXEM3001RB ) {
-        return "XEM3001RB";
-    } else if ( m == brdXEM5010 ) {
-        return "XEM5010";
-    } else if ( m == brdXEM6110LX45 ) {
-        return "XEM6110LX45";
-    } else if ( m == brdXEM6110LX150 ) {
-        return "XEM6110LX150";
-    } else if ( m == brdXEM6001 ) {
-        return "XEM6001";
-    } else if ( m == brdXEM6010LX45 ) {
-        return "XEM6010LX45";
-    } else if ( m == brdXEM6010LX150 ) {
-        return "XEM6010LX150";
-    } else if ( m == brdXEM6006LX9 ) {
-        return "XEM6006LX9";
-    } else if ( m == brdXEM6006LX16 ) {
-        return "XEM6006LX16";
-    } else if ( m == brdXEM6006LX25 ) {
-        return "XEM6006LX25";
-    } else if ( m == brdXEM5010LX110 ) {
-        return "XEM5010LX110";
-    } else {
-        return "Unknown";
+            response = responseBulk;
+        } else if ( transferred != length ) {
+            response = TransferError;
+        } else {
+            response = transferred;
+        }
     }
-}
-//---------------------------------------------------------------------------------------------------------------------------------
-
-/*
-Get serial number
 
-Returns:
-string serial
-*/
+    // The transfer was enabled above, so it must be disabled again whatever happened,
+    // in particular after a timeout, which is the normal outcome when the FPGA has no data.
+#if !defined(WRITE_READ_FAST)
+    error = CheckDisable();
 
-std::string OpenOK::GetSerialNumber()
-{
-    if ( !IsOpen() ) {
-        return "Not Available";
+    if ( ( error != NoError ) && ( response >= 0 ) ) {
+        return error;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].serial;
+#endif
+
+    return response;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the current XEM Device ID string from the device.
+Sets the number of bulk transfers (URBs) kept in flight by the asynchronous pipe API and the size of each.
+With several URBs in flight, the host controller always has a transfer queued, so the bus does not idle between them.
+This can only be changed when no asynchronous transfers are pending.
+
+Parameters:
+[in] 	numberURBs 	The number of URBs in flight (1..64, default 8).
+[in] 	sizeURB 	The size of each URB in bytes, a multiple of the USB max packet size (default 65536).
 
 Returns:
-A string containing the Device ID. If a device is not open, the string will be empty.
+ErrorCode
 */
 
-std::string OpenOK::GetDeviceID()
+OpenOK::ErrorCode OpenOK::SetPipeTransferQueue( int numberURBs, int sizeURB )
 {
-    if ( !IsOpen() ) {
-        return "Not Available";
+    if ( !m_pipeQueue.empty() ) {
+        return Failed;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].deviceID;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Returns:
-The firmware's major version number or DeviceNotOpen if device not open.
-*/
+    if ( ( numberURBs < 1 ) || ( numberURBs > 64 ) || ( sizeURB <= 0 ) ) {
+        return SignedArgumentError;
+    }
 
-int OpenOK::GetDeviceMajorVersion()
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( m_maxPacketSize && ( ( sizeURB % m_maxPacketSize ) != 0 ) ) {
+        return InvalidBlockSize;
     }
-    return ( ( m_listOKDevices[ m_indexOpenedDevice ].bcdUSB >> 8 ) & 255 );
-}
-//---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-Returns:
-The firmware's minor version number or -1 if the query failed
-*/
+    FreePipeURBs();
 
-int OpenOK::GetDeviceMinorVersion()
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
-    return ( m_listOKDevices[ m_indexOpenedDevice ].bcdUSB & 255 );
+    m_numberURBs = numberURBs;
+    m_sizeURB = sizeURB;
+
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the Manufacturer string from the device.
+Queues an asynchronous read from a Pipe Out endpoint into the caller's buffer. The data is read directly into the buffer,
+without intermediate copies, using several bulk transfers in flight (see SetPipeTransferQueue()).
+
+Transfers are carried out in the order they are submitted. When a transfer completes, its status and transferred fields
+are set, it is added to the completion queue (see GetCompletedPipeTransfer()) and its callback, if any, is called.
+Completion only happens within HandlePipeEvents(), which the caller must call regularly.
+
+The callback may submit further transfers, but must not call the synchronous methods of this class.
+Synchronous pipe transfers return Failed while asynchronous transfers are pending.
+
+Parameters:
+[in] 	transfer 	The transfer. epAddr, data and length must be set. The length must be a multiple of the USB max packet size.
 
 Returns:
-A string containing the Manufacturer. If a device is not open, the string will be empty.
+ErrorCode
 */
 
-std::string OpenOK::GetManufacturer()
+OpenOK::ErrorCode OpenOK::SubmitReadFromPipeOut( OpenOK_PipeTransfer *transfer )
 {
-    if ( !IsOpen() ) {
-        return "Not Available";
+    if ( transfer == NULL ) {
+        return PointerNULL;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].manufacturer;
+    transfer->m_isRead = true;
+
+    return SubmitPipeTransfer( transfer, 0xA0, 0xBF );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the Number Endpoints from the device.
+Queues an asynchronous write to a Pipe In endpoint from the caller's buffer. See SubmitReadFromPipeOut().
+
+Parameters:
+[in] 	transfer 	The transfer. epAddr, data and length must be set. The length must be a multiple of the USB max packet size.
 
 Returns:
-Number of Endpoints. If a device is not open, return DeviceNotOpen.
+ErrorCode
 */
 
-int OpenOK::GetNumberEndpoints( unsigned int numberInterface )
+OpenOK::ErrorCode OpenOK::SubmitWriteToPipeIn( OpenOK_PipeTransfer *transfer )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( transfer == NULL ) {
+        return PointerNULL;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].bNumEndpoints[ numberInterface ];
+    transfer->m_isRead = false;
+
+    return SubmitPipeTransfer( transfer, 0x80, 0x9F );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the maximum packet size of endpoint from the device.
+Handles USB events for the asynchronous pipe API, completing transfers and submitting the next ones.
+Returns when at least one event has been handled or the timeout expires.
+
+Parameters:
+[in] 	timeoutMilliseconds 	The maximum time to wait for an event.
 
 Returns:
-The maximum packet size of endpoint. If a device is not open, return DeviceNotOpen.
+ErrorCode
 */
 
-int OpenOK::GetMaxPacketSizeEndpoint( unsigned int numberEndpoint )
+OpenOK::ErrorCode OpenOK::HandlePipeEvents( int timeoutMilliseconds )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    struct timeval tv;
+
+    tv.tv_sec = timeoutMilliseconds / 1000;
+    tv.tv_usec = ( timeoutMilliseconds % 1000 ) * 1000;
+
+    const int responseLibusb = libusb_handle_events_timeout_completed( m_ctx, &tv, NULL );
+
+    if ( responseLibusb != LIBUSB_SUCCESS ) {
+        PrintStdError( "HandlePipeEvents()",
+                       "libusb_handle_events_timeout_completed() failed",
+                       responseLibusb );
+
+        return LibusbError;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].wMaxPacketSize[ numberEndpoint ];
+    return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the endpoint address from the device.
-
 Returns:
-The endpoint address. If a device is not open, return DeviceNotOpen.
+The oldest completed transfer, removing it from the completion queue, or NULL if there is none.
 */
 
-int OpenOK::GetEndpointAddress( unsigned int numberEndpoint )
+OpenOK_PipeTransfer *OpenOK::GetCompletedPipeTransfer()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( m_pipeCompleted.empty() ) {
+        return NULL;
     }
-    return m_listOKDevices[ m_indexOpenedDevice ].bEndpointAddress[ numberEndpoint ];
+
+    OpenOK_PipeTransfer *transfer = m_pipeCompleted.front();
+    m_pipeCompleted.pop_front();
+
+    return transfer;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method retrieves the last length transferred bytes from the device or to pc.
-
 Returns:
-The last length transferred bytes. If a device is not open, return DeviceNotOpen.
+The number of submitted transfers which have not completed.
 */
 
-long OpenOK::GetLastTransferLength()
+int OpenOK::GetPendingPipeTransfers()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
-    return m_lastTransferred;
+    return m_pipeQueue.size();
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Parameters:
-[out] 	pll 	A reference to an okCPLL22150 object.
-Returns:
-ErrorCode
-This method retrieves the current PLL configuration from the on-board XEM EEPROM.
-The pll object is then initialized with this configuration.
-
-ErrorCodes: NoError, DeviceNotOpen
+Cancels all pending asynchronous transfers and waits for the transfer in progress to stop.
+Cancelled transfers complete with status Failed.
 */
 
-OpenOK::ErrorCode OpenOK::GetEepromPLL22150Configuration( OpenOK_CPLL22150 &pll )
+void OpenOK::CancelPipeTransfers()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( m_pipeQueue.empty() ) {
+        return;
     }
 
-    unsigned char dataControl[ sizeRegistersPLL22150 ];
+    m_pipeCancelling = true;
 
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlReadMode,
-                                                 0xb0,
-                                                 0x1ff0,
-                                                 0x0000,
-                                                 dataControl,
-                                                 sizeRegistersPLL22150,
-                                                 m_timeoutUSB );
+    if ( m_pipeActive ) {
+        libusb_cancel_transfer( m_controlURB );
 
-    // Read Eeprom PLL
-    if ( responseControl < 0 ) {
-        PrintStdError( "GetEepromPLL22150Configuration()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
-        return ControlTransferError;
-    }
+        for ( size_t i = 0; i < m_allURBs.size(); i++ ) {
+            libusb_cancel_transfer( m_allURBs[ i ] );
+        }
 
-    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
-        pll.m_registersPLL[ n ] = dataControl[ n ];
+        // Cancellation is asynchronous; wait for the callbacks.
+        for ( int i = 0; ( i < 100 ) && m_pipeActive; i++ ) {
+            HandlePipeEvents( 100 );
+        }
     }
 
-    pll.m_referenceFrequency = m_crystalReference;
+    // The rest never started.
+    while ( !m_pipeQueue.empty() ) {
+        OpenOK_PipeTransfer *transfer = m_pipeQueue.front();
+        m_pipeQueue.pop_front();
 
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+        transfer->status = Failed;
+        m_pipeCompleted.push_back( transfer );
 
-/*
-Parameters:
-[in] 	pll 	A reference to an okCPLL22150 object.
-Returns:
-ErrorCode
-Reads the current PLL configuration over the I2C bus and modifies the pll argument to reflect that configuration.
+        if ( transfer->callback ) {
+            transfer->callback( transfer );
+        }
+    }
 
-ErrorCodes: NoError, DeviceNotOpen
-*/
+    m_pipeCancelling = false;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-OpenOK::ErrorCode OpenOK::GetPLL22150Configuration( OpenOK_CPLL22150 &pll )
+OpenOK::ErrorCode OpenOK::SubmitPipeTransfer( OpenOK_PipeTransfer *transfer, int32_t endpointLower, int32_t endpointUpper )
 {
     if ( !IsOpen() ) {
         return DeviceNotOpen;
     }
 
-    unsigned char dataControl[ sizeRegistersPLL22150 ];
-
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlReadMode,
-                                                 0xb1,
-                                                 0x0000,
-                                                 0x0000,
-                                                 dataControl,
-                                                 sizeRegistersPLL22150,
-                                                 m_timeoutUSB );
-
-    // Read Cypress PLL
-    if ( responseControl < 0 ) {
-        PrintStdError( "GetPLL22150Configuration()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
-
-        return ControlTransferError;
+    if ( m_transport != &m_libusbTransport ) {
+        return UnsupportedFeature;
     }
 
-    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
-        pll.m_registersPLL[ n ] = dataControl[ n ];
+    if ( ( transfer->epAddr < endpointLower ) || ( transfer->epAddr > endpointUpper ) ) {
+        return RangeAddressError;
     }
 
-    pll.m_referenceFrequency = m_crystalReference;
-
-    return NoError;
-}
-//---------------------------------------------------------------------------------------------------------------------------------
+    if ( transfer->data == NULL ) {
+        return PointerNULL;
+    }
 
-/*
-Parameters:
-[in] 	pll 	A reference to an okCPLL22150 object.
-Returns:
-ErrorCode
-Configures the on-board PLL via the I2C bus using the configuration information in the pll object.
+    // The length is sent in 4 bytes but the documented maximum for a pipe transfer is 16,777,215 bytes.
+    if ( ( transfer->length <= 0 ) || ( transfer->length > 0xFFFFFF ) ) {
+        return SignedArgumentError;
+    }
 
-ErrorCodes: NoError, DeviceNotOpen
-*/
+    // The remainder step of ReadWritePipe() is not supported.
+    if ( ( transfer->length % m_maxPacketSize ) != 0 ) {
+        return InvalidBlockSize;
+    }
 
-OpenOK::ErrorCode OpenOK::SetEepromPLL22150Configuration( OpenOK_CPLL22150 &pll )
-{
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    if ( m_pipeCancelling ) {
+        return Failed;
     }
 
-    unsigned char dataControl[ sizeRegistersPLL22150 ];
+    // URBs are allocated once and reused.
+    if ( m_controlURB == NULL ) {
+        m_controlURB = libusb_alloc_transfer( 0 );
 
-    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
-        dataControl[ n ] = pll.m_registersPLL[ n ];
+        if ( m_controlURB == NULL ) {
+            return LibusbError;
+        }
     }
 
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlWriteMode,
-                                                 0xb0,
-                                                 0x1ff0,
-                                                 0x0000,
-                                                 dataControl,
-                                                 sizeRegistersPLL22150,
-                                                 m_timeoutUSB );
-    // Write Eeprom PLL
-    if ( responseControl < 0 ) {
-        PrintStdError( "SetEepromPLL22150Configuration()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
+    while ( (int) m_allURBs.size() < m_numberURBs ) {
+        struct libusb_transfer *urb = libusb_alloc_transfer( 0 );
 
-        return ControlTransferError;
+        if ( urb == NULL ) {
+            return LibusbError;
+        }
+        m_allURBs.push_back( urb );
+        m_freeURBs.push_back( urb );
+        m_urbSubmitted.push_back( timespec() );
     }
 
-    pll.m_referenceFrequency = m_crystalReference;
+    transfer->transferred = 0;
+    transfer->status = NoError;
+    transfer->m_submitted = 0;
+    transfer->m_inFlight = 0;
+    transfer->m_error = NoError;
 
+    m_pipeQueue.push_back( transfer );
+
+    if ( !m_pipeActive ) {
+        StartPipeTransfer();
+    }
     return NoError;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-Parameters:
-[in] 	pll 	A reference to an okCPLL22150 object.
-Returns:
-ErrorCode
-Configures the on-board PLL via the I2C bus using the configuration information in the pll object.
+Starts the transfer at the front of the queue with the setup packet, as for ReadWritePipe().
+The bulk transfers are submitted when the setup has completed.
 
-ErrorCodes: NoError, DeviceNotOpen
+Unless WRITE_READ_FAST is defined, ReadWritePipe() brackets the transfer with CheckEnable() and CheckDisable().
+These are synchronous and can't be called from a libusb callback, so here they are chained asynchronously on
+m_controlURB instead: enable check, setup, bulk transfers, disable check.
 */
 
-OpenOK::ErrorCode OpenOK::SetPLL22150Configuration( OpenOK_CPLL22150 &pll )
+void OpenOK::StartPipeTransfer()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
+    m_pipeActive = true;
 
-    unsigned char dataControl[ sizeRegistersPLL22150 ];
+#if !defined(WRITE_READ_FAST)
+    m_pipeStage = PipeStageEnable;
+    SubmitPipeCheck( 0xb3, 2 );
+#else
+    SubmitPipeSetup();
+#endif
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    for ( unsigned char n = 0; n < sizeRegistersPLL22150; ++n ) {
-        dataControl[ n ] = pll.m_registersPLL[ n ];
-    }
+void OpenOK::SubmitPipeSetup()
+{
+    OpenOK_PipeTransfer *transfer = m_pipeQueue.front();
 
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlWriteMode,
-                                                 0xb1,
-                                                 0x0000,
-                                                 0x0000,
-                                                 dataControl,
-                                                 sizeRegistersPLL22150,
-                                                 m_timeoutUSB );
+    uint8_t *dataControl = m_pipeSetup + LIBUSB_CONTROL_SETUP_SIZE;
+    uint16_t lengthDataControl = 2;
 
-    // Write Cypress PLL
-    if ( responseControl < 0 ) {
-        PrintStdError( "SetPLL22150Configuration()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
-        return ControlTransferError;
+    dataControl[ 0 ] = transfer->epAddr;
+
+    if ( transfer->m_isRead ) {
+        dataControl[ 1 ] = 0x06;
+        dataControl[ 2 ] = transfer->length & 255;
+        dataControl[ 3 ] = ( transfer->length >> 8 ) & 255;
+        dataControl[ 4 ] = ( transfer->length >> 16 ) & 255;
+        dataControl[ 5 ] = ( transfer->length >> 24 ) & 255;
+
+        lengthDataControl = 6;
+    } else {
+        dataControl[ 1 ] = 0x04;
     }
 
-    pll.m_referenceFrequency = m_crystalReference;
+    libusb_fill_control_setup( m_pipeSetup, controlWriteMode, 0xb7, m_maxPacketSize, 0x0000, lengthDataControl );
+    libusb_fill_control_transfer( m_controlURB, m_deviceHandle, m_pipeSetup, PipeControlCallback, this, m_timeoutUSB );
 
-    return NoError;
+    m_pipeStage = PipeStageSetup;
+
+    m_controlSubmitted.tv_sec = m_controlSubmitted.tv_nsec = 0;
+    OpenOK_TransferTrace::Start( &m_controlSubmitted );
+
+    const int responseLibusb = libusb_submit_transfer( m_controlURB );
+
+    if ( responseLibusb != LIBUSB_SUCCESS ) {
+        PrintStdError( "SubmitPipeSetup()",
+                       "libusb_submit_transfer() failed",
+                       responseLibusb );
+
+        CompletePipeTransfer( LibusbError );
+    }
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method modifies the XEM Device ID string with the new string.
-The Device ID string is a user-programmable string of up to 32 characters
-that can be used to uniquely identify a particular XEM. The string will be truncated if it exceeds 32 characters.
-
-Parameters:
-[in] 	str 	A string containing the new Device ID.
+Submits the request used by CheckEnable() (0xb3) or CheckDisable() (0xb8); the response is checked in PipeControlCallback().
 */
 
-void OpenOK::SetDeviceID( const std::string str )
+void OpenOK::SubmitPipeCheck( uint8_t request, uint16_t length )
 {
-    if ( !IsOpen() ) {
-        return;
-    }
+    libusb_fill_control_setup( m_pipeCheck, controlReadMode, request, 0x0000, 0x0000, length );
+    libusb_fill_control_transfer( m_controlURB, m_deviceHandle, m_pipeCheck, PipeControlCallback, this, m_timeoutUSB );
 
-    unsigned char* s = reinterpret_cast< unsigned char* >( const_cast< char* >( str.c_str() ) );
+    m_controlSubmitted.tv_sec = m_controlSubmitted.tv_nsec = 0;
+    OpenOK_TransferTrace::Start( &m_controlSubmitted );
 
-    const int responseControl = ControlTransfer( m_deviceHandle,
-                                                 controlWriteMode,
-                                                 0xb0,
-                                                 0x1fd0,
-                                                 0x0000,
-                                                 s,
-                                                 32,
-                                                 m_timeoutUSB );
+    const int responseLibusb = libusb_submit_transfer( m_controlURB );
 
-    if ( responseControl < 0 ) {
-        PrintStdError( "SetDeviceID()",
-                       "ControlTransfer() failed",
-                       0,
-                       responseControl );
+    if ( responseLibusb != LIBUSB_SUCCESS ) {
+        PrintStdError( "SubmitPipeCheck()",
+                       "libusb_submit_transfer() failed",
+                       responseLibusb );
 
-        return;
+        CompletePipeTransfer( LibusbError );
     }
-    strncpy( m_listOKDevices [m_indexOpenedDevice ].deviceID, str.c_str(), OpenOK_device::SSIZE );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
-
-Returns:
-Total
+Keeps up to m_numberURBs bulk transfers in flight for the transfer in progress.
 */
 
-int OpenOK::SendDataBitFile( unsigned char endp, unsigned char *bytes, unsigned int size, unsigned int timeout )
+void OpenOK::SubmitPipeURBs()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
-
-    if ( size <= 0 ) {
-        return SignedArgumentError;
-    }
-
-    unsigned int totalSend = 0;
+    OpenOK_PipeTransfer *transfer = m_pipeQueue.front();
 
-    const unsigned int num1 = size >> 14; // Multiple of 16384 (Maximum of bytes that transfers Bulk Package)
-    const unsigned int num2 = size - ( num1 << 14 );// Remainder to give.
+    while ( !m_freeURBs.empty() && ( transfer->m_submitted < transfer->length ) && ( transfer->m_error == NoError ) ) {
+        struct libusb_transfer *urb = m_freeURBs.back();
 
-    if ( num1 ) {
-        for ( unsigned int j = 0; j < num1; ++j ) {
-            int transferred = 0;
-            int responseBulk = 0;
+        long size = transfer->length - transfer->m_submitted;
 
-            responseBulk = BulkTransfer( m_deviceHandle,
-                                         endp,
-                                         bytes + ( j << 14 ),
-                                         16384,
-                                         &transferred,
-                                         timeout );
+        if ( size > m_sizeURB ) {
+            size = m_sizeURB;
+        }
 
-            if ( responseBulk < 0 ) {
-                PrintStdError( "SendDataBitFile()",
-                               "BulkTransfer() failed - Step 01",
-                               0,
-                               responseBulk );
+        libusb_fill_bulk_transfer( urb, m_deviceHandle,
+                                   transfer->m_isRead ? endpointIN : endpointOUT,
+                                   transfer->data + transfer->m_submitted, size,
+                                   PipeBulkCallback, this, m_timeoutUSB );
 
-                return responseBulk;
-            }
-            totalSend += transferred;
+        if ( OpenOK_TransferTrace::IsEnabled() ) {
+            OpenOK_TransferTrace::Start( &m_urbSubmitted[ PipeURBIndex( urb ) ] );
         }
-    }
-
-    if ( num2 ) {
-        int transferred = 0;
-        int responseBulk = 0;
 
-        responseBulk = BulkTransfer( m_deviceHandle,
-                                     endp,
-                                     bytes + ( ( num1 << 14 ) ),
-                                     num2,
-                                     &transferred,
-                                     timeout );
+        const int responseLibusb = libusb_submit_transfer( urb );
 
-        if ( responseBulk < 0 ) {
-            PrintStdError( "SendDataBitFile()",
-                           "BulkTransfer() failed - Step 02",
-                           0,
-                           responseBulk );
+        if ( responseLibusb != LIBUSB_SUCCESS ) {
+            PrintStdError( "SubmitPipeURBs()",
+                           "libusb_submit_transfer() failed",
+                           responseLibusb );
 
-            return responseBulk;
+            transfer->m_error = LibusbError;
+            break;
         }
-        totalSend += transferred;
+
+        m_freeURBs.pop_back();
+        transfer->m_submitted += size;
+        transfer->m_inFlight++;
     }
 
-    if ( totalSend != size ) {
-        return NotSentBitFile;
+    if ( transfer->m_inFlight == 0 ) {
+        FinishPipeTransfer( transfer->m_error );
     }
-    return totalSend;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-OpenOK::ErrorCode OpenOK::SendPaddedFileToFPGA( unsigned char* buffer, const unsigned int size )
+/*
+Called when the bulk transfers are done. The disable check is made whatever the outcome, as in ReadFromBlockPipeOut(),
+except when cancelling.
+*/
+
+void OpenOK::FinishPipeTransfer( int status )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+#if !defined(WRITE_READ_FAST)
+    if ( !m_pipeCancelling ) {
+        m_pipeQueue.front()->m_error = status;
+        m_pipeStage = PipeStageDisable;
+        SubmitPipeCheck( 0xb8, 1 );
+        return;
     }
+#endif
+    CompletePipeTransfer( status );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( ControlStatus( controlWriteMode ) == NoError ) {
-        // do a bulk transfer of the file to endpoint 0x02, starting with the header of the xilinx file
-        // ff ff ff ff aa 99 55 66. however every byte is sent as an int16 with the actual byte in the upper bits, ie 0xff -> 0xff00
-        // this was taken care of in the loading and parsing of the file
+void OpenOK::CompletePipeTransfer( int status )
+{
+    OpenOK_PipeTransfer *transfer = m_pipeQueue.front();
+    m_pipeQueue.pop_front();
 
-#ifdef QT_CORE_LIB
-        SleepUtil::usleep( 3200 );
-#else
-        usleep(3200);
-#endif
+    if ( ( status == NoError ) && ( transfer->transferred != transfer->length ) ) {
+        status = TransferError;
+    }
 
-        const int sent = SendDataBitFile( endpointOUT, buffer, size, 2000 );
+    transfer->status = status;
+    m_lastTransferred = transfer->transferred;
+    m_pipeActive = false;
 
-        // can not compare to zero, the return can be NoError
-        if ( sent < 0 ) {
-            return static_cast< OpenOK::ErrorCode > ( sent );
-        }
+    m_pipeCompleted.push_back( transfer );
 
-#ifdef QT_CORE_LIB
-        SleepUtil::usleep( 1000 );
-#else
-        usleep( 1000 );
-#endif
+    if ( transfer->callback ) {
+        transfer->callback( transfer );
+    }
 
-        if ( static_cast< unsigned int > ( sent ) == size ) {
-            return ControlStatus( controlReadMode );
-        }
+    // The callback may have submitted a transfer, which will have started it.
+    if ( !m_pipeActive && !m_pipeQueue.empty() && !m_pipeCancelling ) {
+        StartPipeTransfer();
     }
-    return NotConfigureFPGA;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-template< class iterator >
-OpenOK::ErrorCode OpenOK::SendFileToFPGA( iterator it, iterator end )
+void OpenOK::FreePipeURBs()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    for ( size_t i = 0; i < m_allURBs.size(); i++ ) {
+        libusb_free_transfer( m_allURBs[ i ] );
     }
+    m_allURBs.clear();
+    m_freeURBs.clear();
+    m_urbSubmitted.clear();
 
-    ErrorCode error = NoError;
-
-    unsigned int length = 0;
-    unsigned char lengthDummy = 0;
-
-    std::vector<unsigned char> buffer;
-
-    std::string str;
-
-    // Number of header fields + data field
-    static const unsigned char numberFields = 7;
-
-    for( unsigned char j = 0 ; j < numberFields ; ++j ) {
+    if ( m_controlURB ) {
+        libusb_free_transfer( m_controlURB );
+        m_controlURB = NULL;
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        str = "";
+int OpenOK::PipeURBIndex( const struct libusb_transfer *urb ) const
+{
+    size_t i = 0;
 
-        if ( j < ( numberFields - 1 ) ) { // Read Header
-            length = ( *it & 255 ) << 8;
-            length += ( *(++it) & 255 );
+    while ( i < m_allURBs.size() - 1 && m_allURBs[ i ] != urb ) {
+        i++;
+    }
+    return i;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            for ( unsigned int n = 0 ; n < length ; ++n ) {
-                str += ( *(++it) & 255 );
-            }
+void LIBUSB_CALL OpenOK::PipeControlCallback( struct libusb_transfer *urb )
+{
+    OpenOK *ok = static_cast<OpenOK *>( urb->user_data );
 
-            ++it;
+    TraceURB( ok->m_controlSubmitted, urb );
 
-            if ( ( *it & 255 ) == 'a' || ( *it & 255 ) == 'b' || ( *it & 255 ) == 'c' || ( *it & 255 ) == 'd' ||
-                 ( *it & 255 ) == 'e' ) {
-                ++it;
-            }
-        } else if ( j == ( numberFields - 1 ) ) { // Read Data
-            length = ( *it & 255 ) << 24;
-            length += ( *(++it) & 255 ) << 16;
-            length += ( *(++it) & 255 ) << 8;
-            length += ( *(++it) & 255 );
+    if ( ok->m_pipeStage == PipeStageDisable ) {
+        // An error from the transfer itself takes precedence.
+        int status = ok->m_pipeQueue.front()->m_error;
 
-            for ( unsigned int n = 0 ; n < length ; ++n ) {
-                ++it;
+        if ( status == NoError ) {
+            if ( ( urb->status != LIBUSB_TRANSFER_COMPLETED ) || ( urb->actual_length != 1 ) ) {
+                status = CommunicationError;
+            } else if ( libusb_control_transfer_get_data( urb )[ 0 ] != 0x00 ) {
+                ok->PrintStdError( "PipeControlCallback()",
+                                   "CheckDisable invalid response" );
 
-                if ( it != end ) {
-                    if ( ( *it & 255 ) == 0xFF ) {
-                        lengthDummy++;
-                    } else if ( ( *it & 255 ) == 0xAA ) {
-                        break;
-                    }
-                } else {
-                    return NotFoundSyncWord;
-                }
+                status = CheckDisableInvalidResponse;
             }
         }
+        ok->CompletePipeTransfer( status );
+        return;
+    }
 
-        switch( j ) {
-            case 0 :
-                break;
-
-            case 1 :
-                break;
-
-            case 2 :
-                m_bitStream.designName = str;
-                break;
-
-            case 3 :
-                m_bitStream.partName = str;
-                break;
-
-            case 4 :
-                m_bitStream.date = str;
-                break;
-
-            case 5 :
-                m_bitStream.time = str;
-                break;
+    if ( urb->status != LIBUSB_TRANSFER_COMPLETED ) {
+        ok->CompletePipeTransfer( urb->status == LIBUSB_TRANSFER_TIMED_OUT ? Timeout : TransferError );
+        return;
+    }
 
-            case 6 :
-                m_bitStream.dataLen = length;
-                m_bitStream.dummyLen = lengthDummy;
+    if ( ok->m_pipeCancelling ) {
+        ok->CompletePipeTransfer( Failed );
+        return;
+    }
 
-                if ( lengthDummy <= 4 ) {
-                    m_bitStream.addPadWord = true;
-                } else {
-                    m_bitStream.addPadWord = false;
-                }
+    if ( ok->m_pipeStage == PipeStageEnable ) {
+        const unsigned char *dataControl = libusb_control_transfer_get_data( urb );
 
-                for ( unsigned int n = 0 ; n < m_bitStream.dataLen ; ++n ) {
-                    if ( n < m_bitStream.dummyLen ) {
-                        buffer.push_back( 0xFF );
+        if ( urb->actual_length != 2 ) {
+            ok->CompletePipeTransfer( CommunicationError );
+        } else if ( ( dataControl[ 0 ] != 0xd7 ) || ( dataControl[ 1 ] != 0xa5 ) ) {
+            ok->PrintStdError( "PipeControlCallback()",
+                               "CheckEnable invalid response" );
 
-                        if ( m_bitStream.addPadWord ) {
-                            buffer.push_back(0x00);
-                        }
-                    } else {
-                        buffer.push_back( ( *it & 255 ) );
+            ok->CompletePipeTransfer( CheckEnableInvalidResponse );
+        } else {
+            ok->SubmitPipeSetup();
+        }
+        return;
+    }
 
-                        if ( m_bitStream.addPadWord ) {
-                            buffer.push_back(0x00);
-                        }
+    ok->SubmitPipeURBs();
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-                        ++it;
-                    }
-                }
-                break;
+void LIBUSB_CALL OpenOK::PipeBulkCallback( struct libusb_transfer *urb )
+{
+    OpenOK *ok = static_cast<OpenOK *>( urb->user_data );
+    OpenOK_PipeTransfer *transfer = ok->m_pipeQueue.front();
+
+    if ( OpenOK_TransferTrace::IsEnabled() ) {
+        struct timespec &submitted = ok->m_urbSubmitted[ ok->PipeURBIndex( urb ) ];
+        TraceURB( submitted, urb );
+        submitted.tv_sec = submitted.tv_nsec = 0;
+    }
+
+    ok->m_freeURBs.push_back( urb );
+    transfer->m_inFlight--;
+    transfer->transferred += urb->actual_length;
+
+    if ( transfer->m_error == NoError ) {
+        if ( urb->status == LIBUSB_TRANSFER_TIMED_OUT ) {
+            transfer->m_error = Timeout;
+        } else if ( urb->status == LIBUSB_TRANSFER_CANCELLED ) {
+            transfer->m_error = Failed;
+        } else if ( ( urb->status != LIBUSB_TRANSFER_COMPLETED ) || ( urb->actual_length != urb->length ) ) {
+            transfer->m_error = TransferError;
+        }
 
-            default :
-                error = ReadBitFileError;
-                break;
+        // Stop the rest of this transfer; URBs on an endpoint complete in order, so the data would be out of place.
+        if ( transfer->m_error != NoError ) {
+            for ( size_t i = 0; i < ok->m_allURBs.size(); i++ ) {
+                libusb_cancel_transfer( ok->m_allURBs[ i ] );
+            }
         }
     }
-    error = SendPaddedFileToFPGA( &buffer[ 0 ], buffer.size() );
 
-    return error;
+    if ( ok->m_pipeCancelling && ( transfer->m_error == NoError ) ) {
+        transfer->m_error = Failed;
+    }
+
+    ok->SubmitPipeURBs();
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method downloads a configuration file to the FPGA. The filename should be that of a valid Xilinx bitfile (generated from bitgen).
-
-Parameters:
-[in] 	strFilename 	A string containing the filename of the configuration file.
-
-Returns:
-0 if successful, error code otherwise.
-NO_ERROR - Configuration has occurred successfully.
-DONE_NOT_HIGH - FPGA DONE signal did not assert.
-TRANSFER_ERROR - USB error has occurred during download.
-COMMUNICATION_ERROR - Communication error with the firmware.
-INVALID_BITSTREAM - The bitstream is not properly formatted.
-FILE_ERROR - File error occurred during open or read.
-DEVICE_NOT_OPEN - Communication with a device is not established.
+OpenOK_Transaction
 */
 
-OpenOK::ErrorCode OpenOK::ConfigureFPGA( const std::string strFilename )
+OpenOK_Transaction::OpenOK_Transaction()
+    : status( OpenOK::NoError )
+    , m_readWireOuts( false )
+    , m_readTriggerOuts( false )
+    , m_gotSnapshot( false )
+    , m_ok( NULL )
+    , m_pending( 0 )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
-
-    // FPGA configuration is sent as a bulk transfer, with a control transfer preceding to
-    // tell the device to expect configuration data.
-    // the control transfer has no data bytes, and has setup packet 0x40 b2 00 00 00 00 00 00
-    // the bulk transfer is the bitstream from a Xilinx .bit file, starting with the dummy bytes ( FF FF FF FF ) +
-    // sync word ( AA 99 55 66 )
-    // however the bitstream is sent with each byte padded to 16bits on the right, so 0xFF becomes 0xFF00 in the
-    // data actually sent over USB.
-    // in the real library, a configure call is ended with another control transfer, this appears to be a check to
-    // see if configuration was successful
-    // the transfer has 1 data byte and the setup packet is 0xc0 b2 00 00 00 00 01 00. a byte of 0x01 is returned on success,
-    // and I have seen a byte of
-    // 0x02 returned when it didn't work, but I don't know what the 0x02 means,
-    // or if there are other return values indicating other errors
-
-    // configures the fpga on an xem with the bitstream in Filename
-
-    // first get and parse the bitstream from the file
-    std::basic_ifstream< char > file( strFilename.c_str(), std::ios_base::in | std::ios_base::binary );
+    snapshotTime.tv_sec = 0;
+    snapshotTime.tv_nsec = 0;
 
-    if ( file ) {
-        std::istreambuf_iterator< char > it( file );
-        std::istreambuf_iterator< char > eos;
-
-        return SendFileToFPGA( it, eos );
+    for ( int i = 0; i < MAX_URBS; ++i ) {
+        m_urbs[ i ] = NULL;
     }
-    return NotOpenBitFile;
+    memset( m_buffers, 0, sizeof( m_buffers ) );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-OpenOK::ErrorCode OpenOK::ConfigureFPGAFromMemory( unsigned char *data, const unsigned long length )
+OpenOK_Transaction::~OpenOK_Transaction()
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
+    for ( int i = 0; i < MAX_URBS; ++i ) {
+        if ( m_urbs[ i ] != NULL ) {
+            libusb_free_transfer( m_urbs[ i ] );
+        }
     }
-    return SendFileToFPGA( data, data + length );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method Read/Write data from/to Pipe Out/In.
-
-Parameters:
-[in] 	epAddr 	The address of the destination Pipe In/Out.
-[in] 	length 	The length of the transfer.
-[in] 	data 	A pointer to the transfer data buffer.
-
-Returns:
-The number of bytes written/read or ErrorCode if the write failed.
+Queues a Wire In write. All the Wire In writes in a transaction are sent in a single transfer, before the reads.
+See OpenOK::SetWireInValue().
 */
 
-inline long OpenOK::ReadWritePipe( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
-                                   int32_t magicNumber1, int32_t magicNumber2, int64_t length, uint8_t *data )
+void OpenOK_Transaction::SetWireInValue( int epAddr, unsigned long val, unsigned long mask )
 {
-    if ( !IsOpen() ) {
-        return DeviceNotOpen;
-    }
+    WireIn wireIn;
 
-    int32_t totalTranferred = 0;
+    wireIn.epAddr = epAddr;
+    wireIn.val = val;
+    wireIn.mask = mask;
 
-    const uint8_t sizeDataControl = 6;
-    uint8_t dataControl[ sizeDataControl ];
+    m_wireIns.push_back( wireIn );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    uint8_t lengthDataControl = 2;
+/*
+Requests a read of all Wire Outs
+*/
 
-    // If address not valid.
-    if ( ( epAddr < endpointLower ) || ( epAddr > endpointUpper ) ) {
-        return RangeAddressError;
-    }
+void OpenOK_Transaction::UpdateWireOuts()
+{
+    m_readWireOuts = true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    if ( length <= 0 ) {
-        return SignedArgumentError;
-    }
+/*
+Requests a read of all Trigger Outs. The Trigger Outs are read before the Wire Outs.
+*/
 
-    // Odd transfers will be shortened by one byte.
-    if ( ( length % 2 ) != 0 ) {
-        PrintStdError( "ReadWritePipe()",
-                       "Odd transfers will be shortened by one byte" );
+void OpenOK_Transaction::UpdateTriggerOuts()
+{
+    m_readTriggerOuts = true;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void OpenOK_Transaction::Clear()
+{
+    m_wireIns.clear();
+    m_readWireOuts = false;
+    m_readTriggerOuts = false;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-        length -= 1;
-    }
+/*
+Returns:
+The value of a Wire Out (0x20 to 0x3F) read by the transaction
+*/
 
-    // First step : transferred multiples of 16384.
-    const uint32_t multipleMaxBulkPackage = length >> 14;// Multiple of 16384 (Maximum of bytes that transfers Bulk Package).
-    const uint32_t lenghtFirstPackage = ( multipleMaxBulkPackage << 14 );// Maximum multiple of 16384.
+int OpenOK_Transaction::GetWireOutValue( int epAddr )
+{
+    if ( !m_readWireOuts || ( epAddr < 0x20 ) || ( epAddr > 0x3F ) ) {
+        return 0;
+    }
 
-    // Second step : transferred multiples of MaxPacketSize.
-    const uint32_t multipleMaxPacketSize = ( length - lenghtFirstPackage ) >> m_shiftMaxPacketSize;// Multiple of USB MaxPacketSize.
-    const uint32_t lenghtSecondPackage = ( multipleMaxPacketSize << m_shiftMaxPacketSize );// Maximum multiple of USB MaxPacketSize.
+    const unsigned char *wireOuts = m_buffers[ 2 ] + LIBUSB_CONTROL_SETUP_SIZE;
+    const unsigned char idx = ( epAddr - 0x20 ) << 1;
 
-    // Third step : transferred remaining.
-    const uint32_t remaining = length - lenghtFirstPackage - lenghtSecondPackage;
-    const uint32_t lenghtRemaining = remaining % 2 ? (remaining - 1) : remaining;// Remaining to give.
-    const uint32_t halfLenghtRemaining = lenghtRemaining >> 1; // Half of the remaining to give.
+    return ( wireOuts[ idx + 1 ] << 8 ) + wireOuts[ idx ];
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-#if !defined(WRITE_READ_FAST)
-    ErrorCode error = CheckEnable();
+/*
+Returns:
+True if any of the Trigger Outs (0x60 to 0x7F) in mask was set when the transaction read them
+*/
 
-    if ( error != NoError ) {
-        return error;
+bool OpenOK_Transaction::IsTriggered( int epAddr, unsigned long mask )
+{
+    if ( !m_readTriggerOuts || ( epAddr < 0x60 ) || ( epAddr > 0x7F ) ) {
+        return false;
     }
-#endif
 
-    if ( lenghtFirstPackage || lenghtSecondPackage ) {
-        dataControl[ 0 ] = epAddr;
-        dataControl[ 1 ] = magicNumber1;
+    const unsigned char *triggerOuts = m_buffers[ 1 ] + LIBUSB_CONTROL_SETUP_SIZE;
+    const unsigned char idx = ( epAddr - 0x60 ) << 1;
 
-        if ( endpointDir == endpointIN ) {
-            dataControl[ 2 ] = ( lenghtFirstPackage + lenghtSecondPackage ) & 255;
-            dataControl[ 3 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 8 ) & 255;
-            dataControl[ 4 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 16 ) & 255;
-            dataControl[ 5 ] = ( ( lenghtFirstPackage + lenghtSecondPackage ) >> 24 ) & 255;
+    return ( ( ( triggerOuts[ idx + 1 ] << 8 ) + triggerOuts[ idx ] ) & mask ) != 0;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
 
-            lengthDataControl = sizeDataControl;
-        }
+/*
+Submits the transfers of a transaction. The Wire In write (if any Wire Ins have been set), the Trigger Out read and the
+Wire Out read are all submitted at once, in that order, so that they follow each other on the bus without waiting for the host.
 
-        const int responseControl = ControlTransfer( m_deviceHandle,
-                                                     controlWriteMode,
-                                                     0xb7,
-                                                     m_maxPacketSize,
-                                                     0x0000,
-                                                     dataControl,
-                                                     lengthDataControl,
-                                                     m_timeoutUSB );
-        if ( responseControl < 0 ) {
-            PrintStdError( "ReadWritePipe()",
-                           "ControlTransfer() failed - Step 01 or Step 02",
-                           0,
-                           responseControl );
+The transaction completes within HandlePipeEvents() or WaitForTransaction(). When it has completed, the values read are
+available from the transaction and are also copied to this object, as by UpdateWireOuts() and UpdateTriggerOuts().
 
-            return responseControl;
-        }
+Parameters:
+[in] 	transaction 	The transaction. It must not be pending.
 
-        // Write/Read Multiple of 16384.
-        if ( lenghtFirstPackage ) {
-            int32_t transferred = 0;
+Returns:
+ErrorCode
+*/
 
-            int32_t responseBulk = BulkTransfer( m_deviceHandle,
-                                                 endpointDir,
-                                                 data,
-                                                 lenghtFirstPackage,
-                                                 &transferred,
-                                                 m_timeoutUSB );
+OpenOK::ErrorCode OpenOK::SubmitTransaction( OpenOK_Transaction *transaction )
+{
+    if ( transaction == NULL ) {
+        return PointerNULL;
+    }
 
-            if ( responseBulk < 0 ) {
-                PrintStdError( "ReadWritePipe()",
-                               "BulkTransfer() failed - Step 01",
-                               0,
-                               responseBulk );
+    if ( !IsOpen() ) {
+        return DeviceNotOpen;
+    }
 
-                return responseBulk;
-            }
-            totalTranferred += transferred;
-        }
+    if ( !transaction->IsComplete() ) {
+        return OperationNotPermitted;
+    }
 
-        // Write/Read Multiple of USB MaxPacketSize.
-        if ( lenghtSecondPackage ) {
-            int32_t transferred = 0;
+    transaction->m_ok = this;
+    transaction->m_gotSnapshot = false;
+    transaction->status = NoError;
 
-            int32_t responseBulk = BulkTransfer( m_deviceHandle,
-                                                 endpointDir,
-                                                 data + lenghtFirstPackage,
-                                                 lenghtSecondPackage,
-                                                 &transferred,
-                                                 m_timeoutUSB );
+    bool submit[ OpenOK_Transaction::MAX_URBS ];
 
-            if ( responseBulk < 0 ) {
-                PrintStdError( "ReadWritePipe()",
-                               "BulkTransfer() failed - Step 02",
-                               0,
-                               responseBulk );
+    submit[ 0 ] = !transaction->m_wireIns.empty();
+    submit[ 1 ] = transaction->m_readTriggerOuts;
+    submit[ 2 ] = transaction->m_readWireOuts;
 
-                return responseBulk;
-            }
-            totalTranferred += transferred;
+    for ( int i = 0; i < OpenOK_Transaction::MAX_URBS; ++i ) {
+        if ( !submit[ i ] ) {
+            continue;
         }
 
-        m_lastTransferred = totalTranferred;
-
-#if !defined(WRITE_READ_FAST)
-        ErrorCode error = CheckDisable();
+        if ( transaction->m_urbs[ i ] == NULL ) {
+            transaction->m_urbs[ i ] = libusb_alloc_transfer( 0 );
 
-        if ( error != NoError ) {
-            return error;
+            if ( transaction->m_urbs[ i ] == NULL ) {
+                PrintStdError( "SubmitTransaction()",
+                               "libusb_alloc_transfer() failed" );
+                transaction->status = LibusbError;
+                break;
+            }
         }
-#endif
-    }
 
-    // Write/Read remaining.
-    if ( lenghtRemaining ) {
-        dataControl[ 0 ] = epAddr;
-        dataControl[ 1 ] = magicNumber2;
+        unsigned char *buffer = transaction->m_buffers[ i ];
 
-        if ( endpointDir == endpointIN ) {
-            dataControl[ 2 ] = ( lenghtRemaining ) & 255;
-            dataControl[ 3 ] = ( ( lenghtRemaining ) >> 8 ) & 255;
-            dataControl[ 4 ] = ( ( lenghtRemaining ) >> 16 ) & 255;
-            dataControl[ 5 ] = ( ( lenghtRemaining ) >> 24 ) & 255;
+        if ( i == 0 ) {
+            for ( size_t j = 0; j < transaction->m_wireIns.size(); ++j ) {
+                const OpenOK_Transaction::WireIn &wireIn = transaction->m_wireIns[ j ];
+                SetWireInValue( wireIn.epAddr, wireIn.val, wireIn.mask );
+            }
+            transaction->m_wireIns.clear();
 
-            lengthDataControl = sizeDataControl;
+            memcpy( buffer + LIBUSB_CONTROL_SETUP_SIZE, m_wireIns, OpenOK::WIREINSIZE );
+            libusb_fill_control_setup( buffer, controlWriteMode, 0xb5, 0x0000, 0x0000, OpenOK::WIREINSIZE );
+        } else if ( i == 1 ) {
+            libusb_fill_control_setup( buffer, controlReadMode, 0xb5, 0x0060, 0x0001, OpenOK::TRIGGEROUTSIZE );
+        } else {
+            libusb_fill_control_setup( buffer, controlReadMode, 0xb5, 0x0020, 0x0000, OpenOK::WIREOUTSIZE );
         }
 
-        const int responseControl = ControlTransfer( m_deviceHandle,
-                                                     controlWriteMode,
-                                                     0xb7,
-                                                     halfLenghtRemaining,
-                                                     0x0000,
-                                                     dataControl,
-                                                     lengthDataControl,
-                                                     m_timeoutUSB );
-        if ( responseControl < 0 ) {
-            PrintStdError( "ReadWritePipe()",
-                           "ControlTransfer() failed - Step 03",
-                           0,
-                           responseControl );
-
-            return responseControl;
-        }
+        libusb_fill_control_transfer( transaction->m_urbs[ i ], m_deviceHandle, buffer, TransactionCallback, transaction, m_timeoutUSB );
 
-        int32_t transferred = 0;
+        transaction->m_submitted[ i ].tv_sec = transaction->m_submitted[ i ].tv_nsec = 0;
 
-        int32_t responseBulk = BulkTransfer( m_deviceHandle,
-                                             endpointDir,
-                                             data + ( lenghtFirstPackage + lenghtSecondPackage ),
-                                             lenghtRemaining,
-                                             &transferred,
-                                             m_timeoutUSB );
+        // Another transport only has synchronous transfers, so the transaction completes here
+        if ( m_transport != &m_libusbTransport ) {
+            const int responseControl = ControlTransfer( m_deviceHandle, buffer[ 0 ], buffer[ 1 ], buffer[ 2 ] | ( buffer[ 3 ] << 8 ),
+                                                         buffer[ 4 ] | ( buffer[ 5 ] << 8 ), buffer + LIBUSB_CONTROL_SETUP_SIZE,
+                                                         buffer[ 6 ] | ( buffer[ 7 ] << 8 ), m_timeoutUSB );
 
-        if ( responseBulk < 0 ) {
-            PrintStdError( "ReadWritePipe()",
-                           "BulkTransfer() failed - Step 03",
-                           0,
-                           responseBulk );
+            transaction->m_urbs[ i ]->status = ( responseControl >= 0 ) ? LIBUSB_TRANSFER_COMPLETED : LIBUSB_TRANSFER_ERROR;
+            transaction->m_urbs[ i ]->actual_length = ( responseControl >= 0 ) ? responseControl : 0;
+            transaction->m_pending++;
 
-            return responseBulk;
+            TransactionCallback( transaction->m_urbs[ i ] );
+            continue;
         }
-        totalTranferred += transferred;
 
-        m_lastTransferred = totalTranferred;
-
-#if !defined(WRITE_READ_FAST)
-        ErrorCode error = CheckDisable();
+        OpenOK_TransferTrace::Start( &transaction->m_submitted[ i ] );
 
-        if ( error != NoError ) {
-            PrintStdError( "ReadWritePipe()",
-                           "CheckDisable() failed - Step 03" );
+        const int responseLibusb = libusb_submit_transfer( transaction->m_urbs[ i ] );
 
-            return error;
+        if ( responseLibusb != LIBUSB_SUCCESS ) {
+            PrintStdError( "SubmitTransaction()",
+                           "libusb_submit_transfer() failed",
+                           responseLibusb );
+            transaction->status = LibusbError;
+            break;
         }
-#endif
+        transaction->m_pending++;
     }
 
-    if ( totalTranferred != length ) {
-        return TransferError;
-    }
-
-    m_lastTransferred = totalTranferred;
-
-    return totalTranferred;
+    return static_cast<ErrorCode>( transaction->status );
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
 /*
-This method transfers a specified buffer of data to the given Pipe In endpoint.
-Note: For 16-bit boards (all but the XEM3001v1), the transfer length must be even. Odd transfers will be shortened by one byte.
+Handles USB events until a transaction has completed.
 
-Python Note: Within Python, the 'length' parameter is not used and the 'data' parameter is a string buffer. For example,
+Returns:
+ErrorCode of the transaction
+*/
 
- buf = "\x00"*1076
- xem.WriteToPipeIn(0x80, buf)
+OpenOK::ErrorCode OpenOK::WaitForTransaction( OpenOK_Transaction *transaction )
+{
+    if ( transaction == NULL ) {
+        return PointerNULL;
+    }
 
-Parameters:
-[in] 	epAddr 	The address of the destination Pipe In.
-[in] 	length 	The length of the transfer.
-[in] 	data 	A pointer to the transfer data buffer.
+    while ( !transaction->IsComplete() ) {
+        if ( HandlePipeEvents( m_timeoutUSB ) != NoError ) {
+            return LibusbError;
+        }
+    }
+    return static_cast<ErrorCode>( transaction->status );
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Submits a transaction and waits for it to complete.
 
 Returns:
-The number of bytes written or ErrorCode if the write failed.
+ErrorCode
 */
 
-long OpenOK::WriteToPipeIn( int epAddr, long length, unsigned char *data )
+OpenOK::ErrorCode OpenOK::ExecuteTransaction( OpenOK_Transaction *transaction )
 {
-    // I don't know what the 0x04 means.
-    // For 0x80 and 0x9F address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
-    const long response = ReadWritePipe( epAddr, endpointOUT, 0x80, 0x9F, 0x04, 0x04, length, data );
+    const ErrorCode error = SubmitTransaction( transaction );
 
-    if ( response < 0 ) {
-        PrintStdError( "WriteToPipeIn()",
-                       "ReadWritePipe() failed",
-                       0,
-                       response );
+    if ( transaction == NULL ) {
+        return error;
     }
-    return response;
+
+    // Anything which was submitted before an error must still complete
+    const ErrorCode errorWait = WaitForTransaction( transaction );
+
+    return ( error != NoError ) ? error : errorWait;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
-/*
-This method transfers data from a specified Pipe Out endpoint to the given buffer. The maximum length of a transfer (per call to
-this method) is 16,777,215 bytes.
-Note: For 16-bit boards (all but the XEM3001v1), the transfer length must be even. Odd transfers will be shortened by one byte.
+void LIBUSB_CALL OpenOK::TransactionCallback( struct libusb_transfer *urb )
+{
+    OpenOK_Transaction *transaction = static_cast<OpenOK_Transaction *>( urb->user_data );
+    OpenOK *ok = transaction->m_ok;
 
-Python Note: Within Python, the 'length' parameter is not used and the 'data' parameter is a string buffer. For example,
+    const bool isWireIn = ( urb == transaction->m_urbs[ 0 ] );
+    const bool isTriggerOut = ( urb == transaction->m_urbs[ 1 ] );
 
- buf = "\x00"*1076
- xem.ReadFromPipeOut(0xa0, buf)
+    TraceURB( transaction->m_submitted[ isWireIn ? 0 : ( isTriggerOut ? 1 : 2 ) ], urb );
 
-Parameters:
-[in] 	epAddr 	The address of the source Pipe Out.
-[in] 	length 	The length of the transfer.
-[in] 	data 	A pointer to the transfer data buffer.
+    if ( urb->status == LIBUSB_TRANSFER_COMPLETED ) {
+        if ( !isWireIn && !transaction->m_gotSnapshot ) {
+            clock_gettime( CLOCK_REALTIME, &transaction->snapshotTime );
+            transaction->m_gotSnapshot = true;
+        }
+    } else {
+        ok->PrintStdError( "TransactionCallback()",
+                           "control transfer failed" );
 
-Returns:
-The number of bytes read or ErrorCode if the read failed.
-*/
+        transaction->status = ( urb->status == LIBUSB_TRANSFER_TIMED_OUT ) ? Timeout : TransferError;
 
-long OpenOK::ReadFromPipeOut( int epAddr, long length, unsigned char *data )
-{
-    // I don't know what the 0x05 and 0x06 means.
-    // For 0xA0 and 0xBF address see FrontPanel-UM.pdf, Endpoint Types, pg 40.
-    const long response = ReadWritePipe( epAddr, endpointIN, 0xA0, 0xBF, 0x06, 0x05, length, data );
+        // As for the synchronous methods
+        memset( libusb_control_transfer_get_data( urb ), 0, urb->length - LIBUSB_CONTROL_SETUP_SIZE );
 
-    if ( response < 0 ) {
-        PrintStdError( "ReadFromPipeOut()",
-                       "ReadWritePipe() failed",
-                       0,
-                       response );
+        if ( isWireIn ) {
+            memset( ok->m_wireIns, 0, OpenOK::WIREINSIZE );
+        }
     }
-    return response;
+
+    if ( !isWireIn ) {
+        if ( isTriggerOut ) {
+            memcpy( ok->m_triggerOuts, libusb_control_transfer_get_data( urb ), OpenOK::TRIGGEROUTSIZE );
+        } else {
+            memcpy( ok->m_wireOuts, libusb_control_transfer_get_data( urb ), OpenOK::WIREOUTSIZE );
+        }
+    }
+
+    transaction->m_pending--;
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
@@ -4253,6 +6558,25 @@ void OpenOK::SetTimeout( int timeout )
 }
 //---------------------------------------------------------------------------------------------------------------------------------
 
+/*
+Sends the synchronous transfers through another transport, eg to record them or to replay a recording.
+Any open device is closed and the list of devices is read again from the new transport.
+Asynchronous pipe transfers are only available with libusb; transactions are carried out synchronously with another transport.
+
+Parameters:
+[in] 	transport 	The transport, which must outlive its use here, or NULL for libusb
+*/
+
+void OpenOK::SetTransport( OpenOK_Transport *transport )
+{
+    Close();
+    ClearListOpenOK();
+
+    m_registryValid = false;
+    m_transport = ( transport != NULL ) ? transport : &m_libusbTransport;
+}
+//---------------------------------------------------------------------------------------------------------------------------------
+
 void OpenOK::PrintInfoAllDevice()
 {
     Close();
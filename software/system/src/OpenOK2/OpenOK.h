@@ -60,13 +60,17 @@ THE SOFTWARE.
 #define LIBUSB_H_
 #endif
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <math.h>
+#include <sstream>
 #include <string>
 #include <string.h>
+#include <time.h>
 #include <vector>
+#include <deque>
 
 #ifdef QT_CORE_LIB
 #include "Sleep.h"
@@ -211,8 +215,12 @@ struct OpenOK_device
 
         unsigned short int shiftMaxPacketSize;
 
+        // the device ID, strings and descriptors have been read
+        bool cached;
+
         OpenOK_device() {
             device = NULL;
+            cached = false;
 
             strncpy( deviceID, "Not Available", OpenOK_device::SSIZE );
             strncpy( serial, "Not Available", OpenOK_device::SSIZE );
@@ -254,6 +262,291 @@ struct OpenOK_device
 };
 //---------------------------------------------------------------------------------------------------------------------------------
 
+/*
+A pipe transfer for the asynchronous pipe API (see OpenOK::SubmitReadFromPipeOut()).
+The caller owns the transfer and the data buffer, which must remain valid until the transfer has completed.
+*/
+
+/*
+Optional instrumentation of USB transfers, for all OpenOK objects in the process (Not Official).
+When enabled, each transfer is counted by type and outcome and its latency is added to a histogram.
+Each thread records into its own counters, so recording takes no locks.
+*/
+
+class OpenOK_TransferTrace
+{
+    public:
+        enum Type { WireIn, WireOut, TriggerIn, TriggerOut, PipeSetup, Control, BulkIn, BulkOut, NumberTypes };
+
+        enum Outcome { Completed, Short, TimedOut, Failed };
+
+        static const int HISTOGRAM_BINS = 16; // bin n counts latencies below 2^(n+1) us; the last bin has the rest
+
+        static void Enable( bool enable );
+
+        static bool IsEnabled() { return __atomic_load_n( &s_enabled, __ATOMIC_RELAXED ); }
+
+        static void Start( struct timespec *t ) { if ( IsEnabled() ) clock_gettime( CLOCK_MONOTONIC, t ); }
+
+        static void Record( Type type, const struct timespec &start, long bytes, Outcome outcome );
+
+        static Type ControlType( uint8_t requestType, uint8_t bRequest, uint16_t wValue );
+
+        static std::string Report();
+
+        static void Reset();
+
+    private:
+        struct Counters
+        {
+            unsigned long long count;
+            unsigned long long bytes;
+            unsigned long long shortTransfers;
+            unsigned long long timeouts;
+            unsigned long long errors;
+            unsigned long long totalNs;
+            unsigned long long maxNs;
+            unsigned long long histogram[ HISTOGRAM_BINS ];
+        };
+
+        struct Slot
+        {
+            Counters counters[ NumberTypes ];
+        };
+
+        static const int MAX_SLOTS = 16; // threads beyond this share the last slot
+
+        static bool s_enabled;
+        static int s_numberSlots;
+        static Slot s_slots[ MAX_SLOTS ];
+        static __thread Slot *t_slot;
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+The transport under OpenOK's synchronous transfers (Not Official). This one sends them with libusb.
+OpenOK_RecordingTransport also records them, with their timing, and OpenOK_ReplayTransport plays a recording back
+without a device, so that the transfer logic can be tested and benchmarked on a host without a board.
+Set with OpenOK::SetTransport().
+*/
+
+class OpenOK_Transport
+{
+    public:
+        virtual ~OpenOK_Transport() {}
+
+        // As for libusb_control_transfer(), libusb_bulk_transfer() and libusb_clear_halt()
+        virtual int ControlTransfer( libusb_device_handle *handle, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                     uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout );
+
+        virtual int BulkTransfer( libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length,
+                                  int *transferred, unsigned int timeout );
+
+        virtual int ClearHalt( libusb_device_handle *handle, unsigned char endpoint );
+
+        // Called when OpenOK has opened a device, before its first transfer
+        virtual void DeviceOpened( const OpenOK_device & ) {}
+
+        // A transport with no device behind it lists the devices it emulates instead of libusb
+        virtual bool IsEmulated() { return false; }
+
+        virtual int GetDevices( OpenOK_device *, int ) { return 0; }
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Records the transfers made through it to a file, passing them on to another transport (libusb by default).
+IN data is recorded; OUT data is only recorded as a hash, so that it can be checked on replay.
+The file is in host byte order and only meant to be replayed by the same build of OpenOK.
+*/
+
+class OpenOK_RecordingTransport : public OpenOK_Transport
+{
+    public:
+        OpenOK_RecordingTransport( OpenOK_Transport *transport = NULL ) : m_transport( transport ? transport : &m_libusbTransport ) {}
+
+        bool Open( const std::string &filename );
+
+        bool IsOpen() { return m_file.is_open(); }
+
+        void Close();
+
+        virtual int ControlTransfer( libusb_device_handle *handle, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                     uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout );
+
+        virtual int BulkTransfer( libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length,
+                                  int *transferred, unsigned int timeout );
+
+        virtual int ClearHalt( libusb_device_handle *handle, unsigned char endpoint );
+
+        virtual void DeviceOpened( const OpenOK_device &device );
+
+        virtual bool IsEmulated() { return m_transport->IsEmulated(); }
+
+        virtual int GetDevices( OpenOK_device *devices, int maxDevices ) { return m_transport->GetDevices( devices, maxDevices ); }
+
+    private:
+        OpenOK_Transport m_libusbTransport;
+        OpenOK_Transport *m_transport;
+        std::ofstream m_file;
+
+        template <typename T> void Put( T value ) { m_file.write( reinterpret_cast<const char *>( &value ), sizeof( T ) ); }
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+/*
+Emulates the devices in a recording made by OpenOK_RecordingTransport. Each transfer is answered with the next one recorded,
+after checking that OpenOK has asked for the same transfer. A transfer which doesn't match fails with LIBUSB_ERROR_IO
+and when the recording is used up, the device is disconnected (LIBUSB_ERROR_NO_DEVICE).
+With SetRealTime(), each transfer takes as long as it did when it was recorded, otherwise it returns immediately.
+*/
+
+class OpenOK_ReplayTransport : public OpenOK_Transport
+{
+    public:
+        OpenOK_ReplayTransport() : m_position( 0 ), m_realTime( false ), m_mismatches( 0 ) {}
+
+        bool Open( const std::string &filename );
+
+        void SetRealTime( bool realTime ) { m_realTime = realTime; }
+
+        int GetMismatches() { return m_mismatches; } // transfers which didn't match the recording
+
+        std::string GetLastMismatch() { return m_lastMismatch; }
+
+        bool AtEnd() { return m_position >= m_recording.size(); }
+
+        virtual int ControlTransfer( libusb_device_handle *handle, uint8_t requestType, uint8_t bRequest, uint16_t wValue,
+                                     uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout );
+
+        virtual int BulkTransfer( libusb_device_handle *handle, unsigned char endpoint, unsigned char *data, int length,
+                                  int *transferred, unsigned int timeout );
+
+        virtual int ClearHalt( libusb_device_handle *handle, unsigned char endpoint );
+
+        virtual void DeviceOpened( const OpenOK_device &device );
+
+        virtual bool IsEmulated() { return true; }
+
+        virtual int GetDevices( OpenOK_device *devices, int maxDevices );
+
+    private:
+        struct Record
+        {
+            char kind; // 'C'ontrol, 'B'ulk, clear 'H'alt or 'D'evice opened
+            uint8_t requestType; // or the endpoint
+            uint8_t bRequest;
+            uint16_t wValue;
+            uint16_t wIndex;
+            int32_t length;
+            int32_t response;
+            int32_t transferred;
+            uint64_t ns; // duration
+            uint64_t hash; // of OUT data
+            const unsigned char *data; // IN data, or the device
+            size_t size;
+        };
+
+        std::vector<unsigned char> m_recording;
+        size_t m_position;
+        std::vector<OpenOK_device> m_devices;
+        bool m_realTime;
+        int m_mismatches;
+        std::string m_lastMismatch;
+
+        bool ReadRecord( Record &record );
+        bool Get( void *value, size_t size );
+        int Mismatch( const char *transfer );
+        void Wait( const struct timespec &start, uint64_t ns );
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+class OpenOK_PipeTransfer
+{
+    public:
+        typedef void ( *Callback )( OpenOK_PipeTransfer *transfer );
+
+        OpenOK_PipeTransfer()
+            : epAddr( 0 ), data( NULL ), length( 0 ), callback( NULL ), userData( NULL )
+            , transferred( 0 ), status( 0 ), m_isRead( true ), m_submitted( 0 ), m_inFlight( 0 ), m_error( 0 )
+        {
+        }
+
+        // Set by the caller
+        int epAddr;
+        unsigned char *data;
+        long length;
+        Callback callback; // optional, called from OpenOK::HandlePipeEvents() when the transfer has completed
+        void *userData;
+
+        // Set when the transfer has completed
+        long transferred;
+        int status; // OpenOK::ErrorCode
+
+    private:
+        friend class OpenOK;
+
+        bool m_isRead;
+        long m_submitted;
+        int m_inFlight;
+        int m_error;
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
+class OpenOK;
+
+/*
+A set of Wire In writes and Wire Out/Trigger Out reads which OpenOK carries out together, with all the control transfers
+submitted at once (see OpenOK::SubmitTransaction()). The Trigger Outs and Wire Outs read are kept in the transaction
+so that the values used for one acquisition cycle all come from the same exchange with the device.
+*/
+
+class OpenOK_Transaction
+{
+    public:
+        OpenOK_Transaction();
+        ~OpenOK_Transaction(); // must not be destroyed while it is pending
+
+        void SetWireInValue( int epAddr, unsigned long val, unsigned long mask = 0xffffffff );
+        void UpdateWireOuts();
+        void UpdateTriggerOuts();
+        void Clear(); // removes all operations
+
+        bool IsComplete() { return ( m_pending == 0 ); }
+
+        // Valid when the transaction has completed
+        int GetWireOutValue( int epAddr );
+        bool IsTriggered( int epAddr, unsigned long mask );
+
+        struct timespec snapshotTime; // CLOCK_REALTIME, when the first read completed
+        int status; // OpenOK::ErrorCode
+
+    private:
+        friend class OpenOK;
+
+        static const int MAX_URBS = 3;
+        static const int BUFFER_SIZE = LIBUSB_CONTROL_SETUP_SIZE + 64;
+
+        struct WireIn
+        {
+            int epAddr;
+            unsigned long val;
+            unsigned long mask;
+        };
+
+        std::vector<WireIn> m_wireIns;
+        bool m_readWireOuts;
+        bool m_readTriggerOuts;
+        bool m_gotSnapshot;
+
+        OpenOK *m_ok;
+        int m_pending;
+        struct libusb_transfer *m_urbs[ MAX_URBS ];
+        struct timespec m_submitted[ MAX_URBS ];
+        unsigned char m_buffers[ MAX_URBS ][ BUFFER_SIZE ];
+};
+//---------------------------------------------------------------------------------------------------------------------------------
+
 class OpenOK
 {
     public:
@@ -356,8 +649,25 @@ class OpenOK
 
         short int m_indexOpenedDevice;
 
+        // registry of devices matching the filter; each entry holds a reference to its libusb_device
+        // The registry belongs to this instance and its libusb context, not to the process:
+        // each OpenOK object enumerates the bus at least once.
         struct OpenOK_device m_listOKDevices[ maxUSBDevices ];
 
+        int m_numberOKDevices;
+
+        bool m_registryValid; // kept up to date by hotplug events
+
+        bool m_hotplugRegistered;
+
+        libusb_hotplug_callback_handle m_hotplugHandle;
+
+        std::vector< std::pair<libusb_device *, int> > m_hotplugEvents; // queued by HotplugCallback()
+
+        unsigned short int m_filterVendor;
+
+        unsigned short int m_filterProduct;
+
         long m_lastTransferred;
 
         bool m_enablePrintStdError;
@@ -376,6 +686,28 @@ class OpenOK
 
         bool m_libusbInitialization;
 
+        OpenOK_Transport m_libusbTransport;
+
+        OpenOK_Transport *m_transport;
+
+        bool m_emulatedOpen; // a device of an emulating transport is open
+
+        // Asynchronous pipe transfers
+        std::deque<OpenOK_PipeTransfer *> m_pipeQueue; // the front transfer is in progress
+        std::deque<OpenOK_PipeTransfer *> m_pipeCompleted;
+        std::vector<struct libusb_transfer *> m_freeURBs;
+        struct libusb_transfer *m_controlURB;
+        unsigned char m_pipeSetup[ LIBUSB_CONTROL_SETUP_SIZE + 6 ];
+        unsigned char m_pipeCheck[ LIBUSB_CONTROL_SETUP_SIZE + 2 ]; // for the enable/disable checks
+        enum { PipeStageEnable, PipeStageSetup, PipeStageDisable } m_pipeStage; // what m_controlURB is doing
+        int m_numberURBs;
+        int m_sizeURB;
+        std::vector<struct libusb_transfer *> m_allURBs;
+        std::vector<struct timespec> m_urbSubmitted; // for tracing, indexed as m_allURBs
+        struct timespec m_controlSubmitted;
+        bool m_pipeActive;
+        bool m_pipeCancelling;
+
         double m_crystalReference;
 
         struct bitstream {
@@ -429,6 +761,8 @@ class OpenOK
 
         int GetDeviceCount();
 
+        void SetUSBDeviceFilter( unsigned short int idVendor, unsigned short int idProduct = 0 );
+
         std::string GetSerialNumber();
 
         std::string GetDeviceID();
@@ -443,6 +777,9 @@ class OpenOK
 
         ErrorCode ConfigureFPGAFromMemory( unsigned char *data, const unsigned long length );
 
+        ErrorCode ConfigureFPGAFromCache( const std::string strFilename, const std::string cacheDir,
+                                          bool skipIfLoaded = false, bool *skipped = NULL );
+
         long WriteToPipeIn( int epAddr, long length, unsigned char *data );
 
         long ReadFromPipeOut( int epAddr, long length, unsigned char *data );
@@ -499,6 +836,30 @@ class OpenOK
 
         long ReadFromBlockPipeOut( int epAddr, int blockSize, long length, unsigned char *data );
 
+        // Asynchronous pipe transfers (Not Official)
+
+        ErrorCode SetPipeTransferQueue( int numberURBs, int sizeURB );
+
+        ErrorCode SubmitReadFromPipeOut( OpenOK_PipeTransfer *transfer );
+
+        ErrorCode SubmitWriteToPipeIn( OpenOK_PipeTransfer *transfer );
+
+        ErrorCode HandlePipeEvents( int timeoutMilliseconds );
+
+        OpenOK_PipeTransfer *GetCompletedPipeTransfer();
+
+        int GetPendingPipeTransfers();
+
+        void CancelPipeTransfers();
+
+        // Coalesced register access (Not Official)
+
+        ErrorCode SubmitTransaction( OpenOK_Transaction *transaction );
+
+        ErrorCode WaitForTransaction( OpenOK_Transaction *transaction );
+
+        ErrorCode ExecuteTransaction( OpenOK_Transaction *transaction );
+
         ErrorCode SetEepromPLL22150Configuration( OpenOK_CPLL22150 &pll );
 
         ErrorCode SetPLL22150Configuration( OpenOK_CPLL22150 &pll );
@@ -507,6 +868,10 @@ class OpenOK
 
         ErrorCode GetPLL22150Configuration( OpenOK_CPLL22150 &pll );
 
+        // Transfers through another transport, eg to record or replay them (Not Official)
+
+        void SetTransport( OpenOK_Transport *transport );
+
     private:
         // Not Official
 
@@ -518,12 +883,39 @@ class OpenOK
         template<class iterator>
         ErrorCode SendFileToFPGA(iterator it, iterator end);
 
+        template<class iterator>
+        ErrorCode ParseBitFile( iterator it, iterator end, std::vector<unsigned char> &buffer );
+
+        ErrorCode MapFile( const std::string strFilename, unsigned char **data, size_t *size );
+
+        ErrorCode WriteFileAtomically( const std::string strFilename, const unsigned char *data, const size_t size );
+
         int GetLanguageID( libusb_device_handle *OpenOK_dev_handle );
 
         ErrorCode Get_OK_Devices( bool countEnable, int &countDevices );
 
+        bool MatchesDeviceFilter( const libusb_device_descriptor &descriptorDevice );
+
+        ErrorCode RefreshDeviceRegistry();
+
+        int FindRegistryDevice( libusb_device *device );
+
+        ErrorCode ReadDeviceInfo( OpenOK_device &currentOpalKellyDevice );
+
+        void RegisterHotplug();
+
+        void DeregisterHotplug();
+
+        static int LIBUSB_CALL HotplugCallback( libusb_context *ctx, libusb_device *device, libusb_hotplug_event event, void *userData );
+
+        void ApplyHotplugEvents();
+
+        void ClearHotplugEvents();
+
         ErrorCode OpenByDeviceIndexList( unsigned int indexDeviceList );
 
+        ErrorCode CheckOpenedDevice();
+
         ErrorCode CheckEnable();
 
         ErrorCode CheckDisable();
@@ -578,6 +970,30 @@ class OpenOK
                             int errorCodeLibUSB = 0 ,
                             int erroCode = 0 );
 
+        ErrorCode SubmitPipeTransfer( OpenOK_PipeTransfer *transfer, int32_t endpointLower, int32_t endpointUpper );
+
+        void StartPipeTransfer();
+
+        void SubmitPipeSetup();
+
+        void SubmitPipeCheck( uint8_t request, uint16_t length );
+
+        void SubmitPipeURBs();
+
+        void FinishPipeTransfer( int status );
+
+        void CompletePipeTransfer( int status );
+
+        void FreePipeURBs();
+
+        static void LIBUSB_CALL PipeControlCallback( struct libusb_transfer *urb );
+
+        static void LIBUSB_CALL PipeBulkCallback( struct libusb_transfer *urb );
+
+        int PipeURBIndex( const struct libusb_transfer *urb ) const;
+
+        static void LIBUSB_CALL TransactionCallback( struct libusb_transfer *urb );
+
         inline long ReadWritePipe( int32_t epAddr, int32_t endpointDir, int32_t endpointLower, int32_t endpointUpper,
                                    int32_t magicNumber1, int32_t magicNumber2, int64_t length, uint8_t *data );
 
@@ -0,0 +1,182 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// Benchmark for OpenOK pipe transfers, comparing synchronous ReadFromPipeOut() with the asynchronous pipe API
+// The FPGA configuration must have a Pipe Out which always has data, eg the FIFO pipe of the counter firmware.
+// Usage: pipebench [-b bitfile] [-e endpoint] [-s transfer size] [-t seconds] [-u URBs] [-z URB size]
+//                  [-n transfers] [-r recording | -p recording [-R]]
+// With -r, the synchronous transfers are recorded; with -p, a recording is replayed without a device (-R in real time).
+// The same -n, -s and -b must be used to record and to replay. Only the synchronous benchmark is run in either case.
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "OpenOK.h"
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1.0E-9;
+}
+
+static long nAsyncBytes=0;
+static int nAsyncErrors=0;
+static bool resubmit=true;
+static OpenOK *xem=NULL;
+
+static void asyncCallback(OpenOK_PipeTransfer *t)
+{
+	if (t->status == OpenOK::NoError)
+		nAsyncBytes += t->transferred;
+	else
+		nAsyncErrors++;
+	if (resubmit)
+		xem->SubmitReadFromPipeOut(t); // keep the queue full
+}
+
+int main(int argc,char **argv)
+{
+	std::string bitfile;
+	int ep=0xa1;
+	long size=1048576;
+	double duration=5.0;
+	int nURBs=8;
+	int sizeURB=65536;
+	long nTransfers=0;
+	std::string recordFile,replayFile;
+	bool realTime=false;
+	int opt;
+	
+	while ((opt=getopt(argc,argv,"b:e:n:p:r:Rs:t:u:z:")) != -1){
+		switch(opt){
+			case 'b':bitfile=optarg;break;
+			case 'e':ep=strtol(optarg,NULL,0);break;
+			case 'n':nTransfers=strtol(optarg,NULL,0);break;
+			case 'p':replayFile=optarg;break;
+			case 'r':recordFile=optarg;break;
+			case 'R':realTime=true;break;
+			case 's':size=strtol(optarg,NULL,0);break;
+			case 't':duration=atof(optarg);break;
+			case 'u':nURBs=atoi(optarg);break;
+			case 'z':sizeURB=strtol(optarg,NULL,0);break;
+			default:
+				std::cerr << "Usage: pipebench [-b bitfile] [-e endpoint] [-s transfer size] [-t seconds] [-u URBs] [-z URB size]" << std::endl;
+				std::cerr << "                 [-n transfers] [-r recording | -p recording [-R]]" << std::endl;
+				return EXIT_FAILURE;
+		}
+	}
+	
+	xem = new OpenOK;
+	
+	OpenOK_RecordingTransport recorder;
+	OpenOK_ReplayTransport replayer;
+	if (!recordFile.empty()){
+		if (!recorder.Open(recordFile)){
+			std::cerr << "Can't open " << recordFile << std::endl;
+			return EXIT_FAILURE;
+		}
+		xem->SetTransport(&recorder);
+	}
+	else if (!replayFile.empty()){
+		if (!replayer.Open(replayFile)){
+			std::cerr << "Can't read the recording " << replayFile << std::endl;
+			return EXIT_FAILURE;
+		}
+		replayer.SetRealTime(realTime);
+		xem->SetTransport(&replayer);
+	}
+	
+	if (OpenOK::NoError != xem->OpenBySerial()){
+		std::cerr << "Device could not be opened.  Is one connected?" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!bitfile.empty() && OpenOK::NoError != xem->ConfigureFPGA(bitfile)){
+		std::cerr << "FPGA configuration failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	
+	std::vector<unsigned char> buf0(size),buf1(size);
+	
+	// Synchronous
+	long nBytes=0;
+	int nErrors=0;
+	long nDone=0;
+	double t0=now(),t;
+	while (nTransfers > 0 ? nDone < nTransfers : (t=now()) - t0 < duration){
+		long n = xem->ReadFromPipeOut(ep,size,&buf0[0]);
+		if (n > 0) nBytes += n; else nErrors++;
+		nDone++;
+	}
+	t=now();
+	std::cout << "synchronous : " << nBytes/(t-t0)/1.0E6 << " MB/s (" << nErrors << " errors)" << std::endl;
+	
+	if (!replayFile.empty()){
+		if (replayer.GetMismatches() > 0)
+			std::cout << replayer.GetMismatches() << " transfers did not match the recording: " << replayer.GetLastMismatch() << std::endl;
+		delete xem;
+		return (replayer.GetMismatches() == 0 && nErrors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (!recordFile.empty()){
+		delete xem;
+		return EXIT_SUCCESS;
+	}
+	
+	// Asynchronous, with two transfers queued so that the next one starts as soon as one completes
+	if (OpenOK::NoError != xem->SetPipeTransferQueue(nURBs,sizeURB)){
+		std::cerr << "Bad URB settings" << std::endl;
+		return EXIT_FAILURE;
+	}
+	OpenOK_PipeTransfer tr[2];
+	tr[0].data=&buf0[0];
+	tr[1].data=&buf1[0];
+	for (int i=0;i<2;i++){
+		tr[i].epAddr=ep;
+		tr[i].length=size;
+		tr[i].callback=asyncCallback;
+		if (OpenOK::NoError != xem->SubmitReadFromPipeOut(&tr[i])){
+			std::cerr << "Transfer not submitted" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	t0=now();
+	while ((t=now()) - t0 < duration){
+		xem->HandlePipeEvents(100);
+		while (xem->GetCompletedPipeTransfer()); // the callback does the work
+	}
+	resubmit=false;
+	while (xem->GetPendingPipeTransfers() > 0)
+		xem->HandlePipeEvents(100);
+	t=now();
+	std::cout << "asynchronous: " << nAsyncBytes/(t-t0)/1.0E6 << " MB/s (" << nAsyncErrors << " errors, " <<
+		nURBs << " x " << sizeURB << " byte URBs)" << std::endl;
+	
+	delete xem;
+	return EXIT_SUCCESS;
+}
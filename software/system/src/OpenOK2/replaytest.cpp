@@ -0,0 +1,234 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// Round-trip test for OpenOK_RecordingTransport and OpenOK_ReplayTransport, which needs no board.
+// A short sequence of register, transaction and pipe transfers is made with a fake device under the recorder,
+// then made again with the recording replayed. The results must be byte-identical, with no mismatches
+// and the whole recording used. Finally, a sequence with a different wire in must be reported as a mismatch.
+// Usage: replaytest [-k recording]   (-k keeps the recording in the given file)
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "OpenOK.h"
+
+#define SERIAL "REPLAYTEST"
+
+// Answers every transfer, with responses that change from one transfer to the next
+// so that replaying them out of order would be noticed
+class FakeDevice : public OpenOK_Transport
+{
+	public:
+		FakeDevice(){nTransfers=0;}
+		
+		virtual int ControlTransfer(libusb_device_handle *,uint8_t requestType,uint8_t bRequest,uint16_t,
+			uint16_t,unsigned char *data,uint16_t wLength,unsigned int)
+		{
+			nTransfers++;
+			if (requestType & 0x80){ // IN
+				for (int i=0;i<wLength;i++)
+					data[i]=bRequest + i + nTransfers;
+				switch (bRequest){ // the handshakes which OpenOK checks
+					case 0xb2:data[0]=0x01;break;
+					case 0xb3:data[0]=0xd7;data[1]=0xa5;break;
+					case 0xb8:data[0]=0x00;break;
+					case 0xb9:data[0]=0x80;break;
+				}
+			}
+			return wLength;
+		}
+		
+		virtual int BulkTransfer(libusb_device_handle *,unsigned char endpoint,unsigned char *data,int length,
+			int *transferred,unsigned int)
+		{
+			nTransfers++;
+			if (endpoint & 0x80){ // IN
+				for (int i=0;i<length;i++)
+					data[i]=i*7 + nTransfers;
+			}
+			*transferred=length;
+			return 0;
+		}
+		
+		virtual int ClearHalt(libusb_device_handle *,unsigned char){return 0;}
+		
+		virtual bool IsEmulated(){return true;}
+		
+		virtual int GetDevices(OpenOK_device *devices,int maxDevices)
+		{
+			if (maxDevices < 1) return 0;
+			devices[0]=OpenOK_device();
+			strcpy(devices[0].serial,SERIAL);
+			strcpy(devices[0].product,"XEM6001");
+			devices[0].maxPacketSize=512;
+			devices[0].shiftMaxPacketSize=9;
+			return 1;
+		}
+		
+	private:
+		
+		int nTransfers;
+};
+
+template <typename T> static void append(std::vector<unsigned char> &results,T value)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(&value);
+	results.insert(results.end(),p,p+sizeof(T));
+}
+
+// Makes the test sequence, appending everything read back from the device to results
+static bool run(OpenOK_Transport *transport,unsigned long wireIn,std::vector<unsigned char> &results)
+{
+	OpenOK ok;
+	ok.SetEnablePrintStdError(false); // mismatches are expected in the last test
+	ok.SetTransport(transport);
+	
+	if (OpenOK::NoError != ok.OpenBySerial(SERIAL)){
+		std::cerr << "Device could not be opened" << std::endl;
+		return false;
+	}
+	std::string serial = ok.GetSerialNumber();
+	results.insert(results.end(),serial.begin(),serial.end());
+	
+	ok.SetWireInValue(0x00,wireIn);
+	ok.UpdateWireIns();
+	ok.UpdateWireOuts();
+	append(results,ok.GetWireOutValue(0x21));
+	append(results,ok.GetWireOutValue(0x3f));
+	ok.UpdateTriggerOuts();
+	append(results,ok.IsTriggered(0x60,0xffff));
+	
+	// Covers the multiple of 16384, multiple of the packet size and remainder steps of ReadWritePipe()
+	std::vector<unsigned char> buf(3*16384 + 2*512 + 6);
+	append(results,ok.ReadFromPipeOut(0xa1,buf.size(),&buf[0]));
+	results.insert(results.end(),buf.begin(),buf.end());
+	
+	for (unsigned int i=0;i<buf.size();i++)
+		buf[i]=i;
+	append(results,ok.WriteToPipeIn(0x80,buf.size(),&buf[0]));
+	
+	OpenOK_Transaction t;
+	t.SetWireInValue(0x01,5);
+	t.UpdateWireOuts();
+	t.UpdateTriggerOuts();
+	append(results,ok.ExecuteTransaction(&t));
+	append(results,t.GetWireOutValue(0x22));
+	append(results,t.IsTriggered(0x60,0xffff));
+	
+	ok.Close();
+	return true;
+}
+
+int main(int argc,char **argv)
+{
+	std::string recording;
+	bool keep=false;
+	int opt;
+	
+	while ((opt=getopt(argc,argv,"k:")) != -1){
+		switch(opt){
+			case 'k':recording=optarg;keep=true;break;
+			default:
+				std::cerr << "Usage: replaytest [-k recording]" << std::endl;
+				return EXIT_FAILURE;
+		}
+	}
+	
+	if (recording.empty()){
+		char tmpl[]="/tmp/replaytestXXXXXX";
+		int fd = mkstemp(tmpl);
+		if (fd < 0){
+			std::cerr << "Can't make a temporary file" << std::endl;
+			return EXIT_FAILURE;
+		}
+		close(fd);
+		recording=tmpl;
+	}
+	
+	int failures=0;
+	
+	// Record
+	FakeDevice fake;
+	OpenOK_RecordingTransport recorder(&fake);
+	if (!recorder.Open(recording)){
+		std::cerr << "Can't open " << recording << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::vector<unsigned char> recorded;
+	if (!run(&recorder,3,recorded))
+		return EXIT_FAILURE;
+	recorder.Close();
+	
+	// Replay
+	OpenOK_ReplayTransport replayer;
+	if (!replayer.Open(recording)){
+		std::cerr << "Can't read the recording " << recording << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::vector<unsigned char> replayed;
+	if (!run(&replayer,3,replayed))
+		return EXIT_FAILURE;
+	
+	if (replayed.size() != recorded.size() || 0 != memcmp(&replayed[0],&recorded[0],recorded.size())){
+		std::cout << "FAIL replayed results differ from the recorded ones" << std::endl;
+		failures++;
+	}
+	else
+		std::cout << "ok   replayed " << replayed.size() << " bytes of results, identical to the recorded ones" << std::endl;
+	if (replayer.GetMismatches() != 0){
+		std::cout << "FAIL " << replayer.GetMismatches() << " transfers did not match: " << replayer.GetLastMismatch() << std::endl;
+		failures++;
+	}
+	else
+		std::cout << "ok   no mismatched transfers" << std::endl;
+	if (!replayer.AtEnd()){
+		std::cout << "FAIL the recording was not used up" << std::endl;
+		failures++;
+	}
+	else
+		std::cout << "ok   the recording was used up" << std::endl;
+	
+	// A different request must be caught
+	OpenOK_ReplayTransport changed;
+	changed.Open(recording);
+	std::vector<unsigned char> ignored;
+	run(&changed,4,ignored);
+	if (changed.GetMismatches() == 0){
+		std::cout << "FAIL a changed wire in was not reported" << std::endl;
+		failures++;
+	}
+	else
+		std::cout << "ok   a changed wire in was reported (" << changed.GetLastMismatch() << ")" << std::endl;
+	
+	if (!keep)
+		unlink(recording.c_str());
+	
+	std::cout << (failures ? "FAILED" : "PASSED") << std::endl;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
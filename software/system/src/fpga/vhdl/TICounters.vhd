@@ -114,6 +114,129 @@ begin
 	
 end RTL;
 
+
+-- 
+-- FIFO of counter readings
+--
+-- Each counter trigger is stored as a four word record:
+--   word 0 : counter number (1 to 6)
+--   word 1 : PPS sequence number when the record was stored
+--   word 2 : counter reading LSB
+--   word 3 : counter reading MSB
+-- Everything runs on the host interface clock. 'events' must be one 'clk' period long.
+-- Records are only counted in 'nRecords' once all four words have been written so that
+-- the host never reads a partial record.
+-- If there is no room for a record, it is dropped and 'overflows' is incremented.
+--
+
+library IEEE;
+use IEEE.STD_LOGIC_1164.all;
+use IEEE.std_logic_arith.all;
+use IEEE.std_logic_misc.all;
+use IEEE.std_logic_unsigned.all;
+
+entity TICFIFO is
+	generic( depthBits : integer := 10 ); -- depth in 16 bit words is 2**depthBits
+	port(	clk	:	in STD_LOGIC;
+			events	:	in STD_LOGIC_VECTOR(5 downto 0);
+			ppsSeq	:	in STD_LOGIC_VECTOR(15 downto 0);
+			tint1	:	in STD_LOGIC_VECTOR(31 downto 0);
+			tint2	:	in STD_LOGIC_VECTOR(31 downto 0);
+			tint3	:	in STD_LOGIC_VECTOR(31 downto 0);
+			tint4	:	in STD_LOGIC_VECTOR(31 downto 0);
+			tint5	:	in STD_LOGIC_VECTOR(31 downto 0);
+			tint6	:	in STD_LOGIC_VECTOR(31 downto 0);
+			rd_en	:	in STD_LOGIC;
+			dout	:	out STD_LOGIC_VECTOR(15 downto 0);
+			nRecords	:	out STD_LOGIC_VECTOR(15 downto 0);
+			overflows	:	out STD_LOGIC_VECTOR(15 downto 0)
+			);
+end TICFIFO;
+
+architecture RTL of TICFIFO is
+
+	type ram_type is array (0 to 2**depthBits-1) of STD_LOGIC_VECTOR(15 downto 0);
+	type record_type is array (0 to 3) of STD_LOGIC_VECTOR(15 downto 0);
+	
+	signal ram	: ram_type;
+	signal rec	: record_type;
+	
+	-- pointers have an extra bit so that a full FIFO can be distinguished from an empty one
+	signal wp,rp,wpCommit	: STD_LOGIC_VECTOR(depthBits downto 0) := (others => '0');
+	signal pending	: STD_LOGIC_VECTOR(5 downto 0) := (others => '0');
+	signal wrWord	: STD_LOGIC_VECTOR(1 downto 0) := "00";
+	signal writing	: STD_LOGIC := '0';
+	signal nOverflows : STD_LOGIC_VECTOR(15 downto 0) := (others => '0');
+	signal used	: STD_LOGIC_VECTOR(depthBits downto 0);
+	signal committed	: STD_LOGIC_VECTOR(depthBits downto 0);
+	
+begin
+
+	used <= wp - rp;
+	committed <= wpCommit - rp;
+	
+	-- Write side
+	-- Pending triggers are stored lowest counter first, one word per clock
+	process (clk)
+		variable cleared : STD_LOGIC_VECTOR(5 downto 0);
+		variable chan : integer range 0 to 5;
+	begin
+		if rising_edge(clk) then
+			cleared := (others => '0');
+			if (writing = '1') then
+				ram(conv_integer(wp(depthBits-1 downto 0))) <= rec(conv_integer(wrWord));
+				wp <= wp + 1;
+				wrWord <= wrWord + 1;
+				if (wrWord = "11") then
+					writing <= '0';
+					wpCommit <= wp + 1;
+				end if;
+			elsif (or_reduce(pending) = '1') then
+				chan := 0;
+				for i in 5 downto 0 loop
+					if (pending(i) = '1') then
+						chan := i;
+					end if;
+				end loop;
+				cleared(chan) := '1';
+				if (used <= 2**depthBits - 4) then
+					rec(0) <= conv_std_logic_vector(chan+1,16);
+					rec(1) <= ppsSeq;
+					case chan is
+						when 0 => rec(2) <= tint1(15 downto 0); rec(3) <= tint1(31 downto 16);
+						when 1 => rec(2) <= tint2(15 downto 0); rec(3) <= tint2(31 downto 16);
+						when 2 => rec(2) <= tint3(15 downto 0); rec(3) <= tint3(31 downto 16);
+						when 3 => rec(2) <= tint4(15 downto 0); rec(3) <= tint4(31 downto 16);
+						when 4 => rec(2) <= tint5(15 downto 0); rec(3) <= tint5(31 downto 16);
+						when others => rec(2) <= tint6(15 downto 0); rec(3) <= tint6(31 downto 16);
+					end case;
+					wrWord <= "00";
+					writing <= '1';
+				else
+					nOverflows <= nOverflows + 1;
+				end if;
+			end if;
+			pending <= (pending and not cleared) or events;
+		end if;
+	end process;
+	
+	-- Read side
+	-- Like a standard FIFO, data appears on the clock after rd_en, which is what okPipeOut expects
+	process (clk)
+	begin
+		if rising_edge(clk) then
+			if (rd_en = '1' and rp /= wpCommit) then
+				dout <= ram(conv_integer(rp(depthBits-1 downto 0)));
+				rp <= rp + 1;
+			end if;
+		end if;
+	end process;
+	
+	nRecords <= conv_std_logic_vector(0,15-depthBits+2) & committed(depthBits downto 2);
+	overflows <= nOverflows;
+	
+end RTL;
+
 -- 
 --
 --
@@ -131,6 +254,25 @@ package TICounters is
 		ledPulse	: out STD_LOGIC
 		);
 	end component;
+	
+	component TICFIFO is 
+	generic( depthBits : integer := 10 );
+	port ( 
+		clk	:	in STD_LOGIC;
+		events	:	in STD_LOGIC_VECTOR(5 downto 0);
+		ppsSeq	:	in STD_LOGIC_VECTOR(15 downto 0);
+		tint1	:	in STD_LOGIC_VECTOR(31 downto 0);
+		tint2	:	in STD_LOGIC_VECTOR(31 downto 0);
+		tint3	:	in STD_LOGIC_VECTOR(31 downto 0);
+		tint4	:	in STD_LOGIC_VECTOR(31 downto 0);
+		tint5	:	in STD_LOGIC_VECTOR(31 downto 0);
+		tint6	:	in STD_LOGIC_VECTOR(31 downto 0);
+		rd_en	:	in STD_LOGIC;
+		dout	:	out STD_LOGIC_VECTOR(15 downto 0);
+		nRecords	:	out STD_LOGIC_VECTOR(15 downto 0);
+		overflows	:	out STD_LOGIC_VECTOR(15 downto 0)
+		);
+	end component;
 end TICounters;
 
 
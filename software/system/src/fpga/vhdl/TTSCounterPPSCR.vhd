@@ -15,6 +15,7 @@ use UNISIM.vcomponents.all;
 use work.FRONTPANEL.all;
 use work.TRIGGERS.OneShot;
 use work.TICOUNTERS.TICounter32;
+use work.TICOUNTERS.TICFIFO;
 
 entity TTSCounterPPSCR is
 	port (
@@ -53,8 +54,8 @@ architecture arch of TTSCounterPPSCR is
 	signal ti_clk     : STD_LOGIC;
 	signal ok1        : STD_LOGIC_VECTOR(30 downto 0);
 	signal ok2        : STD_LOGIC_VECTOR(16 downto 0);
--- note that the multiplier of '17' is the number of WireOuts+TriggerOuts
-	signal ok2s       : STD_LOGIC_VECTOR(17*14-1 downto 0);
+-- note that the multiplier of '17' is the number of WireOuts+TriggerOuts+PipeOuts
+	signal ok2s       : STD_LOGIC_VECTOR(17*20-1 downto 0);
 
 -- WireIns
 	signal ep00wire   : STD_LOGIC_VECTOR(15 downto 0); -- system control
@@ -79,9 +80,35 @@ architecture arch of TTSCounterPPSCR is
 	signal ep2bwire   : STD_LOGIC_VECTOR(15 downto 0); -- counter 6 reading
 
 	signal ep2cwire   : STD_LOGIC_VECTOR(15 downto 0); -- system status
+	signal ep2dwire   : STD_LOGIC_VECTOR(15 downto 0); -- number of records in the FIFO
+	signal ep2ewire   : STD_LOGIC_VECTOR(15 downto 0); -- number of records dropped because the FIFO was full
+	signal ep2fwire   : STD_LOGIC_VECTOR(15 downto 0); -- PPS sequence number
+	signal ep3fwire   : STD_LOGIC_VECTOR(15 downto 0); -- firmware version
 	
 -- TriggerOuts
 	signal ep60trig   : STD_LOGIC_VECTOR(15 downto 0); -- counter trigger status
+
+-- Block-throttled PipeOut for event-driven readout
+	signal epA0pipe   : STD_LOGIC_VECTOR(15 downto 0);
+	signal epA0read   : STD_LOGIC;
+	signal epA0blockstrobe : STD_LOGIC;
+	signal epA0ready  : STD_LOGIC;
+	
+-- PipeOut for reading the FIFO
+	signal epA1pipe   : STD_LOGIC_VECTOR(15 downto 0);
+	signal epA1read   : STD_LOGIC;
+	
+	signal dataReady  : STD_LOGIC_VECTOR(5 downto 0);
+	signal readyToggle: STD_LOGIC_VECTOR(5 downto 0) := (others => '0'); -- extclk domain
+	signal readySync1,readySync2,readySync3 : STD_LOGIC_VECTOR(5 downto 0) := (others => '0'); -- ti_clk domain
+	signal newEvents  : STD_LOGIC_VECTOR(5 downto 0);
+	signal ppsToggle  : STD_LOGIC := '0'; -- extclk domain
+	signal ppsSync    : STD_LOGIC_VECTOR(2 downto 0) := (others => '0'); -- ti_clk domain
+	signal ppsSeq     : STD_LOGIC_VECTOR(15 downto 0) := (others => '0');
+	signal nRecords   : STD_LOGIC_VECTOR(15 downto 0);
+	signal overflows  : STD_LOGIC_VECTOR(15 downto 0);
+	signal doorbell   : STD_LOGIC_VECTOR(15 downto 0) := (others => '0');
+	signal doorbellWord : STD_LOGIC_VECTOR(3 downto 0) := (others => '0');
 	
 	signal extclk		: STD_LOGIC;
 	signal sysCtrl    : STD_LOGIC_VECTOR(15 downto 0);  
@@ -251,7 +278,80 @@ ep2bwire <= tint6(31 downto 16);
 ep2awire <= tint6(15 downto 0);
 
 -- counter trigger state
-ep60trig <= "0000000000" & dataReady6 & dataReady5 & dataReady4 & dataReady3 & dataReady2 & dataReady1; 
+dataReady <= dataReady6 & dataReady5 & dataReady4 & dataReady3 & dataReady2 & dataReady1;
+ep60trig <= "0000000000" & dataReady; 
+
+-- FIFO readout
+-- Counter readings are queued in a FIFO with the PPS sequence number (see TICFIFO) and read by the host
+-- in bursts from PipeOut 0xA1. The number of records waiting is available on WireOut 0x2d. 
+-- 
+-- For event-driven readout, PipeOut 0xA0 is block-throttled, with ep_ready held high while the FIFO is not empty,
+-- so a host read blocks until there is something to read. Each block is 16 words:
+--   word 0     : number of records in the FIFO
+--   word 1     : number of records dropped because the FIFO was full
+--   word 2     : PPS sequence number
+--   words 3-15 : zero
+-- The host then drains the FIFO from PipeOut 0xA1.
+--
+-- dataReady and trigA are single extclk pulses, too short to be seen in the ti_clk domain, so they are converted to toggles
+-- which are synchronized and edge-detected. As for the WireOuts, the counter readings are stable long before 
+-- they are stored in the FIFO, so they don't need synchronizers.
+
+process (extclk)
+begin
+	if rising_edge(extclk) then
+		readyToggle <= readyToggle xor dataReady;
+		ppsToggle <= ppsToggle xor trigA;
+	end if;
+end process;
+
+newEvents <= readySync2 xor readySync3;
+
+process (ti_clk)
+begin
+	if rising_edge(ti_clk) then
+		readySync1 <= readyToggle;
+		readySync2 <= readySync1;
+		readySync3 <= readySync2;
+		ppsSync <= ppsSync(1 downto 0) & ppsToggle;
+		if (ppsSync(2) /= ppsSync(1)) then
+			ppsSeq <= ppsSeq + 1;
+		end if;
+	end if;
+end process;
+
+ticFIFO : TICFIFO port map (clk => ti_clk, events => newEvents, ppsSeq => ppsSeq,
+			tint1 => tint1, tint2 => tint2, tint3 => tint3, tint4 => tint4, tint5 => tint5, tint6 => tint6,
+			rd_en => epA1read, dout => epA1pipe, nRecords => nRecords, overflows => overflows);
+
+process (ti_clk)
+begin
+	if rising_edge(ti_clk) then
+		if (epA0blockstrobe = '1') then
+			doorbellWord <= (others => '0');
+		elsif (epA0read = '1') then
+			case doorbellWord is
+				when x"0" => doorbell <= nRecords;
+				when x"1" => doorbell <= overflows;
+				when x"2" => doorbell <= ppsSeq;
+				when others => doorbell <= (others => '0');
+			end case;
+			doorbellWord <= doorbellWord + 1;
+		end if;
+	end if;
+end process;
+
+epA0pipe <= doorbell;
+epA0ready <= or_reduce(nRecords);
+
+ep2dwire <= nRecords;
+ep2ewire <= overflows;
+ep2fwire <= ppsSeq;
+
+-- firmware version
+-- 0 (unconnected) : trigger outs and wire outs only
+-- 1               : FIFO 
+ep3fwire <= x"0001";
 
 -- system config/status
 -- bit 2->0: pps out source
@@ -293,7 +393,7 @@ okHI : okHost port map (
 		hi_in=>hi_in, hi_out=>hi_out, hi_inout=>hi_inout,
 		ti_clk=>ti_clk, ok1=>ok1, ok2=>ok2);
 
-okWO : okWireOR     generic map (N=>14) port map (ok2=>ok2, ok2s=>ok2s);
+okWO : okWireOR     generic map (N=>20) port map (ok2=>ok2, ok2s=>ok2s);
 
 -- WireOuts are updated synchronously with the host interface clock.
 -- In particular, the counter readings have to cross a clock domain. This can be done without a synchronizer because
@@ -327,4 +427,20 @@ ep00 : okWireIn    port map (ok1=>ok1, ep_addr=>x"00", ep_dataout=>ep00wire);
 -- counter trigger state
 ep60 : okTriggerOut port map (ok1=>ok1,ok2=>ok2s( 14*17-1 downto 13*17 ),  ep_addr=>x"60", ep_clk=>extclk, ep_trigger=>ep60trig);
 
+-- FIFO status
+ep2d : okWireOut    port map (ok1=>ok1, ok2=>ok2s( 15*17-1 downto 14*17 ), ep_addr=>x"2d", ep_datain=>ep2dwire);
+ep2e : okWireOut    port map (ok1=>ok1, ok2=>ok2s( 16*17-1 downto 15*17 ), ep_addr=>x"2e", ep_datain=>ep2ewire);
+ep2f : okWireOut    port map (ok1=>ok1, ok2=>ok2s( 17*17-1 downto 16*17 ), ep_addr=>x"2f", ep_datain=>ep2fwire);
+
+-- firmware version
+ep3f : okWireOut    port map (ok1=>ok1, ok2=>ok2s( 18*17-1 downto 17*17 ), ep_addr=>x"3f", ep_datain=>ep3fwire);
+
+-- event readout
+epA0 : okBTPipeOut  port map (ok1=>ok1, ok2=>ok2s( 19*17-1 downto 18*17 ), ep_addr=>x"a0", 
+			ep_read=>epA0read, ep_blockstrobe=>epA0blockstrobe, ep_datain=>epA0pipe, ep_ready=>epA0ready);
+
+-- FIFO
+epA1 : okPipeOut    port map (ok1=>ok1, ok2=>ok2s( 20*17-1 downto 19*17 ), ep_addr=>x"a1", 
+			ep_read=>epA1read, ep_datain=>epA1pipe);
+
 end arch;
\ No newline at end of file
@@ -46,7 +46,7 @@
 using namespace std;
 
 #define APPNAME "okbfloader"
-#define VERSION "0.2"
+#define VERSION "0.3"
 #define AUTHOR  "Michael Wouters, Louis Marais"
 
 #ifdef OKFRONTPANEL
@@ -61,6 +61,8 @@ static void printVersion();
 #define LOGMSG( os, msg ) os << msg << std::endl
        
 static int channelMask=1;
+static string cacheDir="/var/cache/openok";
+static bool skipIfLoaded=false;
 
 #ifdef OKFRONTPANEL
 okCFrontPanel * 
@@ -103,12 +105,17 @@ initializeFPGA(
 #ifdef OKFRONTPANEL
 	if (okCFrontPanel::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
 #else
-	if (OpenOK::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
+	bool skipped=false;
+	if (OpenOK::NoError != xem->ConfigureFPGAFromCache(bitfile,cacheDir,skipIfLoaded,&skipped)) {
 #endif
 		LOGMSG(cerr,"FPGA configuration failed");
 		delete xem;
 		return(NULL);
 	}
+#ifndef OKFRONTPANEL
+	if (skipped)
+		LOGMSG(cout,"Bitfile is already loaded - not reconfigured");
+#endif
 
 	// Check for FrontPanel support in the FPGA configuration.
 	if (xem->IsFrontPanelEnabled())
@@ -124,8 +131,10 @@ static void
 printHelp(
 	)
 {
-	cout << "Usage: " << APPNAME << "[-chv] <bitfile>" << endl;
+	cout << "Usage: " << APPNAME << " [-c dir] [-hkv] <bitfile>" << endl;
+	cout << "-c <dir> bitfile cache directory (default " << cacheDir << ")" << endl;
 	cout << "-h  show this help" << endl;
+	cout << "-k  don't load the bitfile if it is recorded as already loaded" << endl;
 	cout << "-v  print version" << endl;
 }
 
@@ -151,13 +160,19 @@ main(int argc,
 	int opt;
 	string bitfile;
 	
-	while ((opt=getopt(argc,argv,"hv")) != -1){
+	while ((opt=getopt(argc,argv,"c:hkv")) != -1){
 		switch (opt)
 		{
+			case 'c':
+				cacheDir=optarg;
+				break;
 			case 'h':
 				printHelp();
 				exit(EXIT_SUCCESS);
 				break;
+			case 'k':
+				skipIfLoaded=true;
+				break;
 			case 'v':
 				printVersion();
 				exit(EXIT_SUCCESS);
@@ -0,0 +1,139 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <sstream>
+
+#include "AcquisitionStats.h"
+
+// bin edges, in ns
+static const long long transferEdges[] = {100000,200000,500000,1000000,2000000,5000000,10000000,20000000,50000000};
+static const long long latencyEdges[] = {500000,1000000,2000000,5000000,10000000,20000000,50000000,100000000,
+	200000000,500000000,1000000000,2000000000};
+
+//
+// Histogram
+//
+
+Histogram::Histogram(const long long *e,int nEdges)
+{
+	edges.assign(e,e+nEdges);
+	counts.assign(nEdges+1,0); // last bin is overflow
+	n=0;
+	sum=max=0;
+}
+
+void Histogram::add(long long v)
+{
+	unsigned int i=0;
+	while (i < edges.size() && v >= edges[i])
+		i++;
+	counts[i]++;
+	n++;
+	sum += v;
+	if (v > max) max=v;
+}
+
+string Histogram::toString(string name)
+{
+	// eg
+	// latency (ms): n=1000 mean=0.812 max=1.931
+	// latency (ms): <0.5 12 <1 900 ...
+	ostringstream ss;
+	ss.setf(ios::fixed);
+	ss.precision(3);
+	ss << name << " (ms): n=" << n << " mean=" << (n > 0 ? sum*1.0E-6/n : 0.0) << " max=" << max*1.0E-6 << endl;
+	ss.unsetf(ios::fixed);
+	ss.precision(6);
+	ss << name << " (ms):";
+	for (unsigned int i=0;i<edges.size();i++)
+		ss << " <" << edges[i]*1.0E-6 << " " << counts[i];
+	ss << " >=" << edges.back()*1.0E-6 << " " << counts.back() << endl;
+	return ss.str();
+}
+
+//
+// AcquisitionStats
+//
+
+AcquisitionStats::AcquisitionStats():
+	transferTime(transferEdges,sizeof(transferEdges)/sizeof(long long)),
+	latency(latencyEdges,sizeof(latencyEdges)/sizeof(long long))
+{
+	pthread_mutex_init(&mutex,0);
+	for (int i=0;i<=MAX_CHANNELS;i++){
+		nReadings[i]=nMissed[i]=0;
+		lastReading[i]=-1;
+	}
+	nOverflows=0;
+	startTime=time(NULL);
+}
+
+AcquisitionStats::~AcquisitionStats()
+{
+	pthread_mutex_destroy(&mutex);
+}
+
+void AcquisitionStats::addTransfer(Timestamp &start,Timestamp &stop)
+{
+	pthread_mutex_lock(&mutex);
+	transferTime.add(stop.since(start));
+	pthread_mutex_unlock(&mutex);
+}
+
+void AcquisitionStats::addReading(int channel,long long tv_sec,long long l)
+{
+	if (channel < 1 || channel > MAX_CHANNELS)
+		return;
+	pthread_mutex_lock(&mutex);
+	latency.add(l);
+	nReadings[channel]++;
+	if (lastReading[channel] >= 0 && tv_sec - lastReading[channel] > 1)
+		nMissed[channel] += tv_sec - lastReading[channel] - 1;
+	lastReading[channel] = tv_sec;
+	pthread_mutex_unlock(&mutex);
+}
+
+void AcquisitionStats::addOverflows(unsigned int n)
+{
+	pthread_mutex_lock(&mutex);
+	nOverflows += n;
+	pthread_mutex_unlock(&mutex);
+}
+
+string AcquisitionStats::toString()
+{
+	pthread_mutex_lock(&mutex);
+	ostringstream ss;
+	ss << "uptime (s): " << time(NULL) - startTime << endl;
+	for (int i=1;i<=MAX_CHANNELS;i++){
+		if (nReadings[i] > 0)
+			ss << "channel " << i << ": readings=" << nReadings[i] << " missed=" << nMissed[i] << endl;
+	}
+	ss << "FIFO overflows: " << nOverflows << endl;
+	ss << transferTime.toString("transfer time");
+	ss << latency.toString("latency");
+	pthread_mutex_unlock(&mutex);
+	return ss.str();
+}
@@ -0,0 +1,109 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __ACQUISITION_STATS_H_
+#define __ACQUISITION_STATS_H_
+
+#include <pthread.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define MAX_CHANNELS 32
+
+// Host timestamps, taken together
+class Timestamp
+{
+	public:
+		struct timespec realtime;
+		struct timespec monotonic;
+		
+		void now()
+		{
+			clock_gettime(CLOCK_MONOTONIC,&monotonic);
+			clock_gettime(CLOCK_REALTIME,&realtime);
+		}
+		
+		// ns elapsed since t, on the monotonic clock
+		long long since(const Timestamp &t)
+		{
+			return (monotonic.tv_sec - t.monotonic.tv_sec)*1000000000LL + (monotonic.tv_nsec - t.monotonic.tv_nsec);
+		}
+};
+
+class Histogram
+{
+	public:
+		
+		Histogram(const long long *edges,int nEdges); // bin upper edges, in ns
+		void add(long long);
+		string toString(string name);
+		
+	private:
+		
+		vector<long long> edges;
+		vector<unsigned long> counts;
+		unsigned long n;
+		long long sum,max;
+};
+
+// Statistics on acquisition which can be queried by clients
+// Updated by the acquisition thread and read by the server thread, so access is locked.
+// 
+// The latency of a reading is the time from the 1 pps which triggered the reading 
+// to the host timestamp of the transfer which returned the reading. This assumes that
+// the host's clock is synchronized. 
+// A missed trigger is a second with no reading on a channel that is otherwise producing readings.
+
+class AcquisitionStats
+{
+	public:
+		
+		AcquisitionStats();
+		~AcquisitionStats();
+		
+		void addTransfer(Timestamp &,Timestamp &);
+		void addReading(int channel,long long tv_sec,long long latency);
+		void addOverflows(unsigned int);
+		string toString();
+		
+	private:
+		
+		pthread_mutex_t mutex;
+		
+		Histogram transferTime;
+		Histogram latency;
+		
+		unsigned long nReadings[MAX_CHANNELS+1];
+		unsigned long nMissed[MAX_CHANNELS+1];
+		long long lastReading[MAX_CHANNELS+1];
+		unsigned long nOverflows;
+		time_t startTime;
+};
+
+#endif
@@ -22,19 +22,21 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 // Modification history
-//
 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 
-#include <sstream>
 #include <cstring>
+#include <iostream>
 
 #include "Debug.h"
 #include "Client.h"
-#include "Server.h"
+#include "ReadingQueue.h"
 
 #define BUFSIZE 8192
 
@@ -45,88 +47,190 @@ extern ostream* debugStream;
 // Public methods
 //
 
-Client::Client(Server *s,int fd)
+Client::Client(int fd,unsigned int bufSize)
 {
-	ostringstream ss;
-	ss << fd;
-	threadID = "client"+ ss.str();
-	
 	socketfd=fd;
-	channelMask=0;
-	server=s;
+	channelMask=0xffffffff;
+	decimation=1;
+	memset(decimationCount,0,sizeof(decimationCount));
+	binary=false;
+	state=Connected;
+	wantWrite=false;
+	closingSince=0;
+	replaying=false;
+	replaySeq=0;
+	nSent=nDropped=0;
+	outSize=bufSize;
+	outbuf=new char[outSize];
+	outHead=nQueued=0;
 }
 
 Client::~Client()
 {
-	// Socket is not closed until the Client is destroyed
-	// This deals with the problem that if a counter logging process exits (and the Client socket is immediately released),
-	// there is a finite time before it is destroyed. If a new process is started before it is destroyed, then the OS may give 
-	// the new process the same file descriptor, which this Client then closes 
 	close(socketfd);
+	delete[] outbuf;
 }
 
-void Client::sendData(vector< int >&data)
+void Client::configure(const string &msg)
 {
-	DBGMSG(debugStream,"sending data:" << data.size());
-	
-	string msg;
-	for (unsigned int i=0;i<data.size();i+=4){
-		ostringstream ss;
-		ss << data.at(i) << " " << data.at(i+1) << " " << data.at(i+2) << " " << data.at(i+3) << endl;
-		msg += ss.str();
+	// Looks for mask=N and decimate=M 
+	// N can be given in hex (0x..)
+	const char *pmask = strstr(msg.c_str(),"mask=");
+	if (NULL != pmask){
+		channelMask = strtoul(pmask+5,NULL,0);
+		DBGMSG(debugStream,"fd " << socketfd << " mask=" << channelMask);
 	}
-	DBGMSG(debugStream,msg);
-	
-	int nw,nEINTR=0;
-	int nleft = msg.size();
-	const char* pbuf=msg.c_str();
+	const char *pdec = strstr(msg.c_str(),"decimate=");
+	if (NULL != pdec){
+		int d = atoi(pdec+9);
+		decimation = (d > 1 ? d : 1);
+		memset(decimationCount,0,sizeof(decimationCount));
+		DBGMSG(debugStream,"fd " << socketfd << " decimate=" << decimation);
+	}
+}
+
+void Client::queueReadings(vector<Reading> &rdgs)
+{
+	// Only format what the client has asked for
+	vector<Reading> selected;
+	selected.reserve(rdgs.size());
+	for (unsigned int i=0;i<rdgs.size();i++){
+		int ch = rdgs.at(i).channel;
+		if (ch < 1 || ch > MAX_CHANNELS || !(channelMask & (0x01u << (ch-1))))
+			continue;
+		if (decimation > 1 && (decimationCount[ch]++ % decimation) != 0)
+			continue;
+		selected.push_back(rdgs.at(i));
+	}
+	if (selected.empty())
+		return;
 	
-	while (nleft > 0){
-		if (( nw = write(socketfd,pbuf,nleft)) <= 0){
-			if (errno==EINTR){ // interrupted by signal
-				nw=0;
-				nEINTR++;
-				if (10==nEINTR){
-					DBGMSG(debugStream, "too many interrrupts - write() aborted");
-					return;
-				}
-			}
-			else{
-				DBGMSG(debugStream, strerror(errno));
-				return;
-			}
-		}
-		DBGMSG(debugStream, "wrote " << nw);
-		nleft -=nw;
-		pbuf += nw;
-	}	
+	if (binary)
+		queueBinary(selected);
+	else
+		queueText(selected);
 }
 
-void Client::doWork()
+bool Client::queueMessage(const string &msg)
 {
-	int nread;
-	char msgbuf[BUFSIZE];
-	while (!stopRequested){
-		while ((nread=recv(socketfd,msgbuf,BUFSIZE-1,0))>0){ // nread ==0 -> shutdown
-			msgbuf[nread]=0; // terminate that string
-			// Get the channel mask
-			DBGMSG(debugStream,threadID << ":" << msgbuf);
-			// Expected input is of the form mask=N
-		}
-		int serror=errno; // save the errorno since subsequent system calls will overwrite it
-		if (0==nread){
-			DBGMSG(debugStream,"connection " << threadID << " closed by remote");
-			//close(socketfd);
-			stopRequested=true;
+	// Messages are not split - either all of it fits or it's dropped
+	if (msg.size() > outSize - nQueued)
+		return false;
+	unsigned int tail = (outHead + nQueued) % outSize;
+	unsigned int n1 = msg.size();
+	if (n1 > outSize - tail) n1 = outSize - tail;
+	memcpy(outbuf+tail,msg.data(),n1);
+	memcpy(outbuf,msg.data()+n1,msg.size()-n1);
+	nQueued += msg.size();
+	return true;
+}
+
+bool Client::flush()
+{
+	// Writes as much as the socket will take without blocking
+	// Returns false on error
+	while (nQueued > 0){
+		struct iovec iov[2];
+		int niov=1;
+		iov[0].iov_base = outbuf + outHead;
+		if (outHead + nQueued > outSize){
+			iov[0].iov_len = outSize - outHead;
+			iov[1].iov_base = outbuf;
+			iov[1].iov_len = nQueued - iov[0].iov_len;
+			niov=2;
 		}
-		else if (-1==nread){
-			DBGMSG(debugStream,"recv error : " << strerror(serror) << " " << threadID << " closed");
-			//close(socketfd);
-			stopRequested=true;
+		else
+			iov[0].iov_len = nQueued;
+		
+		ssize_t nw = writev(socketfd,iov,niov);
+		if (nw < 0){
+			if (errno == EINTR) 
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			DBGMSG(debugStream, "fd " << socketfd << " " << strerror(errno));
+			return false;
 		}
+		outHead = (outHead + nw) % outSize;
+		nQueued -= nw;
 	}
-	DBGMSG(debugStream, "finished");
-	running=false;
+	outHead=0;
+	return true;
 }
 
+bool Client::readInput(string &msg)
+{
+	// Reads everything available
+	// Returns false if the connection has been closed or there was an error, but msg
+	// still contains anything read before that
+	char msgbuf[BUFSIZE];
+	int nread;
+	msg="";
+	while ((nread=recv(socketfd,msgbuf,BUFSIZE,0)) > 0)
+		msg.append(msgbuf,nread);
+	if (0==nread){
+		DBGMSG(debugStream,"fd " << socketfd << " closed by remote");
+		return false;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return true;
+	DBGMSG(debugStream,"recv error : " << strerror(errno) << " fd " << socketfd << " closed");
+	return false;
+}
+
+//
+// Private methods
+//
+
+static inline void putLE(char *p,unsigned long long v,int nbytes)
+{
+	for (int i=0;i<nbytes;i++){
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+void Client::queueText(vector<Reading> &rdgs)
+{
+	char msg[96];
+	for (unsigned int i=0;i<rdgs.size();i++){
+		Reading &r = rdgs.at(i);
+		int len = snprintf(msg,sizeof(msg),"%d %lld %d %d\n",r.channel,r.tv_sec,r.tv_nsec/1000,r.rdg);
+		if (queueMessage(string(msg,len)))
+			nSent++;
+		else
+			nDropped++;
+	}
+}
+
+void Client::queueBinary(vector<Reading> &rdgs)
+{
+	// The batch is queued whole or not at all
+	unsigned int n = rdgs.size();
+	string msg(BINARY_HEADER_SIZE + n*BINARY_RECORD_SIZE,'\0');
+	char *p = &msg[0];
+	
+	memcpy(p,"OKCD",4);
+	putLE(p+4,1,2);
+	putLE(p+6,n,2);
+	putLE(p+8,BINARY_HEADER_SIZE,2);
+	putLE(p+10,BINARY_RECORD_SIZE,2);
+	putLE(p+12,nDropped,4);
+	p += BINARY_HEADER_SIZE;
+	
+	for (unsigned int i=0;i<n;i++){
+		Reading &r = rdgs.at(i);
+		putLE(p,r.seq,4);
+		putLE(p+4,r.channel,2);
+		putLE(p+8,r.tv_sec,8);
+		putLE(p+16,r.tv_nsec,4);
+		putLE(p+20,(unsigned int) r.rdg,4);
+		p += BINARY_RECORD_SIZE;
+	}
+	
+	if (queueMessage(msg))
+		nSent += n;
+	else
+		nDropped += n;
+}
 
@@ -26,32 +26,95 @@
 #ifndef __CLIENT_H_
 #define __CLIENT_H_
 
-#include <vector>
+#include <time.h>
 
-#include "Thread.h"
+#include <string>
+#include <vector>
 
 using namespace std;
 
-class Server;
+class Reading;
+
+// A connection to the server. 
+// Clients don't have their own thread: the Server's event loop does all I/O on non-blocking sockets.
+// Output is queued in a fixed size ring buffer. If a client doesn't keep up and the buffer fills, 
+// further readings are dropped (and counted) rather than holding up the server.
+//
+// Readings are sent either as text lines or, if requested, in binary batches.
+// All binary values are little-endian. Each batch is a header followed by the records:
+//
+// Header (16 bytes)
+//   0  char[4] "OKCD"
+//   4  uint16  format version (1)
+//   6  uint16  number of records
+//   8  uint16  header size (16)
+//  10  uint16  record size (24)
+//  12  uint32  number of readings dropped for this client so far
+// Record (24 bytes)
+//   0  uint32  sequence number
+//   4  uint16  channel
+//   6  uint16  reserved (0)
+//   8  int64   timestamp seconds
+//  16  uint32  timestamp nanoseconds
+//  20  int32   reading (ns)
+//
+// Clients should use the header and record sizes in the header to step through the batch, so that
+// fields can be added in future.
+//
+// A client can restrict what it is sent with 'mask=N' (bit 0 is channel 1) and 'decimate=M' (send every Mth reading
+// on each channel), either in the LISTEN request or sent later.
+//
+// A client can ask for recent readings to be replayed from the Server's history before live data
+// with 'from=T' (Unix time, s) or 'since=S' (sequence number) in the LISTEN request.
+
+#define BINARY_HEADER_SIZE 16
+#define BINARY_RECORD_SIZE 24
+#define MAX_CHANNELS 32
+#define MAX_READING_SIZE 64 // upper limit on the size of a formatted reading
 
-class Client:public Thread
+class Client
 {
 	public:
 	
-		Client(Server *,int);
-		virtual ~Client();
+		enum State {Connected,Waiting,Listening,Closing}; // Waiting for the device to carry out a request
 		
-		void sendData(vector<int> &);
-
-	protected:
+		Client(int,unsigned int bufSize=65536);
+		~Client();
+		
+		int fd(){return socketfd;}
+		
+		void setBinary(bool b){binary=b;}
+		void configure(const string &);
+		void queueReadings(vector<Reading> &);
+		bool queueMessage(const string &);
+		bool flush();
+		bool readInput(string &);
+		bool hasOutput(){return nQueued > 0;}
+		unsigned int space(){return outSize - nQueued;}
 		
-		virtual void doWork();
+		State state;
+		bool wantWrite;       // EPOLLOUT is set
+		time_t closingSince;
+		
+		bool replaying;
+		unsigned int replaySeq; // next reading to replay
+		
+		unsigned long nSent;
+		unsigned long nDropped;
 		
 	private:
 		
-		Server *server;
+		void queueText(vector<Reading> &);
+		void queueBinary(vector<Reading> &);
+		
 		int socketfd;
-		int channelMask;
+		unsigned int channelMask;
+		unsigned int decimation;
+		unsigned int decimationCount[MAX_CHANNELS+1];
+		bool binary;
+		
+		char *outbuf;
+		unsigned int outSize,outHead,nQueued;
 		
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,107 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __COMMAND_QUEUE_H_
+#define __COMMAND_QUEUE_H_
+
+#include <future>
+#include <vector>
+
+// A multiple producer, single consumer queue of commands for the device.
+// All USB I/O is done by the acquisition thread. Other threads push commands and wait on the
+// returned future; the acquisition thread takes all the queued commands at once and carries 
+// them out with its next poll of the device. Pushing never blocks and taking never waits on a pusher.
+
+class DeviceCommand
+{
+	public:
+		
+		enum Type {WriteWireIn,ReadWireOut};
+		
+		DeviceCommand(Type t,int ep,unsigned long v=0,unsigned long m=0xffffffff)
+		{
+			type=t;epAddr=ep;val=v;mask=m;next=NULL;
+		}
+		
+		Type type;
+		int epAddr;
+		unsigned long val,mask;
+		std::promise<unsigned int> result; // the wire out value, or 0 for a write
+		DeviceCommand *next;
+};
+
+// The results of the commands pushed for one request, in the order they were pushed
+typedef std::vector<std::future<unsigned int> > CommandResults;
+
+class CommandQueue
+{
+	public:
+		
+		CommandQueue(){head=NULL;}
+		
+		~CommandQueue()
+		{
+			DeviceCommand *c = takeAll();
+			while (c){
+				DeviceCommand *next = c->next;
+				c->result.set_value(0);
+				delete c;
+				c = next;
+			}
+		}
+		
+		// any thread; the queue takes ownership of c
+		std::future<unsigned int> push(DeviceCommand *c)
+		{
+			std::future<unsigned int> f = c->result.get_future(); // c can be deleted as soon as it's pushed
+			DeviceCommand *h = __atomic_load_n(&head,__ATOMIC_RELAXED);
+			do{
+				c->next = h;
+			} while (!__atomic_compare_exchange_n(&head,&h,c,true,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+			return f;
+		}
+		
+		// consumer only. Returns the queued commands, oldest first. The caller sets their results and deletes them.
+		DeviceCommand *takeAll()
+		{
+			DeviceCommand *c = __atomic_exchange_n(&head,(DeviceCommand *) NULL,__ATOMIC_ACQUIRE);
+			DeviceCommand *oldest=NULL;
+			while (c){ // the list is newest first
+				DeviceCommand *next = c->next;
+				c->next = oldest;
+				oldest = c;
+				c = next;
+			}
+			return oldest;
+		}
+		
+		bool empty(){return __atomic_load_n(&head,__ATOMIC_RELAXED) == NULL;}
+		
+	private:
+		
+		DeviceCommand *head;
+};
+
+#endif
@@ -66,7 +66,7 @@ int main(
 	OKCounterD *app = new OKCounterD(argc,argv);
 	
 	// Process the command line options
-	while ((opt=getopt(argc,argv,"b:d:hv")) != -1)
+	while ((opt=getopt(argc,argv,"b:d:ehkl:r:stvx:")) != -1)
 	{
 		switch(opt)
 		{
@@ -92,14 +92,39 @@ int main(
 					break;
 				}
 				break;
+			case 'e':
+				app->setEventDriven(true);
+				break;
 			case 'h':
 				app->showHelp();
 				exit(EXIT_SUCCESS);
 				break;
+			case 'k':
+				app->setSkipIfLoaded(true);
+				break;
+			case 'l':
+				if (!app->addLogChannel(optarg)){
+					cerr << "Bad logging option " << optarg << " (expected channel:directory[:extension])" << endl;
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'r':
+				app->setHistoryLength(atoi(optarg));
+				break;
+			case 's':
+				app->setLogBinary(true);
+				break;
+			case 't':
+				app->setTraceUSB(true);
+				break;
 			case 'v': 
 				app->showVersion();
 				exit(EXIT_SUCCESS);
 				break;
+			case 'x':
+				if (!app->addBoard(optarg))
+					exit(EXIT_FAILURE);
+				break;
 		}
 	}
 	
@@ -25,20 +25,51 @@
 // Modification history
 
 #include <sys/time.h>
+#include <syslog.h>
 #include <unistd.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+#include "AcquisitionStats.h"
+#include "CommandQueue.h"
 #include "Debug.h"
 #include "OKCounterD.h"
+#include "PPSStats.h"
 #include "Server.h"
+#include "TICLogger.h"
 
-#define NCHANNELS 6
+#define NCHANNELS 6 // per board
 #define BASEADDR 0x20
 
+#define EVENT_BLOCK_SIZE 32 // bytes in a block read from the event pipe
+#define FIFO_RECORD_SIZE 8  // bytes in a FIFO record
+#define FIFO_MAX_RECORDS 256
+
+
 extern ostream *debugStream;
 
+//
+// CounterBoard
+//
+
+CounterBoard::CounterBoard(string s,int first)
+{
+	serial=s;
+	firstChannel=first;
+	xem=NULL;
+	commands=new CommandQueue();
+	firmwareVersion=0;
+	fifoOverflows=0;
+}
+
+CounterBoard::~CounterBoard()
+{
+	delete commands;
+	delete xem;
+}
+
 //
 // public members
 //
@@ -52,6 +83,13 @@ OKCounterD::~OKCounterD()
 {
 	server->stop();
 	delete server;
+	if (logger->isRunning())
+		logger->stop();
+	delete logger;
+	delete stats;
+	delete ppsStats;
+	for (unsigned int b=0;b<boards.size();b++)
+		delete boards.at(b);
 }
 
 void OKCounterD::showHelp()
@@ -61,16 +99,25 @@ void OKCounterD::showHelp()
 	cout << "Available options are" << endl;
 	cout << "-b <file> specify a bitfile to load"<< endl;
 	cout << "-d <file> turn on debugging to <file> (use 'stderr' for output to stderr)" << endl;
+	cout << "-e use event-driven acquisition (requires FPGA firmware with the event pipe)" << endl;
 	cout << "-h print this help message" << endl;
+	cout << "-k don't load the bitfile if it is recorded as already loaded" << endl;
+	cout << "-l <channel:directory[:extension]> log a channel to daily files (may be repeated)" << endl;
+	cout << "-r <minutes> minutes of readings to keep for replay to clients (default 10)" << endl;
+	cout << "-s also write a binary file of readings for each logged channel" << endl;
+	cout << "-t trace USB transfers (see QUERY USB)" << endl;
 	cout << "-v print version" << endl;
+	cout << "-x <serial> open the board with this serial number (may be repeated, to use several boards)" << endl;
 } 
 
 void OKCounterD::showVersion()
 {
 	cout << APP_NAME <<  " version " << OKCOUNTERD_VERSION << endl;
 	cout << "Compiled against ";
-#ifdef OKFRONTPANEL
+#if defined(OKFRONTPANEL)
 	cout << " okFrontPanel" << endl;
+#elif defined(SIMULATOR)
+	cout << " the device simulator" << endl;
 #else 
 	cout << " OpenOK2" << endl;
 #endif
@@ -82,68 +129,38 @@ void OKCounterD::run()
 {
 	// Collects data from the FPGA
 	
-	vector<int> measurements;
-	
-	server = new Server(this,port); // start the Server thread
+	server = new Server(this,port,historyMinutes); // start the Server thread
 	server->go();
 	
 	DBGMSG(debugStream,"server started");
 	
-	xem->UpdateTriggerOuts();
+	if (logger->hasChannels()){
+		logger->go();
+		DBGMSG(debugStream,"logger started");
+	}
 	
-	// system control register
-  // bits 2->0 : selection of output 1 pps source  
-  // bit  3    : enable external I/O on GPIO pin
-	xem->SetWireInValue(epSysControl,0x0f);
-	xem->UpdateWireIns();
-	xem->UpdateWireOuts();
+	for (unsigned int b=0;b<boards.size();b++)
+		setupBoard(boards.at(b));
 	
-	// bit 2->0: pps out source
-	// bit 3   : GPIO enabled
-	// bit 4   : DCM locked
-	unsigned int sysStatus=xem->GetWireOutValue(epSysStatus) & 0xffff;
-	DBGMSG(debugStream,"Status: " << "PPS OUT=" << (sysStatus & 0x07) << 
-		" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4));
-
-	for (;;){
-		usleep(10000);
-		measurements.clear();
-		xem->UpdateTriggerOuts();
-		int triggered=0;
-		int bitmask=0x01;
-		for (int i=0;i<NCHANNELS;i++){
-			triggered = triggered || (xem->IsTriggered(0x60,bitmask) && (channelMask & bitmask));
-			bitmask=bitmask << 1;
-		}
-		
-		if (triggered){
-			int addr=BASEADDR;
-			int bitmask=0x01;
-			struct timeval tv;
-			int rdg;
-			unsigned int upperbits,lowerbits;
-			xem->UpdateWireOuts();
-			for (int i=0;i<NCHANNELS;i++){
-				if (channelMask & bitmask){
-					if (xem->IsTriggered(0x60,bitmask)){
-						gettimeofday(&tv,NULL);
-						upperbits=xem->GetWireOutValue(addr+1) & 0xffff;
-						lowerbits=xem->GetWireOutValue(addr) & 0xffff;
-						rdg = (upperbits  << 16) + lowerbits;
-						rdg= (int)rdg*5.0E-9*1.0E9/4.0;
-						if (rdg>500000000) rdg -= 1000000000;
-						measurements.push_back(i+1);
-						measurements.push_back((int) tv.tv_sec);
-						measurements.push_back((int) tv.tv_usec);
-						measurements.push_back(rdg);
-					}
-				}
-				bitmask=bitmask << 1;
-				addr += 2;
-			}
-			server->sendData(measurements);
-		}// if triggered
-	}	
+	bool haveFIFO=true;
+	for (unsigned int b=0;b<boards.size();b++)
+		haveFIFO = haveFIFO && (boards.at(b)->firmwareVersion >= 1);
+	
+	if (eventDriven && !haveFIFO){
+		syslog(LOG_WARNING,"firmware does not support event-driven acquisition - polling instead");
+		eventDriven=false;
+	}
+	
+	// A blocking read can only wait on one board
+	if (eventDriven && boards.size() > 1){
+		syslog(LOG_WARNING,"event-driven acquisition is only possible with one board - polling instead");
+		eventDriven=false;
+	}
+	
+	if (eventDriven)
+		waitForEvents();
+	else
+		poll();
 }
 
 void OKCounterD::log(string msg)
@@ -151,29 +168,119 @@ void OKCounterD::log(string msg)
 	cout << msg << endl;
 }
 
-void OKCounterD::setOutputPPSSource(int src)
+bool OKCounterD::addBoard(string serial)
+{
+	// Boards are given channels in the order they are added
+	if ((int) (boards.size() + 1)*NCHANNELS > MAX_CHANNELS){
+		cerr << "Too many boards (at most " << MAX_CHANNELS/NCHANNELS << ")" << endl;
+		return false;
+	}
+	for (unsigned int b=0;b<boards.size();b++){
+		if (boards.at(b)->serial == serial){
+			cerr << "Board " << serial << " is given twice" << endl;
+			return false;
+		}
+	}
+	boards.push_back(new CounterBoard(serial,boards.size()*NCHANNELS + 1));
+	return true;
+}
+
+bool OKCounterD::addLogChannel(string spec)
+{
+	return logger->addChannel(spec);
+}
+
+void OKCounterD::setLogBinary(bool b)
 {
-	DBGMSG(debugStream,"Setting output PPS source " << src);
+	logger->setBinary(b);
+}
+
+// These are called from the server thread, so the device is accessed via the command queue.
+// They don't wait: the acquisition thread sets the results and then wakes the server.
+
+// board is numbered from 1. If it is 0, all boards are configured.
+
+CommandResults OKCounterD::setOutputPPSSource(int src,int board)
+{
+	DBGMSG(debugStream,"Setting output PPS source " << src << " board " << board);
   // bits 2->0 : selection of output 1 pps source   
-	xem->SetWireInValue(epSysControl,src & 0x07,0x07);
-	xem->UpdateWireIns();
+	CommandResults results;
+	for (unsigned int b=0;b<boards.size();b++){
+		if (board == 0 || board == (int) b+1)
+			results.push_back(boards.at(b)->commands->push(new DeviceCommand(DeviceCommand::WriteWireIn,epSysControl,src & 0x07,0x07)));
+	}
+	return results;
 }
 
-void OKCounterD::setGPIOEnable(bool en)
+CommandResults OKCounterD::setGPIOEnable(bool en,int board)
 {
-	DBGMSG(debugStream,"Setting GPIO enable " << (en? "ON" : "OFF"));
+	DBGMSG(debugStream,"Setting GPIO enable " << (en? "ON" : "OFF") << " board " << board);
 	 // bit  3    : enable external I/O on GPIO pin
 	unsigned int enb = en ? 0x08 : 0x00;
-	xem->SetWireInValue(epSysControl,enb,0x08);
-	xem->UpdateWireIns();
+	CommandResults results;
+	for (unsigned int b=0;b<boards.size();b++){
+		if (board == 0 || board == (int) b+1)
+			results.push_back(boards.at(b)->commands->push(new DeviceCommand(DeviceCommand::WriteWireIn,epSysControl,enb,0x08)));
+	}
+	return results;
 }
 
-string OKCounterD::getConfiguration()
+CommandResults OKCounterD::queryConfiguration()
+{
+	// One result for each board, in order
+	CommandResults results;
+	for (unsigned int b=0;b<boards.size();b++)
+		results.push_back(boards.at(b)->commands->push(new DeviceCommand(DeviceCommand::ReadWireOut,epSysStatus)));
+	return results;
+}
+
+string OKCounterD::getStats()
+{
+	return stats->toString();
+}
+
+string OKCounterD::getPPSStats()
+{
+	return ppsStats->toString();
+}
+
+void OKCounterD::setTraceUSB(bool trace)
+{
+	traceUSB=trace;
+#if !defined(OKFRONTPANEL) && !defined(SIMULATOR)
+	OpenOK_TransferTrace::Enable(trace);
+#endif
+}
+
+string OKCounterD::getUSBTrace()
+{
+	// The counters are updated without locks, so this doesn't need to go through the acquisition thread
+#if defined(OKFRONTPANEL) || defined(SIMULATOR)
+	return "USB tracing not available";
+#else
+	if (!traceUSB)
+		return "USB tracing off (start with -t)";
+	return OpenOK_TransferTrace::Report();
+#endif
+}
+
+string OKCounterD::getConfiguration(CommandResults &results)
 { 
-	xem->UpdateWireOuts();
-	unsigned int sysStatus=xem->GetWireOutValue(epSysStatus) & 0xffff;
+	// Formats the results of queryConfiguration(). Any that are not ready have timed out.
+	// With several boards, there is a line for each board
 	ostringstream ss;
-	ss << "PPS OUT=" << (sysStatus & 0x07) <<" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4);
+	for (unsigned int b=0;b<boards.size();b++){
+		CounterBoard *brd = boards.at(b);
+		if (boards.size() > 1)
+			ss << (b > 0 ? "\n" : "") << "BOARD=" << b+1 << " SERIAL=" << brd->xem->GetSerialNumber() << 
+				" CHANNELS=" << brd->firstChannel << "-" << brd->firstChannel + NCHANNELS - 1 << " ";
+		if (results.at(b).wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+			ss << "device not responding";
+			continue;
+		}
+		unsigned int sysStatus = results.at(b).get();
+		ss << "PPS OUT=" << (sysStatus & 0x07) <<" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4);
+	}
 	DBGMSG(debugStream,"Status: " << ss.str());
 	return ss.str();
 }
@@ -185,28 +292,400 @@ string OKCounterD::getConfiguration()
 
 void OKCounterD::init()
 {
-	xem=NULL;
 	dbgOn=false;
 	port=21577;
 	server=NULL;
-	channelMask=0xffff;
+	logger=new TICLogger(this);
+	stats=new AcquisitionStats();
+	ppsStats=new PPSStats();
+	channelMask=0xffffffff;
 	epSysControl=0x00;
 	epSysStatus=0x2c;
+	epEvents=0xa0;
+	epFIFO=0xa1;
+	epFIFOCount=0x2d;
+	epFIFOOverflows=0x2e;
+	epPPSSequence=0x2f;
+	epFirmwareVersion=0x3f;
+	eventDriven=false;
+	skipIfLoaded=false;
+	traceUSB=false;
+	historyMinutes=10;
 }
 
-bool OKCounterD::initializeFPGA(string bitfile)
+void OKCounterD::setupBoard(CounterBoard *brd)
+{
+	XEM *xem = brd->xem;
+	
+	// system control register
+  // bits 2->0 : selection of output 1 pps source  
+  // bit  3    : enable external I/O on GPIO pin
+#ifdef OKFRONTPANEL
+	xem->UpdateTriggerOuts();
+	xem->SetWireInValue(epSysControl,0x0f);
+	xem->UpdateWireIns();
+	xem->UpdateWireOuts();
+#else
+	XEMTransaction setup;
+	setup.UpdateTriggerOuts(); // clears any stale triggers
+	setup.SetWireInValue(epSysControl,0x0f);
+	setup.UpdateWireOuts();
+	xem->ExecuteTransaction(&setup);
+#endif
+	
+	// bit 2->0: pps out source
+	// bit 3   : GPIO enabled
+	// bit 4   : DCM locked
+	unsigned int sysStatus=xem->GetWireOutValue(epSysStatus) & 0xffff;
+	DBGMSG(debugStream,"Board " << brd->serial << " status: " << "PPS OUT=" << (sysStatus & 0x07) << 
+		" GPIO_EN=" << ((sysStatus &0x08)>>3) << " DCM_LOCK=" << ((sysStatus & 0x10)>>4));
+	
+	// firmware without a version number reads as 0
+	brd->firmwareVersion = xem->GetWireOutValue(epFirmwareVersion) & 0xffff;
+	brd->fifoOverflows   = xem->GetWireOutValue(epFIFOOverflows) & 0xffff;
+	DBGMSG(debugStream,"Firmware version: " << brd->firmwareVersion);
+	
+#ifndef OKFRONTPANEL
+	// Without the FIFO, the trigger outs and counters are read together in one transaction, saving a round trip
+	// when there are readings, and so that the counters read go with the trigger outs read
+	if (brd->firmwareVersion < 1)
+		brd->cycle.UpdateTriggerOuts();
+	brd->cycle.UpdateWireOuts();
+#endif
+}
+
+void OKCounterD::poll()
+{
+	// Polls all the boards every 10 ms. The FIFO status is read and the FIFO is drained when there is something in it.
+	// For firmware without the FIFO, the trigger outs are read instead, and the counters which have triggered.
+	// The readings from all the boards are sent together.
+	
+	vector<int> measurements;
+	vector<Timestamp> t0(boards.size()),t1(boards.size());
+#ifndef OKFRONTPANEL
+	vector<DeviceCommand *> cmds(boards.size());
+#endif
+	
+	DBGMSG(debugStream,"polling " << boards.size() << " board(s)");
+	
+	for (;;){
+		usleep(10000);
+		measurements.clear();
+#ifdef OKFRONTPANEL
+		for (unsigned int b=0;b<boards.size();b++){
+			CounterBoard *brd = boards.at(b);
+			runCommands(brd);
+			t0[b].now();
+			if (brd->firmwareVersion >= 1)
+				brd->xem->UpdateWireOuts();
+			else
+				brd->xem->UpdateTriggerOuts();
+			t1[b].now();
+		}
+#else
+		// Every board's transaction is submitted before waiting on any of them, so that the transfers
+		// to different boards overlap
+		for (unsigned int b=0;b<boards.size();b++){
+			CounterBoard *brd = boards.at(b);
+			cmds[b] = takeCommands(brd,&(brd->cycle)); // done with this poll
+			t0[b].now();
+			brd->xem->SubmitTransaction(&(brd->cycle));
+		}
+		for (unsigned int b=0;b<boards.size();b++){
+			CounterBoard *brd = boards.at(b);
+			brd->xem->WaitForTransaction(&(brd->cycle));
+			t1[b].now();
+			if (brd->firmwareVersion < 1)
+				t1[b].realtime = brd->cycle.snapshotTime; // when the trigger outs were read
+			completeCommands(brd,cmds[b]);
+		}
+#endif
+		for (unsigned int b=0;b<boards.size();b++){
+			CounterBoard *brd = boards.at(b);
+			stats->addTransfer(t0[b],t1[b]);
+			if (brd->firmwareVersion >= 1){
+				unsigned int nRecords = brd->xem->GetWireOutValue(epFIFOCount) & 0xffff;
+				if (nRecords > 0){
+					drainFIFO(brd,nRecords,brd->xem->GetWireOutValue(epPPSSequence) & 0xffff,
+						brd->xem->GetWireOutValue(epFIFOOverflows) & 0xffff,&t1[b],measurements);
+				}
+			}
+			else
+				readTriggers(brd,&t1[b],measurements);
+		}
+		if (!measurements.empty())
+			sendMeasurements(measurements);
+	}	
+}
+
+void OKCounterD::waitForEvents()
+{
+	// Blocks on the event pipe of the (only) board. The FPGA only releases a block when there is something in the FIFO,
+	// so there is no USB traffic while waiting.
+	// Block layout (16 bit words, LSB first):
+	//   word 0 : number of records in the FIFO
+	//   word 1 : number of records dropped because the FIFO was full
+	//   word 2 : PPS sequence number
+	
+	unsigned char buf[EVENT_BLOCK_SIZE];
+	vector<int> measurements;
+	CounterBoard *brd = boards.at(0);
+	XEM *xem = brd->xem;
+	
+	DBGMSG(debugStream,"waiting for events");
+	
+	for (;;){
+		// The read blocks until there is an event so it's not useful to record its duration
+		long nread = xem->ReadFromBlockPipeOut(epEvents,EVENT_BLOCK_SIZE,EVENT_BLOCK_SIZE,buf);
+		Timestamp t;
+		t.now();
+		
+		// Commands wait for the next event or timeout
+		if (!brd->commands->empty()){
+#ifdef OKFRONTPANEL
+			runCommands(brd);
+#else
+			XEMTransaction batch;
+			DeviceCommand *cmds = takeCommands(brd,&batch);
+			xem->ExecuteTransaction(&batch);
+			completeCommands(brd,cmds);
+#endif
+		}
+		
+		if (nread == XEM::Timeout){
+			DBGMSG(debugStream,"timeout");
+			continue;
+		}
+		if (nread != EVENT_BLOCK_SIZE){
+			DBGMSG(debugStream,"read failed " << nread);
+			usleep(100000); // don't spin if the device has gone away
+			continue;
+		}
+		
+		measurements.clear();
+		drainFIFO(brd,buf[0] + (buf[1] << 8),buf[4] + (buf[5] << 8),buf[2] + (buf[3] << 8),&t,measurements);
+		if (!measurements.empty())
+			sendMeasurements(measurements);
+	}
+}
+
+void OKCounterD::readTriggers(CounterBoard *brd,Timestamp *tstamp,vector<int> &measurements)
+{
+	// For firmware without the FIFO. Reads the counters which have triggered.
+	// Readings are timestamped when the trigger outs were read (tstamp), not after 
+	// the counters have been read, so that the timestamp doesn't include that transfer
+	
+	XEM *xem = brd->xem;
+	unsigned int boardMask = (channelMask >> (brd->firstChannel - 1)) & ((0x01 << NCHANNELS) - 1);
+	int triggered=0;
+	int bitmask=0x01;
+	for (int i=0;i<NCHANNELS;i++){
+		triggered = triggered || (xem->IsTriggered(0x60,bitmask) && (boardMask & bitmask));
+		bitmask=bitmask << 1;
+	}
+	if (!triggered)
+		return;
+	
+	int addr=BASEADDR;
+	unsigned int upperbits,lowerbits;
+#ifdef OKFRONTPANEL
+	Timestamp t2,t3;
+	t2.now();
+	xem->UpdateWireOuts();
+	t3.now();
+	stats->addTransfer(t2,t3);
+#endif
+	bitmask=0x01;
+	for (int i=0;i<NCHANNELS;i++){
+		if (boardMask & bitmask){
+			if (xem->IsTriggered(0x60,bitmask)){
+				upperbits=xem->GetWireOutValue(addr+1) & 0xffff;
+				lowerbits=xem->GetWireOutValue(addr) & 0xffff;
+				int channel = brd->firstChannel + i;
+				addMeasurement(measurements,channel,(upperbits  << 16) + lowerbits,&(tstamp->realtime));
+				stats->addReading(channel,tstamp->realtime.tv_sec,tstamp->realtime.tv_nsec);
+			}
+		}
+		bitmask=bitmask << 1;
+		addr += 2;
+	}
+}
+
+void OKCounterD::drainFIFO(CounterBoard *brd,unsigned int nRecords,unsigned int ppsSeq,unsigned int overflows,Timestamp *tstamp,
+	vector<int> &measurements)
 {
+	// Reads nRecords from the board's FIFO in one transfer. Each record is (16 bit words, LSB first):
+	//   word 0     : counter number (1 to 6)
+	//   word 1     : PPS sequence number when the record was stored
+	//   words 2,3  : counter reading LSB,MSB
+	// Records can have been waiting in the FIFO, so the timestamp is corrected using the difference between 
+	// the current PPS sequence number (ppsSeq) and the record's.
+	// tstamp is the time at which the FIFO status was read.
+	
+	unsigned char buf[FIFO_MAX_RECORDS*FIFO_RECORD_SIZE];
+	
+	if (overflows != brd->fifoOverflows){
+		syslog(LOG_WARNING,"FIFO overflow - %u records lost",(overflows - brd->fifoOverflows) & 0xffff);
+		stats->addOverflows((overflows - brd->fifoOverflows) & 0xffff);
+		brd->fifoOverflows = overflows;
+	}
+	
+	if (nRecords > FIFO_MAX_RECORDS) nRecords = FIFO_MAX_RECORDS;
+	long nbytes = nRecords*FIFO_RECORD_SIZE;
+	Timestamp t0,t1;
+	t0.now();
+	long nread = brd->xem->ReadFromPipeOut(epFIFO,nbytes,buf);
+	t1.now();
+	stats->addTransfer(t0,t1);
+	if (nread != nbytes){
+		DBGMSG(debugStream,"read failed " << nread);
+		return;
+	}
+	
+	DBGMSG(debugStream,nRecords << " records");
 	
-	// Open the first XEM - try all board types.
+	for (unsigned int i=0;i<nRecords;i++){
+		unsigned char *rec = buf + i*FIFO_RECORD_SIZE;
+		int channel = rec[0] + (rec[1] << 8);
+		if (channel < 1 || channel > NCHANNELS){
+			DBGMSG(debugStream,"bad record: channel " << channel);
+			continue;
+		}
+		channel += brd->firstChannel - 1;
+		if (!(channelMask & (0x01u << (channel-1))))
+			continue;
+		unsigned int seq = rec[2] + (rec[3] << 8);
+		unsigned int waited = (ppsSeq - seq) & 0xffff;
+		struct timespec rects = tstamp->realtime;
+		rects.tv_sec -= waited;
+		addMeasurement(measurements,channel,rec[4] + (rec[5] << 8) + (rec[6] << 16) + (rec[7] << 24),&rects);
+		stats->addReading(channel,rects.tv_sec,waited*1000000000LL + rects.tv_nsec);
+	}
+}
+
+// A reading, as stored in a measurement vector, for sorting
+struct MeasurementRecord
+{
+	int channel,tv_sec,tv_nsec,reading;
+};
+
+static bool measurementBefore(const MeasurementRecord &a,const MeasurementRecord &b)
+{
+	if (a.tv_sec != b.tv_sec) return a.tv_sec < b.tv_sec;
+	if (a.tv_nsec != b.tv_nsec) return a.tv_nsec < b.tv_nsec;
+	return a.channel < b.channel;
+}
+
+void OKCounterD::sendMeasurements(vector<int> &measurements)
+{
+	// Readings from different boards are merged, so that clients see them in time order
+	if (boards.size() > 1){
+		vector<MeasurementRecord> recs(measurements.size()/4);
+		for (unsigned int i=0;i<recs.size();i++){
+			recs[i].channel = measurements[4*i];
+			recs[i].tv_sec  = measurements[4*i+1];
+			recs[i].tv_nsec = measurements[4*i+2];
+			recs[i].reading = measurements[4*i+3];
+		}
+		std::stable_sort(recs.begin(),recs.end(),measurementBefore);
+		for (unsigned int i=0;i<recs.size();i++){
+			measurements[4*i]   = recs[i].channel;
+			measurements[4*i+1] = recs[i].tv_sec;
+			measurements[4*i+2] = recs[i].tv_nsec;
+			measurements[4*i+3] = recs[i].reading;
+		}
+	}
+	for (unsigned int i=0;i<measurements.size();i+=4)
+		ppsStats->addReading(measurements[i],measurements[i+1],measurements[i+3]);
+	server->sendData(measurements);
+	if (logger->isRunning())
+		logger->sendData(measurements);
+}
+
 #ifdef OKFRONTPANEL
-	xem = new okCFrontPanel;
-	if (okCFrontPanel::NoError != xem->OpenBySerial()) {
+
+void OKCounterD::runCommands(CounterBoard *brd)
+{
+	XEM *xem = brd->xem;
+	DeviceCommand *cmds = brd->commands->takeAll();
+	bool wireIns=false,wireOuts=false;
+	for (DeviceCommand *c=cmds;c;c=c->next){
+		if (c->type == DeviceCommand::WriteWireIn){
+			xem->SetWireInValue(c->epAddr,c->val,c->mask);
+			wireIns=true;
+		}
+		else
+			wireOuts=true;
+	}
+	if (wireIns) xem->UpdateWireIns();
+	if (wireOuts) xem->UpdateWireOuts();
+	completeCommands(brd,cmds);
+}
+
 #else
-	xem = new OpenOK;
-	if (OpenOK::NoError != xem->OpenBySerial()) {
+
+DeviceCommand *OKCounterD::takeCommands(CounterBoard *brd,XEMTransaction *t)
+{
+	// Adds the queued commands for a board to a transaction
+	DeviceCommand *cmds = brd->commands->takeAll();
+	for (DeviceCommand *c=cmds;c;c=c->next){
+		if (c->type == DeviceCommand::WriteWireIn)
+			t->SetWireInValue(c->epAddr,c->val,c->mask);
+		else
+			t->UpdateWireOuts();
+	}
+	return cmds;
+}
+
 #endif
+
+void OKCounterD::completeCommands(CounterBoard *brd,DeviceCommand *cmds)
+{
+	if (NULL == cmds)
+		return;
+	while (cmds){
+		DeviceCommand *next = cmds->next;
+		cmds->result.set_value(cmds->type == DeviceCommand::ReadWireOut ? (brd->xem->GetWireOutValue(cmds->epAddr) & 0xffff) : 0);
+		delete cmds;
+		cmds = next;
+	}
+	server->commandsCompleted(); // the server waits on its event loop, not on the results
+}
+
+void OKCounterD::addMeasurement(vector<int> &measurements,int channel,unsigned int counts,struct timespec *ts)
+{
+	int rdg = counts;
+	rdg= (int)rdg*5.0E-9*1.0E9/4.0;
+	if (rdg>500000000) rdg -= 1000000000;
+	measurements.push_back(channel);
+	measurements.push_back((int) ts->tv_sec);
+	measurements.push_back((int) ts->tv_nsec);
+	measurements.push_back(rdg);
+}
+
+bool OKCounterD::initializeFPGA(string bitfile)
+{
+	// Without -x, the first XEM found is used
+	if (boards.empty())
+		addBoard("");
+	for (unsigned int b=0;b<boards.size();b++){
+		if (!openBoard(boards.at(b),bitfile))
+			return false;
+	}
+	return true;
+}
+
+bool OKCounterD::openBoard(CounterBoard *brd,string bitfile)
+{
+	
+	// Open the XEM - try all board types.
+	XEM *xem = new XEM;
+	if (XEM::NoError != xem->OpenBySerial(brd->serial)) {
 		delete xem;
-		cerr << "Device could not be opened.  Is one connected?" << endl;
+		if (brd->serial.empty())
+			cerr << "Device could not be opened.  Is one connected?" << endl;
+		else
+			cerr << "Device " << brd->serial << " could not be opened.  Is it connected?" << endl;
 		return false;
 	}
 	
@@ -218,21 +697,28 @@ bool OKCounterD::initializeFPGA(string bitfile)
 	DBGMSG(debugStream, "Device firmware version: " << xem->GetDeviceMajorVersion() << "." << xem->GetDeviceMinorVersion());
 	DBGMSG(debugStream, "Device serial number:" << xem->GetSerialNumber());
 	DBGMSG(debugStream, "Device ID: " << xem->GetDeviceID());
+	DBGMSG(debugStream, "Channels " << brd->firstChannel << " to " << brd->firstChannel + NCHANNELS - 1);
 	
 	// Download the configuration file, if one has been specified on the command line
 	if (!bitfile.empty()){
 #ifdef OKFRONTPANEL
-		if (okCFrontPanel::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
+		if (XEM::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
 #else
-		if (OpenOK::NoError != xem->ConfigureFPGA(bitfile.c_str())) {
+		// the preprocessed bitstream is cached; configuration is only skipped if asked for
+		bool skipped=false;
+		if (XEM::NoError != xem->ConfigureFPGAFromCache(bitfile,BITFILE_CACHE,skipIfLoaded,&skipped)) {
 #endif
 			cerr << "FPGA configuration failed";
 			delete xem;
 			return false;
 		}
+#ifndef OKFRONTPANEL
+		DBGMSG(debugStream, "Bitfile " << bitfile << (skipped?" already loaded":" loaded"));
+#endif
 	}
 	// Check for FrontPanel support in the FPGA configuration.
 	DBGMSG(debugStream, "FrontPanel support is " << (xem->IsFrontPanelEnabled()?"":"not ") << "enabled");
 	
+	brd->xem = xem;
 	return true;
 }
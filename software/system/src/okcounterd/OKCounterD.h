@@ -26,22 +26,60 @@
 #ifndef __OK_COUNTERD_H_
 #define __OK_COUNTERD_H_
 
+#include <sys/time.h>
+
+#include <future>
 #include <string>
+#include <vector>
 
-#ifdef OKFRONTPANEL
+#include "CommandQueue.h"
+
+// okFrontPanel has no transactions, so the register reads and writes are done one at a time
+#if defined(OKFRONTPANEL)
 	#include <okFrontPanelDLL.h>
+	typedef okCFrontPanel XEM;
+#elif defined(SIMULATOR)
+	#include "SimulatedXEM.h"
+	typedef SimulatedXEM XEM;
+	typedef SimulatedXEM::Transaction XEMTransaction;
 #else
 	#include "OpenOK.h"
+	typedef OpenOK XEM;
+	typedef OpenOK_Transaction XEMTransaction;
 #endif 
 
 #define APP_NAME "okcounterd"
 #define AUTHOR "Michael Wouters, Louis Marais"
 #define OKCOUNTERD_VERSION "0.2.0"
 #define OKCOUNTERD_CONFIG "/usr/local/etc/okcounterd.conf"
+#define BITFILE_CACHE "/var/cache/openok"
+#define COMMAND_TIMEOUT 5 // seconds to wait for the acquisition thread to carry out a command
 
 using namespace std;
 
 class Server;
+class TICLogger;
+class AcquisitionStats;
+class PPSStats;
+class Timestamp;
+
+// A counter board. Its channels are presented to clients as firstChannel, firstChannel+1, ...
+class CounterBoard
+{
+	public:
+		CounterBoard(string,int);
+		~CounterBoard();
+		
+		string serial; // empty for the first board found
+		int firstChannel;
+		XEM *xem;
+		CommandQueue *commands; // device access from other threads
+		unsigned int firmwareVersion;
+		unsigned int fifoOverflows;
+#ifndef OKFRONTPANEL
+		XEMTransaction cycle; // the transaction done at each poll
+#endif
+};
 
 class OKCounterD
 {
@@ -51,6 +89,14 @@ class OKCounterD
 
 		bool debugOn(){return dbgOn;};
 		void setDebugOn(bool dbg){dbgOn=dbg;}
+		void setEventDriven(bool ed){eventDriven=ed;}
+		void setHistoryLength(int minutes){historyMinutes=minutes;}
+		void setSkipIfLoaded(bool skip){skipIfLoaded=skip;}
+		void setTraceUSB(bool);
+		bool addBoard(string);
+		int numBoards(){return boards.size();}
+		bool addLogChannel(string);
+		void setLogBinary(bool);
 		
 		bool initializeFPGA(string bitfile);
 		
@@ -60,25 +106,54 @@ class OKCounterD
 		
 		void log(string);
 		
-		void setOutputPPSSource(int);
-		void setGPIOEnable(bool);
-		string getConfiguration();
+		CommandResults setOutputPPSSource(int,int board=0);
+		CommandResults setGPIOEnable(bool,int board=0);
+		CommandResults queryConfiguration();
+		string getConfiguration(CommandResults &);
+		string getStats();
+		string getPPSStats();
+		string getUSBTrace();
 		
 private:
 	
 		void init();
-		bool dbgOn;
+		bool openBoard(CounterBoard *,string);
+		void setupBoard(CounterBoard *);
+		void poll();
+		void waitForEvents();
+		void readTriggers(CounterBoard *,Timestamp *,vector<int> &);
+		void drainFIFO(CounterBoard *,unsigned int,unsigned int,unsigned int,Timestamp *,vector<int> &);
+		void addMeasurement(vector<int> &,int,unsigned int,struct timespec *);
+		void sendMeasurements(vector<int> &);
+		
 #ifdef OKFRONTPANEL
-		okCFrontPanel *xem;
+		void runCommands(CounterBoard *);
 #else
-		OpenOK *xem;
+		DeviceCommand *takeCommands(CounterBoard *,XEMTransaction *);
 #endif
+		void completeCommands(CounterBoard *,DeviceCommand *);
+		
+		bool dbgOn;
+		bool eventDriven;
+		bool skipIfLoaded;
+		bool traceUSB;
+		vector<CounterBoard *> boards; // in the order of their channels
 		Server *server;
+		TICLogger *logger;
+		AcquisitionStats *stats;
+		PPSStats *ppsStats;
 		long port;
+		int historyMinutes;
 		
 		unsigned int channelMask;
 		unsigned int epSysControl;
 		unsigned int epSysStatus;
+		unsigned int epEvents;
+		unsigned int epFIFO;
+		unsigned int epFIFOCount;
+		unsigned int epFIFOOverflows;
+		unsigned int epPPSSequence;
+		unsigned int epFirmwareVersion;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <syslog.h>
+#include <math.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "PPSStats.h"
+
+#define MAX_PHASE_SUM 1000000000000000000LL // a sequence is restarted before the sums can overflow
+
+//
+// PPSStats::Channel
+//
+
+PPSStats::Channel::Channel()
+{
+	n=0;
+	mean=M2=0.0;
+	min=max=0;
+	nDiff=0;
+	diffMean=diffM2=0.0;
+	nOutliers=0;
+	afterOutlier=false;
+	lastOutlier=-1;
+	lastOutlierLogged=0;
+	lastSecond=-1;
+	lastReading=0;
+	unwrap=0;
+	x0=0;
+	P.resize(3*(1 << (PPS_OCTAVES-1)) + 1);
+	nP=0;
+	for (int i=0;i<PPS_OCTAVES;i++){
+		adevSum[i]=tdevSum[i]=0.0;
+		adevN[i]=tdevN[i]=0;
+	}
+}
+
+bool PPSStats::Channel::add(long long tv_sec,int reading)
+{
+	bool outlier=false;
+	bool contiguous = (n > 0) && (tv_sec - lastSecond <= 1);
+	
+	// Readings are in [-0.5 s,0.5 s) so the phase wraps when it drifts through the limits
+	long long change = 0;
+	if (n > 0){
+		change = (long long) reading - lastReading;
+		if (change > 500000000){
+			unwrap -= 1000000000;
+			change -= 1000000000;
+		}
+		else if (change < -500000000){
+			unwrap += 1000000000;
+			change += 1000000000;
+		}
+	}
+	
+	// Running mean and variance (Welford)
+	n++;
+	double delta = reading - mean;
+	mean += delta/n;
+	M2 += delta*(reading - mean);
+	if (n == 1 || reading < min) min=reading;
+	if (n == 1 || reading > max) max=reading;
+	
+	// Outliers are found from the change since the previous reading, so that a drifting reference doesn't produce them.
+	// Outliers are left out of the statistics on changes so that they don't mask later ones.
+	// The change back from an outlier is skipped, so that a single bad reading counts once
+	if (afterOutlier)
+		afterOutlier=false;
+	else if (contiguous){
+		double sd = (nDiff > 1) ? sqrt(diffM2/(nDiff-1)) : 0.0;
+		if (nDiff >= PPS_OUTLIER_MIN_N && fabs(change - diffMean) > PPS_OUTLIER_SIGMAS*std::max(sd,PPS_OUTLIER_MIN_SD)){
+			outlier=true;
+			afterOutlier=true;
+			nOutliers++;
+			lastOutlier=tv_sec;
+		}
+		else{
+			nDiff++;
+			double d = change - diffMean;
+			diffMean += d/nDiff;
+			diffM2 += d*(change - diffMean);
+		}
+	}
+	
+	lastSecond=tv_sec;
+	lastReading=reading;
+	
+	// Overlapping ADEV and TDEV from the phase sums.
+	// With t the index of the newest sum and x[k] = P[k+1] - P[k], for m = 2^i:
+	//   ADEV: x[t-1] - 2x[t-1-m] + x[t-1-2m], which needs t >= 2m+1
+	//   TDEV: the sum over m of the above, which is P[t] - 3P[t-m] + 3P[t-2m] - P[t-3m], needing t >= 3m
+	long long x = reading + unwrap;
+	if (!contiguous || llabs(sum(nP-1)) > MAX_PHASE_SUM)
+		nP=0;
+	if (nP == 0){
+		x0 = x;
+		P[0]=0;
+		nP=1;
+	}
+	P[nP % P.size()] = sum(nP-1) + (x - x0);
+	unsigned long t = nP;
+	nP++;
+	
+	for (int i=0;i<PPS_OCTAVES;i++){
+		unsigned long m = 1UL << i;
+		if (t < 2*m+1)
+			break;
+		double d2 = (double) ((sum(t) - sum(t-1)) - 2*(sum(t-m) - sum(t-1-m)) + (sum(t-2*m) - sum(t-1-2*m)));
+		adevSum[i] += d2*d2;
+		adevN[i]++;
+		if (t >= 3*m){
+			double s = (double) (sum(t) - 3*sum(t-m) + 3*sum(t-2*m) - sum(t-3*m));
+			tdevSum[i] += s*s;
+			tdevN[i]++;
+		}
+	}
+	
+	return outlier;
+}
+
+//
+// PPSStats
+//
+
+PPSStats::PPSStats()
+{
+	pthread_mutex_init(&mutex,0);
+	for (int i=0;i<=MAX_CHANNELS;i++)
+		channels[i]=NULL;
+}
+
+PPSStats::~PPSStats()
+{
+	for (int i=0;i<=MAX_CHANNELS;i++)
+		delete channels[i];
+	pthread_mutex_destroy(&mutex);
+}
+
+void PPSStats::addReading(int channel,long long tv_sec,int reading)
+{
+	if (channel < 1 || channel > MAX_CHANNELS)
+		return;
+	pthread_mutex_lock(&mutex);
+	if (NULL == channels[channel])
+		channels[channel] = new Channel();
+	Channel *ch = channels[channel];
+	if (ch->add(tv_sec,reading)){
+		// at most one message a minute per channel, so that a bad reference doesn't flood the log
+		time_t now = time(NULL);
+		if (now - ch->lastOutlierLogged >= 60){
+			syslog(LOG_WARNING,"channel %d: outlier reading %d ns (%lu so far)",channel,reading,ch->nOutliers);
+			ch->lastOutlierLogged = now;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+string PPSStats::toString()
+{
+	// eg
+	// channel 1: readings=86400 mean=12.345 sd=1.234 min=8 max=17 (ns) outliers=0
+	// channel 1 ADEV: 1:1.23e-09 2:6.2e-10 ...
+	// channel 1 TDEV (ns): 1:0.71 2:0.5 ...
+	pthread_mutex_lock(&mutex);
+	ostringstream ss;
+	for (int i=1;i<=MAX_CHANNELS;i++){
+		Channel *ch = channels[i];
+		if (NULL == ch)
+			continue;
+		ss.setf(ios::fixed);
+		ss.precision(3);
+		ss << "channel " << i << ": readings=" << ch->n << " mean=" << ch->mean << 
+			" sd=" << (ch->n > 1 ? sqrt(ch->M2/(ch->n-1)) : 0.0) << " min=" << ch->min << " max=" << ch->max << " (ns)" <<
+			" outliers=" << ch->nOutliers;
+		if (ch->lastOutlier >= 0)
+			ss << " (last at " << ch->lastOutlier << ")";
+		ss << endl;
+		ss.unsetf(ios::fixed);
+		ss.precision(3);
+		ss << "channel " << i << " ADEV:";
+		for (int j=0;j<PPS_OCTAVES && ch->adevN[j] > 0;j++){
+			double m = 1 << j;
+			ss << " " << (1 << j) << ":" << sqrt(ch->adevSum[j]/(2.0*m*m*ch->adevN[j]))*1.0E-9;
+		}
+		ss << endl;
+		ss << "channel " << i << " TDEV (ns):";
+		for (int j=0;j<PPS_OCTAVES && ch->tdevN[j] > 0;j++){
+			double m = 1 << j;
+			ss << " " << (1 << j) << ":" << sqrt(ch->tdevSum[j]/(6.0*m*m*ch->tdevN[j]));
+		}
+		ss << endl;
+	}
+	pthread_mutex_unlock(&mutex);
+	return ss.str();
+}
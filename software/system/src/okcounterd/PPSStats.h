@@ -0,0 +1,106 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __PPS_STATS_H_
+#define __PPS_STATS_H_
+
+#include <pthread.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "AcquisitionStats.h"
+
+using namespace std;
+
+#define PPS_OCTAVES 13        // taus of 1,2,4, ... 4096 s
+#define PPS_OUTLIER_SIGMAS 5
+#define PPS_OUTLIER_MIN_N 30   // changes needed before outliers are looked for
+#define PPS_OUTLIER_MIN_SD 2.0 // ns - lower limit on the standard deviation used, since readings are quantized
+
+// Running statistics on the readings on each channel, so that a misbehaving reference can be spotted as it happens.
+// Updated by the acquisition thread and read by the server thread, so access is locked.
+//
+// For each channel:
+//   the mean, standard deviation, minimum and maximum of the readings
+//   outliers, which are readings whose change from the previous reading is more than PPS_OUTLIER_SIGMAS 
+//   standard deviations from the mean change
+//   the overlapping Allan deviation and time deviation, at taus of 1,2,4, ... s
+// Readings are assumed to be 1 s apart and the phase is unwrapped across the +/- 0.5 s limits of a reading.
+// A missing second restarts the sequence used for ADEV and TDEV, but the sums so far are kept.
+// The memory used is fixed: the last 3*2^(PPS_OCTAVES-1) phase sums for each channel with readings.
+
+class PPSStats
+{
+	public:
+		
+		PPSStats();
+		~PPSStats();
+		
+		void addReading(int channel,long long tv_sec,int reading);
+		string toString();
+		
+	private:
+		
+		class Channel
+		{
+			public:
+				Channel();
+				bool add(long long tv_sec,int reading); // true if the reading is an outlier
+				
+				// readings
+				unsigned long n;
+				double mean,M2;
+				int min,max;
+				
+				// changes between successive readings, for outlier detection
+				unsigned long nDiff;
+				double diffMean,diffM2;
+				unsigned long nOutliers;
+				bool afterOutlier;
+				long long lastOutlier;
+				time_t lastOutlierLogged;
+				
+				long long lastSecond;
+				int lastReading;
+				long long unwrap;  // added to readings to unwrap the phase, ns
+				long long x0;      // first unwrapped reading of the current sequence, subtracted to keep the sums small
+				
+				// phase sums P[k] = x[0] + ... + x[k-1] for the current sequence, in a ring buffer
+				vector<long long> P;
+				unsigned long nP;  // number of sums in the current sequence
+				
+				double adevSum[PPS_OCTAVES],tdevSum[PPS_OCTAVES];
+				unsigned long adevN[PPS_OCTAVES],tdevN[PPS_OCTAVES];
+				
+			private:
+				long long sum(unsigned long k){return P[k % P.size()];}
+		};
+		
+		pthread_mutex_t mutex;
+		Channel *channels[MAX_CHANNELS+1]; // allocated when a channel has its first reading
+};
+
+#endif
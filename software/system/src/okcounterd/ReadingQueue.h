@@ -0,0 +1,95 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __READING_QUEUE_H_
+#define __READING_QUEUE_H_
+
+// A single producer, single consumer queue of counter readings.
+// The acquisition thread pushes and the server thread pops, without locking,
+// so that acquisition never waits on the server. If the queue is full, the reading
+// is dropped and counted.
+
+class Reading
+{
+	public:
+		unsigned int seq; // counts readings, so that clients can detect dropped readings
+		int channel;
+		long long tv_sec;
+		int tv_nsec;
+		int rdg;          // ns
+};
+
+class ReadingQueue
+{
+	public:
+		
+		ReadingQueue(unsigned int sizeLog2=12)
+		{
+			size = 1 << sizeLog2;
+			mask = size - 1;
+			buf = new Reading[size];
+			head=tail=0;
+			nDropped=0;
+		}
+		
+		~ReadingQueue()
+		{
+			delete[] buf;
+		}
+		
+		// producer only
+		bool push(const Reading &r)
+		{
+			unsigned int t = tail; // only the producer writes tail
+			if (t - __atomic_load_n(&head,__ATOMIC_ACQUIRE) == size){
+				__atomic_add_fetch(&nDropped,1,__ATOMIC_RELAXED);
+				return false;
+			}
+			buf[t & mask] = r;
+			__atomic_store_n(&tail,t+1,__ATOMIC_RELEASE);
+			return true;
+		}
+		
+		// consumer only
+		bool pop(Reading *r)
+		{
+			unsigned int h = head; // only the consumer writes head
+			if (h == __atomic_load_n(&tail,__ATOMIC_ACQUIRE))
+				return false;
+			*r = buf[h & mask];
+			__atomic_store_n(&head,h+1,__ATOMIC_RELEASE);
+			return true;
+		}
+		
+		unsigned long dropped(){return __atomic_load_n(&nDropped,__ATOMIC_RELAXED);}
+		
+	private:
+		
+		Reading *buf;
+		unsigned int size,mask;
+		unsigned int head,tail;
+		unsigned long nDropped;
+};
+
+#endif
@@ -24,17 +24,22 @@
 
 #include <sys/types.h>         
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <string.h>
 #include <strings.h>
-#include <sys/select.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 #include <unistd.h>
 #include <cstdio>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -43,8 +48,10 @@
 #include "OKCounterD.h"
 #include "Server.h"
 
-#define BUFSIZE 8096
 #define MAXCLIENTS 16
+#define MAXEVENTS 32
+#define CLOSE_TIMEOUT 5 // seconds to wait for the remote end to close after a reply
+#define REPLAY_CHUNK 256  // maximum number of readings replayed at a time
 
 extern ostream* debugStream;
 
@@ -52,27 +59,50 @@ extern ostream* debugStream;
 // Public
 //
 
-Server::Server(OKCounterD *a,int p)
+Server::Server(OKCounterD *a,int p,int historyMinutes)
 {
 	threadID = "server";
 	app = a;
 	port=p; 
+	historyLength = (historyMinutes > 0 ? historyMinutes*60 : 0);
+	historyMaxSize = historyLength * MAX_CHANNELS; // memory limit - 1 reading per second per channel
+	nListeners=0;
+	queueDropsReported=0;
+	nextSeq=0;
 	if (!init())
 		exit(EXIT_FAILURE);
 }
 
 Server::~Server()
 {
+	std::map<int,Client *>::iterator it;
+	for (it=clients.begin();it!=clients.end();it++)
+		delete it->second;
+	close(epollfd);
+	close(wakefd);
 	close(listenfd);
-	for (unsigned int i=0;i<clients.size();i++)
-		clients.at(i)->stop();
 }
 
-
-void Server::sendData(vector<int> &data){
-	for (unsigned int i=0;i<clients.size();i++){
-		clients.at(i)->sendData(data);
+void Server::sendData(vector<int> &data)
+{
+	// Called from the acquisition thread so this must not block
+	for (unsigned int i=0;i<data.size();i+=4){
+		Reading r;
+		r.seq     = nextSeq++;
+		r.channel = data.at(i);
+		r.tv_sec  = data.at(i+1);
+		r.tv_nsec = data.at(i+2);
+		r.rdg     = data.at(i+3);
+		readings.push(r);
 	}
+	wake();
+}
+
+void Server::stop()
+{
+	stopRequested=true;
+	wake();
+	Thread::stop();
 }
 
 //
@@ -91,48 +121,93 @@ void Server::doWork()
 	sigaddset(&blocked,SIGPIPE);
 	pthread_sigmask(SIG_BLOCK,&blocked,NULL);
 	
-	int socketfd;
-	socklen_t len;
-	struct sockaddr_in cli_addr; 
-	bzero(&cli_addr,sizeof(cli_addr));
-
-	fd_set rfds;
-  struct timeval tv;
-  int retval;
+	struct epoll_event events[MAXEVENTS];
 	
 	while (!stopRequested) 
 	{
-	
-		tv.tv_sec=5;
-		tv.tv_usec=0;
+		// wake up more often while there are requests which may time out
+		int nfds = epoll_wait(epollfd,events,MAXEVENTS,pending.empty() ? 5000 : 1000);
+		if (nfds < 0){
+			if (errno != EINTR)
+				app->log("ERROR in epoll_wait()");
+			continue;
+		}
 		
-		FD_ZERO(&rfds);
-		FD_SET(listenfd, &rfds);
-
-		retval = select(listenfd+1, &rfds, NULL,NULL, &tv); // note number of file descriptors!
-	
-		if (retval) {
-			len= sizeof(cli_addr);
-			if((socketfd = accept(listenfd, (struct sockaddr *)&cli_addr, &len)) < 0)
-				app->log("ERROR in accept()");
-			else{
-				processRequest(socketfd);
+		for (int i=0;i<nfds;i++){
+			int fd = events[i].data.fd;
+			if (fd == listenfd){
+				acceptConnections();
+				continue;
+			}
+			if (fd == wakefd){
+				uint64_t n;
+				read(wakefd,&n,sizeof(n));
+				distributeReadings();
+				completeRequests();
+				continue;
+			}
+			
+			std::map<int,Client *>::iterator it = clients.find(fd);
+			if (it == clients.end()) // already closed
+				continue;
+			Client *c = it->second;
+			
+			if (events[i].events & EPOLLIN){
+				string msg;
+				bool open = c->readInput(msg);
+				if (!msg.empty()){
+					if (c->state == Client::Connected)
+						processRequest(c,msg);
+					else if (c->state == Client::Listening)
+						c->configure(msg);
+				}
+				if (!open){
+					if (clients.count(fd)) closeClient(c);
+					continue;
+				}
+				if (!clients.count(fd)) // closed by processRequest()
+					continue;
+			}
+			else if (events[i].events & (EPOLLERR | EPOLLHUP)){
+				closeClient(c);
+				continue;
+			}
+			
+			if (events[i].events & EPOLLOUT){
+				if (!c->flush()){
+					closeClient(c);
+					continue;
+				}
+				if (c->replaying && !replay(c)){
+					closeClient(c);
+					continue;
+				}
+				if (c->state == Client::Closing && !c->hasOutput())
+					shutdown(fd,SHUT_WR);
+				updateEvents(c);
 			}
 		}
 		
-		unsigned int j=0;
-		while (j<clients.size()){
-			Client *c = clients.at(j);
-			if (!c->isRunning()){
-				DBGMSG(debugStream,"stopping client");
-				c->stop();
-				clients.erase(clients.begin()+j);
-				delete c;
-			}
-			else
-				j++;
+		if (!pending.empty()) // catch any which have timed out
+			completeRequests();
+		
+		// Give up on replies that the remote end hasn't closed
+		time_t now = time(NULL);
+		vector<Client *> stale;
+		std::map<int,Client *>::iterator it;
+		for (it=clients.begin();it!=clients.end();it++){
+			if (it->second->state == Client::Closing && now - it->second->closingSince > CLOSE_TIMEOUT)
+				stale.push_back(it->second);
 		}
+		for (unsigned int i=0;i<stale.size();i++)
+			closeClient(stale.at(i));
 		
+		if (readings.dropped() != queueDropsReported){
+			ostringstream ss;
+			ss << "server too slow - " << readings.dropped() - queueDropsReported << " readings dropped";
+			app->log(ss.str());
+			queueDropsReported = readings.dropped();
+		}
 	}
 	
 	running=false;
@@ -188,6 +263,31 @@ bool Server::init()
 		return false;
 	}
 	
+	if ((epollfd = epoll_create(MAXEVENTS)) < 0){
+		app->log("ERROR in epoll_create()");
+		return false;
+	}
+	
+	if ((wakefd = eventfd(0,0)) < 0){
+		app->log("ERROR in eventfd()");
+		return false;
+	}
+	fcntl(wakefd, F_SETFL, O_NONBLOCK);
+	
+	struct epoll_event ev;
+	bzero(&ev,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = listenfd;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,listenfd,&ev) < 0){
+		app->log("ERROR in epoll_ctl()");
+		return false;
+	}
+	ev.data.fd = wakefd;
+	if (epoll_ctl(epollfd,EPOLL_CTL_ADD,wakefd,&ev) < 0){
+		app->log("ERROR in epoll_ctl()");
+		return false;
+	}
+	
 	ostringstream ss;
 	ss << "listening on port " << port;
 	app->log(ss.str());
@@ -196,108 +296,346 @@ bool Server::init()
 	
 }
 
-bool Server::processRequest(int socketfd)
+void Server::acceptConnections()
 {
-	// Two requests:
-	// LISTEN to counter readings
-	// CONFIGURE the counter
-	// QUERY the counter configuration
-	
-	long ret;
-	static char buffer[BUFSIZE+1]; 
-
-	ret =read(socketfd,buffer,BUFSIZE); 	// read request in one go 
-	if(ret == 0 || ret == -1) {	// read failure
-		//app->log("failed to read client request");
-		return false;
-	}
-	if(ret > 0 && ret < BUFSIZE)	// return code is valid chars 
-		buffer[ret]=0;		// terminate the buffer 
-	else buffer[0]=0;
+	int socketfd;
+	socklen_t len;
+	struct sockaddr_in cli_addr; 
 	
-	if (NULL != strstr(buffer,"CONFIGURE") ){
-		DBGMSG(debugStream,"received " << buffer);
-		if (NULL != strstr(buffer,"PPSSOURCE")){
-			int src;
-			sscanf(buffer,"%*s%*s%i",&src);
-			app->setOutputPPSSource(src);
-		}
-		else if (NULL != strstr(buffer,"GPIO")){
-			int en;
-			sscanf(buffer,"%*s%*s%i",&en);
-			app->setGPIOEnable((en==1));
-		}
-		else{
-			DBGMSG(debugStream,"unknown command");
+	for (;;){
+		len= sizeof(cli_addr);
+		if ((socketfd = accept(listenfd, (struct sockaddr *)&cli_addr, &len)) < 0){
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				app->log("ERROR in accept()");
+			return;
 		}
+		fcntl(socketfd, F_SETFL, O_NONBLOCK);
 		
-		// done so close the connection
-		if (-1==shutdown(socketfd,SHUT_RDWR)){
-			app->log("ERROR in shutdown()");
+		Client *c = new Client(socketfd);
+		struct epoll_event ev;
+		bzero(&ev,sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = socketfd;
+		if (epoll_ctl(epollfd,EPOLL_CTL_ADD,socketfd,&ev) < 0){
+			app->log("ERROR in epoll_ctl()");
+			delete c;
+			continue;
 		}
-		if (-1==close(socketfd)){
-			app->log("ERROR in close()");
+		clients[socketfd]=c;
+		DBGMSG(debugStream,"accepted fd " << socketfd);
+	}
+}
+
+void Server::processRequest(Client *c,string &request)
+{
+	// Three requests:
+	// LISTEN [BINARY] [mask=N] [decimate=M] [from=T | since=S] to counter readings
+	// CONFIGURE [board=B] the counter (all boards, if there are several and none is given)
+	// QUERY the counter configuration, acquisition statistics, PPS statistics or USB transfer statistics
+	
+	const char *buffer = request.c_str();
+	DBGMSG(debugStream,"received " << buffer);
+	
+	if (NULL != strstr(buffer,"CONFIGURE") ){
+		string err;
+		int board=0,setting=-1;
+		string cmd;
+		if (!parseConfigure(request,&cmd,&setting,&board,err)){
+			DBGMSG(debugStream,"bad CONFIGURE: " << err);
+			reply(c,"ERROR " + err);
 		}
+		else if (cmd == "PPSSOURCE")
+			waitForDevice(c,PendingRequest::Configure,app->setOutputPPSSource(setting,board));
+		else
+			waitForDevice(c,PendingRequest::Configure,app->setGPIOEnable((setting==1),board));
 	}
 	else if (NULL != strstr(buffer,"QUERY CONFIGURATION") ){
-		DBGMSG(debugStream,"received " << buffer);
-		string cfg = app->getConfiguration();
-		writeBuffer(cfg,socketfd);
-		sleep(1); // wait a bit
-		// done so close the connection
-		if (-1==shutdown(socketfd,SHUT_RDWR)){
-			app->log("ERROR in shutdown()");
-		}
-		if (-1==close(socketfd)){
-			app->log("ERROR in close()");
-		}
+		waitForDevice(c,PendingRequest::QueryConfiguration,app->queryConfiguration());
+	}
+	else if (NULL != strstr(buffer,"QUERY STATS") ){
+		reply(c,app->getStats());
+	}
+	else if (NULL != strstr(buffer,"QUERY PPS") ){
+		reply(c,app->getPPSStats());
+	}
+	else if (NULL != strstr(buffer,"QUERY USB") ){
+		reply(c,app->getUSBTrace());
 	}
 	else if(NULL != strstr(buffer,"LISTEN") ){ 
-		DBGMSG(debugStream,"received " << buffer);
 		// Sanity check on number of clients
-		if (clients.size() == MAXCLIENTS){
+		if (nListeners == MAXCLIENTS){
 			app->log("Too many connections");
-			if (-1==shutdown(socketfd,SHUT_RDWR)){
-				app->log("ERROR in shutdown()");
+			closeClient(c);
+		}
+		else{	
+			// LISTEN BINARY selects binary framing
+			c->setBinary(NULL != strstr(buffer,"BINARY"));
+			c->configure(request);
+			c->state = Client::Listening;
+			nListeners++;
+			startReplay(c,request);
+		}
+	}
+	else{
+		DBGMSG(debugStream,"unknown request");
+		closeClient(c);
+	}
+}
+
+static bool parseInt(const string &s,int *val)
+{
+	// The whole string must be a number. Hexadecimal is accepted.
+	if (s.empty()) return false;
+	char *end;
+	errno=0;
+	long v = strtol(s.c_str(),&end,0);
+	if (*end != '\0' || errno != 0 || v < INT_MIN || v > INT_MAX) return false;
+	*val = v;
+	return true;
+}
+
+bool Server::parseConfigure(const string &request,string *cmd,int *setting,int *board,string &err)
+{
+	// CONFIGURE PPSSOURCE n | GPIO 0|1 [board=B], with the tokens after CONFIGURE in any order
+	// The setting must immediately follow its keyword
+	istringstream ss(request);
+	string tok;
+	*board=0;
+	cmd->clear();
+	ss >> tok; // CONFIGURE
+	while (ss >> tok){
+		if (0 == tok.compare(0,6,"board=")){
+			if (!parseInt(tok.substr(6),board) || *board < 1 || *board > app->numBoards()){
+				err = "invalid board " + tok.substr(6);
+				return false;
 			}
-			if (-1==close(socketfd)){
-				app->log("ERROR in close()");
+		}
+		else if (tok == "PPSSOURCE" || tok == "GPIO"){
+			if (!cmd->empty()){
+				err = "only one setting can be configured at a time";
+				return false;
+			}
+			*cmd = tok;
+			if (!(ss >> tok) || !parseInt(tok,setting)){
+				err = "missing or invalid value for " + *cmd;
+				return false;
 			}
 		}
-		else{	
-			Client *client = new Client(this,socketfd);
-			clients.push_back(client);
-			client->go();
+		else{
+			err = "unexpected " + tok;
+			return false;
 		}
 	}
+	if (cmd->empty()){
+		err = "nothing to configure";
+		return false;
+	}
+	if (*cmd == "PPSSOURCE" && (*setting < 0 || *setting > 7)){ // 3 bits
+		err = "PPSSOURCE must be 0 to 7";
+		return false;
+	}
+	if (*cmd == "GPIO" && *setting != 0 && *setting != 1){
+		err = "GPIO must be 0 or 1";
+		return false;
+	}
 	return true;
 }
 
-void Server::writeBuffer(string msg,int socketfd){
+void Server::reply(Client *c,const string &msg)
+{
+	c->queueMessage(msg);
+	// close once the reply has been sent and the remote end has closed
+	c->state = Client::Closing;
+	c->closingSince = time(NULL);
+	if (!c->flush()){
+		closeClient(c);
+		return;
+	}
+	if (!c->hasOutput())
+		shutdown(c->fd(),SHUT_WR);
+	updateEvents(c);
+}
+
+void Server::waitForDevice(Client *c,PendingRequest::Type type,CommandResults results)
+{
+	// The reply is made by completeRequests() once the acquisition thread has carried out the commands
+	c->state = Client::Waiting; // further input is ignored
+	pending.push_back(new PendingRequest(c,type,results));
+	completeRequests(); // in case there was nothing to do
+}
+
+void Server::completeRequests()
+{
+	// Replies to requests whose commands have been carried out or have timed out
+	time_t now = time(NULL);
+	std::list<PendingRequest *>::iterator it = pending.begin();
+	while (it != pending.end()){
+		PendingRequest *p = *it;
+		bool done = true;
+		for (unsigned int i=0;i<p->results.size();i++){
+			if (p->results.at(i).wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+				done=false;
+				break;
+			}
+		}
+		if (!done){
+			if (now - p->since <= COMMAND_TIMEOUT){
+				it++;
+				continue;
+			}
+			app->log("timed out waiting for the device");
+		}
+		it = pending.erase(it);
+		if (p->type == PendingRequest::QueryConfiguration)
+			reply(p->client,app->getConfiguration(p->results));
+		else // done so close the connection
+			closeClient(p->client);
+		delete p;
+	}
+}
+
+void Server::distributeReadings()
+{
+	// Everything waiting is sent as one batch
+	vector<Reading> batch;
+	Reading r;
+	while (readings.pop(&r))
+		batch.push_back(r);
+	if (batch.empty())
+		return;
 	
-	int nw,nEINTR=0;
-	int nleft = msg.size();
-	const char* pbuf=msg.c_str();
+	if (historyLength > 0){
+		history.insert(history.end(),batch.begin(),batch.end());
+		while (!history.empty() && (history.size() > historyMaxSize || 
+			history.front().tv_sec < history.back().tv_sec - historyLength))
+			history.pop_front();
+	}
 	
-	while (nleft > 0){
-		if (( nw = write(socketfd,pbuf,nleft)) <= 0){
-			if (errno==EINTR){ // interrupted by signal
-				nw=0;
-				nEINTR++;
-				if (10==nEINTR){
-					DBGMSG(debugStream, "too many interrrupts - write() aborted");
-					return;
-				}
-			}
-			else{
-				DBGMSG(debugStream, strerror(errno));
-				return;
+	vector<Client *> failed;
+	std::map<int,Client *>::iterator it;
+	for (it=clients.begin();it!=clients.end();it++){
+		Client *c = it->second;
+		if (c->state == Client::Listening){
+			if (c->replaying){ // this batch will be picked up from the history
+				if (!replay(c))
+					failed.push_back(c);
+				continue;
 			}
+			c->queueReadings(batch);
+			if (!c->flush())
+				failed.push_back(c);
+			else
+				updateEvents(c);
 		}
-		DBGMSG(debugStream, "wrote " << nw);
-		nleft -=nw;
-		pbuf += nw;
-	}	
+	}
+	for (unsigned int i=0;i<failed.size();i++)
+		closeClient(failed.at(i));
 }
 
+// The history is in sequence number order, so it can be searched by sequence number.
+// It is not in time order, since readings drained from the FIFO are back-dated.
+static bool seqBefore(const Reading &r,unsigned int seq){return r.seq < seq;}
+
+void Server::startReplay(Client *c,const string &request)
+{
+	// Replay is requested by from=T (Unix time) or since=S (sequence number)
+	const char *pfrom = strstr(request.c_str(),"from=");
+	const char *psince = strstr(request.c_str(),"since=");
+	if ((NULL == pfrom && NULL == psince) || history.empty())
+		return;
+	
+	std::deque<Reading>::iterator it;
+	if (NULL != psince)
+		it = std::lower_bound(history.begin(),history.end(),(unsigned int) strtoul(psince+6,NULL,0),seqBefore);
+	else{ // the first reading at or after T
+		long long from = atoll(pfrom+5);
+		for (it=history.begin();it!=history.end();it++)
+			if (it->tv_sec >= from) break;
+	}
+	if (it == history.end())
+		return;
 	
+	DBGMSG(debugStream,"fd " << c->fd() << " replaying from sequence number " << it->seq);
+	c->replaying = true;
+	c->replaySeq = it->seq;
+	if (!replay(c))
+		closeClient(c);
+}
+
+bool Server::replay(Client *c)
+{
+	// Queues as much of the history as fits in the client's buffer, starting from replaySeq
+	// When the client has caught up, it switches to live data
+	// Returns false if the client has failed
+	while (c->replaying){
+		std::deque<Reading>::iterator it = std::lower_bound(history.begin(),history.end(),c->replaySeq,seqBefore);
+		if (it == history.end()){
+			DBGMSG(debugStream,"fd " << c->fd() << " replay done");
+			c->replaying=false;
+			break;
+		}
+		unsigned int n = c->space()/MAX_READING_SIZE;
+		if (n == 0) // wait for EPOLLOUT
+			break;
+		if (n > REPLAY_CHUNK) n = REPLAY_CHUNK;
+		if (n > (unsigned int) (history.end() - it)) n = history.end() - it;
+		vector<Reading> batch(it,it+n);
+		c->queueReadings(batch);
+		c->replaySeq = batch.back().seq + 1;
+		if (!c->flush())
+			return false;
+	}
+	updateEvents(c);
+	return true;
+}
+
+void Server::updateEvents(Client *c)
+{
+	// Only ask for EPOLLOUT while there is something waiting to be sent
+	bool want = c->hasOutput();
+	if (want == c->wantWrite) 
+		return;
+	struct epoll_event ev;
+	bzero(&ev,sizeof(ev));
+	ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+	ev.data.fd = c->fd();
+	if (epoll_ctl(epollfd,EPOLL_CTL_MOD,c->fd(),&ev) < 0)
+		app->log("ERROR in epoll_ctl()");
+	c->wantWrite = want;
+}
+
+void Server::closeClient(Client *c)
+{
+	int fd = c->fd();
+	DBGMSG(debugStream,"closing fd " << fd);
+	epoll_ctl(epollfd,EPOLL_CTL_DEL,fd,NULL);
+	if (c->state == Client::Listening){
+		nListeners--;
+		DBGMSG(debugStream,"fd " << fd << " sent " << c->nSent << " dropped " << c->nDropped);
+		if (c->nDropped > 0){
+			ostringstream ss;
+			ss << "client too slow - " << c->nDropped << " readings dropped";
+			app->log(ss.str());
+		}
+	}
+	// a request may still be waiting on the device
+	std::list<PendingRequest *>::iterator it = pending.begin();
+	while (it != pending.end()){
+		if ((*it)->client == c){
+			delete *it;
+			it = pending.erase(it);
+		}
+		else
+			it++;
+	}
+	shutdown(fd,SHUT_RDWR);
+	clients.erase(fd);
+	delete c; // closes the socket
+}
+
+void Server::wake()
+{
+	uint64_t one=1;
+	write(wakefd,&one,sizeof(one)); // if the counter is saturated, the server is awake anyway
+}
+
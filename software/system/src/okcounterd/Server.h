@@ -25,20 +25,52 @@
 #ifndef __SERVER_H_
 #define __SERVER_H_
 
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
 #include <vector>
 
+#include "CommandQueue.h"
 #include "Thread.h"
+#include "ReadingQueue.h"
 
 class OKCounterD;
 class Client;
 
+// The Server runs a single epoll event loop which handles new connections, requests 
+// and sending readings to listening clients.
+// It keeps a history of the last few minutes of readings so that a client which has been restarted
+// can ask for what it missed to be replayed.
+// The acquisition thread hands readings over via sendData(), which only pushes onto a 
+// lock-free queue and signals an eventfd, so acquisition never blocks on socket I/O.
+// Requests which need the device are queued for the acquisition thread; it signals the same
+// eventfd when they have been carried out and the reply is then sent, so the event loop never
+// waits on the device either.
+
+// A request waiting for the acquisition thread
+class PendingRequest
+{
+	public:
+		enum Type {Configure,QueryConfiguration};
+		
+		PendingRequest(Client *cl,Type t,CommandResults &r):client(cl),type(t),results(std::move(r)),since(time(NULL)){}
+		
+		Client *client;
+		Type type;
+		CommandResults results;
+		time_t since;
+};
+
 class Server:public Thread
 {
 	public:
 
-		Server(OKCounterD *,int);
+		Server(OKCounterD *,int,int historyMinutes=10);
 		virtual ~Server();
 		void sendData(vector<int> &);
+		void commandsCompleted(){wake();} // called from the acquisition thread
+		virtual void stop();
 		
 	protected:
 		
@@ -47,12 +79,33 @@ class Server:public Thread
 	private:
 
 		bool init();
-		bool processRequest(int);
-		void writeBuffer(string,int);
+		void acceptConnections();
+		void processRequest(Client *,string &);
+		bool parseConfigure(const string &,string *,int *,int *,string &);
+		void reply(Client *,const string &);
+		void distributeReadings();
+		void waitForDevice(Client *,PendingRequest::Type,CommandResults);
+		void completeRequests();
+		void startReplay(Client *,const string &);
+		bool replay(Client *);
+		void updateEvents(Client *);
+		void closeClient(Client *);
+		void wake();
 		
 		OKCounterD *app;
 		long port,listenfd;
-		std::vector<Client *> clients;	
+		int epollfd,wakefd;
+		
+		ReadingQueue readings;
+		std::deque<Reading> history;
+		unsigned int historyLength; // seconds
+		unsigned int historyMaxSize;
+		std::map<int,Client *> clients;	
+		std::list<PendingRequest *> pending;
+		int nListeners;
+		
+		unsigned long queueDropsReported;
+		unsigned int nextSeq;
 };
 
 #endif
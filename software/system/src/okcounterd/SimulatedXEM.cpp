@@ -0,0 +1,289 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SimulatedXEM.h"
+
+#define TRIGGER_OUT 0x60
+#define EVENT_PIPE  0xa0
+#define FIFO_PIPE   0xa1
+#define BLOCK_TIMEOUT 2000000000LL // ns, for the event pipe
+
+//
+// Public
+//
+
+SimulatedXEM::SimulatedXEM()
+{
+	nChannels=6;
+	rate=1.0;
+	firmwareVersion=1;
+	latency=125;
+	fifoDepth=1024;
+	configure(getenv("OKCOUNTERD_SIMULATOR"));
+	
+	lastTick=-1;
+	ppsSeq=0;
+	memset(wireIns,0,sizeof(wireIns));
+	memset(pendingWireIns,0,sizeof(pendingWireIns));
+	memset(wireOuts,0,sizeof(wireOuts));
+	memset(counters,0,sizeof(counters));
+	triggers=pendingTriggers=0;
+	overflows=0;
+}
+
+SimulatedXEM::ErrorCode SimulatedXEM::OpenBySerial(std::string str)
+{
+	serial=str; // any serial number opens a simulated device
+	lastTick=-1; // start triggering from now
+	return NoError;
+}
+
+std::string SimulatedXEM::GetBoardModelString(BoardModel m)
+{
+	return (m == brdSimulated ? "simulated XEM" : "unknown");
+}
+
+SimulatedXEM::ErrorCode SimulatedXEM::SetWireInValue(int epAddr,unsigned long val,unsigned long mask)
+{
+	if (epAddr < 0 || epAddr >= 0x20)
+		return InvalidEndpoint;
+	pendingWireIns[epAddr] = (pendingWireIns[epAddr] & ~mask) | (val & mask);
+	return NoError;
+}
+
+void SimulatedXEM::UpdateWireIns()
+{
+	transfer();
+	memcpy(wireIns,pendingWireIns,sizeof(wireIns));
+}
+
+void SimulatedXEM::UpdateWireOuts()
+{
+	transfer();
+	latchWireOuts();
+}
+
+void SimulatedXEM::latchWireOuts()
+{
+	// see TTSCounterPPSCR.vhd for the wire out layout
+	for (int i=0;i<6;i++){
+		wireOuts[2*i]   = counters[i] & 0xffff;
+		wireOuts[2*i+1] = counters[i] >> 16;
+	}
+	wireOuts[0x0c] = (wireIns[0] & 0x0f) | 0x10; // system status: DCM always locked
+	if (firmwareVersion >= 1){
+		wireOuts[0x0d] = (fifo.size() > 0xffff ? 0xffff : fifo.size());
+		wireOuts[0x0e] = overflows & 0xffff;
+		wireOuts[0x0f] = ppsSeq;
+	}
+	wireOuts[0x1f] = firmwareVersion;
+}
+
+int SimulatedXEM::GetWireOutValue(int epAddr)
+{
+	if (epAddr < 0x20 || epAddr >= 0x40)
+		return 0;
+	return wireOuts[epAddr - 0x20];
+}
+
+void SimulatedXEM::UpdateTriggerOuts()
+{
+	transfer();
+	latchTriggerOuts();
+}
+
+void SimulatedXEM::latchTriggerOuts()
+{
+	triggers = pendingTriggers;
+	pendingTriggers=0;
+}
+
+bool SimulatedXEM::IsTriggered(int epAddr,unsigned long mask)
+{
+	return (epAddr == TRIGGER_OUT) && (triggers & mask);
+}
+
+long SimulatedXEM::ReadFromPipeOut(int epAddr,long length,unsigned char *data)
+{
+	if (epAddr != FIFO_PIPE || firmwareVersion < 1)
+		return InvalidEndpoint;
+	transfer();
+	// Each record is 4 16 bit words, LSB first: channel, PPS sequence number, reading LSB, MSB
+	// Reading an empty FIFO gives zeroes, as for the firmware
+	memset(data,0,length);
+	for (long i=0;i+8<=length && !fifo.empty();i+=8){
+		Record &r = fifo.front();
+		unsigned char *p = data+i;
+		p[0] = r.channel & 0xff;      p[1] = r.channel >> 8;
+		p[2] = r.ppsSeq & 0xff;       p[3] = (r.ppsSeq >> 8) & 0xff;
+		p[4] = r.counts & 0xff;       p[5] = (r.counts >> 8) & 0xff;
+		p[6] = (r.counts >> 16) & 0xff; p[7] = (r.counts >> 24) & 0xff;
+		fifo.pop_front();
+	}
+	return length;
+}
+
+long SimulatedXEM::ReadFromBlockPipeOut(int epAddr,int blockSize,long length,unsigned char *data)
+{
+	if (epAddr != EVENT_PIPE || firmwareVersion < 1)
+		return InvalidEndpoint;
+	
+	// Block until there is something in the FIFO
+	long long t0 = now();
+	transfer();
+	while (fifo.empty()){
+		long long t = now();
+		if (t - t0 > BLOCK_TIMEOUT)
+			return Timeout;
+		// sleep until the next trigger
+		long long tnext = (long long) ((lastTick + 1)/rate*1.0E9) + 1;
+		if (tnext < t) tnext = t;
+		struct timespec ts;
+		ts.tv_sec  = tnext/1000000000LL;
+		ts.tv_nsec = tnext%1000000000LL;
+		clock_nanosleep(CLOCK_REALTIME,TIMER_ABSTIME,&ts,NULL);
+		generate();
+	}
+	
+	// The block is words: number of records, overflows, PPS sequence number
+	memset(data,0,length);
+	unsigned int n = (fifo.size() > 0xffff ? 0xffff : fifo.size());
+	data[0] = n & 0xff;          data[1] = n >> 8;
+	data[2] = overflows & 0xff;  data[3] = (overflows >> 8) & 0xff;
+	data[4] = ppsSeq & 0xff;     data[5] = ppsSeq >> 8;
+	return length;
+}
+
+//
+// Private
+//
+
+void SimulatedXEM::configure(const char *cfg)
+{
+	if (NULL == cfg)
+		return;
+	const char *p;
+	if ((p = strstr(cfg,"channels=")))
+		nChannels = atoi(p+9);
+	if (nChannels < 1) nChannels = 1;
+	if (nChannels > 6) nChannels = 6;
+	if ((p = strstr(cfg,"rate=")))
+		rate = atof(p+5);
+	if (rate <= 0.0) rate = 1.0;
+	if ((p = strstr(cfg,"firmware=")))
+		firmwareVersion = atoi(p+9);
+	if ((p = strstr(cfg,"latency=")))
+		latency = atoi(p+8);
+	if ((p = strstr(cfg,"depth=")))
+		fifoDepth = atoi(p+6);
+	if (fifoDepth < 1) fifoDepth = 1;
+}
+
+void SimulatedXEM::Transaction::SetWireInValue(int epAddr,unsigned long val,unsigned long mask)
+{
+	wireIns.push_back(epAddr);
+	wireIns.push_back(val);
+	wireIns.push_back(mask);
+}
+
+SimulatedXEM::ErrorCode SimulatedXEM::ExecuteTransaction(Transaction *t)
+{
+	transfer();
+	if (!t->wireIns.empty()){
+		for (unsigned int i=0;i<t->wireIns.size();i+=3)
+			SetWireInValue(t->wireIns[i],t->wireIns[i+1],t->wireIns[i+2]);
+		t->wireIns.clear();
+		memcpy(wireIns,pendingWireIns,sizeof(wireIns));
+	}
+	if (t->readTriggerOuts)
+		latchTriggerOuts();
+	if (t->readWireOuts)
+		latchWireOuts();
+	clock_gettime(CLOCK_REALTIME,&(t->snapshotTime));
+	t->status=NoError;
+	return NoError;
+}
+
+void SimulatedXEM::transfer()
+{
+	// Each transfer takes some time, like the real thing
+	if (latency > 0){
+		struct timespec ts;
+		ts.tv_sec  = latency/1000000;
+		ts.tv_nsec = (latency%1000000)*1000;
+		nanosleep(&ts,NULL);
+	}
+	generate();
+}
+
+void SimulatedXEM::generate()
+{
+	// Generates all triggers which are due
+	long long tick = (long long) (now()*1.0E-9*rate);
+	if (lastTick < 0)
+		lastTick = tick;
+	
+	// If we've fallen a long way behind, only the most recent triggers can fit in the FIFO
+	long long maxTicks = fifoDepth/nChannels + 1;
+	if (tick - lastTick > maxTicks){
+		if (firmwareVersion >= 1)
+			overflows += (tick - lastTick - maxTicks)*nChannels;
+		lastTick = tick - maxTicks;
+	}
+	
+	for (long long k=lastTick+1;k<=tick;k++){
+		ppsSeq = ((long long) (k/rate)) & 0xffff; // counts seconds, whatever the trigger rate
+		for (int ch=1;ch<=nChannels;ch++){
+			// about 100 ns per channel, with a few ns of noise, in counts of 1.25 ns
+			unsigned int ns = 100*ch + (((unsigned int) k*2654435761U) >> 28);
+			unsigned int counts = ns*4/5;
+			counters[ch-1] = counts;
+			pendingTriggers |= (0x01 << (ch-1));
+			if (firmwareVersion >= 1){
+				if (fifo.size() < fifoDepth){
+					Record r;
+					r.channel=ch;
+					r.ppsSeq=ppsSeq;
+					r.counts=counts;
+					fifo.push_back(r);
+				}
+				else
+					overflows++;
+			}
+		}
+	}
+	lastTick = tick;
+}
+
+long long SimulatedXEM::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME,&ts);
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
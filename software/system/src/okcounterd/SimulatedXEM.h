@@ -0,0 +1,147 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __SIMULATED_XEM_H_
+#define __SIMULATED_XEM_H_
+
+#include <time.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// A software stand-in for an XEM running the counter firmware, for testing and profiling okcounterd 
+// without hardware. Build with Makefile.Simulator.
+// 
+// It emulates the wire outs, trigger outs and pipes used by okcounterd. All channels are triggered
+// together at 'rate' times per second, aligned with the system clock. The PPS sequence number counts seconds.
+// With 'firmware=0', only the counter wire outs and trigger outs are emulated. Otherwise,
+// readings are queued in a FIFO, as in current firmware.
+//
+// The simulation is configured via the environment variable OKCOUNTERD_SIMULATOR, eg
+// OKCOUNTERD_SIMULATOR="channels=6 rate=1000 firmware=1 latency=125 depth=1024"
+// where
+// channels : number of channels triggered (1 to 6)
+// rate     : triggers per second
+// firmware : firmware version to emulate
+// latency  : delay added to each simulated USB transfer, in us
+// depth    : FIFO depth, in readings
+
+class SimulatedXEM
+{
+	public:
+		
+		enum ErrorCode
+		{
+			NoError = 0,
+			Failed = -1,
+			Timeout = -2,
+			InvalidEndpoint = -9
+		};
+		
+		enum BoardModel
+		{
+			brdUnknown = 0,
+			brdSimulated = 1000
+		};
+		
+		// As for OpenOK_Transaction: the whole transaction costs a single simulated transfer
+		class Transaction
+		{
+			public:
+				Transaction():status(NoError),readWireOuts(false),readTriggerOuts(false){snapshotTime.tv_sec=snapshotTime.tv_nsec=0;}
+				void SetWireInValue(int epAddr,unsigned long val,unsigned long mask = 0xffffffff);
+				void UpdateWireOuts(){readWireOuts=true;}
+				void UpdateTriggerOuts(){readTriggerOuts=true;}
+				void Clear(){wireIns.clear();readWireOuts=readTriggerOuts=false;}
+				
+				struct timespec snapshotTime;
+				int status;
+				
+			private:
+				friend class SimulatedXEM;
+				std::vector<unsigned long> wireIns; // triples of address, value, mask
+				bool readWireOuts,readTriggerOuts;
+		};
+		
+		SimulatedXEM();
+		
+		ErrorCode OpenBySerial(std::string str = "");
+		std::string GetBoardModelString(BoardModel);
+		BoardModel GetBoardModel(){return brdSimulated;}
+		ErrorCode LoadDefaultPLLConfiguration(){return NoError;}
+		int GetDeviceMajorVersion(){return 0;}
+		int GetDeviceMinorVersion(){return 0;}
+		std::string GetSerialNumber(){return serial.empty() ? "SIMULATED" : serial;}
+		std::string GetDeviceID(){return "okcounterd simulator";}
+		ErrorCode ConfigureFPGA(const std::string){return NoError;}
+		ErrorCode ConfigureFPGAFromCache(const std::string,const std::string,bool,bool *skipped=NULL){if (skipped) *skipped=false;return NoError;}
+		bool IsFrontPanelEnabled(){return true;}
+		
+		ErrorCode SetWireInValue(int epAddr,unsigned long val,unsigned long mask = 0xffffffff);
+		void UpdateWireIns();
+		void UpdateWireOuts();
+		int GetWireOutValue(int epAddr);
+		void UpdateTriggerOuts();
+		bool IsTriggered(int epAddr,unsigned long mask);
+		long ReadFromPipeOut(int epAddr,long length,unsigned char *data);
+		long ReadFromBlockPipeOut(int epAddr,int blockSize,long length,unsigned char *data);
+		ErrorCode ExecuteTransaction(Transaction *);
+		ErrorCode SubmitTransaction(Transaction *t){return ExecuteTransaction(t);} // done at once
+		ErrorCode WaitForTransaction(Transaction *t){return (ErrorCode) t->status;}
+		
+	private:
+		
+		class Record
+		{
+			public:
+				unsigned int channel,ppsSeq,counts;
+		};
+		
+		void configure(const char *);
+		void transfer();
+		void latchWireOuts();
+		void latchTriggerOuts();
+		void generate();
+		long long now();
+		
+		std::string serial;
+		int nChannels;
+		double rate;
+		unsigned int firmwareVersion;
+		int latency;
+		unsigned int fifoDepth;
+		
+		long long lastTick; // index of the last trigger generated
+		unsigned int ppsSeq;
+		unsigned int wireIns[0x20],pendingWireIns[0x20];
+		unsigned int wireOuts[0x20];
+		unsigned int counters[6];
+		unsigned int triggers,pendingTriggers;
+		std::deque<Record> fifo;
+		unsigned int overflows;
+};
+
+#endif
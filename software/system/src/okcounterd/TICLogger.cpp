@@ -0,0 +1,218 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+
+#include "Debug.h"
+#include "OKCounterD.h"
+#include "TICLogger.h"
+
+#define POLL_INTERVAL 10000    // us, delay between reading the counter and timestamping the reading, as for okxemlog.pl
+#define WRITE_INTERVAL 100000  // us, how often queued readings are written out
+#define FILE_BUFFER_SIZE 16384
+#define BINARY_RECORD_SIZE 16
+
+extern ostream *debugStream;
+
+static void putLE(unsigned char *p,unsigned long long v,int nbytes)
+{
+	for (int i=0;i<nbytes;i++){
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+//
+// Public
+//
+
+TICLogger::TICLogger(OKCounterD *a)
+{
+	threadID = "logger";
+	app=a;
+	binary=false;
+	queueDropsReported=0;
+}
+
+TICLogger::~TICLogger()
+{
+	for (unsigned int i=0;i<channels.size();i++){
+		closeFiles(channels.at(i));
+		delete channels.at(i);
+	}
+}
+
+bool TICLogger::addChannel(string spec)
+{
+	// spec is channel:path[:extension]
+	// Files are named path/MJD.extension
+	int channel;
+	char path[1024],ext[64];
+	ext[0]=0;
+	int n = sscanf(spec.c_str(),"%d:%1023[^:]:%63s",&channel,path,ext);
+	if (n < 2 || channel < 1 || channel > 32)
+		return false;
+	string p(path);
+	if (p.at(p.length()-1) != '/')
+		p += "/";
+	string e = (n == 3 ? ext : "tic");
+	if (e.at(0) == '.')
+		e.erase(0,1);
+	channels.push_back(new LogChannel(channel,p,e));
+	DBGMSG(debugStream,"logging channel " << channel << " to " << p << "MJD." << e);
+	return true;
+}
+
+void TICLogger::sendData(vector<int> &data)
+{
+	// Called from the acquisition thread so this must not block
+	for (unsigned int i=0;i<data.size();i+=4){
+		Reading r;
+		r.seq     = 0;
+		r.channel = data.at(i);
+		r.tv_sec  = data.at(i+1);
+		r.tv_nsec = data.at(i+2);
+		r.rdg     = data.at(i+3);
+		readings.push(r);
+	}
+}
+
+//
+// Protected
+//
+
+void TICLogger::doWork()
+{
+	// Readings arrive once a second, so there's no need to be woken up for each one.
+	// Files are flushed after each batch so that other processes see the readings promptly.
+	
+	Reading r;
+	while (!stopRequested){
+		usleep(WRITE_INTERVAL);
+		bool wrote=false;
+		while (readings.pop(&r)){
+			writeReading(r);
+			wrote=true;
+		}
+		if (wrote){
+			for (unsigned int i=0;i<channels.size();i++){
+				if (channels.at(i)->fout) fflush(channels.at(i)->fout);
+				if (channels.at(i)->fbin) fflush(channels.at(i)->fbin);
+			}
+		}
+		if (readings.dropped() != queueDropsReported){
+			ostringstream ss;
+			ss << "logger: " << readings.dropped() - queueDropsReported << " readings dropped";
+			app->log(ss.str());
+			queueDropsReported = readings.dropped();
+		}
+	}
+	
+	while (readings.pop(&r)) // files are flushed when they are closed
+		writeReading(r);
+}
+
+//
+// Private
+//
+
+void TICLogger::writeReading(Reading &r)
+{
+	LogChannel *lc=NULL;
+	for (unsigned int i=0;i<channels.size();i++){
+		if (channels.at(i)->channel == r.channel){
+			lc = channels.at(i);
+			break;
+		}
+	}
+	if (NULL == lc)
+		return;
+	
+	// The reading is timestamped just after the counter is read so the timestamp is rounded 
+	// to the nearest second allowing for that delay.
+	time_t t = r.tv_sec + (r.tv_nsec/1000 + POLL_INTERVAL)/1000000;
+	int mjd = t/86400 + 40587;
+	if (mjd != lc->mjd)
+		openFiles(lc,mjd);
+	
+	double rdg = r.rdg;
+	if (rdg > 5.0E8) rdg -= 1.0E9;
+	
+	if (lc->fout){
+		int tod = t % 86400;
+		fprintf(lc->fout,"%02d:%02d:%02d  %.15g\n",tod/3600,(tod%3600)/60,tod%60,rdg*1.0E-9);
+	}
+	
+	if (lc->fbin){
+		// int64 timestamp (s), uint32 timestamp (ns), int32 reading (ns), little-endian
+		unsigned char rec[BINARY_RECORD_SIZE];
+		putLE(rec,r.tv_sec,8);
+		putLE(rec+8,r.tv_nsec,4);
+		putLE(rec+12,(unsigned int) r.rdg,4);
+		fwrite(rec,BINARY_RECORD_SIZE,1,lc->fbin);
+	}
+}
+
+void TICLogger::openFiles(LogChannel *lc,int mjd)
+{
+	closeFiles(lc);
+	lc->mjd = mjd;
+	
+	ostringstream ss;
+	ss << lc->path << mjd << "." << lc->extension;
+	DBGMSG(debugStream,"opening " << ss.str());
+	lc->fout = fopen(ss.str().c_str(),"a");
+	if (NULL == lc->fout){
+		app->log("logger: unable to open " + ss.str() + " : " + strerror(errno));
+		return; // try again tomorrow
+	}
+	setvbuf(lc->fout,NULL,_IOFBF,FILE_BUFFER_SIZE);
+	
+	if (binary){
+		string fbin = ss.str() + ".bin";
+		lc->fbin = fopen(fbin.c_str(),"ab");
+		if (NULL == lc->fbin)
+			app->log("logger: unable to open " + fbin + " : " + strerror(errno));
+		else
+			setvbuf(lc->fbin,NULL,_IOFBF,FILE_BUFFER_SIZE);
+	}
+}
+
+void TICLogger::closeFiles(LogChannel *lc)
+{
+	if (lc->fout){
+		fclose(lc->fout);
+		lc->fout=NULL;
+	}
+	if (lc->fbin){
+		fclose(lc->fbin);
+		lc->fbin=NULL;
+	}
+}
@@ -0,0 +1,84 @@
+//
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2022  Michael J. Wouters
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __TIC_LOGGER_H_
+#define __TIC_LOGGER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Thread.h"
+#include "ReadingQueue.h"
+
+class OKCounterD;
+
+// Writes counter readings directly to daily log files, one file per channel, named by MJD
+// The format is the same as that written by okxemlog.pl, ie
+// HH:MM:SS reading (s)
+// Optionally, a binary file with the full timestamp of each reading is written alongside.
+// As for the Server, the acquisition thread only pushes readings onto a queue;
+// formatting and writing is done in the logger's own thread.
+
+class TICLogger:public Thread
+{
+	public:
+		
+		TICLogger(OKCounterD *);
+		virtual ~TICLogger();
+		
+		bool addChannel(string);
+		bool hasChannels(){return !channels.empty();}
+		void setBinary(bool b){binary=b;}
+		void sendData(vector<int> &);
+		
+	protected:
+		
+		virtual void doWork();
+		
+	private:
+		
+		class LogChannel
+		{
+			public:
+				LogChannel(int ch,string p,string ext){channel=ch;path=p;extension=ext;mjd=-1;fout=NULL;fbin=NULL;}
+				int channel;
+				string path,extension;
+				int mjd;
+				FILE *fout,*fbin;
+		};
+		
+		void writeReading(Reading &);
+		void openFiles(LogChannel *,int);
+		void closeFiles(LogChannel *);
+		
+		OKCounterD *app;
+		ReadingQueue readings;
+		vector<LogChannel *> channels;
+		bool binary;
+		unsigned long queueDropsReported;
+};
+
+#endif
@@ -23,12 +23,13 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  * 
- * Usage: ppsd [-dhvs] [-o delay ]
+ * Usage: ppsd [-dhvs] [-o delay ] [-a cpu]
  *	-d turn debugging on
  *  -h print help
  *  -s use soft timing
  *  -v print version number
  *  -o delay offset for pps in us
+ *  -a run on this CPU
  *
  * Requires a configuration file /usr/local/etc/ppsd.conf
  * The file has one entry, the pps offset in 1 ms
@@ -50,6 +51,8 @@
  	
 /* Compile with gcc -O -Wall -o ppsd ppsd.c */
 
+#define _GNU_SOURCE /* for sched_setaffinity() */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -75,7 +78,7 @@
 #include <configurator.h>
 
 #define APP_NAME "ppsd"
-#define APP_VERSION "3.0.0"
+#define APP_VERSION "3.1.0"
 #define PID_FILE _PATH_VARRUN "ppsd.pid"
 #define DEFAULT_CONFIG "/usr/local/etc/ppsd.conf"
 #define DEFAULT_LOG_DIR	 "/home/ntp-admin/logs/"
@@ -83,6 +86,23 @@
 #define BUFLEN 1024
 #define PRETTIFIER "*********************************************"
 
+#define NSEC_PER_SEC 1000000000LL
+
+/* In hard timing mode, ppsd sleeps until 'lead' ns before the tick and then busy-waits.
+ * The lead is adjusted from the measured wake-up latency: it is LEAD_FACTOR times the
+ * peak latency, which decays by LEAD_DECAY each second, plus LEAD_MARGIN.
+ */
+#define MIN_LEAD      20000LL    /* ns */
+#define MAX_LEAD   20000000LL    /* ns */
+#define START_LEAD  2000000LL    /* ns */
+#define LEAD_MARGIN   10000LL    /* ns */
+#define LEAD_FACTOR 1.5
+#define LEAD_DECAY  0.99
+#define MAX_LATENCY 100000000LL  /* ns - a longer wake-up latency is taken to be a time step */
+
+#define REPORT_INTERVAL 3600     /* s, between reports of the jitter histogram to syslog */
+#define JITTER_BINS 10
+
 typedef int BOOL;
 #define TRUE 1
 #define FALSE 0
@@ -254,10 +274,31 @@ F8186X_init()
 #endif
 
 
+/* Statistics on the error of the output edge (hard timing) or wake-up (soft timing), 
+ * from the requested time, since ppsd was started
+ */
+typedef struct _Tjitter
+{
+	unsigned long counts[JITTER_BINS+1]; /* last bin is overflow */
+	unsigned long n;
+	unsigned long nLate;  /* pulses skipped because ppsd woke up after the tick */
+	double sum,max;       /* ns */
+	double spinSum;       /* ns */
+} Tjitter;
+
+static const long long jitterEdges[JITTER_BINS] = {1000,2000,5000,10000,20000,50000,100000,200000,500000,1000000}; /* ns */
+
+static volatile sig_atomic_t reportRequested=0;
+
 typedef struct _Tppsd
 {
 	uid_t uid;
 	int offset;
+	int cpu;             /* CPU to run on, or -1 */
+	
+	long long lead;      /* ns, time before the tick at which the busy wait starts */
+	double peakLatency;  /* ns, decaying peak of the wake-up latency */
+	Tjitter jitter;
 	
 	FILE *logFile;       /* current data log file */
 	char *logPath;       /* path for log files  */
@@ -290,6 +331,7 @@ ppsd_print_help()
 	printf("-s soft timing (default is hard)\n");
 	printf("-o output delay in us\n");
 	printf("-c <config> set configuration file\n");
+	printf("-a <cpu> run on this CPU\n");
 }
 
 static void
@@ -301,8 +343,13 @@ ppsd_init(
 	
 	pp->MJD=-1;
 	pp->offset=1000;
+	pp->cpu=-1;
 	pp->hardTiming = FALSE;
 	
+	pp->lead=START_LEAD;
+	pp->peakLatency=0.0;
+	memset(&(pp->jitter),0,sizeof(Tjitter));
+	
 	pp->configurationFile=strdup(DEFAULT_CONFIG);
 	
 	pp->logFile=NULL;
@@ -444,7 +491,14 @@ ppsd_load_config(
 	ppsd_set_config_str(last,"main","log path",&(pp->logPath),&configOK,FALSE);
 	ppsd_set_config_str(last,"main","host name",&(pp->hostname),&configOK,FALSE);
 	ppsd_set_config_int(last,"main","delay",&(pp->offset),&configOK,FALSE);
+	/* Same check as for -o, otherwise the target time is invalid */
+	if (abs(pp->offset) > 999999){
+		fprintf(stderr,"Error in the configuration file %s\n",pp->configurationFile);
+		fprintf(stderr,"Absolute value of delay must be less than 999999\n");
+		exit(EXIT_FAILURE);
+	}
 	ppsd_set_config_bool(last,"main","hard timing",&(pp->hardTiming),&configOK,FALSE);
+	ppsd_set_config_int(last,"main","cpu",&(pp->cpu),&configOK,FALSE);
 }
 
 static int
@@ -485,16 +539,102 @@ ppsd_open_log(
 static void
 ppsd_log(
 	Tppsd *pp,
-	struct timeval *tv)
+	struct timespec *tv)
 {
 	struct tm *ts;
 	char timestr[64];
 	ts=gmtime((&(tv->tv_sec)));
 	strftime(timestr,63,"%H:%M:%S",ts);
-	fprintf(pp->logFile,"%s %i\n",timestr,(int) tv->tv_usec);
+	fprintf(pp->logFile,"%s %i\n",timestr,(int) (tv->tv_nsec/1000));
 	fflush(pp->logFile);
 }
 
+static long long
+ppsd_ts_diff(
+	struct timespec *t1,
+	struct timespec *t0)
+{
+	/* t1 - t0, in ns */
+	return (t1->tv_sec - t0->tv_sec)*NSEC_PER_SEC + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static void
+ppsd_ts_add(
+	struct timespec *t,
+	long long ns)
+{
+	long long tns = t->tv_nsec + ns;
+	t->tv_sec += tns/NSEC_PER_SEC;
+	tns = tns % NSEC_PER_SEC;
+	if (tns < 0){
+		tns += NSEC_PER_SEC;
+		t->tv_sec--;
+	}
+	t->tv_nsec = tns;
+}
+
+static void
+ppsd_update_lead(
+	Tppsd *pp,
+	long long latency)
+{
+	long long lead;
+	pp->peakLatency *= LEAD_DECAY;
+	if (latency > pp->peakLatency)
+		pp->peakLatency = latency;
+	lead = LEAD_FACTOR*pp->peakLatency + LEAD_MARGIN;
+	if (lead < MIN_LEAD) lead = MIN_LEAD;
+	if (lead > MAX_LEAD) lead = MAX_LEAD;
+	pp->lead = lead;
+}
+
+static void
+ppsd_add_jitter(
+	Tppsd *pp,
+	long long err,
+	long long spin)
+{
+	Tjitter *j = &(pp->jitter);
+	int i=0;
+	if (err < 0) err = -err;
+	while (i < JITTER_BINS && err >= jitterEdges[i])
+		i++;
+	j->counts[i]++;
+	j->n++;
+	j->sum += err;
+	if (err > j->max) j->max = err;
+	j->spinSum += spin;
+}
+
+static void
+ppsd_report_jitter(
+	Tppsd *pp)
+{
+	/* eg
+	 * jitter (us): n=3600 mean=0.412 max=3.120 late=0 spin mean=31.2 lead=40.1
+	 * jitter (us): <1 3500 <2 90 ...
+	 */
+	char buf[BUFLEN];
+	int i,n;
+	Tjitter *j = &(pp->jitter);
+	
+	syslog(LOG_INFO,"jitter (us): n=%lu mean=%.3f max=%.3f late=%lu spin mean=%.1f lead=%.1f",
+		j->n,(j->n > 0 ? j->sum*1.0E-3/j->n : 0.0),j->max*1.0E-3,j->nLate,
+		(j->n > 0 ? j->spinSum*1.0E-3/j->n : 0.0),(pp->hardTiming ? pp->lead*1.0E-3 : 0.0));
+	n = snprintf(buf,BUFLEN,"jitter (us):");
+	for (i=0;i<JITTER_BINS;i++)
+		n += snprintf(buf+n,BUFLEN-n," <%g %lu",jitterEdges[i]*1.0E-3,j->counts[i]);
+	snprintf(buf+n,BUFLEN-n," >=%g %lu",jitterEdges[JITTER_BINS-1]*1.0E-3,j->counts[JITTER_BINS]);
+	syslog(LOG_INFO,"%s",buf);
+}
+
+static void
+ppsd_request_report(
+	int sig)
+{
+	reportRequested=1;
+}
+
 /* 
  * 
  */
@@ -510,15 +650,16 @@ main(
 	FILE *str;
 	pid_t pid;
 	
-	int offset;
-	int opts=FALSE,opto=FALSE,optc=FALSE;
+	int offset,cpu,ret;
+	int opts=FALSE,opto=FALSE,optc=FALSE,opta=FALSE;
 	char *configurationFile=NULL;
 	
-	int tstart;
 	struct sched_param	sched;
-	long twait;
-	struct timeval tv;
-	long tloop;
+	cpu_set_t cpus;
+	struct sigaction sa;
+	struct timespec now,target,wake;
+	long long latency,togo;
+	time_t lastReport;
 	
 #ifdef USE_PARALLEL_PORT
 	int j;
@@ -533,9 +674,16 @@ main(
 	ppsd_init(&ppsd);
 	
 	/* Process the command line options */
-	while ((c=getopt(argc,argv,"dhsvo:c:")) != -1){
+	while ((c=getopt(argc,argv,"dhsvo:c:a:")) != -1){
 		switch(c)
 		{
+			case 'a':
+				if (1 != sscanf(optarg,"%i",&cpu) || cpu < 0){
+					fprintf(stderr,"Error in argument to option -a\n");
+					return EXIT_FAILURE;
+				}
+				opta=TRUE;
+				break;
 			case 'c':
 				configurationFile = strdup(optarg);
 				optc=TRUE;
@@ -605,6 +753,10 @@ main(
 		ppsd.hardTiming = FALSE;
 	}
 	
+	if (opta){
+		ppsd.cpu = cpu;
+	}
+	
 	if (debugOn){
 		fprintf(stderr,"Hard timing is %s\n",(ppsd.hardTiming?"ON":"OFF"));
 	}
@@ -732,11 +884,26 @@ main(
 		unlink(PID_FILE);
 		exit(EXIT_FAILURE);
 	}
+	/* Keep to one CPU, so that other processes can be kept off it */
+	if (ppsd.cpu >= 0){
+		CPU_ZERO(&cpus);
+		CPU_SET(ppsd.cpu,&cpus);
+		if (sched_setaffinity(0,sizeof(cpus),&cpus) == -1)
+			syslog(LOG_WARNING,"unable to run on CPU %d: %s",ppsd.cpu,strerror(errno));
+	}
+	
+	/* SIGUSR1 reports the jitter histogram */
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = ppsd_request_report;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1,&sa,NULL);
 	
 	/* Main loop
 	 * Here, we get the time and sleep till just before the tick.
 	 * ppsd then goes into a busy loop waiting for the tick.
-	 *
+	 * The sleep is to an absolute time, so that the time taken to set it up doesn't matter,
+	 * and the busy loop starts 'lead' before the tick, with lead adjusted to the wake-up latency
+	 * seen, so that as little time as possible is spent in it.
 	 */
 
 	
@@ -747,48 +914,76 @@ main(
 	F8186X_write(GPIO_ODR, dout);
 #endif
 	
+	clock_gettime(CLOCK_REALTIME,&now);
+	lastReport = now.tv_sec;
+	
 	for (;;){
 	
-		/* Get the time */
-		gettimeofday(&tv,NULL);
-		tstart=tv.tv_sec;
-		twait= ppsd.offset+1000000-tv.tv_usec;
-		// if (debugOn) fprintf(stderr,"twait %i\n",(int) twait);
+		if (reportRequested || now.tv_sec - lastReport >= REPORT_INTERVAL){
+			ppsd_report_jitter(&ppsd);
+			reportRequested=0;
+			lastReport = now.tv_sec;
+		}
 		
-		if (ppsd.hardTiming){
-			/* We have to go into the busy loop 20 ms before the tick 
-			* to have a decent chance of getting and keeping the time
-			* slice.
-			*/
-			if (twait > 20000) 
-				twait-=20000;
+		/* The next tick, leaving time to sleep */
+		clock_gettime(CLOCK_REALTIME,&now);
+		target.tv_sec  = now.tv_sec;
+		target.tv_nsec = 0;
+		ppsd_ts_add(&target,ppsd.offset*1000LL); /* keeps tv_nsec in [0,1e9) whatever the sign of the offset */
+		if (ppsd_ts_diff(&target,&now) < (ppsd.hardTiming ? ppsd.lead : 0) + 1000000LL)
+			target.tv_sec++;
+		
+		wake = target;
+		if (ppsd.hardTiming)
+			ppsd_ts_add(&wake,-ppsd.lead);
+		
+		/* Wait till just before the tick. A time step while sleeping is handled by the kernel */
+		while (EINTR == (ret = clock_nanosleep(CLOCK_REALTIME,TIMER_ABSTIME,&wake,NULL))){}
+		if (ret != 0){
+			/* Don't spin on a bad wake-up time */
+			syslog(LOG_ERR,"clock_nanosleep failed: %s",strerror(ret));
+			sleep(1);
+			clock_gettime(CLOCK_REALTIME,&now);
+			continue;
 		}
 		
-		/* Wait till just before the tick */
-		usleep(twait);
+		clock_gettime(CLOCK_REALTIME,&now);
+		latency = ppsd_ts_diff(&now,&wake);
+		
+		/* A time step forwards makes us wake up immediately. Skip this tick */
+		if (latency < 0 || latency > MAX_LATENCY){
+			if (debugOn)
+				fprintf(stderr,"time step? latency %lld ns\n",latency);
+			continue;
+		}
 		
 		if (ppsd.hardTiming){
-			/* Loop till we see the tick */
-			gettimeofday(&tv,NULL);
+			ppsd_update_lead(&ppsd,latency);
 			
-			/* Are we too late ? If we are then we will immediately output a pulse*/
-			if ((tv.tv_sec > tstart && tv.tv_usec > ppsd.offset))
+			/* Are we too late ? If we are, skip this tick. The lead has been increased */
+			if (ppsd_ts_diff(&now,&target) > 0){
+				ppsd.jitter.nLate++;
+				if (debugOn)
+					fprintf(stderr,"late by %lld ns, lead now %lld ns\n",ppsd_ts_diff(&now,&target),ppsd.lead);
 				continue;
-				
-			/* How many us to go ? */
+			}
+			
+			/* How many ns to go ? */
 			if (debugOn)
-				fprintf(stderr,"%i us to go\n",(int)
-					((tstart+1 -tv.tv_sec)*1000000	+ ppsd.offset - tv.tv_usec));
-			tloop = (tstart+1 -tv.tv_sec)*1000000	+ ppsd.offset - tv.tv_usec;
-			/* Guard against the system time going backwards while we are looping by restricting tloop */
-			while ( tloop > 0 && tloop < 20000 ){
-				gettimeofday(&tv,NULL);
-				tloop = (tstart+1 -tv.tv_sec)*1000000	+ ppsd.offset - tv.tv_usec;
+				fprintf(stderr,"%lld ns to go\n",ppsd_ts_diff(&target,&now));
+			
+			/* Loop till we see the tick.
+			 * Guard against the system time going backwards while we are looping by restricting togo
+			 */
+			togo = ppsd_ts_diff(&target,&now);
+			while (togo > 0 && togo < MAX_LEAD){
+				clock_gettime(CLOCK_REALTIME,&now);
+				togo = ppsd_ts_diff(&target,&now);
 			}
+			if (togo > 0)
+				continue;
 		}
-		else{
-			gettimeofday(&tv,NULL); /* BEF timestamp */
-		}
+		/* In soft timing, 'now' is the BEF timestamp */
 		
 #ifdef USE_PARALLEL_PORT
 		outb(0xff,PPBASE); /* We go high    */ 
@@ -807,9 +1002,11 @@ main(
 		F8186X_write(GPIO_ODR, dout);
 #endif
 		
+		ppsd_add_jitter(&ppsd,ppsd_ts_diff(&now,&target),ppsd_ts_diff(&now,&wake));
+		
 		if (!ppsd.hardTiming){/* log the wakeup time */
 			
-			time_t tt = tv.tv_sec;
+			time_t tt = now.tv_sec;
 			//if ( pp.lastpps.tv_nsec> NSEC_PER_SEC / 2)
 			//	tt++;
 			int mjd = tt/86400 + 40587;
@@ -818,13 +1015,13 @@ main(
 				if (ppsd_open_log(&ppsd,mjd))
 					ppsd.MJD=mjd;
 			}
-			ppsd_log(&ppsd,&tv);
+			ppsd_log(&ppsd,&now);
 		}
 		
 		if (debugOn){
-			fprintf(stderr,"BEF %i\n",(int) tv.tv_usec);
-			gettimeofday(&tv,NULL);
-			fprintf(stderr,"AFT %i\n",(int) tv.tv_usec);
+			fprintf(stderr,"BEF %i latency %lld lead %lld\n",(int) (now.tv_nsec/1000),latency,ppsd.lead);
+			clock_gettime(CLOCK_REALTIME,&now);
+			fprintf(stderr,"AFT %i\n",(int) (now.tv_nsec/1000));
 		}
 	}	
 
@@ -26,6 +26,8 @@
 
 
 #include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,7 +45,7 @@
 #include <sys/timepps.h>
 
 #define APP_NAME "ppsdevlog"
-#define APP_VERSION "0.1.4"
+#define APP_VERSION "0.2.0"
 #define LAST_MODIFIED ""
 
 #define DEFAULT_CONFIG			"/usr/local/etc/ppsdevlog.conf" 
@@ -53,8 +55,10 @@
 #define DEFAULT_DEV 				"/dev/pps0"
 #define DEFAULT_TRIGGER_LEVEL "clear"
 
-#define TSLEEP  300000       /* sleep to sleep between polls of the PPS device */
-#define DEFAULT_TIMEOUT     60 /* if no data received, bomb out */
+#define TSLEEP  300000       /* time to sleep between polls of a PPS device which can't wait for events */
+#define FETCH_TIMEOUT        3 /* s, timeout for a blocking fetch, so that a quit is seen */
+#define DEFAULT_TIMEOUT     60 /* if no data received from any device, bomb out */
+#define MAX_SOURCES          8 /* PPS devices */
 
 #define BUFLEN 1024
 #define PRETTIFIER "*********************************************"
@@ -63,16 +67,38 @@ typedef int BOOL;
 #define FALSE 0
 #define TRUE 1
 
+struct _ppsdevlog;
+
+/* A PPS device. Each is read by its own thread, which blocks until there is an event */
 typedef struct
 {
-	char *configurationFile;
+	struct _ppsdevlog *pp;
 	
 	char *devName;
-	int  devfd;            /* device file descriptor */
+	char *label;           /* identifies the device in the log, when there are several */
 	pps_handle_t devHandle;
 	int reqCaps;
 	int availCaps;
 	
+	pthread_t thread;
+	
+	pps_seq_t lastSeq[2];    /* assert,clear - this is tracked so that duplicates can be filtered out */
+	time_t lastEvent;        /* system time of the last event; set by the capture thread, read by the main thread, so atomic */
+	BOOL timedOut;           /* main thread only */
+	
+}ppssource;
+
+typedef struct _ppsdevlog
+{
+	char *configurationFile;
+	
+	char *devNames;        /* comma separated list of device[:trigger level] */
+	ppssource sources[MAX_SOURCES];
+	int nSources;
+	int nEdges;            /* total edges logged, over all sources */
+	
+	pthread_mutex_t logMutex; /* the log is shared by the source threads */
+	
 	FILE *logFile;       /* current data log file */
 	char *logPath;       /* path for log files  */
 	
@@ -81,10 +107,7 @@ typedef struct
 	
 	char * lockFileName;
 	char * hostname;
-	char * triggerLevel;
-	
-	struct timespec lastpps; /* this is tracked so that duplicates can be filtered out */
-	unsigned long   seq; /* pps counter */
+	char * triggerLevel;   /* default trigger level */
 	
 	int MJD; /* to track day rollover */
 	
@@ -95,18 +118,20 @@ static volatile bool quit = false;
 
 
 static int debugOn=0;
-char timestr[64];
+
+#define TIMESTAMP_LEN 32
 
 static char *
-timestamp(time_t tt,int showDate)
+timestamp(time_t tt,int showDate,char *buf)
 {
-	struct tm *ts;
-	ts=gmtime(&tt);
+	/* buf must have TIMESTAMP_LEN characters. This is called from several threads. */
+	struct tm ts;
+	gmtime_r(&tt,&ts);
 	if (TRUE==showDate)
-		strftime(timestr,64,"%F %T",ts);
+		strftime(buf,TIMESTAMP_LEN,"%F %T",&ts);
 	else
-		strftime(timestr,64,"%T",ts);
-	return timestr;
+		strftime(buf,TIMESTAMP_LEN,"%T",&ts);
+	return buf;
 }
 
 static void 
@@ -123,9 +148,10 @@ ppsdevlog_log_status(
 										)
 {
 	FILE *statusFile;
+	char tbuf[TIMESTAMP_LEN];
 	
 	if ((statusFile = fopen(pp->statusFileName,"a"))){
-		fprintf(statusFile,"%s %s\n",timestamp(time(NULL),TRUE),msg);
+		fprintf(statusFile,"%s %s\n",timestamp(time(NULL),TRUE,tbuf),msg);
 		fclose(statusFile);
 	}
 }
@@ -148,27 +174,23 @@ ppsdevlog_init(
 )
 {
 	char hn[BUFLEN];
-	struct timeval tv;
 	
-	pp->reqCaps = PPS_CAPTURECLEAR;
-	pp->availCaps = 0;
+	pp->nSources=0;
+	pp->nEdges=0;
+	pthread_mutex_init(&(pp->logMutex),NULL);
 	pp->configurationFile=strdup(DEFAULT_CONFIG);
 	
 	pp->lockFileName=strdup(DEFAULT_LOCK);
 	pp->logFile=NULL;
 	pp->statusFileName=strdup(DEFAULT_STATUS_FILE);
 	pp->logPath=strdup(DEFAULT_LOG_DIR);
-	pp->devName=strdup(DEFAULT_DEV);
+	pp->devNames=strdup(DEFAULT_DEV);
 	pp->triggerLevel=strdup(DEFAULT_TRIGGER_LEVEL);
 	
 	pp->hostname=strdup("localhost");
 	gethostname(hn,BUFLEN);
 	pp->hostname = strdup(hn); /* this will not usually be the FQDN - specify that via config file */
 	pp->MJD=-1;
-	
-	gettimeofday(&tv,NULL);
-	pp->lastpps.tv_nsec=0;
-	pp->lastpps.tv_sec=tv.tv_sec; /* set this so that we can track an initial timeout on the 1 pps */
 }
 
 static int
@@ -207,6 +229,20 @@ ppsdevlog_set_config(
 	return true;
 }
 
+static int
+ppsdevlog_trigger_caps(
+	const char *level)
+{
+	/* Returns the capture mode for a trigger level, or 0 if it's not recognized */
+	if (0==strncmp(level,"clear",5))
+		return PPS_CAPTURECLEAR; // 0x01
+	else if (0==strncmp(level,"assert",6))
+		return PPS_CAPTUREASSERT; // 0x02
+	else if (0==strncmp(level,"both",4))
+		return PPS_CAPTUREBOTH;
+	return 0;
+}
+
 static void
 ppsdevlog_load_config(
 	ppsdevlog *pp
@@ -214,6 +250,9 @@ ppsdevlog_load_config(
 {
 	
 	int configOK;
+	int defaultCaps;
+	char *devs,*tok,*saveptr,*level;
+	ppssource *src;
 	
 	ListEntry *last;
 	if (!configfile_parse_as_list(&last,pp->configurationFile)){
@@ -221,21 +260,45 @@ ppsdevlog_load_config(
 		exit(EXIT_FAILURE);
 	}
 	
-	ppsdevlog_set_config(last,"main","device",&(pp->devName),&configOK,FALSE);
+	ppsdevlog_set_config(last,"main","device",&(pp->devNames),&configOK,FALSE);
 	ppsdevlog_set_config(last,"main","lock file",&(pp->lockFileName),&configOK,FALSE);
 	ppsdevlog_set_config(last,"main","log path",&(pp->logPath),&configOK,FALSE);
 	ppsdevlog_set_config(last,"main","status file",&(pp->statusFileName),&configOK,TRUE);
 	ppsdevlog_set_config(last,"main","trigger level",&(pp->triggerLevel),&configOK,FALSE);
 	ppsdevlog_set_config(last,"main","host name",&(pp->hostname),&configOK,FALSE);
 	
-	if (0==strncmp(pp->triggerLevel,"clear",5)){
-		pp->reqCaps = PPS_CAPTURECLEAR; // 0x01
+	if (0 == (defaultCaps = ppsdevlog_trigger_caps(pp->triggerLevel))){
+		fprintf(stderr,"Unknown trigger level in the configuration file %s - exiting\n",pp->configurationFile);
+		exit(EXIT_FAILURE);
 	}
-	else if (0==strncmp(pp->triggerLevel,"assert",6)){
-		pp->reqCaps = PPS_CAPTUREASSERT; // 0x02
+	
+	/* Devices are given as eg /dev/pps0, /dev/pps1:assert */
+	devs = strdup(pp->devNames);
+	for (tok = strtok_r(devs,", \t",&saveptr);tok != NULL;tok = strtok_r(NULL,", \t",&saveptr)){
+		if (pp->nSources == MAX_SOURCES){
+			fprintf(stderr,"Too many devices in the configuration file %s (maximum %d) - exiting\n",pp->configurationFile,MAX_SOURCES);
+			exit(EXIT_FAILURE);
+		}
+		src = &(pp->sources[pp->nSources]);
+		memset(src,0,sizeof(ppssource));
+		src->pp = pp;
+		src->reqCaps = defaultCaps;
+		if ((level = strchr(tok,':'))){
+			*level='\0';
+			level++;
+			if (0 == (src->reqCaps = ppsdevlog_trigger_caps(level))){
+				fprintf(stderr,"Unknown trigger level %s in the configuration file %s - exiting\n",level,pp->configurationFile);
+				exit(EXIT_FAILURE);
+			}
+		}
+		src->devName = strdup(tok);
+		src->label = strdup(strrchr(tok,'/') ? strrchr(tok,'/') + 1 : tok);
+		pp->nEdges += ((src->reqCaps & PPS_CAPTUREASSERT) ? 1 : 0) + ((src->reqCaps & PPS_CAPTURECLEAR) ? 1 : 0);
+		pp->nSources++;
 	}
-	else{
-		fprintf(stderr,"Unknown trigger level in the configuration file %s - exiting\n",pp->configurationFile);
+	free(devs);
+	if (0 == pp->nSources){
+		fprintf(stderr,"No device in the configuration file %s - exiting\n",pp->configurationFile);
 		exit(EXIT_FAILURE);
 	}
 }
@@ -282,7 +345,7 @@ ppsdevlog_open_log(
 {
 	char buf[BUFLEN];
 	time_t tt;
-	struct tm *gmt;
+	struct tm gmt;
 	struct stat sbuf;
 	
 	/* Open log file for recording time stamps */
@@ -302,8 +365,8 @@ ppsdevlog_open_log(
 	if (!(pp->logFile = fopen(buf,"a")))
 		return FALSE;
 	else{
-		gmt=gmtime(&tt);
-		pp->logyday=gmt->tm_yday;
+		gmtime_r(&tt,&gmt);
+		pp->logyday=gmt.tm_yday;
 		fprintf(pp->logFile,"# %s system 1 pps log, %s %s\n",pp->hostname,APP_NAME,APP_VERSION);
 		fprintf(pp->logFile,"# Delay = 0\n");
 		fflush(pp->logFile);
@@ -313,131 +376,183 @@ ppsdevlog_open_log(
 
 int 
 ppsdevlog_open_source(
-	ppsdevlog *pp)
+	ppsdevlog *pp,
+	ppssource *src)
 {
 	pps_params_t params;
+	pps_info_t infobuf;
+	struct timespec timeout = { 0, 0 };
 	int ret;
+	char msg[BUFLEN];
 
 	if (debugOn)
-		fprintf(stderr,"Trying PPS source %s\n", pp->devName);
+		fprintf(stderr,"Trying PPS source %s\n", src->devName);
 
 	/* Check that there is a device */
-	if ((ret = open(pp->devName, O_RDWR)) < 0){
-		ppsdevlog_log_status(pp,"Unable to open device");
+	if ((ret = open(src->devName, O_RDWR)) < 0){
+		snprintf(msg,BUFLEN,"Unable to open device %s",src->devName);
+		ppsdevlog_log_status(pp,msg);
 		return ret;
 	}
 
-	if ((ret = time_pps_create(ret, &(pp->devHandle))) < 0){
-		ppsdevlog_log_status(pp,"Cannot create a PPS source from device ");
+	if ((ret = time_pps_create(ret, &(src->devHandle))) < 0){
+		snprintf(msg,BUFLEN,"Cannot create a PPS source from device %s",src->devName);
+		ppsdevlog_log_status(pp,msg);
 		return -1;
 	}
 	if (debugOn)
-		fprintf(stderr,"Found PPS source %s\n", pp->devName);
+		fprintf(stderr,"Found PPS source %s\n", src->devName);
 
 	/* Get the device capabilities */
-	if ((ret = time_pps_getcap(pp->devHandle, &(pp->availCaps))) < 0){
-		ppsdevlog_log_status(pp,"Cannot get device capabilities");
+	if ((ret = time_pps_getcap(src->devHandle, &(src->availCaps))) < 0){
+		snprintf(msg,BUFLEN,"Cannot get device capabilities for %s",src->devName);
+		ppsdevlog_log_status(pp,msg);
 		return -1;
 	}
 	
 	/* Check that we got the desired mode */
-	if ((pp->availCaps & pp->reqCaps) == pp->reqCaps) {
+	if ((src->availCaps & src->reqCaps) == src->reqCaps) {
 		/* Get current parameters */
-		ret = time_pps_getparams(pp->devHandle, &params);
+		ret = time_pps_getparams(src->devHandle, &params);
 		if (ret < 0) {
-			ppsdevlog_log_status(pp,"Cannot get parameters");
+			snprintf(msg,BUFLEN,"Cannot get parameters for %s",src->devName);
+			ppsdevlog_log_status(pp,msg);
 			return -1;
 		}
-		params.mode |= pp->reqCaps;
-		ret = time_pps_setparams(pp->devHandle, &params); /* this requires write permission for the device */
+		params.mode |= src->reqCaps;
+		ret = time_pps_setparams(src->devHandle, &params); /* this requires write permission for the device */
 		if (ret < 0) {
-			ppsdevlog_log_status(pp,"Cannot set the parameters");
+			snprintf(msg,BUFLEN,"Cannot set the parameters for %s",src->devName);
+			ppsdevlog_log_status(pp,msg);
 			return -1;
 		}
 	} else {
-		ppsdevlog_log_status(pp,"The selected mode is not supported");
+		snprintf(msg,BUFLEN,"The selected mode is not supported by %s",src->devName);
+		ppsdevlog_log_status(pp,msg);
 		return -1;
 	}
-
+	
+	/* Events before we started are not logged */
+	if (0 == time_pps_fetch(src->devHandle, PPS_TSFMT_TSPEC, &infobuf, &timeout)){
+		src->lastSeq[0] = infobuf.assert_sequence;
+		src->lastSeq[1] = infobuf.clear_sequence;
+	}
+	__atomic_store_n(&(src->lastEvent),time(NULL),__ATOMIC_RELAXED); /* so that we can track an initial timeout on the 1 pps */
+	
 	fflush(stdout);
 	return TRUE;
 }
 
 
 
-int 
-ppsdevlog_read(
-	ppsdevlog *pp)
+#define NSEC_PER_SEC 1000000000L
+
+static void
+ppsdevlog_rotate_log(
+	ppsdevlog *pp,
+	int mjd)
+{
+	/* The log is only rotated forwards. The caller holds the log mutex */
+	if (mjd > pp->MJD){
+		if (TRUE==ppsdevlog_open_log(pp,mjd))
+			pp->MJD=mjd;
+	}
+}
+
+static void
+ppsdevlog_log(
+	ppsdevlog *pp,
+	ppssource *src,
+	const char *edge,
+	struct timespec *ppsrdg,
+	pps_seq_t seq)
 {
-	struct timespec timeout = { 3, 0 };
-	struct timespec ppsrdg;
+	int tsns= ppsrdg->tv_nsec;
+	time_t tt = ppsrdg->tv_sec;
+	char tbuf[TIMESTAMP_LEN];
+	
+	if (tsns > NSEC_PER_SEC / 2){
+		tsns -= NSEC_PER_SEC ;
+		tt++;
+	}
+	
+	pthread_mutex_lock(&(pp->logMutex));
+	
+	if (debugOn)
+		fprintf(stderr,"%s %s timestamp: %ld, sequence: %ld, offset: % 6ld\n", src->devName, edge, ppsrdg->tv_sec, (long) seq, ppsrdg->tv_nsec);
 	
+	/* Rotate log ? Use the timestamp in the PPS event */
+	ppsdevlog_rotate_log(pp,tt/86400 + 40587);
+	
+	if (NULL != pp->logFile){
+		/* Note the sign for the timestamp. Our convention is that the PPS is the reference */
+		if (pp->nEdges > 1) /* then the device and edge are needed to tell readings apart */
+			fprintf(pp->logFile,"%s %i %s.%s\n",timestamp(tt,FALSE,tbuf),-tsns,src->label,edge);
+		else
+			fprintf(pp->logFile,"%s %i\n",timestamp(tt,FALSE,tbuf),-tsns); 
+		fflush(pp->logFile);
+	}
+	
+	pthread_mutex_unlock(&(pp->logMutex));
+}
+
+static void *
+ppsdevlog_capture(
+	void *arg)
+{
+	/* Thread for each PPS device. 
+	 * If the device can wait for events, the thread blocks in time_pps_fetch() until there is one, 
+	 * so that each edge is seen as soon as it happens. Otherwise, the device is polled.
+	 */
+	ppssource *src = (ppssource *) arg;
+	ppsdevlog *pp = src->pp;
+	struct timespec timeout = { FETCH_TIMEOUT, 0 };
+	struct timespec nowait = { 0, 0 };
 	pps_info_t infobuf;
+	sigset_t sigs;
 	int ret;
-
-	while (!quit){ /* loop here until we get a new reading or we get a SIGxxx */
-		if (pp->availCaps & PPS_CANWAIT){ /* waits for the next event */
-			ret = time_pps_fetch(pp->devHandle, PPS_TSFMT_TSPEC, &infobuf,
-						&timeout);
+	
+	/* Signals are left to the main thread */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_BLOCK,&sigs,NULL);
+	
+	while (!quit){
+		if (src->availCaps & PPS_CANWAIT){ /* waits for the next event */
+			ret = time_pps_fetch(src->devHandle, PPS_TSFMT_TSPEC, &infobuf, &timeout);
 		}
 		else {
 			usleep(TSLEEP);
-			ret = time_pps_fetch(pp->devHandle, PPS_TSFMT_TSPEC, &infobuf,
-						&timeout);
+			ret = time_pps_fetch(src->devHandle, PPS_TSFMT_TSPEC, &infobuf, &nowait);
 		}
-	
-		if (ret < 0 || quit) {
-			if (errno == EINTR || quit) {
-				if (debugOn)
-					fprintf(stderr, "time_pps_fetch() EINTR\n");
-				return -1;
-			}
+		
+		if (quit)
+			break;
+		
+		if (ret < 0) {
+			if (errno == ETIMEDOUT || errno == EINTR) /* the main thread checks for timeouts */
+				continue;
 			if (debugOn)
-				fprintf(stderr, "time_pps_fetch() error %d\n", ret);
-			return -1;
+				fprintf(stderr, "%s: time_pps_fetch() error %d\n", src->devName, errno);
+			usleep(TSLEEP); /* don't spin if the device has gone away */
+			continue;
 		}
 		
-		ppsrdg.tv_sec=0;
-		ppsrdg.tv_nsec=0;
-		pp->seq=0;
-		if (pp->reqCaps & PPS_CAPTUREASSERT) {
-			ppsrdg = infobuf.assert_timestamp;
-			pp->seq = infobuf.assert_sequence;
-		} else if (pp->reqCaps & PPS_CAPTURECLEAR) {
-			ppsrdg = infobuf.clear_timestamp;
-			pp->seq = infobuf.clear_sequence;
+		/* A fetch can return both edges, so each is checked for a new event */
+		if ((src->reqCaps & PPS_CAPTUREASSERT) && infobuf.assert_sequence != src->lastSeq[0]){
+			src->lastSeq[0] = infobuf.assert_sequence;
+			__atomic_store_n(&(src->lastEvent),time(NULL),__ATOMIC_RELAXED);
+			ppsdevlog_log(pp,src,"assert",&(infobuf.assert_timestamp),infobuf.assert_sequence);
 		}
-	
-		if (ppsrdg.tv_sec != pp->lastpps.tv_sec || 
-			(ppsrdg.tv_sec == pp->lastpps.tv_sec && ppsrdg.tv_nsec != pp->lastpps.tv_nsec) /* ignore duplicates */
-		){
-			pp->lastpps = ppsrdg;
-			return 0;
+		if ((src->reqCaps & PPS_CAPTURECLEAR) && infobuf.clear_sequence != src->lastSeq[1]){
+			src->lastSeq[1] = infobuf.clear_sequence;
+			__atomic_store_n(&(src->lastEvent),time(NULL),__ATOMIC_RELAXED);
+			ppsdevlog_log(pp,src,"clear",&(infobuf.clear_timestamp),infobuf.clear_sequence);
 		}
 	}
-
-	return 0;
-}
-
-#define NSEC_PER_SEC 1000000000L
-static void
-ppsdevlog_log(
-	ppsdevlog *pp)
-{
-	if (debugOn)
-		fprintf(stderr,"timestamp: %ld, sequence: %ld, offset: % 6ld\n", pp->lastpps.tv_sec, pp->seq, pp->lastpps.tv_nsec);
-	int tsns= pp->lastpps.tv_nsec;
-	time_t tt = pp->lastpps.tv_sec;
-	if (tsns > NSEC_PER_SEC / 2){
-		tsns -= NSEC_PER_SEC ;
-		tt++;
-	}
 	
-	fprintf(pp->logFile,"%s %i\n",timestamp(tt,FALSE),-tsns); /* Note the sign for the timestamp. Our convention is that the PPS is the reference */
-	fflush(pp->logFile);
+	return NULL;
 }
 
-
 /*
  * 
  */
@@ -447,10 +562,9 @@ int main(
 	char *argv[])
 {
 	struct sigaction sigact;
-	int opt,ret;
-	time_t tt;
-	int mjd;
-	struct timeval tvnow;
+	int opt,ret,i,nTimedOut;
+	time_t now;
+	char msg[BUFLEN];
 	
 	ppsdevlog pp;
 	
@@ -487,9 +601,11 @@ int main(
 	
 	ppsdevlog_log_status(&pp,"started");
 	
-	if (FALSE == ppsdevlog_open_source(&pp)){
-		ppsdevlog_log_status(&pp,"Failed to get pps device");
-		exit(EXIT_FAILURE);
+	for (i=0;i<pp.nSources;i++){
+		if (TRUE != ppsdevlog_open_source(&pp,&(pp.sources[i]))){
+			ppsdevlog_log_status(&pp,"Failed to get pps device");
+			exit(EXIT_FAILURE);
+		}
 	}
 	
 	sigact.sa_handler = sighandler_exit;
@@ -498,52 +614,61 @@ int main(
 	sigaction(SIGINT,  &sigact, NULL);
 	sigaction(SIGTERM, &sigact, NULL);
 	sigaction(SIGQUIT, &sigact, NULL);
-
 	
-	/* Data capture loop */
-	while (1) {
-		
-		ret = ppsdevlog_read(&pp);
-		/* Rotate log ? */
-		if (ret == 0){ /* use the timestamp in the PPS event */
-			tt = pp.lastpps.tv_sec;
-			if ( pp.lastpps.tv_nsec> NSEC_PER_SEC / 2)
-				tt++;
-			mjd = tt/86400 + 40587;
-		}
-		else /* we want an empty log if nothing is working */
-			mjd = (int)(time(&tt)/86400 + 40587);
-		
-		if (mjd != pp.MJD){
-			if (TRUE==ppsdevlog_open_log(&pp,mjd))
-				pp.MJD=mjd;
-		}
-			
-		if (ret == 0){		
-			ppsdevlog_log(&pp);
+	/* we want an empty log if nothing is working */
+	pthread_mutex_lock(&(pp.logMutex));
+	ppsdevlog_rotate_log(&pp,(int)(time(NULL)/86400 + 40587));
+	pthread_mutex_unlock(&(pp.logMutex));
+	
+	/* Data capture, one thread per device */
+	for (i=0;i<pp.nSources;i++){
+		if (0 != pthread_create(&(pp.sources[i].thread),NULL,ppsdevlog_capture,&(pp.sources[i]))){
+			ppsdevlog_log_status(&pp,"Failed to start a capture thread");
+			exit(EXIT_FAILURE);
 		}
+	}
+	
+	/* Watch for a quit, devices which have stopped and the day rollover */
+	ret = 0;
+	while (!quit){
+		sleep(1);
 		
-		if ((ret < 0 && errno == EINTR) || quit) {
-			ret = 0;
-			break;
-		}
+		now = time(NULL);
 		
-		if (ret < 0 && errno != ETIMEDOUT) /* exit on all other errors except a timeout since we tolerate a timeout for a while */
-			break;
+		pthread_mutex_lock(&(pp.logMutex));
+		ppsdevlog_rotate_log(&pp,(int)(now/86400 + 40587));
+		pthread_mutex_unlock(&(pp.logMutex));
 		
-		gettimeofday(&tvnow,NULL);
+		nTimedOut=0;
+		for (i=0;i<pp.nSources;i++){
+			ppssource *src = &(pp.sources[i]);
+			if (now - __atomic_load_n(&(src->lastEvent),__ATOMIC_RELAXED) > DEFAULT_TIMEOUT){
+				if (!src->timedOut){
+					snprintf(msg,BUFLEN,"No events from %s",src->devName);
+					ppsdevlog_log_status(&pp,msg);
+					if (debugOn)
+						fprintf(stderr,"timeout %s\n",src->devName);
+				}
+				src->timedOut = TRUE;
+				nTimedOut++;
+			}
+			else
+				src->timedOut = FALSE;
+		}
 		
-		if (tvnow.tv_sec - pp.lastpps.tv_sec > DEFAULT_TIMEOUT){
-			if (debugOn)
-				fprintf(stderr,"timeout\n");
+		if (nTimedOut == pp.nSources){ /* bomb out if nothing is working */
+			ret = -1;
 			break;
 		}
 	}
 	
-	time_pps_destroy(pp.devHandle);
+	quit = true;
+	for (i=0;i<pp.nSources;i++){
+		pthread_join(pp.sources[i].thread,NULL);
+		time_pps_destroy(pp.sources[i].devHandle);
+	}
 
 	ppsdevlog_log_status(&pp,"stopped");
 
 	return ret;
 }
-